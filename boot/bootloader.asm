@@ -5,9 +5,29 @@
 [org 0x7C00]           ; Boot sector load address
 [bits 16]              ; 16-bit real mode
 
-; Constants
-KERNEL_OFFSET equ 0x1000    ; Kernel load address
-KERNEL_SECTORS equ 20       ; Number of sectors to read (adjust as needed)
+; Constants (must match kernel/memory.h and linker.ld)
+KERNEL_OFFSET equ 0x10000   ; Kernel load address
+KERNEL_SEG equ 0x1000       ; ... as a real-mode segment
+INITRD_SEG equ 0x7000       ; Initial ramdisk, loaded at 0x70000
+STACK_TOP equ 0x90000
+SECTORS_PER_TRACK equ 18    ; 1.44MB floppy geometry
+HEADS equ 2
+
+; Image layout, passed in by the Makefile: the kernel follows this sector,
+; then the initrd
+%ifndef KERNEL_SECTORS
+%define KERNEL_SECTORS 20
+%endif
+%ifndef INITRD_SECTORS
+%define INITRD_SECTORS 0
+%endif
+
+; Boot information handed to the kernel (must match kernel/memory.h)
+BOOT_INFO_ADDR equ 0x0500           ; Magic dword set when a VBE mode is active
+BOOT_VBE_MAGIC equ 0x21454256       ; "VBE!"
+BOOT_VBE_MODE_INFO equ 0x0600       ; VBE ModeInfoBlock (256 bytes)
+BOOT_FONT_SEG equ 0x9000            ; VGA BIOS 8x16 font copied to 0x90000
+VBE_MODE equ 0x144                  ; 1024x768x32 (Bochs/QEMU VBE)
 
 start:
     ; Initialize segments
@@ -16,28 +36,71 @@ start:
     mov es, ax
     mov ss, ax
     mov sp, 0x7C00
+    mov [boot_drive], dl    ; BIOS passes the boot drive in DL
 
     ; Print loading message
     mov si, loading_msg
     call print_string
 
-    ; Load kernel from disk
-    mov bx, KERNEL_OFFSET   ; Load to this address
-    mov ah, 0x02            ; Read sectors function
-    mov al, KERNEL_SECTORS  ; Number of sectors to read
-    mov ch, 0x00            ; Cylinder 0
-    mov cl, 0x02            ; Sector 2 (sector 1 is bootloader)
-    mov dh, 0x00            ; Head 0
-    mov dl, 0x00            ; Drive 0 (floppy)
-    int 0x13                ; BIOS disk interrupt
-
-    ; Check for errors
-    jc disk_error
+    ; Load the kernel from sector 2 (sector 1 is the bootloader)
+    mov ax, KERNEL_SEG
+    mov es, ax
+    mov ax, 1
+    mov cx, KERNEL_SECTORS
+    call read_sectors
+
+%if INITRD_SECTORS > 0
+    ; The initrd follows the kernel on disk
+    mov ax, INITRD_SEG
+    mov es, ax
+    mov ax, 1 + KERNEL_SECTORS
+    mov cx, INITRD_SECTORS
+    call read_sectors
+%endif
+
+    xor ax, ax
+    mov es, ax
 
     ; Print success message
     mov si, success_msg
     call print_string
 
+%ifdef VBE_CONSOLE
+    ; Copy the 8x16 ROM font for the framebuffer console (ES:BP -> font)
+    mov dword [BOOT_INFO_ADDR], 0
+    mov ax, 0x1130
+    mov bh, 0x06
+    int 0x10
+    push ds
+    push es
+    pop ds
+    mov si, bp
+    mov ax, BOOT_FONT_SEG
+    mov es, ax
+    xor di, di
+    mov cx, 2048            ; 256 glyphs * 16 bytes, in words
+    cld
+    rep movsw
+    pop ds
+    xor ax, ax
+    mov es, ax
+
+    ; Fetch the mode info block, then switch to the linear framebuffer
+    mov ax, 0x4F01
+    mov cx, VBE_MODE
+    mov di, BOOT_VBE_MODE_INFO
+    int 0x10
+    cmp ax, 0x004F
+    jne .no_vbe
+    mov ax, 0x4F02
+    mov bx, VBE_MODE | 0x4000
+    int 0x10
+    cmp ax, 0x004F
+    jne .no_vbe
+    mov dword [BOOT_INFO_ADDR], BOOT_VBE_MAGIC
+.no_vbe:
+%endif
+
     ; Switch to protected mode
     cli                     ; Disable interrupts
     lgdt [gdt_descriptor]   ; Load GDT
@@ -66,6 +129,35 @@ print_string:
 .done:
     ret
 
+; Read CX sectors starting at LBA AX to ES:0, one at a time so no read
+; crosses a track or a 64KB DMA boundary. ES is left past the data.
+read_sectors:
+    push ax
+    push cx
+    xor dx, dx
+    mov bx, SECTORS_PER_TRACK
+    div bx                  ; AX = track, DX = sector - 1
+    mov cl, dl
+    inc cl
+    xor dx, dx
+    mov bx, HEADS
+    div bx                  ; AX = cylinder, DX = head
+    mov ch, al
+    mov dh, dl
+    mov dl, [boot_drive]
+    xor bx, bx
+    mov ax, 0x0201          ; Read one sector
+    int 0x13
+    jc disk_error
+    mov ax, es
+    add ax, 512 / 16
+    mov es, ax
+    pop cx
+    pop ax
+    inc ax
+    loop read_sectors
+    ret
+
 disk_error:
     mov si, error_msg
     call print_string
@@ -83,7 +175,7 @@ protected_mode:
     mov ss, ax
 
     ; Set up stack
-    mov esp, 0x90000
+    mov esp, STACK_TOP
 
     ; Jump to kernel
     call KERNEL_OFFSET
@@ -105,6 +197,8 @@ gdt_descriptor:
     dw gdt_end - gdt_start - 1
     dd gdt_start
 
+boot_drive db 0
+
 ; Messages
 loading_msg db 'Loading ProtoOS...', 0x0D, 0x0A, 0
 success_msg db 'Kernel loaded successfully!', 0x0D, 0x0A, 0
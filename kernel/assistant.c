@@ -3,6 +3,7 @@
 #include "langchain.h"
 #include "network.h"
 #include "screen.h"
+#include "klog.h"
 #include <string.h>
 
 // Global assistant system state
@@ -26,10 +27,9 @@ void init_assistant_system() {
     
     assistant_initialized = 1;
     
-    print_string("ProtoOS AI Assistant System Initialized\n", VGA_LIGHT_GREEN);
-    print_string("Capabilities: Web Search, Weather, News, AI Chat, Voice Commands\n", VGA_LIGHT_CYAN);
-    print_string("Mode: Always-On Voice Assistant\n", VGA_LIGHT_YELLOW);
-    print_string("Say 'Hey Proto' to activate voice commands\n", VGA_LIGHT_GREEN);
+    klog(KLOG_INFO, "assistant: system initialized");
+    klog(KLOG_INFO, "assistant: capabilities web search, weather, news, AI chat, voice commands");
+    klog(KLOG_INFO, "assistant: mode always-on voice assistant");
 }
 
 // Start the assistant
@@ -46,8 +46,7 @@ int start_assistant() {
         start_voice_listening();
     }
     
-    print_string("AI Assistant is now active and listening\n", VGA_LIGHT_GREEN);
-    print_string("Voice commands: 'Hey Proto', 'Proto Assistant', 'Hey OS'\n", VGA_LIGHT_CYAN);
+    klog(KLOG_INFO, "assistant: active and listening");
     
     return 1;
 }
@@ -313,31 +312,30 @@ int is_assistant_ready() {
 
 // Print assistant help
 void print_assistant_help() {
-    print_string("ProtoOS AI Assistant - Voice Commands\n", VGA_LIGHT_CYAN);
-    print_string("=====================================\n", VGA_LIGHT_CYAN);
-    print_string("\nWake Words:\n", VGA_LIGHT_YELLOW);
-    print_string("  'Hey Proto' - Activate voice assistant\n", VGA_LIGHT_WHITE);
-    print_string("  'Proto Assistant' - Alternative wake word\n", VGA_LIGHT_WHITE);
-    print_string("  'Hey OS' - Another wake word option\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nVoice Commands:\n", VGA_LIGHT_YELLOW);
-    print_string("  'Search for [topic]' - Web search\n", VGA_LIGHT_WHITE);
-    print_string("  'What's the weather' - Weather information\n", VGA_LIGHT_WHITE);
-    print_string("  'What time is it' - Current time\n", VGA_LIGHT_WHITE);
-    print_string("  'Tell me the news' - Latest news\n", VGA_LIGHT_WHITE);
-    print_string("  'Ask AI [question]' - Chat with AI\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nAssistant Modes:\n", VGA_LIGHT_YELLOW);
-    print_string("  Voice-Only - Voice commands only\n", VGA_LIGHT_WHITE);
-    print_string("  Text-Only - Text interface only\n", VGA_LIGHT_WHITE);
-    print_string("  Always-On - Continuous voice listening\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nCapabilities:\n", VGA_LIGHT_YELLOW);
-    print_string("  Web Search - Search the internet\n", VGA_LIGHT_WHITE);
-    print_string("  Weather - Get weather information\n", VGA_LIGHT_WHITE);
-    print_string("  News - Latest news updates\n", VGA_LIGHT_WHITE);
-    print_string("  AI Chat - Intelligent conversations\n", VGA_LIGHT_WHITE);
-    print_string("  Voice Commands - Hands-free operation\n", VGA_LIGHT_WHITE);
+    print_string(
+        ANSI_LIGHT_CYAN "ProtoOS AI Assistant - Voice Commands\n"
+        "=====================================\n"
+        ANSI_LIGHT_YELLOW "\nWake Words:\n"
+        ANSI_LIGHT_WHITE "  'Hey Proto' - Activate voice assistant\n"
+        "  'Proto Assistant' - Alternative wake word\n"
+        "  'Hey OS' - Another wake word option\n"
+        ANSI_LIGHT_YELLOW "\nVoice Commands:\n"
+        ANSI_LIGHT_WHITE "  'Search for [topic]' - Web search\n"
+        "  'What's the weather' - Weather information\n"
+        "  'What time is it' - Current time\n"
+        "  'Tell me the news' - Latest news\n"
+        "  'Ask AI [question]' - Chat with AI\n"
+        ANSI_LIGHT_YELLOW "\nAssistant Modes:\n"
+        ANSI_LIGHT_WHITE "  Voice-Only - Voice commands only\n"
+        "  Text-Only - Text interface only\n"
+        "  Always-On - Continuous voice listening\n"
+        ANSI_LIGHT_YELLOW "\nCapabilities:\n"
+        ANSI_LIGHT_WHITE "  Web Search - Search the internet\n"
+        "  Weather - Get weather information\n"
+        "  News - Latest news updates\n"
+        "  AI Chat - Intelligent conversations\n"
+        "  Voice Commands - Hands-free operation\n",
+        VGA_LIGHT_WHITE);
 }
 
 // Get current time
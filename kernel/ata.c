@@ -0,0 +1,370 @@
+#include "ata.h"
+#include "pci.h"
+#include "io.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "klog.h"
+#include "block.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+// Physical region descriptor: one contiguous piece of a DMA transfer that
+// doesn't cross a 64KB boundary (byte count 0 means 64KB)
+typedef struct {
+    unsigned int address;
+    unsigned short byte_count;
+    unsigned short flags;
+} __attribute__((packed)) ata_prd_t;
+
+typedef struct {
+    unsigned short base;                // Command block
+    unsigned short control;             // Device control / alternate status
+    unsigned short bus_master;          // 0 without a bus-master controller
+    int irq;
+    volatile int completed;             // Set by the IRQ handler
+    volatile unsigned char status;      // Device status read by the handler
+} ata_channel_t;
+
+static ata_channel_t channels[ATA_CHANNELS];
+static ata_drive_t drives[ATA_MAX_DRIVES];
+static int drive_count = 0;
+static int dma_enabled = 1;
+
+// 64 bytes aligned to 64 can't cross a 64KB boundary, as the controller
+// requires of the table
+static ata_prd_t prd_tables[ATA_CHANNELS][ATA_PRD_ENTRIES] __attribute__((aligned(64)));
+
+// Reading the alternate status four times gives the 400ns the device
+// needs after a drive select
+static void delay_400ns(ata_channel_t* channel) {
+    for (int i = 0; i < 4; i++) {
+        inb(channel->control);
+    }
+}
+
+// Wait for BSY to clear. Returns the status, or -1 on timeout.
+static int wait_not_busy(ata_channel_t* channel) {
+    unsigned int start = get_uptime_ms();
+    unsigned char status;
+    
+    while ((status = inb(channel->base + ATA_REG_STATUS)) & ATA_STATUS_BSY) {
+        if (get_uptime_ms() - start >= ATA_TIMEOUT_MS) return -1;
+    }
+    return status;
+}
+
+// Wait for the device to accept or offer a sector of PIO data
+static int wait_data(ata_channel_t* channel) {
+    int status = wait_not_busy(channel);
+    if (status < 0 || (status & (ATA_STATUS_ERR | ATA_STATUS_DF))) return -1;
+    return (status & ATA_STATUS_DRQ) ? 0 : -1;
+}
+
+// Completion interrupt. With a bus-master controller its status says
+// whether the interrupt is ours; reading the device status acknowledges it.
+static void handle_irq(ata_channel_t* channel) {
+    if (channel->bus_master) {
+        unsigned char bm_status = inb(channel->bus_master + ATA_BM_STATUS);
+        if (!(bm_status & ATA_BM_STATUS_INTERRUPT)) return;
+        outb(channel->bus_master + ATA_BM_STATUS, ATA_BM_STATUS_INTERRUPT);
+    }
+    channel->status = inb(channel->base + ATA_REG_STATUS);
+    channel->completed = 1;
+}
+
+static void primary_irq() {
+    handle_irq(&channels[0]);
+}
+
+static void secondary_irq() {
+    handle_irq(&channels[1]);
+}
+
+// Select the drive and load an LBA28 address and sector count
+static int setup_command(ata_channel_t* channel, const ata_drive_t* drive,
+                         unsigned int lba, unsigned int count) {
+    outb(channel->base + ATA_REG_DRIVE, ATA_DRIVE_LBA | (drive->slave ? ATA_DRIVE_SLAVE : 0) |
+         ((lba >> 24) & 0x0F));
+    delay_400ns(channel);
+    if (wait_not_busy(channel) < 0) return -1;
+    
+    outb(channel->base + ATA_REG_SECTOR_COUNT, count & 0xFF);
+    outb(channel->base + ATA_REG_LBA_LOW, lba & 0xFF);
+    outb(channel->base + ATA_REG_LBA_MID, (lba >> 8) & 0xFF);
+    outb(channel->base + ATA_REG_LBA_HIGH, (lba >> 16) & 0xFF);
+    return 0;
+}
+
+// Describe `bytes` at `buffer` in the channel's PRD table, split at 64KB
+// boundaries. Returns 0, or -1 if the table is too short.
+static int build_prd_table(ata_prd_t* table, unsigned int address, unsigned int bytes) {
+    int entry = 0;
+    
+    while (bytes > 0) {
+        if (entry >= ATA_PRD_ENTRIES) return -1;
+        
+        unsigned int chunk = 0x10000 - (address & 0xFFFF);
+        if (chunk > bytes) chunk = bytes;
+        
+        table[entry].address = address;
+        table[entry].byte_count = chunk & 0xFFFF;
+        table[entry].flags = 0;
+        address += chunk;
+        bytes -= chunk;
+        entry++;
+    }
+    table[entry - 1].flags = ATA_PRD_END;
+    return 0;
+}
+
+// One bus-master transfer of up to ATA_MAX_SECTORS, straight between the
+// device and `buffer`. The CPU only sets it up and waits for the interrupt.
+static int dma_transfer(const ata_drive_t* drive, unsigned int lba, unsigned int count,
+                        void* buffer, int write) {
+    ata_channel_t* channel = &channels[drive->channel];
+    ata_prd_t* table = prd_tables[drive->channel];
+    
+    if (build_prd_table(table, (unsigned int)buffer, count * ATA_SECTOR_SIZE) < 0) return -1;
+    
+    outl(channel->bus_master + ATA_BM_PRDT, (unsigned int)table);
+    outb(channel->bus_master + ATA_BM_COMMAND, write ? 0 : ATA_BM_CMD_READ);
+    outb(channel->bus_master + ATA_BM_STATUS, ATA_BM_STATUS_ERROR | ATA_BM_STATUS_INTERRUPT);
+    
+    if (setup_command(channel, drive, lba, count) < 0) return -1;
+    
+    channel->completed = 0;
+    outb(channel->base + ATA_REG_COMMAND, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+    outb(channel->bus_master + ATA_BM_COMMAND, (write ? 0 : ATA_BM_CMD_READ) | ATA_BM_CMD_START);
+    
+    unsigned int start = get_uptime_ms();
+    while (!channel->completed) {
+        if (get_uptime_ms() - start >= ATA_TIMEOUT_MS) break;
+    }
+    
+    outb(channel->bus_master + ATA_BM_COMMAND, write ? 0 : ATA_BM_CMD_READ);
+    unsigned char bm_status = inb(channel->bus_master + ATA_BM_STATUS);
+    
+    if (!channel->completed || (bm_status & ATA_BM_STATUS_ERROR) ||
+        (channel->status & (ATA_STATUS_ERR | ATA_STATUS_DF))) {
+        klog_value(KLOG_ERR, "ata: DMA transfer failed at LBA ", lba);
+        return -1;
+    }
+    return 0;
+}
+
+// PIO fallback: the CPU moves every word through the data register
+static int pio_transfer(const ata_drive_t* drive, unsigned int lba, unsigned int count,
+                        void* buffer, int write) {
+    ata_channel_t* channel = &channels[drive->channel];
+    unsigned short* words = (unsigned short*)buffer;
+    
+    if (setup_command(channel, drive, lba, count) < 0) return -1;
+    outb(channel->base + ATA_REG_COMMAND, write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO);
+    
+    for (unsigned int sector = 0; sector < count; sector++) {
+        if (wait_data(channel) < 0) {
+            klog_value(KLOG_ERR, "ata: PIO transfer failed at LBA ", lba + sector);
+            return -1;
+        }
+        if (write) {
+            outsw(channel->base + ATA_REG_DATA, words, ATA_SECTOR_SIZE / 2);
+        } else {
+            insw(channel->base + ATA_REG_DATA, words, ATA_SECTOR_SIZE / 2);
+        }
+        words += ATA_SECTOR_SIZE / 2;
+    }
+    
+    if (write && wait_not_busy(channel) < 0) return -1;
+    return 0;
+}
+
+// Split a request into commands. DMA needs word-aligned buffers; anything
+// else goes through PIO.
+static int transfer(int index, unsigned int lba, unsigned int count, void* buffer, int write) {
+    if (index < 0 || index >= drive_count) return -1;
+    
+    const ata_drive_t* drive = &drives[index];
+    if (lba >= drive->sectors || count > drive->sectors - lba) return -1;
+    
+    int use_dma = dma_enabled && drive->dma && ((unsigned int)buffer & 1) == 0;
+    char* position = (char*)buffer;
+    
+    while (count > 0) {
+        unsigned int chunk = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        int result = use_dma ? dma_transfer(drive, lba, chunk, position, write) :
+                               pio_transfer(drive, lba, chunk, position, write);
+        if (result < 0) return -1;
+        
+        lba += chunk;
+        count -= chunk;
+        position += chunk * ATA_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+// Read `count` sectors starting at `lba`. Returns 0, or -1 on error.
+int ata_read(int drive, unsigned int lba, unsigned int count, void* buffer) {
+    return transfer(drive, lba, count, buffer, 0);
+}
+
+int ata_write(int drive, unsigned int lba, unsigned int count, const void* buffer) {
+    return transfer(drive, lba, count, (void*)buffer, 1);
+}
+
+// Ask the drive to commit its write cache
+int ata_flush(int index) {
+    if (index < 0 || index >= drive_count) return -1;
+    
+    const ata_drive_t* drive = &drives[index];
+    ata_channel_t* channel = &channels[drive->channel];
+    
+    outb(channel->base + ATA_REG_DRIVE, ATA_DRIVE_LBA | (drive->slave ? ATA_DRIVE_SLAVE : 0));
+    delay_400ns(channel);
+    outb(channel->base + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+    
+    int status = wait_not_busy(channel);
+    return (status < 0 || (status & ATA_STATUS_ERR)) ? -1 : 0;
+}
+
+static int block_read_op(block_device_t* device, unsigned int lba, unsigned int count, void* buffer) {
+    return ata_read(device->unit, lba, count, buffer);
+}
+
+static int block_write_op(block_device_t* device, unsigned int lba, unsigned int count, const void* buffer) {
+    return ata_write(device->unit, lba, count, buffer);
+}
+
+static int block_flush_op(block_device_t* device) {
+    return ata_flush(device->unit);
+}
+
+static const block_ops_t block_ops = {
+    block_read_op, block_write_op, block_flush_op, NULL, NULL
+};
+
+// Identify a drive by PIO. Returns 1 for an ATA disk, 0 for nothing or a
+// packet device.
+static int identify(int channel_index, int slave, ata_drive_t* drive) {
+    ata_channel_t* channel = &channels[channel_index];
+    unsigned short id[256];
+    
+    outb(channel->base + ATA_REG_DRIVE, 0xA0 | (slave ? ATA_DRIVE_SLAVE : 0));
+    delay_400ns(channel);
+    outb(channel->base + ATA_REG_SECTOR_COUNT, 0);
+    outb(channel->base + ATA_REG_LBA_LOW, 0);
+    outb(channel->base + ATA_REG_LBA_MID, 0);
+    outb(channel->base + ATA_REG_LBA_HIGH, 0);
+    outb(channel->base + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    
+    unsigned char status = inb(channel->base + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF) return 0;
+    if (wait_not_busy(channel) < 0) return 0;
+    
+    // ATAPI and SATA devices put a signature here instead of answering
+    if (inb(channel->base + ATA_REG_LBA_MID) || inb(channel->base + ATA_REG_LBA_HIGH)) return 0;
+    if (wait_data(channel) < 0) return 0;
+    
+    insw(channel->base + ATA_REG_DATA, id, 256);
+    
+    drive->channel = channel_index;
+    drive->slave = slave;
+    drive->sectors = id[60] | ((unsigned int)id[61] << 16);
+    drive->dma = channel->bus_master && (id[49] & ATA_IDENTIFY_DMA);
+    
+    // Model string: words 27-46, high byte first
+    for (int i = 0; i < 20; i++) {
+        drive->model[i * 2] = id[27 + i] >> 8;
+        drive->model[i * 2 + 1] = id[27 + i] & 0xFF;
+    }
+    int length = 40;
+    while (length > 0 && drive->model[length - 1] == ' ') length--;
+    drive->model[length] = '\0';
+    
+    return drive->sectors > 0;
+}
+
+// Find the IDE controller and its disks. Channels in native mode take
+// their ports from the PCI BARs, otherwise the legacy ports and IRQs are
+// used. Returns the number of disks.
+int init_ata() {
+    const pci_device_t* controller = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE);
+    unsigned short bus_master = 0;
+    
+    channels[0].base = ATA_PRIMARY_BASE;
+    channels[0].control = ATA_PRIMARY_CONTROL;
+    channels[0].irq = ATA_PRIMARY_IRQ;
+    channels[1].base = ATA_SECONDARY_BASE;
+    channels[1].control = ATA_SECONDARY_CONTROL;
+    channels[1].irq = ATA_SECONDARY_IRQ;
+    
+    if (controller) {
+        if (controller->prog_if & ATA_PROG_IF_PRIMARY_NATIVE) {
+            channels[0].base = pci_bar(controller, 0);
+            channels[0].control = pci_bar(controller, 1) + 2;
+            channels[0].irq = controller->irq;
+        }
+        if (controller->prog_if & ATA_PROG_IF_SECONDARY_NATIVE) {
+            channels[1].base = pci_bar(controller, 2);
+            channels[1].control = pci_bar(controller, 3) + 2;
+            channels[1].irq = controller->irq;
+        }
+        if (controller->prog_if & ATA_PROG_IF_BUS_MASTER) {
+            bus_master = pci_bar(controller, 4);
+            pci_enable(controller, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+        }
+    }
+    
+    drive_count = 0;
+    for (int c = 0; c < ATA_CHANNELS; c++) {
+        ata_channel_t* channel = &channels[c];
+        channel->bus_master = bus_master ? bus_master + c * ATA_BM_CHANNEL_STRIDE : 0;
+        channel->completed = 0;
+        
+        // A floating bus reads 0xFF: no devices on this channel
+        if (inb(channel->base + ATA_REG_STATUS) == 0xFF) continue;
+        
+        outb(channel->control, 0);      // Interrupts on
+        for (int slave = 0; slave < 2; slave++) {
+            if (identify(c, slave, &drives[drive_count])) {
+                klog_detail(KLOG_INFO, "ata: disk ", drives[drive_count].model);
+                drive_count++;
+            }
+        }
+        // In native mode both channels share the controller's line, and
+        // each handler runs on every interrupt of it
+        register_irq_handler(channel->irq, c == 0 ? primary_irq : secondary_irq);
+    }
+    
+    // Disks appear as hda, hdb, ... in detection order
+    for (int i = 0; i < drive_count; i++) {
+        char name[4] = { 'h', 'd', 'a' + i, '\0' };
+        block_register(name, "ata", drives[i].sectors, i, &block_ops);
+    }
+    
+    if (drive_count == 0) {
+        klog(KLOG_INFO, "ata: no disks");
+    } else if (!bus_master) {
+        klog(KLOG_WARNING, "ata: no bus-master controller, using PIO");
+    }
+    return drive_count;
+}
+
+int ata_drive_count() {
+    return drive_count;
+}
+
+const ata_drive_t* ata_get_drive(int index) {
+    if (index < 0 || index >= drive_count) return NULL;
+    return &drives[index];
+}
+
+// Force PIO (0) or allow DMA (1), for comparing the two
+void ata_set_dma(int enabled) {
+    dma_enabled = enabled;
+}
+
+int ata_dma_enabled() {
+    return dma_enabled;
+}
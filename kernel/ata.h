@@ -0,0 +1,88 @@
+#ifndef ATA_H
+#define ATA_H
+
+// Legacy (compatibility mode) channel resources
+#define ATA_PRIMARY_BASE 0x1F0
+#define ATA_PRIMARY_CONTROL 0x3F6
+#define ATA_SECONDARY_BASE 0x170
+#define ATA_SECONDARY_CONTROL 0x376
+#define ATA_PRIMARY_IRQ 14
+#define ATA_SECONDARY_IRQ 15
+
+#define ATA_CHANNELS 2
+#define ATA_MAX_DRIVES 4
+#define ATA_SECTOR_SIZE 512
+
+// Command block register offsets
+#define ATA_REG_DATA 0
+#define ATA_REG_ERROR 1
+#define ATA_REG_SECTOR_COUNT 2
+#define ATA_REG_LBA_LOW 3
+#define ATA_REG_LBA_MID 4
+#define ATA_REG_LBA_HIGH 5
+#define ATA_REG_DRIVE 6
+#define ATA_REG_STATUS 7
+#define ATA_REG_COMMAND 7
+
+// Status bits
+#define ATA_STATUS_ERR 0x01
+#define ATA_STATUS_DRQ 0x08
+#define ATA_STATUS_DF 0x20
+#define ATA_STATUS_DRDY 0x40
+#define ATA_STATUS_BSY 0x80
+
+#define ATA_DRIVE_LBA 0xE0              // LBA addressing, bits 24-27 below
+#define ATA_DRIVE_SLAVE 0x10
+
+// Commands
+#define ATA_CMD_READ_PIO 0x20
+#define ATA_CMD_WRITE_PIO 0x30
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+
+// Bus master IDE registers, per channel (secondary at +8)
+#define ATA_BM_COMMAND 0
+#define ATA_BM_STATUS 2
+#define ATA_BM_PRDT 4
+#define ATA_BM_CHANNEL_STRIDE 8
+
+#define ATA_BM_CMD_START 0x01
+#define ATA_BM_CMD_READ 0x08            // Device to memory
+#define ATA_BM_STATUS_ACTIVE 0x01
+#define ATA_BM_STATUS_ERROR 0x02
+#define ATA_BM_STATUS_INTERRUPT 0x04
+
+// PCI IDE programming interface bits
+#define ATA_PROG_IF_PRIMARY_NATIVE 0x01
+#define ATA_PROG_IF_SECONDARY_NATIVE 0x04
+#define ATA_PROG_IF_BUS_MASTER 0x80
+
+// Transfers
+#define ATA_MAX_SECTORS 256             // Per command (LBA28 count 0 = 256)
+#define ATA_PRD_ENTRIES 8
+#define ATA_PRD_END 0x8000
+#define ATA_IDENTIFY_DMA 0x0100         // Capabilities word 49
+#define ATA_TIMEOUT_MS 2000
+
+// A detected ATA disk
+typedef struct {
+    int channel;
+    int slave;
+    int dma;                            // Bus-master DMA usable
+    unsigned int sectors;               // LBA28 capacity
+    char model[41];
+} ata_drive_t;
+
+// ATA functions
+int init_ata();
+int ata_drive_count();
+const ata_drive_t* ata_get_drive(int index);
+int ata_read(int drive, unsigned int lba, unsigned int count, void* buffer);
+int ata_write(int drive, unsigned int lba, unsigned int count, const void* buffer);
+int ata_flush(int drive);
+void ata_set_dma(int enabled);
+int ata_dma_enabled();
+
+#endif // ATA_H
@@ -0,0 +1,380 @@
+#include "bcache.h"
+#include "memory.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+#define BCACHE_BLOCKS (BCACHE_SIZE / BCACHE_BLOCK_SIZE)
+#define BCACHE_NONE -1
+
+// Cached block. Buffers live in the reserved slab, one per entry.
+typedef struct {
+    block_device_t* device;
+    unsigned int block;
+    short next;                         // Hash chain
+    unsigned char valid;
+    unsigned char dirty;
+    unsigned char referenced;           // CLOCK bit, set on arrival and each use
+    unsigned char prefetched;           // Read ahead and not yet used
+    unsigned char trigger;              // Using it starts the next read-ahead
+} bcache_entry_t;
+
+// Sequential access detection, per device
+typedef struct {
+    block_device_t* device;
+    unsigned int next_block;            // Block a sequential reader asks for next
+    unsigned int run;                   // Consecutive sequential blocks
+    unsigned int window;                // Current read-ahead size in blocks
+    unsigned int ahead;                 // First block past the read-ahead
+} bcache_stream_t;
+
+static char* const slab = (char*)BCACHE_BASE;
+static bcache_entry_t entries[BCACHE_BLOCKS];
+static short buckets[BCACHE_HASH_SIZE];
+static bcache_stream_t streams[BLOCK_MAX_DEVICES];
+static int hand = 0;
+static bcache_stats_t stats;
+
+static char* block_data(int index) {
+    return slab + index * BCACHE_BLOCK_SIZE;
+}
+
+static unsigned int bucket_of(block_device_t* device, unsigned int block) {
+    unsigned int hash = block * 0x9E3779B9u ^ (unsigned int)device;
+    return (hash ^ (hash >> 16)) & (BCACHE_HASH_SIZE - 1);
+}
+
+// Sectors of `block` that exist on the device (the last block may be short)
+static unsigned int block_sectors(block_device_t* device, unsigned int block) {
+    unsigned int first = block * BCACHE_BLOCK_SECTORS;
+    if (first >= device->sectors) return 0;
+    unsigned int left = device->sectors - first;
+    return left < BCACHE_BLOCK_SECTORS ? left : BCACHE_BLOCK_SECTORS;
+}
+
+void init_bcache() {
+    for (int i = 0; i < BCACHE_HASH_SIZE; i++) buckets[i] = BCACHE_NONE;
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        entries[i].valid = 0;
+        entries[i].device = NULL;
+        entries[i].next = BCACHE_NONE;
+    }
+    for (int i = 0; i < BLOCK_MAX_DEVICES; i++) streams[i].device = NULL;
+    hand = 0;
+    bcache_reset_stats();
+    stats.dirty = 0;
+    stats.cached = 0;
+    stats.capacity = BCACHE_BLOCKS;
+}
+
+static int find(block_device_t* device, unsigned int block) {
+    for (int i = buckets[bucket_of(device, block)]; i != BCACHE_NONE; i = entries[i].next) {
+        if (entries[i].device == device && entries[i].block == block && entries[i].valid) return i;
+    }
+    return BCACHE_NONE;
+}
+
+static void unhash(int index) {
+    bcache_entry_t* entry = &entries[index];
+    short* link = &buckets[bucket_of(entry->device, entry->block)];
+    
+    while (*link != BCACHE_NONE && *link != index) link = &entries[*link].next;
+    if (*link == index) *link = entry->next;
+    if (entry->valid) stats.cached--;
+    entry->valid = 0;
+    entry->device = NULL;
+}
+
+static int write_back(int index) {
+    bcache_entry_t* entry = &entries[index];
+    if (!entry->dirty) return 0;
+    
+    unsigned int sectors = block_sectors(entry->device, entry->block);
+    if (block_write(entry->device, entry->block * BCACHE_BLOCK_SECTORS, sectors, block_data(index)) < 0) {
+        klog_value(KLOG_ERR, "bcache: write-back failed for block ", entry->block);
+        return -1;
+    }
+    entry->dirty = 0;
+    stats.dirty--;
+    stats.writebacks++;
+    return 0;
+}
+
+// Take a buffer for (device, block) with the CLOCK algorithm: the hand
+// clears reference bits until it finds an entry nobody used since its last
+// pass. A dirty victim is written back first.
+static int allocate(block_device_t* device, unsigned int block) {
+    for (int sweep = 0; sweep < 2 * BCACHE_BLOCKS + 1; sweep++) {
+        int index = hand;
+        bcache_entry_t* entry = &entries[index];
+        hand = (hand + 1) % BCACHE_BLOCKS;
+        
+        if (entry->valid && entry->referenced) {
+            entry->referenced = 0;
+            continue;
+        }
+        if (entry->valid) {
+            if (write_back(index) < 0) continue;
+            unhash(index);
+            stats.evictions++;
+        }
+        
+        unsigned int bucket = bucket_of(device, block);
+        entry->device = device;
+        entry->block = block;
+        entry->valid = 1;
+        entry->dirty = 0;
+        entry->referenced = 1;
+        entry->prefetched = 0;
+        entry->trigger = 0;
+        entry->next = buckets[bucket];
+        buckets[bucket] = index;
+        stats.cached++;
+        return index;
+    }
+    return BCACHE_NONE;
+}
+
+// Fetch blocks [first, first + count) that aren't cached yet. Transfers
+// are queued together so drivers that can keep several in flight do.
+// Returns the number of blocks fetched, or -1 on an I/O error.
+static int fetch(block_device_t* device, unsigned int first, unsigned int count, int prefetch) {
+    int queued[BCACHE_READAHEAD_MAX + 1];
+    int fetched = 0;
+    
+    for (unsigned int block = first; block < first + count && fetched <= BCACHE_READAHEAD_MAX; block++) {
+        unsigned int sectors = block_sectors(device, block);
+        if (sectors == 0) break;
+        if (find(device, block) != BCACHE_NONE) continue;
+        
+        int index = allocate(device, block);
+        if (index == BCACHE_NONE) break;
+        entries[index].prefetched = prefetch;
+        
+        if (block_submit(device, block * BCACHE_BLOCK_SECTORS, sectors, block_data(index), 0) < 0) {
+            unhash(index);
+            block_complete(device);
+            for (int i = 0; i < fetched; i++) unhash(queued[i]);
+            return -1;
+        }
+        queued[fetched++] = index;
+    }
+    
+    if (block_complete(device) < 0) {
+        for (int i = 0; i < fetched; i++) unhash(queued[i]);
+        return -1;
+    }
+    if (prefetch) stats.readahead_blocks += fetched;
+    return fetched;
+}
+
+static bcache_stream_t* stream_for(block_device_t* device) {
+    for (int i = 0; i < BLOCK_MAX_DEVICES; i++) {
+        if (streams[i].device == device) return &streams[i];
+    }
+    for (int i = 0; i < BLOCK_MAX_DEVICES; i++) {
+        if (!streams[i].device) {
+            streams[i].device = device;
+            streams[i].next_block = 0xFFFFFFFF;
+            streams[i].run = 0;
+            streams[i].window = 0;
+            streams[i].ahead = 0;
+            return &streams[i];
+        }
+    }
+    return &streams[0];
+}
+
+// Read the next window past stream->ahead. Its first block carries the
+// trigger, so the reader reaching it starts the window after, keeping the
+// device busy ahead of the reader.
+static void read_ahead(block_device_t* device, bcache_stream_t* stream) {
+    stream->window = stream->window ? stream->window * 2 : BCACHE_READAHEAD_MIN;
+    if (stream->window > BCACHE_READAHEAD_MAX) stream->window = BCACHE_READAHEAD_MAX;
+    
+    unsigned int first = stream->ahead;
+    if (fetch(device, first, stream->window, 1) < 0) return;
+    stream->ahead = first + stream->window;
+    
+    int index = find(device, first);
+    if (index != BCACHE_NONE) entries[index].trigger = 1;
+}
+
+// Cached block for a read, fetching it (and read-ahead) on a miss
+static int get_block(block_device_t* device, unsigned int block) {
+    bcache_stream_t* stream = stream_for(device);
+    
+    // Re-reading the current block (smaller reads) keeps the run going
+    if (block == stream->next_block) {
+        stream->run++;
+    } else if (block + 1 != stream->next_block) {
+        stream->run = 0;
+        stream->window = 0;
+    }
+    stream->next_block = block + 1;
+    int sequential = stream->run >= BCACHE_SEQUENTIAL_RUN;
+    
+    int index = find(device, block);
+    if (index != BCACHE_NONE) {
+        bcache_entry_t* entry = &entries[index];
+        stats.hits++;
+        entry->referenced = 1;
+        if (entry->prefetched) {
+            entry->prefetched = 0;
+            stats.readahead_hits++;
+        }
+        if (entry->trigger) {
+            entry->trigger = 0;
+            if (sequential) read_ahead(device, stream);
+        }
+        return index;
+    }
+    
+    stats.misses++;
+    if (fetch(device, block, 1, 0) < 0) return BCACHE_NONE;
+    if (sequential) {
+        stream->ahead = block + 1;
+        read_ahead(device, stream);
+    }
+    return find(device, block);
+}
+
+static void copy(char* to, const char* from, unsigned int length) {
+    for (unsigned int i = 0; i < length; i++) to[i] = from[i];
+}
+
+// Read sectors through the cache. Returns 0, or -1 on an error.
+int bcache_read(block_device_t* device, unsigned int lba, unsigned int count, void* buffer) {
+    char* out = (char*)buffer;
+    
+    if (lba >= device->sectors || count > device->sectors - lba) return -1;
+    
+    while (count > 0) {
+        unsigned int block = lba / BCACHE_BLOCK_SECTORS;
+        unsigned int offset = lba % BCACHE_BLOCK_SECTORS;
+        unsigned int sectors = BCACHE_BLOCK_SECTORS - offset;
+        if (sectors > count) sectors = count;
+        
+        int index = get_block(device, block);
+        if (index == BCACHE_NONE) return -1;
+        copy(out, block_data(index) + offset * BLOCK_SECTOR_SIZE, sectors * BLOCK_SECTOR_SIZE);
+        
+        out += sectors * BLOCK_SECTOR_SIZE;
+        lba += sectors;
+        count -= sectors;
+    }
+    return 0;
+}
+
+// Write sectors into the cache; they reach the device on eviction or
+// bcache_sync(). Whole blocks are not read first.
+int bcache_write(block_device_t* device, unsigned int lba, unsigned int count, const void* buffer) {
+    const char* in = (const char*)buffer;
+    
+    if (lba >= device->sectors || count > device->sectors - lba) return -1;
+    
+    while (count > 0) {
+        unsigned int block = lba / BCACHE_BLOCK_SECTORS;
+        unsigned int offset = lba % BCACHE_BLOCK_SECTORS;
+        unsigned int sectors = BCACHE_BLOCK_SECTORS - offset;
+        if (sectors > count) sectors = count;
+        
+        int index = find(device, block);
+        if (index == BCACHE_NONE) {
+            if (offset == 0 && sectors == block_sectors(device, block)) {
+                index = allocate(device, block);
+            } else if (fetch(device, block, 1, 0) >= 0) {
+                index = find(device, block);
+            }
+            if (index == BCACHE_NONE) return -1;
+        }
+        
+        bcache_entry_t* entry = &entries[index];
+        copy(block_data(index) + offset * BLOCK_SECTOR_SIZE, in, sectors * BLOCK_SECTOR_SIZE);
+        entry->referenced = 1;
+        if (!entry->dirty) {
+            entry->dirty = 1;
+            stats.dirty++;
+        }
+        
+        in += sectors * BLOCK_SECTOR_SIZE;
+        lba += sectors;
+        count -= sectors;
+    }
+    
+    if (stats.dirty > BCACHE_DIRTY_LIMIT) return bcache_sync(NULL);
+    return 0;
+}
+
+// Write back dirty blocks of `device` (every device for NULL) in block
+// order, then flush the device caches. A block whose write fails stays
+// dirty for the next sync. Returns -1 if a write failed.
+int bcache_sync(block_device_t* device) {
+    block_device_t* last_device = NULL;
+    unsigned int last_block = 0;
+    int result = 0;
+    
+    for (;;) {
+        // Lowest dirty block past the last one tried, so a failed block
+        // is not retried in this pass
+        int lowest = BCACHE_NONE;
+        for (int i = 0; i < BCACHE_BLOCKS; i++) {
+            bcache_entry_t* entry = &entries[i];
+            if (!entry->valid || !entry->dirty || (device && entry->device != device)) continue;
+            if (last_device && (entry->device < last_device ||
+                (entry->device == last_device && entry->block <= last_block))) {
+                continue;
+            }
+            if (lowest == BCACHE_NONE || entry->device < entries[lowest].device ||
+                (entry->device == entries[lowest].device && entry->block < entries[lowest].block)) {
+                lowest = i;
+            }
+        }
+        if (lowest == BCACHE_NONE) break;
+        
+        last_device = entries[lowest].device;
+        last_block = entries[lowest].block;
+        if (write_back(lowest) < 0) {
+            stats.write_errors++;
+            result = -1;
+        }
+    }
+    
+    for (int i = 0; i < block_count(); i++) {
+        block_device_t* target = block_get(i);
+        if ((!device || target == device) && block_flush(target) < 0) result = -1;
+    }
+    return result;
+}
+
+// Drop every cached block of a device, writing dirty ones back first.
+// Blocks that still fail to write are lost.
+void bcache_invalidate(block_device_t* device) {
+    bcache_sync(device);
+    for (int i = 0; i < BCACHE_BLOCKS; i++) {
+        if (!entries[i].valid || entries[i].device != device) continue;
+        if (entries[i].dirty) {
+            klog_value(KLOG_ERR, "bcache: dropping unwritten block ", entries[i].block);
+            entries[i].dirty = 0;
+            stats.dirty--;
+        }
+        unhash(i);
+    }
+    stream_for(device)->next_block = 0xFFFFFFFF;
+}
+
+const bcache_stats_t* bcache_get_stats() {
+    return &stats;
+}
+
+void bcache_reset_stats() {
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.readahead_blocks = 0;
+    stats.readahead_hits = 0;
+    stats.evictions = 0;
+    stats.writebacks = 0;
+    stats.write_errors = 0;
+}
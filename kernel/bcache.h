@@ -0,0 +1,40 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "block.h"
+
+// Block buffer cache over the block device layer
+#define BCACHE_BLOCK_SIZE 4096
+#define BCACHE_BLOCK_SECTORS (BCACHE_BLOCK_SIZE / BLOCK_SECTOR_SIZE)
+#define BCACHE_HASH_SIZE 512            // Buckets, power of two
+#define BCACHE_DIRTY_LIMIT 64           // Dirty blocks before a forced write-back
+
+// Read-ahead: after BCACHE_SEQUENTIAL_RUN consecutive blocks the window
+// starts at BCACHE_READAHEAD_MIN and doubles up to BCACHE_READAHEAD_MAX
+#define BCACHE_SEQUENTIAL_RUN 2
+#define BCACHE_READAHEAD_MIN 4
+#define BCACHE_READAHEAD_MAX 32
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int readahead_blocks;      // Fetched ahead of demand
+    unsigned int readahead_hits;        // ... and later used
+    unsigned int evictions;
+    unsigned int writebacks;
+    unsigned int write_errors;          // Failed write-backs; the blocks stay dirty
+    unsigned int dirty;
+    unsigned int cached;
+    unsigned int capacity;
+} bcache_stats_t;
+
+// Block cache functions
+void init_bcache();
+int bcache_read(block_device_t* device, unsigned int lba, unsigned int count, void* buffer);
+int bcache_write(block_device_t* device, unsigned int lba, unsigned int count, const void* buffer);
+int bcache_sync(block_device_t* device);
+void bcache_invalidate(block_device_t* device);
+const bcache_stats_t* bcache_get_stats();
+void bcache_reset_stats();
+
+#endif // BCACHE_H
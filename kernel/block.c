@@ -0,0 +1,81 @@
+#include "block.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+int strcmp(const char* s1, const char* s2);
+
+static block_device_t devices[BLOCK_MAX_DEVICES];
+static int device_count = 0;
+
+// Add a device. Returns it, or NULL when the table is full.
+block_device_t* block_register(const char* name, const char* driver, unsigned int sectors,
+                               int unit, const block_ops_t* ops) {
+    if (device_count >= BLOCK_MAX_DEVICES) return NULL;
+    
+    block_device_t* device = &devices[device_count++];
+    int i = 0;
+    for (; name[i] && i < BLOCK_NAME_LENGTH - 1; i++) {
+        device->name[i] = name[i];
+    }
+    device->name[i] = '\0';
+    device->driver = driver;
+    device->sectors = sectors;
+    device->unit = unit;
+    device->ops = ops;
+    
+    klog_detail(KLOG_INFO, "block: registered ", device->name);
+    return device;
+}
+
+int block_count() {
+    return device_count;
+}
+
+block_device_t* block_get(int index) {
+    if (index < 0 || index >= device_count) return NULL;
+    return &devices[index];
+}
+
+block_device_t* block_find(const char* name) {
+    for (int i = 0; i < device_count; i++) {
+        if (strcmp(devices[i].name, name) == 0) return &devices[i];
+    }
+    return NULL;
+}
+
+static int in_range(block_device_t* device, unsigned int lba, unsigned int count) {
+    return lba < device->sectors && count <= device->sectors - lba;
+}
+
+// Transfers return 0, or -1 on an error or a range past the end
+int block_read(block_device_t* device, unsigned int lba, unsigned int count, void* buffer) {
+    if (!in_range(device, lba, count)) return -1;
+    return device->ops->read(device, lba, count, buffer);
+}
+
+int block_write(block_device_t* device, unsigned int lba, unsigned int count, const void* buffer) {
+    if (!in_range(device, lba, count)) return -1;
+    return device->ops->write(device, lba, count, buffer);
+}
+
+int block_flush(block_device_t* device) {
+    return device->ops->flush ? device->ops->flush(device) : 0;
+}
+
+// Queue a transfer; `buffer` must stay untouched until block_complete()
+int block_submit(block_device_t* device, unsigned int lba, unsigned int count, void* buffer, int write) {
+    if (!in_range(device, lba, count)) return -1;
+    if (device->ops->submit) {
+        return device->ops->submit(device, lba, count, buffer, write);
+    }
+    return write ? device->ops->write(device, lba, count, buffer) :
+                   device->ops->read(device, lba, count, buffer);
+}
+
+// Wait for every queued transfer. Returns -1 if any of them failed.
+int block_complete(block_device_t* device) {
+    return device->ops->complete ? device->ops->complete(device) : 0;
+}
@@ -0,0 +1,44 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+// Block device registry: disk drivers register here and everything above
+// them (benchmarks, caches, filesystems) goes through these calls
+#define BLOCK_MAX_DEVICES 8
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_NAME_LENGTH 8
+
+typedef struct block_device block_device_t;
+
+// Driver operations. `submit` queues a transfer without waiting and
+// `complete` waits for everything queued; drivers that can only do one
+// transfer at a time leave both NULL and block_submit runs synchronously.
+typedef struct {
+    int (*read)(block_device_t* device, unsigned int lba, unsigned int count, void* buffer);
+    int (*write)(block_device_t* device, unsigned int lba, unsigned int count, const void* buffer);
+    int (*flush)(block_device_t* device);
+    int (*submit)(block_device_t* device, unsigned int lba, unsigned int count, void* buffer, int write);
+    int (*complete)(block_device_t* device);
+} block_ops_t;
+
+struct block_device {
+    char name[BLOCK_NAME_LENGTH];       // "hda", "vda", ...
+    const char* driver;
+    unsigned int sectors;
+    int unit;                           // Driver's own index
+    const block_ops_t* ops;
+};
+
+// Block device functions
+block_device_t* block_register(const char* name, const char* driver, unsigned int sectors,
+                               int unit, const block_ops_t* ops);
+int block_count();
+block_device_t* block_get(int index);
+block_device_t* block_find(const char* name);
+
+int block_read(block_device_t* device, unsigned int lba, unsigned int count, void* buffer);
+int block_write(block_device_t* device, unsigned int lba, unsigned int count, const void* buffer);
+int block_flush(block_device_t* device);
+int block_submit(block_device_t* device, unsigned int lba, unsigned int count, void* buffer, int write);
+int block_complete(block_device_t* device);
+
+#endif // BLOCK_H
@@ -0,0 +1,252 @@
+#include "capture.h"
+#include "screen.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "memory.h"
+#include "interrupts.h"
+#include "job.h"
+
+// Captured rows, `width` cells each, in the reserved pool. The buffer
+// grows a row at a time as output arrives.
+static unsigned short* const cells = (unsigned short*)CAPTURE_BASE;
+static unsigned char wrapped[CAPTURE_MAX_ROWS];     // Row ended by wrapping, not '\n'
+static int width = 0;
+static int max_rows = 0;
+static int rows = 0;                    // Rows holding output
+static int row = 0;                     // Write position
+static int col = 0;
+static int active = 0;
+static int truncated = 0;
+
+static unsigned short make_cell(char c, char color) {
+    return (unsigned char)c | ((unsigned short)(unsigned char)color << 8);
+}
+
+// Make sure `index` is a usable row. Returns 0 once the pool is full.
+static int ensure_row(int index) {
+    while (rows <= index) {
+        if (rows >= max_rows) {
+            truncated = 1;
+            return 0;
+        }
+        for (int c = 0; c < width; c++) {
+            cells[rows * width + c] = make_cell(' ', VGA_LIGHT_GREY);
+        }
+        wrapped[rows] = 0;
+        rows++;
+    }
+    return 1;
+}
+
+static void next_row(int wrap) {
+    wrapped[row] = wrap;
+    row++;
+    col = 0;
+}
+
+// Output hook: the same cursor rules as print_char, applied to the buffer
+static void capture_output(char c, char color, void* context) {
+    if (truncated) return;
+    
+    if (c == '\n') {
+        if (ensure_row(row)) next_row(0);
+    } else if (c == '\r') {
+        col = 0;
+    } else if (c == '\b') {
+        if (col > 0) {
+            col--;
+        } else if (row > 0) {
+            row--;
+            col = width - 1;
+        }
+    } else if (c == '\t') {
+        col = (col + 4) & ~3;
+        if (col >= width && ensure_row(row)) next_row(1);
+    } else if (ensure_row(row)) {
+        cells[row * width + col] = make_cell(c, color);
+        if (++col >= width) next_row(1);
+    }
+}
+
+// Start capturing print_char/print_string output
+void capture_begin() {
+    width = VGA_WIDTH;
+    max_rows = CAPTURE_SIZE / (width * sizeof(unsigned short));
+    if (max_rows > CAPTURE_MAX_ROWS) max_rows = CAPTURE_MAX_ROWS;
+    
+    rows = 0;
+    row = 0;
+    col = 0;
+    truncated = 0;
+    active = 1;
+    screen_redirect_output(capture_output, 0);
+}
+
+int capture_active() {
+    return active;
+}
+
+// Write the buffer to the console. Wrapped rows are printed in full and
+// wrap again by themselves; other rows drop trailing blanks.
+static void flush_rows() {
+    for (int r = 0; r < rows; r++) {
+        unsigned short* line = &cells[r * width];
+        int length = width;
+        if (!wrapped[r]) {
+            while (length > 0 && (line[length - 1] & 0xFF) == ' ') length--;
+        }
+        
+        for (int c = 0; c < length; c++) {
+            print_char(line[c] & 0xFF, line[c] >> 8);
+        }
+        if (!wrapped[r] && r < row) {
+            print_char('\n', VGA_LIGHT_GREY);
+        }
+    }
+}
+
+static void print_status_number(int value, int* column) {
+    char digits[12];
+    int count = 0;
+    
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        print_char_at(digits[--count], PAGER_STATUS_COLOR, VGA_HEIGHT - 1, (*column)++);
+    }
+}
+
+static void print_status_text(const char* text, int* column) {
+    while (*text && *column < VGA_WIDTH) {
+        print_char_at(*text++, PAGER_STATUS_COLOR, VGA_HEIGHT - 1, (*column)++);
+    }
+}
+
+// Render the page starting at `top` and the status line below it
+static void pager_draw(int top) {
+    int page = VGA_HEIGHT - 1;
+    
+    for (int r = 0; r < page; r++) {
+        int source = top + r;
+        for (int c = 0; c < VGA_WIDTH; c++) {
+            unsigned short cell = (source < rows && c < width) ?
+                cells[source * width + c] : make_cell(' ', VGA_LIGHT_GREY);
+            print_char_at(cell & 0xFF, cell >> 8, r, c);
+        }
+    }
+    
+    int column = 0;
+    int last = top + page < rows ? top + page : rows;
+    print_status_text(" lines ", &column);
+    print_status_number(top + 1, &column);
+    print_status_text("-", &column);
+    print_status_number(last, &column);
+    print_status_text(" of ", &column);
+    print_status_number(rows, &column);
+    print_status_text(truncated ? " (truncated)" : "", &column);
+    print_status_text("  q:quit space/b:page j/k:line g/G:ends ", &column);
+    while (column < VGA_WIDTH) {
+        print_char_at(' ', PAGER_STATUS_COLOR, VGA_HEIGHT - 1, column++);
+    }
+}
+
+// Work the pager loop has without waiting for an interrupt
+static int pager_ready() {
+    return keyboard_pending() || mouse_pending() || jobs_runnable();
+}
+
+// Interactive pager over the captured rows. Only the visible page is ever
+// drawn; the last page viewed stays on screen afterwards.
+static void run_pager() {
+    int page = VGA_HEIGHT - 1;
+    int bottom = rows - page;
+    int top = 0;
+    int quit = 0;
+    
+    pager_draw(top);
+    screen_flush();
+    
+    // Background jobs keep running under the pager. What they print here
+    // is held until it closes, and their completion is reported back at
+    // the prompt.
+    jobs_hold_console(get_active_console());
+    
+    while (!quit) {
+        poll_keyboard();
+        poll_mouse();
+        
+        int target = top + get_mouse_wheel() * PAGER_WHEEL_LINES;
+        key_event_t event;
+        while (!quit && get_key_event(&event)) {
+            switch (event.key) {
+                case 'q':
+                case 'Q':
+                case KEY_ESCAPE:
+                case 0x03:                      // Ctrl-C
+                    quit = 1;
+                    break;
+                case ' ':
+                case 'f':
+                case KEY_PAGE_DOWN:
+                    target += page;
+                    break;
+                case 'b':
+                case KEY_PAGE_UP:
+                    target -= page;
+                    break;
+                case '\n':
+                case 'j':
+                case KEY_DOWN:
+                    target++;
+                    break;
+                case 'k':
+                case KEY_UP:
+                    target--;
+                    break;
+                case 'g':
+                case KEY_HOME:
+                    target = 0;
+                    break;
+                case 'G':
+                case KEY_END:
+                    target = bottom;
+                    break;
+            }
+        }
+        
+        if (target > bottom) target = bottom;
+        if (target < 0) target = 0;
+        if (target != top) {
+            top = target;
+            pager_draw(top);
+            screen_flush();
+        }
+        
+        jobs_step();
+        wait_for_interrupt(pager_ready);
+    }
+    
+    // The prompt takes the status line
+    for (int c = 0; c < VGA_WIDTH; c++) {
+        print_char_at(' ', VGA_LIGHT_GREY, page, c);
+    }
+    set_cursor(page, 0);
+    jobs_release_console();
+}
+
+// Stop capturing and show the output: in one pass if it fits on screen,
+// otherwise in the pager
+void capture_end() {
+    if (!active) return;
+    
+    screen_redirect_output(0, 0);
+    active = 0;
+    
+    if (rows > VGA_HEIGHT - 1) {
+        run_pager();
+    } else {
+        flush_rows();
+    }
+}
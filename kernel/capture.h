@@ -0,0 +1,16 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+// Command output capture and pager configuration
+#define CAPTURE_MAX_ROWS 4096
+#define PAGER_WHEEL_LINES 3             // Rows scrolled per wheel notch
+#define PAGER_STATUS_COLOR 0x70         // Black on grey
+
+// Output of a command is laid out into rows of cells as the console would
+// show it, then written to the screen in one pass when the command ends.
+// Output taller than the screen opens a pager instead.
+void capture_begin();
+int capture_active();
+void capture_end();
+
+#endif // CAPTURE_H
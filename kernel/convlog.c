@@ -0,0 +1,530 @@
+#include "convlog.h"
+#include "bcache.h"
+#include "fat.h"
+#include "timer.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+// A message's payload: timestamp and role, then the content
+#define CONVLOG_PAYLOAD_HEADER (sizeof(long) + 16)
+#define CONVLOG_RECORD_MAX (sizeof(convlog_record_t) + CONVLOG_PAYLOAD_HEADER + MAX_PROMPT_LENGTH)
+#define CONVLOG_READ_SECTORS ((CONVLOG_RECORD_MAX + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE + 1)
+
+int strcmp(const char* s1, const char* s2);
+
+// Appends to one region. The sector holding the end is kept here, so
+// records are added without reading it back.
+typedef struct {
+    unsigned int region;
+    unsigned int tail;
+    unsigned char sector[BLOCK_SECTOR_SIZE];
+} convlog_writer_t;
+
+static block_device_t* device = NULL;
+static convlog_super_t super;           // Current state; on disk as of the last commit
+static convlog_writer_t writer;         // Appends to the active region
+static unsigned int pending = 0;        // Records and history stores since the last commit
+static unsigned int pending_since;      // Uptime when the oldest of them was appended
+
+// Compaction in progress: records copy_first.. are copied in sequence
+// order into the other region, copy_index holding their new offsets
+static int compacting = 0;
+static convlog_writer_t copier;
+static unsigned int copy_first;
+static unsigned int copy_next;
+static unsigned int copy_index[CONVLOG_INDEX_ENTRIES];
+
+static unsigned char record_buffer[CONVLOG_RECORD_MAX + 4];
+static unsigned char read_buffer[CONVLOG_READ_SECTORS * BLOCK_SECTOR_SIZE];
+static convlog_stats_t stats;
+
+static unsigned int fnv1a(unsigned int hash, const void* data, unsigned int length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (unsigned int i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void copy(void* to, const void* from, unsigned int length) {
+    for (unsigned int i = 0; i < length; i++) ((char*)to)[i] = ((const char*)from)[i];
+}
+
+static void zero(void* to, unsigned int length) {
+    for (unsigned int i = 0; i < length; i++) ((char*)to)[i] = 0;
+}
+
+static unsigned int region_lba(unsigned int region) {
+    return CONVLOG_REGION_START + region * super.region_sectors;
+}
+
+// The history area follows the regions. Disks formatted before it was
+// reserved may have no room for it.
+static unsigned int history_lba() {
+    return CONVLOG_REGION_START + 2 * super.region_sectors;
+}
+
+static int history_fits() {
+    return history_lba() + CONVLOG_HISTORY_SECTORS <= device->sectors;
+}
+
+static unsigned int region_bytes() {
+    return super.region_sectors * BLOCK_SECTOR_SIZE;
+}
+
+static unsigned int record_size(const convlog_record_t* record) {
+    return (sizeof(convlog_record_t) + record->length + 3) & ~3u;
+}
+
+static unsigned int super_checksum(const convlog_super_t* copy) {
+    return fnv1a(2166136261u, copy, sizeof(convlog_super_t) - sizeof(unsigned int));
+}
+
+// Oldest record worth keeping: in the region, after the last clear and
+// still in the index
+static unsigned int live_sequence() {
+    unsigned int first = super.first_sequence;
+    if (super.clear_sequence + 1 > first) first = super.clear_sequence + 1;
+    if (super.next_sequence - first > CONVLOG_INDEX_ENTRIES) {
+        first = super.next_sequence - CONVLOG_INDEX_ENTRIES;
+    }
+    return first;
+}
+
+// Stop logging after a failed transfer rather than leave holes in the log
+static int io_error(const char* message) {
+    klog_detail(KLOG_ERR, message, device->name);
+    device = NULL;
+    compacting = 0;
+    return -1;
+}
+
+static void writer_start(convlog_writer_t* target, unsigned int region, unsigned int tail) {
+    target->region = region;
+    target->tail = tail;
+    zero(target->sector, BLOCK_SECTOR_SIZE);
+    
+    // Keep what precedes the end in its sector; whatever follows is stale
+    unsigned int offset = tail % BLOCK_SECTOR_SIZE;
+    if (offset && bcache_read(device, region_lba(region) + tail / BLOCK_SECTOR_SIZE, 1, target->sector) == 0) {
+        zero(target->sector + offset, BLOCK_SECTOR_SIZE - offset);
+    }
+}
+
+// Append bytes through the block cache. They reach the disk at the next
+// commit (or earlier, if the cache writes them back).
+static int put_bytes(convlog_writer_t* target, const void* data, unsigned int length) {
+    const unsigned char* in = (const unsigned char*)data;
+    
+    while (length > 0) {
+        unsigned int offset = target->tail % BLOCK_SECTOR_SIZE;
+        unsigned int chunk = BLOCK_SECTOR_SIZE - offset;
+        if (chunk > length) chunk = length;
+        
+        copy(target->sector + offset, in, chunk);
+        unsigned int lba = region_lba(target->region) + target->tail / BLOCK_SECTOR_SIZE;
+        if (bcache_write(device, lba, 1, target->sector) < 0) return -1;
+        
+        in += chunk;
+        length -= chunk;
+        target->tail += chunk;
+        if (target->tail % BLOCK_SECTOR_SIZE == 0) zero(target->sector, BLOCK_SECTOR_SIZE);
+    }
+    return 0;
+}
+
+// Record `sequence` at `offset` of `region`, or NULL if what is there is
+// not that record intact. Stale records left by an earlier use of the
+// region carry lower sequence numbers, so they fail too.
+static const convlog_record_t* read_record(unsigned int region, unsigned int offset, unsigned int sequence) {
+    if (offset % 4 || offset + sizeof(convlog_record_t) > region_bytes()) return NULL;
+    
+    unsigned int first = offset / BLOCK_SECTOR_SIZE;
+    unsigned int count = (offset % BLOCK_SECTOR_SIZE + CONVLOG_RECORD_MAX + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+    if (count > super.region_sectors - first) count = super.region_sectors - first;
+    if (bcache_read(device, region_lba(region) + first, count, read_buffer) < 0) return NULL;
+    
+    const convlog_record_t* record = (const convlog_record_t*)(read_buffer + offset % BLOCK_SECTOR_SIZE);
+    if (record->magic != CONVLOG_RECORD_MAGIC || record->sequence != sequence ||
+        (record->type != CONVLOG_MESSAGE && record->type != CONVLOG_CLEAR) ||
+        sizeof(convlog_record_t) + record->length > CONVLOG_RECORD_MAX ||
+        offset % BLOCK_SECTOR_SIZE + sizeof(convlog_record_t) + record->length > count * BLOCK_SECTOR_SIZE) {
+        return NULL;
+    }
+    
+    convlog_record_t header = *record;
+    header.checksum = 0;
+    unsigned int hash = fnv1a(2166136261u, &header, sizeof(header));
+    if (fnv1a(hash, record + 1, record->length) != record->checksum) return NULL;
+    return record;
+}
+
+// Lay out a record in record_buffer. Returns its padded size.
+static unsigned int build_record(int type, unsigned int sequence, const conversation_message_t* message) {
+    convlog_record_t* header = (convlog_record_t*)record_buffer;
+    unsigned char* payload = record_buffer + sizeof(convlog_record_t);
+    unsigned int length = 0;
+    
+    if (message) {
+        unsigned int content = 0;
+        while (content < MAX_PROMPT_LENGTH - 1 && message->content[content]) content++;
+        copy(payload, &message->timestamp, sizeof(long));
+        copy(payload + sizeof(long), message->role, 16);
+        copy(payload + CONVLOG_PAYLOAD_HEADER, message->content, content);
+        length = CONVLOG_PAYLOAD_HEADER + content;
+    }
+    
+    header->magic = CONVLOG_RECORD_MAGIC;
+    header->type = type;
+    header->length = length;
+    header->sequence = sequence;
+    header->checksum = 0;
+    
+    unsigned int size = sizeof(convlog_record_t) + length;
+    header->checksum = fnv1a(2166136261u, record_buffer, size);
+    while (size % 4) record_buffer[size++] = 0;
+    return size;
+}
+
+// Make everything appended so far durable: write the log back, then the
+// superblock copy not written last time, so a torn superblock write leaves
+// the other copy intact
+static int commit() {
+    unsigned char sector[BLOCK_SECTOR_SIZE];
+    
+    if (bcache_sync(device) < 0) return io_error("convlog: log write-back failed on ");
+    
+    super.tail = writer.tail;
+    super.generation++;
+    super.checksum = super_checksum(&super);
+    zero(sector, BLOCK_SECTOR_SIZE);
+    copy(sector, &super, sizeof(super));
+    
+    // The superblocks bypass the cache: nothing else reads them
+    if (block_write(device, super.generation & 1, 1, sector) < 0 || block_flush(device) < 0) {
+        return io_error("convlog: superblock write failed on ");
+    }
+    
+    pending = 0;
+    stats.commits++;
+    return 0;
+}
+
+static void start_compaction() {
+    copy_first = live_sequence();
+    copy_next = copy_first;
+    writer_start(&copier, 1 - super.active, 0);
+    compacting = 1;
+}
+
+// Copy up to `records` records into the other region; once caught up with
+// the log, switch regions. Returns -1 on an I/O error.
+static int compact_step(int records) {
+    // Appends overran the index while copying: start over from what is left
+    if (super.next_sequence - copy_next > CONVLOG_INDEX_ENTRIES) start_compaction();
+    
+    for (; records > 0 && copy_next != super.next_sequence; records--, copy_next++) {
+        unsigned int slot = copy_next % CONVLOG_INDEX_ENTRIES;
+        const convlog_record_t* record = read_record(super.active, super.index[slot], copy_next);
+        if (!record) {
+            klog_value(KLOG_WARNING, "convlog: dropping unreadable record ", copy_next);
+            copy_index[slot] = 1;       // Never a record offset
+            continue;
+        }
+        
+        copy_index[slot] = copier.tail;
+        if (put_bytes(&copier, record, record_size(record)) < 0) {
+            return io_error("convlog: compaction write failed on ");
+        }
+    }
+    if (copy_next != super.next_sequence) return 0;
+    
+    super.active = copier.region;
+    super.first_sequence = copy_first;
+    for (unsigned int s = copy_first; s != super.next_sequence; s++) {
+        super.index[s % CONVLOG_INDEX_ENTRIES] = copy_index[s % CONVLOG_INDEX_ENTRIES];
+    }
+    writer = copier;
+    compacting = 0;
+    stats.compactions++;
+    klog_value(KLOG_INFO, "convlog: compacted, bytes kept: ", writer.tail);
+    return commit();
+}
+
+static int append(int type, const conversation_message_t* message) {
+    if (!device) return -1;
+    
+    unsigned int sequence = super.next_sequence;
+    unsigned int size = build_record(type, sequence, message);
+    
+    // Out of room: compact now rather than in the background
+    if (writer.tail + size > region_bytes()) {
+        if (!compacting) start_compaction();
+        while (compacting) {
+            if (compact_step(CONVLOG_INDEX_ENTRIES) < 0) return -1;
+        }
+        if (writer.tail + size > region_bytes()) {
+            klog(KLOG_WARNING, "convlog: log full");
+            return -1;
+        }
+    }
+    
+    unsigned int offset = writer.tail;
+    if (put_bytes(&writer, record_buffer, size) < 0) return io_error("convlog: append failed on ");
+    
+    super.index[sequence % CONVLOG_INDEX_ENTRIES] = offset;
+    if (type == CONVLOG_CLEAR) super.clear_sequence = sequence;
+    super.next_sequence++;
+    stats.records++;
+    stats.bytes += size;
+    
+    if (!compacting && writer.tail >= region_bytes() / 100 * CONVLOG_COMPACT_PERCENT) {
+        start_compaction();
+    }
+    
+    if (pending++ == 0) pending_since = get_uptime_ms();
+    return pending >= CONVLOG_SYNC_BATCH ? commit() : 0;
+}
+
+// Newest valid superblock of `candidate`. Returns 1 if there is one, 0 if
+// both copies are blank (a new log disk) and -1 for anything else.
+static int load_super(block_device_t* candidate) {
+    unsigned char sectors[2 * BLOCK_SECTOR_SIZE];
+    int found = 0;
+    int blank = 1;
+    
+    if (candidate->sectors < CONVLOG_REGION_START || block_read(candidate, 0, 2, sectors) < 0) return -1;
+    
+    for (int slot = 0; slot < 2; slot++) {
+        const convlog_super_t* copy = (const convlog_super_t*)(sectors + slot * BLOCK_SECTOR_SIZE);
+        if (copy->magic != CONVLOG_MAGIC || copy->checksum != super_checksum(copy)) continue;
+        if (copy->active > 1 || copy->region_sectors < CONVLOG_MIN_REGION_SECTORS ||
+            copy->region_sectors > CONVLOG_MAX_REGION_SECTORS ||
+            CONVLOG_REGION_START + 2 * copy->region_sectors > candidate->sectors ||
+            copy->tail > copy->region_sectors * BLOCK_SECTOR_SIZE) {
+            continue;
+        }
+        if (!found || copy->generation > super.generation) super = *copy;
+        found = 1;
+    }
+    if (found) return 1;
+    
+    for (unsigned int i = 0; i < sizeof(sectors); i++) {
+        if (sectors[i]) blank = 0;
+    }
+    return blank ? 0 : -1;
+}
+
+// Lay out an empty log on a blank disk
+static int format(block_device_t* candidate) {
+    if (candidate->sectors < CONVLOG_REGION_START + CONVLOG_HISTORY_SECTORS) return 0;
+    unsigned int region_sectors = (candidate->sectors - CONVLOG_REGION_START - CONVLOG_HISTORY_SECTORS) / 2;
+    region_sectors -= region_sectors % BCACHE_BLOCK_SECTORS;
+    if (region_sectors > CONVLOG_MAX_REGION_SECTORS) region_sectors = CONVLOG_MAX_REGION_SECTORS;
+    if (region_sectors < CONVLOG_MIN_REGION_SECTORS) return 0;
+    
+    zero(&super, sizeof(super));
+    super.magic = CONVLOG_MAGIC;
+    super.region_sectors = region_sectors;
+    super.first_sequence = 1;
+    super.next_sequence = 1;
+    
+    device = candidate;
+    writer_start(&writer, 0, 0);
+    if (commit() < 0) return 0;
+    klog_detail(KLOG_NOTICE, "convlog: formatted log disk ", candidate->name);
+    return 1;
+}
+
+// Open the log on the first disk holding one, or format the first blank
+// disk other than the FAT volume's. Records appended after the last commit
+// are found by scanning on from the committed end; the scan stops at the
+// first record that is not the next in sequence.
+int init_convlog() {
+    device = NULL;
+    compacting = 0;
+    pending = 0;
+    zero(&stats, sizeof(stats));
+    
+    for (int i = 0; i < block_count() && !device; i++) {
+        block_device_t* candidate = block_get(i);
+        if (fat_mounted() && strcmp(candidate->name, fat_device_name()) == 0) continue;
+        
+        int state = load_super(candidate);
+        if (state > 0) {
+            device = candidate;
+        } else if (state == 0) {
+            format(candidate);
+        }
+    }
+    if (!device) {
+        klog(KLOG_INFO, "convlog: no log disk, conversations are not kept");
+        return 0;
+    }
+    
+    unsigned int offset = super.tail;
+    const convlog_record_t* record;
+    while ((record = read_record(super.active, offset, super.next_sequence)) != NULL) {
+        super.index[super.next_sequence % CONVLOG_INDEX_ENTRIES] = offset;
+        if (record->type == CONVLOG_CLEAR) super.clear_sequence = super.next_sequence;
+        offset += record_size(record);
+        super.next_sequence++;
+        stats.recovered++;
+    }
+    writer_start(&writer, super.active, offset);
+    
+    klog_detail(KLOG_INFO, "convlog: log on ", device->name);
+    if (!history_fits()) klog(KLOG_NOTICE, "convlog: no room for the command history on this log disk");
+    klog_value(KLOG_INFO, "convlog: records: ", super.next_sequence - super.first_sequence);
+    if (stats.recovered) {
+        klog_value(KLOG_NOTICE, "convlog: uncommitted records recovered: ", stats.recovered);
+        return commit() == 0;
+    }
+    return 1;
+}
+
+int convlog_ready() {
+    return device != NULL;
+}
+
+const char* convlog_device_name() {
+    return device ? device->name : "";
+}
+
+// Append a message. It is durable once committed: after CONVLOG_SYNC_BATCH
+// records, CONVLOG_SYNC_MS, or convlog_sync.
+int convlog_append(const conversation_message_t* message) {
+    return append(CONVLOG_MESSAGE, message);
+}
+
+// Record that the history was cleared
+int convlog_append_clear() {
+    return append(CONVLOG_CLEAR, NULL);
+}
+
+// Reload the last `max` messages since the history was last cleared,
+// oldest first. Only those records are read, found through the index.
+int convlog_restore(conversation_message_t* messages, int max) {
+    int count = 0;
+    
+    if (!device || max <= 0) return 0;
+    
+    unsigned int first = live_sequence();
+    if (super.next_sequence - first > (unsigned int)max) first = super.next_sequence - max;
+    
+    for (unsigned int s = first; s != super.next_sequence; s++) {
+        const convlog_record_t* record = read_record(super.active, super.index[s % CONVLOG_INDEX_ENTRIES], s);
+        stats.restore_reads++;
+        if (!record || record->type != CONVLOG_MESSAGE || record->length < CONVLOG_PAYLOAD_HEADER) continue;
+        
+        const unsigned char* payload = (const unsigned char*)(record + 1);
+        conversation_message_t* message = &messages[count++];
+        unsigned int length = record->length - CONVLOG_PAYLOAD_HEADER;
+        if (length > MAX_PROMPT_LENGTH - 1) length = MAX_PROMPT_LENGTH - 1;
+        
+        copy(&message->timestamp, payload, sizeof(long));
+        copy(message->role, payload + sizeof(long), 16);
+        message->role[15] = '\0';
+        copy(message->content, payload + CONVLOG_PAYLOAD_HEADER, length);
+        message->content[length] = '\0';
+    }
+    
+    stats.restored = count;
+    return count;
+}
+
+// Commit now. Returns -1 if the log is unavailable or the write failed.
+int convlog_sync() {
+    if (!device) return -1;
+    return pending ? commit() : 0;
+}
+
+// Run a compaction to the end now
+int convlog_compact() {
+    if (!device) return -1;
+    if (!compacting) start_compaction();
+    while (compacting) {
+        if (compact_step(CONVLOG_INDEX_ENTRIES) < 0) return -1;
+    }
+    return 0;
+}
+
+// Called from the shell loop: copy a few records of a compaction in
+// progress, and commit records that have waited CONVLOG_SYNC_MS
+void convlog_poll() {
+    if (!device) return;
+    if (compacting) compact_step(CONVLOG_COMPACT_STEP);
+    if (device && pending && get_uptime_ms() - pending_since >= CONVLOG_SYNC_MS) commit();
+}
+
+const convlog_stats_t* convlog_get_stats() {
+    stats.used = device ? writer.tail : 0;
+    stats.capacity = device ? region_bytes() : 0;
+    return &stats;
+}
+
+// Read the stored command history image into `buffer`. Returns its length,
+// 0 if none was stored, or -1 if it can't be read or fails its checksum.
+int convlog_load_history(char* buffer, int size) {
+    unsigned char sector[BLOCK_SECTOR_SIZE];
+    convlog_history_t header;
+    
+    if (!device || !history_fits()) return 0;
+    if (bcache_read(device, history_lba(), 1, sector) < 0) return -1;
+    copy(&header, sector, sizeof(header));
+    if (header.magic != CONVLOG_HISTORY_MAGIC) return 0;
+    if (header.length > (unsigned int)size ||
+        header.length > (CONVLOG_HISTORY_SECTORS - 1) * BLOCK_SECTOR_SIZE) {
+        return -1;
+    }
+    
+    // Whole sectors straight into the buffer, the partial last one through `sector`
+    unsigned int whole = header.length / BLOCK_SECTOR_SIZE;
+    unsigned int rest = header.length % BLOCK_SECTOR_SIZE;
+    if (whole && bcache_read(device, history_lba() + 1, whole, buffer) < 0) return -1;
+    if (rest) {
+        if (bcache_read(device, history_lba() + 1 + whole, 1, sector) < 0) return -1;
+        copy(buffer + whole * BLOCK_SECTOR_SIZE, sector, rest);
+    }
+    
+    if (fnv1a(2166136261u, buffer, header.length) != header.checksum) {
+        klog(KLOG_WARNING, "convlog: stored command history is damaged, starting empty");
+        return -1;
+    }
+    return header.length;
+}
+
+// Store a command history image. It goes to the cache and is written back
+// with the next commit, like a record.
+int convlog_store_history(const char* data, int length) {
+    unsigned char sector[BLOCK_SECTOR_SIZE];
+    convlog_history_t header;
+    
+    if (!device || !history_fits() || length < 0 ||
+        (unsigned int)length > (CONVLOG_HISTORY_SECTORS - 1) * BLOCK_SECTOR_SIZE) {
+        return -1;
+    }
+    
+    unsigned int whole = length / BLOCK_SECTOR_SIZE;
+    unsigned int rest = length % BLOCK_SECTOR_SIZE;
+    if (whole && bcache_write(device, history_lba() + 1, whole, data) < 0) return -1;
+    if (rest) {
+        zero(sector, BLOCK_SECTOR_SIZE);
+        copy(sector, data + whole * BLOCK_SECTOR_SIZE, rest);
+        if (bcache_write(device, history_lba() + 1 + whole, 1, sector) < 0) return -1;
+    }
+    
+    header.magic = CONVLOG_HISTORY_MAGIC;
+    header.length = length;
+    header.checksum = fnv1a(2166136261u, data, length);
+    zero(sector, BLOCK_SECTOR_SIZE);
+    copy(sector, &header, sizeof(header));
+    if (bcache_write(device, history_lba(), 1, sector) < 0) return -1;
+    
+    if (pending++ == 0) pending_since = get_uptime_ms();
+    return 0;
+}
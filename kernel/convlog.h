@@ -0,0 +1,97 @@
+#ifndef CONVLOG_H
+#define CONVLOG_H
+
+#include "block.h"
+#include "langchain.h"
+
+// Persistent AI conversation log: an append-only record log on a disk of
+// its own. Sectors 0 and 1 hold two superblock copies written in turn; the
+// rest is split into two regions, one holding the log while compaction
+// copies the live tail of the conversation into the other. The shell's
+// command history is kept in an area of its own after the regions.
+#define CONVLOG_MAGIC 0x474C5643        // "CVLG", superblock
+#define CONVLOG_RECORD_MAGIC 0x52
+#define CONVLOG_REGION_START 8          // First region sector (block 1 of the cache)
+#define CONVLOG_MIN_REGION_SECTORS 256  // 128KB, room for a compacted conversation
+#define CONVLOG_MAX_REGION_SECTORS 0x10000 // 32MB; the rest of a bigger disk is unused
+#define CONVLOG_HISTORY_MAGIC 0x54534843 // "CHST", history area header
+#define CONVLOG_HISTORY_SECTORS 72      // Header sector, then a full history image
+
+// Offset index kept in the superblock: where each of the last
+// CONVLOG_INDEX_ENTRIES records starts, so restoring a session reads only
+// the records it needs
+#define CONVLOG_INDEX_ENTRIES 64        // Power of two
+
+// Group commit: the log is synced after this many records, or once the
+// oldest unsynced record is this old
+#define CONVLOG_SYNC_BATCH 8
+#define CONVLOG_SYNC_MS 1000
+
+// Compaction starts when the active region is this full and copies this
+// many records per convlog_poll call
+#define CONVLOG_COMPACT_PERCENT 75
+#define CONVLOG_COMPACT_STEP 4
+
+// Record types
+#define CONVLOG_MESSAGE 1
+#define CONVLOG_CLEAR 2                 // History cleared; nothing before it is restored
+
+// Superblock. The copy with the highest generation and a good checksum
+// is current; `tail` and `index` are as of the last commit.
+typedef struct {
+    unsigned int magic;
+    unsigned int generation;
+    unsigned int active;                // Region holding the log, 0 or 1
+    unsigned int region_sectors;
+    unsigned int tail;                  // Committed end, bytes into the region
+    unsigned int first_sequence;        // Oldest record in the region
+    unsigned int next_sequence;
+    unsigned int clear_sequence;        // Last CONVLOG_CLEAR record, 0 for none
+    unsigned int index[CONVLOG_INDEX_ENTRIES]; // Offset of record s at [s % ENTRIES]
+    unsigned int checksum;              // FNV-1a of the fields above
+} convlog_super_t;
+
+// Record header, followed by `length` bytes of payload and padded to 4
+// bytes. A message's payload is its timestamp, role[16] and content.
+typedef struct {
+    unsigned char magic;
+    unsigned char type;
+    unsigned short length;
+    unsigned int sequence;
+    unsigned int checksum;              // FNV-1a of header (checksum 0) and payload
+} convlog_record_t;
+
+// First sector of the history area. The image follows in the next sectors.
+typedef struct {
+    unsigned int magic;
+    unsigned int length;                // Bytes of image
+    unsigned int checksum;              // FNV-1a of the image
+} convlog_history_t;
+
+typedef struct {
+    unsigned int records;               // Appended since boot
+    unsigned int bytes;
+    unsigned int commits;
+    unsigned int recovered;             // Uncommitted records found at boot
+    unsigned int restored;              // Messages reloaded into the session
+    unsigned int restore_reads;         // Records read to reload them
+    unsigned int compactions;
+    unsigned int used;                  // Bytes of the active region in use
+    unsigned int capacity;
+} convlog_stats_t;
+
+// Conversation log functions
+int init_convlog();
+int convlog_ready();
+const char* convlog_device_name();
+int convlog_append(const conversation_message_t* message);
+int convlog_append_clear();
+int convlog_restore(conversation_message_t* messages, int max);
+int convlog_sync();
+int convlog_compact();
+void convlog_poll();
+const convlog_stats_t* convlog_get_stats();
+int convlog_load_history(char* buffer, int size);
+int convlog_store_history(const char* data, int length);
+
+#endif // CONVLOG_H
@@ -1,5 +1,7 @@
 #include "env.h"
 #include "screen.h"
+#include "klog.h"
+#include "vfs.h"
 
 // Define NULL for kernel environment
 #ifndef NULL
@@ -9,6 +11,8 @@
 // Define size_t for kernel environment
 typedef unsigned int size_t;
 
+int strncmp(const char* s1, const char* s2, size_t n);
+
 // String function implementations for kernel environment
 int strcmp(const char* s1, const char* s2) {
     while (*s1 && (*s1 == *s2)) {
@@ -64,31 +68,81 @@ static int env_count = 0;
 void init_environment() {
     env_count = 0;
     
-    // Try to load .env file
-    if (load_env_file(".env")) {
-        print_string("Environment loaded from .env file\n", VGA_LIGHT_GREEN);
+    // Try the .env packed into the initrd, then the one on disk
+    if (load_env_file(ENV_INITRD_PATH) || load_env_file(ENV_FILE_PATH)) {
+        klog(KLOG_INFO, "env: environment loaded from .env file");
     } else {
-        print_string("No .env file found, using default environment\n", VGA_LIGHT_YELLOW);
+        klog(KLOG_WARNING, "env: no .env file found, using default environment");
+        set_env_var("GEMINI_API_KEY", "your_gemini_api_key_here");
+        set_env_var("OPENAI_API_KEY", "your_openai_api_key_here");
+        set_env_var("ANTHROPIC_API_KEY", "your_anthropic_api_key_here");
+    }
+}
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Parse KEY=VALUE lines. Blank lines and # comments are skipped, an
+// "export " prefix is allowed, and matching quotes around a value are
+// removed. Returns the number of variables set.
+int parse_env(char* text) {
+    int count = 0;
+    
+    while (*text) {
+        char* line = text;
+        while (*text && *text != '\n') text++;
+        if (*text) *text++ = '\0';
+        
+        while (is_blank(*line)) line++;
+        if (*line == '\0' || *line == '#') continue;
+        if (strncmp(line, "export ", 7) == 0) line += 7;
+        
+        char* equals = line;
+        while (*equals && *equals != '=') equals++;
+        if (*equals != '=') continue;
+        
+        char* key_end = equals;
+        while (key_end > line && is_blank(key_end[-1])) key_end--;
+        *key_end = '\0';
+        if (*line == '\0') continue;
+        
+        char* value = equals + 1;
+        while (is_blank(*value)) value++;
+        char* value_end = value + strlen(value);
+        while (value_end > value && is_blank(value_end[-1])) value_end--;
+        if (value_end - value >= 2 && (*value == '"' || *value == '\'') && value_end[-1] == *value) {
+            value++;
+            value_end--;
+        }
+        *value_end = '\0';
+        
+        if (set_env_var(line, value)) count++;
     }
+    return count;
 }
 
-// Load environment variables from file
+// Load environment variables from a file. parse_env edits the text, so
+// it is read into a buffer rather than mapped. Returns 1 if the file was
+// read.
 int load_env_file(const char* filename) {
-    // In a real OS, you'd read from the actual file system
-    // For now, we'll simulate loading some common environment variables
+    static char text[ENV_FILE_MAX_SIZE];
     
-    // Simulate loading from .env file
-    set_env_var("GEMINI_API_KEY", "your_gemini_api_key_here");
-    set_env_var("OPENAI_API_KEY", "your_openai_api_key_here");
-    set_env_var("ANTHROPIC_API_KEY", "your_anthropic_api_key_here");
+    int fd = vfs_open(filename, VFS_READ);
+    if (fd < 0) return 0;
     
-    // In a real implementation, you would:
-    // 1. Open the .env file
-    // 2. Parse each line (key=value format)
-    // 3. Store in env_vars array
-    // 4. Handle comments (# lines) and empty lines
+    int length = 0;
+    int count;
+    while (length < ENV_FILE_MAX_SIZE - 1 &&
+           (count = vfs_read(fd, text + length, ENV_FILE_MAX_SIZE - 1 - length)) > 0) {
+        length += count;
+    }
+    vfs_close(fd);
+    text[length] = '\0';
     
-    return 1; // Success
+    klog_detail(KLOG_INFO, "env: reading ", filename);
+    klog_value(KLOG_INFO, "env: variables read from file: ", parse_env(text));
+    return 1;
 }
 
 // Get environment variable value
@@ -5,6 +5,9 @@
 #define MAX_ENV_VARS 20
 #define MAX_ENV_KEY_LENGTH 64
 #define MAX_ENV_VALUE_LENGTH 256
+#define ENV_INITRD_PATH "/initrd/.env"  // Packed at build time
+#define ENV_FILE_PATH "/disk/.env"      // On the FAT volume
+#define ENV_FILE_MAX_SIZE 4096
 
 // Environment variable structure
 typedef struct {
@@ -15,6 +18,7 @@ typedef struct {
 // Environment functions
 void init_environment();
 int load_env_file(const char* filename);
+int parse_env(char* text);
 const char* get_env_var(const char* key);
 int set_env_var(const char* key, const char* value);
 
@@ -0,0 +1,536 @@
+#include "fat.h"
+#include "memory.h"
+#include "bcache.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+// Mounted volume. Sector numbers are absolute on the device.
+static block_device_t* volume = NULL;
+static unsigned int sectors_per_cluster;
+static unsigned int cluster_bytes;
+static unsigned int fat_lba;
+static unsigned int fat_sectors;
+static unsigned int root_lba;
+static unsigned int root_sectors;
+static unsigned int data_lba;
+static unsigned int cluster_count;
+static int fat_bits;
+
+// The whole first FAT, read once at mount
+static unsigned char* const fat_table = (unsigned char*)FAT_CACHE_BASE;
+
+// Directory entry as found by a lookup
+typedef struct {
+    unsigned int first_cluster;
+    unsigned int size;
+    unsigned char attributes;
+} fat_entry_t;
+
+// Directory lookup cache, direct mapped on (directory, name). Misses are
+// cached too, so probing for an absent file doesn't rescan the directory.
+typedef struct {
+    int valid;
+    int found;
+    unsigned int parent;
+    char name[FAT_NAME_LENGTH];
+    fat_entry_t entry;
+} dcache_slot_t;
+
+static dcache_slot_t dcache[FAT_DCACHE_SIZE];
+static unsigned char sector[BLOCK_SECTOR_SIZE] __attribute__((aligned(4)));
+static fat_stats_t stats;
+
+static unsigned int le16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int le32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static char lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static int same_name(const char* a, const char* b) {
+    while (*a && lower(*a) == lower(*b)) {
+        a++;
+        b++;
+    }
+    return *a == '\0' && *b == '\0';
+}
+
+static unsigned int next_cluster(unsigned int cluster) {
+    if (fat_bits == 16) {
+        return le16(fat_table + cluster * 2);
+    }
+    unsigned int value = le16(fat_table + cluster + cluster / 2);
+    return (cluster & 1) ? value >> 4 : value & 0xFFF;
+}
+
+// End of chain, bad cluster, or a value that can't be a data cluster
+static int chain_ended(unsigned int cluster) {
+    return cluster < 2 || cluster >= cluster_count + 2;
+}
+
+static unsigned int cluster_lba(unsigned int cluster) {
+    return data_lba + (cluster - 2) * sectors_per_cluster;
+}
+
+// Read a run of sectors through the block cache, counting it
+static int read_sectors(unsigned int lba, unsigned int count, void* buffer) {
+    stats.runs++;
+    stats.sectors += count;
+    return bcache_read(volume, lba, count, buffer);
+}
+
+// Checksum of an 8.3 name, stored in each of its long name entries
+static unsigned char short_name_checksum(const unsigned char* name) {
+    unsigned char sum = 0;
+    for (int i = 0; i < 11; i++) {
+        sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+    }
+    return sum;
+}
+
+// "NAME.EXT" from an 8.3 entry, honouring the lowercase flags
+static void short_name(const unsigned char* entry, char* name) {
+    int length = 0;
+    int lower_base = entry[12] & 0x08;
+    int lower_ext = entry[12] & 0x10;
+    
+    for (int i = 0; i < 8 && entry[i] != ' '; i++) {
+        name[length++] = lower_base ? lower(entry[i]) : entry[i];
+    }
+    if (entry[8] != ' ') {
+        name[length++] = '.';
+        for (int i = 8; i < 11 && entry[i] != ' '; i++) {
+            name[length++] = lower_ext ? lower(entry[i]) : entry[i];
+        }
+    }
+    name[length] = '\0';
+}
+
+// Long name pieces arrive last piece first; each holds 13 UTF-16
+// characters, kept here as ASCII
+typedef struct {
+    char name[FAT_NAME_LENGTH];
+    int valid;
+    unsigned char checksum;
+} long_name_t;
+
+static void add_long_name_piece(long_name_t* long_name, const unsigned char* entry) {
+    static const unsigned char offsets[FAT_LFN_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+    
+    if (entry[0] & FAT_LFN_LAST) {
+        for (int i = 0; i < FAT_NAME_LENGTH; i++) long_name->name[i] = '\0';
+        long_name->valid = 1;
+        long_name->checksum = entry[13];
+    } else if (entry[13] != long_name->checksum) {
+        long_name->valid = 0;
+    }
+    if (!long_name->valid) return;
+    
+    int position = ((entry[0] & 0x1F) - 1) * FAT_LFN_CHARS;
+    for (int i = 0; i < FAT_LFN_CHARS; i++) {
+        unsigned int c = le16(entry + offsets[i]);
+        if (c == 0 || c == 0xFFFF) break;
+        if (position + i >= FAT_NAME_LENGTH - 1) {
+            long_name->valid = 0;       // Too long to match anything we look up
+            return;
+        }
+        long_name->name[position + i] = c < 0x80 ? c : '?';
+    }
+}
+
+// Called for each entry of a directory; return 1 to stop
+typedef int (*entry_fn)(const char* name, const fat_entry_t* entry, void* context);
+
+// Walk a directory: the fixed root region for cluster 0, otherwise its
+// cluster chain. Returns 1 if the callback stopped the walk, -1 on error.
+static int walk_directory(unsigned int first_cluster, entry_fn callback, void* context) {
+    long_name_t long_name;
+    unsigned int cluster = first_cluster;
+    unsigned int index = 0;             // Sector within the root or cluster
+    
+    long_name.valid = 0;
+    for (;;) {
+        unsigned int lba;
+        if (first_cluster == 0) {
+            if (index >= root_sectors) return 0;
+            lba = root_lba + index;
+        } else {
+            if (index == sectors_per_cluster) {
+                cluster = next_cluster(cluster);
+                index = 0;
+            }
+            if (chain_ended(cluster)) return 0;
+            lba = cluster_lba(cluster) + index;
+        }
+        index++;
+        
+        if (read_sectors(lba, 1, sector) < 0) return -1;
+        
+        for (int offset = 0; offset < BLOCK_SECTOR_SIZE; offset += FAT_DIR_ENTRY_SIZE) {
+            const unsigned char* raw = sector + offset;
+            if (raw[0] == FAT_ENTRY_END) return 0;
+            if (raw[0] == FAT_ENTRY_DELETED) {
+                long_name.valid = 0;
+                continue;
+            }
+            if ((raw[11] & FAT_ATTR_LONG_NAME) == FAT_ATTR_LONG_NAME) {
+                add_long_name_piece(&long_name, raw);
+                continue;
+            }
+            if (raw[11] & FAT_ATTR_VOLUME_ID) {
+                long_name.valid = 0;
+                continue;
+            }
+            
+            char name[FAT_NAME_LENGTH];
+            const char* chosen = name;
+            if (long_name.valid && long_name.checksum == short_name_checksum(raw)) {
+                chosen = long_name.name;
+            } else {
+                short_name(raw, name);
+            }
+            long_name.valid = 0;
+            
+            fat_entry_t entry;
+            entry.first_cluster = le16(raw + 26);
+            entry.size = le32(raw + 28);
+            entry.attributes = raw[11];
+            if (callback(chosen, &entry, context)) return 1;
+        }
+    }
+}
+
+typedef struct {
+    const char* name;
+    fat_entry_t* entry;
+} find_context_t;
+
+static int find_entry(const char* name, const fat_entry_t* entry, void* context) {
+    find_context_t* find = (find_context_t*)context;
+    if (!same_name(name, find->name)) return 0;
+    *find->entry = *entry;
+    return 1;
+}
+
+static unsigned int dcache_slot(unsigned int parent, const char* name) {
+    unsigned int hash = 2166136261u ^ (parent * 0x9E3779B9u);
+    while (*name) {
+        hash ^= (unsigned char)lower(*name++);
+        hash *= 16777619u;
+    }
+    return (hash ^ (hash >> 16)) & (FAT_DCACHE_SIZE - 1);
+}
+
+// Look `name` up in a directory, through the cache. Returns 1 if found.
+static int lookup(unsigned int parent, const char* name, fat_entry_t* entry) {
+    dcache_slot_t* slot = &dcache[dcache_slot(parent, name)];
+    
+    stats.lookups++;
+    if (slot->valid && slot->parent == parent && same_name(slot->name, name)) {
+        stats.dcache_hits++;
+        *entry = slot->entry;
+        return slot->found;
+    }
+    
+    find_context_t find = { name, entry };
+    int result = walk_directory(parent, find_entry, &find);
+    if (result < 0) return 0;
+    
+    slot->valid = 1;
+    slot->found = result == 1;
+    slot->parent = parent;
+    int i = 0;
+    for (; name[i] && i < FAT_NAME_LENGTH - 1; i++) slot->name[i] = name[i];
+    slot->name[i] = '\0';
+    slot->entry = *entry;
+    return slot->found;
+}
+
+// Open a file or directory by absolute path ("/" or "" is the root). A
+// ".." entry pointing at the root has cluster 0, which is the root here.
+int fat_open(const char* path, fat_file_t* file) {
+    if (!volume) return -1;
+    
+    fat_entry_t entry = { 0, 0, FAT_ATTR_DIRECTORY };
+    while (*path) {
+        char component[FAT_NAME_LENGTH];
+        int length = 0;
+        
+        while (*path == '/') path++;
+        while (*path && *path != '/') {
+            if (length >= FAT_NAME_LENGTH - 1) return -1;
+            component[length++] = *path++;
+        }
+        component[length] = '\0';
+        if (length == 0 || (length == 1 && component[0] == '.')) continue;
+        
+        if (!(entry.attributes & FAT_ATTR_DIRECTORY)) return -1;
+        if (!lookup(entry.first_cluster, component, &entry)) return -1;
+    }
+    
+    file->first_cluster = entry.first_cluster;
+    file->size = entry.size;
+    file->attributes = entry.attributes;
+    file->position = 0;
+    file->cluster = entry.first_cluster;
+    file->cluster_index = 0;
+    return 0;
+}
+
+// Make file->cluster the `index`th cluster of the chain. Walks forward
+// from where the file already is when it can.
+static int seek_cluster(fat_file_t* file, unsigned int index) {
+    if (index < file->cluster_index) {
+        file->cluster = file->first_cluster;
+        file->cluster_index = 0;
+    }
+    while (file->cluster_index < index) {
+        unsigned int next = next_cluster(file->cluster);
+        if (chain_ended(next)) return 0;
+        file->cluster = next;
+        file->cluster_index++;
+    }
+    return !chain_ended(file->cluster);
+}
+
+// Read from the current position. Clusters that follow each other on
+// disk are read as one multi-sector request straight into `buffer`; only
+// partial sectors at the ends go through the sector buffer. Returns the
+// number of bytes read, or -1 on an I/O error.
+int fat_read(fat_file_t* file, void* buffer, unsigned int length) {
+    char* out = (char*)buffer;
+    unsigned int done = 0;
+    
+    if (!volume || (file->attributes & FAT_ATTR_DIRECTORY)) return -1;
+    if (file->position >= file->size) return 0;
+    if (length > file->size - file->position) length = file->size - file->position;
+    
+    while (done < length) {
+        if (!seek_cluster(file, file->position / cluster_bytes)) break;
+        
+        unsigned int offset = file->position % cluster_bytes;
+        unsigned int wanted = length - done;
+        
+        // Extend the run over contiguous clusters we still need
+        unsigned int run = 1;
+        unsigned int last = file->cluster;
+        while (run * cluster_bytes < offset + wanted) {
+            unsigned int next = next_cluster(last);
+            if (next != last + 1 || chain_ended(next)) break;
+            last = next;
+            run++;
+        }
+        
+        unsigned int available = run * cluster_bytes - offset;
+        if (available > wanted) available = wanted;
+        unsigned int lba = cluster_lba(file->cluster) + offset / BLOCK_SECTOR_SIZE;
+        unsigned int in_sector = offset % BLOCK_SECTOR_SIZE;
+        unsigned int chunk;
+        
+        if (in_sector == 0 && available >= BLOCK_SECTOR_SIZE) {
+            chunk = available - available % BLOCK_SECTOR_SIZE;
+            if (read_sectors(lba, chunk / BLOCK_SECTOR_SIZE, out + done) < 0) return -1;
+        } else {
+            chunk = BLOCK_SECTOR_SIZE - in_sector;
+            if (chunk > available) chunk = available;
+            if (read_sectors(lba, 1, sector) < 0) return -1;
+            for (unsigned int i = 0; i < chunk; i++) {
+                out[done + i] = sector[in_sector + i];
+            }
+        }
+        
+        done += chunk;
+        file->position += chunk;
+    }
+    return done;
+}
+
+// Read a whole file into `buffer` and NUL-terminate it. Returns the
+// length, or -1 if it can't be read.
+int fat_read_file(const char* path, char* buffer, int size) {
+    fat_file_t file;
+    
+    if (size <= 0 || fat_open(path, &file) < 0) return -1;
+    
+    int length = fat_read(&file, buffer, size - 1);
+    if (length < 0) return -1;
+    buffer[length] = '\0';
+    return length;
+}
+
+typedef struct {
+    fat_list_fn callback;
+    void* context;
+} list_context_t;
+
+static int list_entry(const char* name, const fat_entry_t* entry, void* context) {
+    list_context_t* list = (list_context_t*)context;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) return 0;
+    list->callback(name, entry->size, (entry->attributes & FAT_ATTR_DIRECTORY) != 0, list->context);
+    return 0;
+}
+
+// Call `callback` for each entry of a directory. Returns -1 if `path`
+// isn't a directory.
+int fat_list(const char* path, fat_list_fn callback, void* context) {
+    fat_file_t directory;
+    
+    if (fat_open(path, &directory) < 0 || !(directory.attributes & FAT_ATTR_DIRECTORY)) return -1;
+    
+    list_context_t list = { callback, context };
+    return walk_directory(directory.first_cluster, list_entry, &list) < 0 ? -1 : 0;
+}
+
+// VFS glue. Nodes are named by their first cluster, 0 being the root
+// directory; the open file's cursor cluster is kept in its state.
+static int vfs_fat_lookup(const vfs_node_t* directory, const char* name, vfs_node_t* node) {
+    fat_entry_t entry;
+    
+    if (!volume || !lookup(directory->id, name, &entry)) return 0;
+    node->id = entry.first_cluster;
+    node->size = entry.size;
+    node->type = (entry.attributes & FAT_ATTR_DIRECTORY) ? VFS_DIRECTORY : VFS_FILE;
+    return 1;
+}
+
+static int vfs_fat_read(vfs_file_t* file, void* buffer, unsigned int length) {
+    fat_file_t fat;
+    
+    fat.first_cluster = file->node.id;
+    fat.size = file->node.size;
+    fat.attributes = 0;
+    fat.position = file->position;
+    fat.cluster = file->state[0] ? file->state[0] : file->node.id;
+    fat.cluster_index = file->state[1];
+    
+    int result = fat_read(&fat, buffer, length);
+    file->position = fat.position;
+    file->state[0] = fat.cluster;
+    file->state[1] = fat.cluster_index;
+    return result;
+}
+
+static int vfs_fat_size(const vfs_node_t* node) {
+    return node->size;
+}
+
+static int vfs_fat_list(const vfs_node_t* directory, vfs_list_fn callback, void* context) {
+    if (!volume) return -1;
+    list_context_t list = { callback, context };
+    return walk_directory(directory->id, list_entry, &list) < 0 ? -1 : 0;
+}
+
+const vfs_ops_t fat_vfs_ops = {
+    "fat",
+    vfs_fat_lookup,
+    vfs_fat_read,
+    NULL,
+    NULL,
+    NULL,
+    vfs_fat_size,
+    vfs_fat_list,
+    NULL,
+};
+
+// Accept a boot sector whose BPB describes a FAT12/16 volume at `start`
+static int parse_boot_sector(const unsigned char* boot, unsigned int start) {
+    if (le16(boot + 510) != FAT_BOOT_SIGNATURE) return 0;
+    if (boot[0] != 0xEB && boot[0] != 0xE9) return 0;
+    if (le16(boot + 11) != BLOCK_SECTOR_SIZE) return 0;
+    
+    unsigned int per_cluster = boot[13];
+    unsigned int reserved = le16(boot + 14);
+    unsigned int fats = boot[16];
+    unsigned int root_entries = le16(boot + 17);
+    unsigned int total = le16(boot + 19) ? le16(boot + 19) : le32(boot + 32);
+    unsigned int per_fat = le16(boot + 22);     // 0 on FAT32
+    
+    if (per_cluster == 0 || (per_cluster & (per_cluster - 1)) || fats == 0 || per_fat == 0) return 0;
+    
+    unsigned int root = (root_entries * FAT_DIR_ENTRY_SIZE + BLOCK_SECTOR_SIZE - 1) / BLOCK_SECTOR_SIZE;
+    unsigned int overhead = reserved + fats * per_fat + root;
+    if (total <= overhead) return 0;
+    
+    sectors_per_cluster = per_cluster;
+    cluster_bytes = per_cluster * BLOCK_SECTOR_SIZE;
+    fat_lba = start + reserved;
+    fat_sectors = per_fat;
+    root_lba = fat_lba + fats * per_fat;
+    root_sectors = root;
+    data_lba = root_lba + root;
+    cluster_count = (total - overhead) / per_cluster;
+    fat_bits = cluster_count < FAT12_MAX_CLUSTERS ? 12 : 16;
+    return cluster_count < FAT16_MAX_CLUSTERS;
+}
+
+// Mount a FAT12/16 volume: the whole device, or the first FAT partition
+// in its MBR. Returns 1 on success.
+int fat_mount(block_device_t* device) {
+    static const unsigned char fat_types[] = { 0x01, 0x04, 0x06, 0x0E };
+    unsigned char boot[BLOCK_SECTOR_SIZE];
+    int found = 0;
+    
+    volume = NULL;
+    if (block_read(device, 0, 1, boot) < 0) return 0;
+    
+    if (parse_boot_sector(boot, 0)) {
+        found = 1;
+    } else if (le16(boot + 510) == FAT_BOOT_SIGNATURE) {
+        for (int p = 0; p < 4 && !found; p++) {
+            const unsigned char* partition = boot + FAT_MBR_PARTITIONS + p * 16;
+            unsigned int start = le32(partition + 8);
+            for (unsigned int t = 0; t < sizeof(fat_types) && !found; t++) {
+                if (partition[4] != fat_types[t] || start == 0) continue;
+                
+                unsigned char partition_boot[BLOCK_SECTOR_SIZE];
+                found = block_read(device, start, 1, partition_boot) == 0 &&
+                        parse_boot_sector(partition_boot, start);
+            }
+        }
+    }
+    if (!found) return 0;
+    
+    if (fat_sectors * BLOCK_SECTOR_SIZE > FAT_CACHE_SIZE) {
+        klog_detail(KLOG_WARNING, "fat: FAT too large to cache on ", device->name);
+        return 0;
+    }
+    
+    // The table is kept in FAT_CACHE, so bypass the block cache
+    if (block_read(device, fat_lba, fat_sectors, fat_table) < 0) return 0;
+    volume = device;
+    
+    for (int i = 0; i < FAT_DCACHE_SIZE; i++) dcache[i].valid = 0;
+    stats.lookups = 0;
+    stats.dcache_hits = 0;
+    klog_detail(KLOG_INFO, fat_bits == 12 ? "fat: FAT12 volume on " : "fat: FAT16 volume on ", device->name);
+    return 1;
+}
+
+// Mount the first block device holding a FAT volume
+int init_fat() {
+    for (int i = 0; i < block_count(); i++) {
+        if (fat_mount(block_get(i))) return 1;
+    }
+    klog(KLOG_INFO, "fat: no FAT volume found");
+    return 0;
+}
+
+int fat_mounted() {
+    return volume != NULL;
+}
+
+const char* fat_device_name() {
+    return volume ? volume->name : "";
+}
+
+const fat_stats_t* fat_get_stats() {
+    return &stats;
+}
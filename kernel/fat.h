@@ -0,0 +1,65 @@
+#ifndef FAT_H
+#define FAT_H
+
+#include "block.h"
+#include "vfs.h"
+
+// On-disk layout
+#define FAT_BOOT_SIGNATURE 0xAA55
+#define FAT_DIR_ENTRY_SIZE 32
+#define FAT_MBR_PARTITIONS 0x1BE
+
+#define FAT_ATTR_READ_ONLY 0x01
+#define FAT_ATTR_HIDDEN 0x02
+#define FAT_ATTR_SYSTEM 0x04
+#define FAT_ATTR_VOLUME_ID 0x08
+#define FAT_ATTR_DIRECTORY 0x10
+#define FAT_ATTR_LONG_NAME 0x0F
+
+#define FAT_ENTRY_END 0x00              // First name byte: no more entries
+#define FAT_ENTRY_DELETED 0xE5
+#define FAT_LFN_LAST 0x40
+#define FAT_LFN_CHARS 13
+
+#define FAT12_MAX_CLUSTERS 4085
+#define FAT16_MAX_CLUSTERS 65525
+
+// Driver limits
+#define FAT_NAME_LENGTH 64
+#define FAT_PATH_LENGTH 128
+#define FAT_DCACHE_SIZE 64              // Directory lookup cache slots, power of two
+
+// An open file (or directory). The current cluster is remembered so
+// sequential reads don't walk the chain from the start.
+typedef struct {
+    unsigned int first_cluster;         // 0 for the FAT12/16 root directory
+    unsigned int size;
+    unsigned char attributes;
+    unsigned int position;
+    unsigned int cluster;               // Cluster holding `position`
+    unsigned int cluster_index;         // Its index in the chain
+} fat_file_t;
+
+// Called for each directory entry by fat_list
+typedef void (*fat_list_fn)(const char* name, unsigned int size, int directory, void* context);
+
+typedef struct {
+    unsigned int lookups;
+    unsigned int dcache_hits;
+    unsigned int runs;                  // Multi-sector reads issued
+    unsigned int sectors;
+} fat_stats_t;
+
+// FAT functions
+int init_fat();
+int fat_mount(block_device_t* device);
+int fat_mounted();
+const char* fat_device_name();
+int fat_open(const char* path, fat_file_t* file);
+int fat_read(fat_file_t* file, void* buffer, unsigned int length);
+int fat_read_file(const char* path, char* buffer, int size);
+int fat_list(const char* path, fat_list_fn callback, void* context);
+const fat_stats_t* fat_get_stats();
+extern const vfs_ops_t fat_vfs_ops;
+
+#endif // FAT_H
@@ -0,0 +1,346 @@
+#include "fbcon.h"
+#include "screen.h"
+#include "memory.h"
+
+// Framebuffer geometry (from the VBE mode info block)
+static unsigned char* fb_base = 0;
+static unsigned int fb_pitch = 0;
+static int fb_cols = 0;
+static int fb_rows = 0;
+static int has_sse2 = 0;
+
+// VGA palette as 32bpp pixels, laid out per the mode's RGB field positions
+static unsigned int palette[16];
+static const unsigned int vga_rgb[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+// Bitmap font copied out of the VGA BIOS by the bootloader
+static const unsigned char* font = (const unsigned char*)BOOT_FONT_ADDR;
+
+// Dirty column span per text row (min > max means the row is clean)
+static short dirty_min[SCREEN_MAX_HEIGHT];
+static short dirty_max[SCREEN_MAX_HEIGHT];
+static int any_dirty = 0;
+
+// Glyph cache: each slot holds all 256 glyphs pre-rendered for one color
+// pair (attribute byte), filled lazily and evicted least recently used
+static signed char pair_slot[256];
+static unsigned char slot_pair[GLYPH_CACHE_SLOTS];
+static unsigned int slot_stamp[GLYPH_CACHE_SLOTS];
+static unsigned int slot_valid[GLYPH_CACHE_SLOTS][FONT_GLYPHS / 32];
+static unsigned int cache_clock = 0;
+
+// Cell currently carrying the text cursor bar
+static int drawn_cursor_row = -1;
+static int drawn_cursor_col = -1;
+
+// Enable SSE in CR0/CR4 if the CPU has SSE2; returns 1 when usable
+static int enable_sse2() {
+    unsigned int eax = 1, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+
+    // Need FXSR (bit 24) and SSE2 (bit 26)
+    if (!(edx & (1 << 24)) || !(edx & (1 << 26))) {
+        return 0;
+    }
+
+    unsigned int cr0, cr4;
+    __asm__ __volatile__("mov %%cr0, %0" : "=r" (cr0));
+    cr0 &= ~(1 << 2); // Clear EM (no x87 emulation)
+    cr0 |= (1 << 1);  // Set MP
+    __asm__ __volatile__("mov %0, %%cr0" : : "r" (cr0));
+
+    __asm__ __volatile__("mov %%cr4, %0" : "=r" (cr4));
+    cr4 |= (1 << 9) | (1 << 10); // OSFXSR | OSXMMEXCPT
+    __asm__ __volatile__("mov %0, %%cr4" : : "r" (cr4));
+
+    return 1;
+}
+
+// Copy a block of pixels; bytes must be a multiple of 16.
+// The kernel is built without -msse, so the compiler never allocates xmm
+// registers and they need no clobbers.
+static void fb_copy(unsigned char* dst, const unsigned char* src, unsigned int bytes) {
+    if (!has_sse2) {
+        unsigned int count = bytes >> 2;
+        __asm__ __volatile__("cld; rep movsl" : "+D" (dst), "+S" (src), "+c" (count) : : "memory");
+        return;
+    }
+
+    unsigned int blocks = bytes >> 6;
+    unsigned int tail = (bytes & 63) >> 4;
+
+    if (blocks) {
+        __asm__ __volatile__(
+            "1:\n\t"
+            "movdqu (%1), %%xmm0\n\t"
+            "movdqu 16(%1), %%xmm1\n\t"
+            "movdqu 32(%1), %%xmm2\n\t"
+            "movdqu 48(%1), %%xmm3\n\t"
+            "movdqu %%xmm0, (%0)\n\t"
+            "movdqu %%xmm1, 16(%0)\n\t"
+            "movdqu %%xmm2, 32(%0)\n\t"
+            "movdqu %%xmm3, 48(%0)\n\t"
+            "add $64, %0\n\t"
+            "add $64, %1\n\t"
+            "dec %2\n\t"
+            "jnz 1b"
+            : "+r" (dst), "+r" (src), "+r" (blocks) : : "memory");
+    }
+
+    while (tail--) {
+        __asm__ __volatile__(
+            "movdqu (%1), %%xmm0\n\t"
+            "movdqu %%xmm0, (%0)"
+            : : "r" (dst), "r" (src) : "memory");
+        dst += 16;
+        src += 16;
+    }
+}
+
+// Fill a block with one 32bpp pixel value; bytes must be a multiple of 16
+static void fb_fill(unsigned char* dst, unsigned int pixel, unsigned int bytes) {
+    if (!has_sse2) {
+        unsigned int count = bytes >> 2;
+        __asm__ __volatile__("cld; rep stosl" : "+D" (dst), "+c" (count) : "a" (pixel) : "memory");
+        return;
+    }
+
+    unsigned int blocks = bytes >> 4;
+    if (blocks) {
+        __asm__ __volatile__(
+            "movd %2, %%xmm0\n\t"
+            "pshufd $0, %%xmm0, %%xmm0\n\t"
+            "1:\n\t"
+            "movdqu %%xmm0, (%0)\n\t"
+            "add $16, %0\n\t"
+            "dec %1\n\t"
+            "jnz 1b"
+            : "+r" (dst), "+r" (blocks) : "r" (pixel) : "memory");
+    }
+}
+
+// Copy one cached glyph (8 pixels x 16 rows) into the framebuffer
+static void blit_glyph(unsigned char* dst, const unsigned int* glyph) {
+    if (!has_sse2) {
+        for (int y = 0; y < FONT_HEIGHT; y++) {
+            unsigned int* row = (unsigned int*)dst;
+            for (int x = 0; x < FONT_WIDTH; x++) {
+                row[x] = glyph[x];
+            }
+            glyph += FONT_WIDTH;
+            dst += fb_pitch;
+        }
+        return;
+    }
+
+    unsigned int rows = FONT_HEIGHT;
+    __asm__ __volatile__(
+        "1:\n\t"
+        "movdqu (%1), %%xmm0\n\t"
+        "movdqu 16(%1), %%xmm1\n\t"
+        "movdqu %%xmm0, (%0)\n\t"
+        "movdqu %%xmm1, 16(%0)\n\t"
+        "add %3, %0\n\t"
+        "add $32, %1\n\t"
+        "dec %2\n\t"
+        "jnz 1b"
+        : "+r" (dst), "+r" (glyph), "+r" (rows) : "r" (fb_pitch) : "memory");
+}
+
+// Find (rendering on a miss) the cached glyph for a character/attribute
+static const unsigned int* glyph_lookup(unsigned char attr, unsigned char ch) {
+    int slot = pair_slot[attr];
+
+    if (slot < 0) {
+        // Evict the least recently used color pair
+        slot = 0;
+        for (int i = 1; i < GLYPH_CACHE_SLOTS; i++) {
+            if (slot_stamp[i] < slot_stamp[slot]) {
+                slot = i;
+            }
+        }
+        if (slot_stamp[slot] != 0) {
+            pair_slot[slot_pair[slot]] = -1;
+        }
+        slot_pair[slot] = attr;
+        pair_slot[attr] = (signed char)slot;
+        for (int i = 0; i < FONT_GLYPHS / 32; i++) {
+            slot_valid[slot][i] = 0;
+        }
+    }
+    slot_stamp[slot] = ++cache_clock;
+
+    unsigned int* glyph = (unsigned int*)(GLYPH_CACHE_BASE +
+        (slot * FONT_GLYPHS + ch) * GLYPH_BYTES);
+
+    if (!(slot_valid[slot][ch >> 5] & (1u << (ch & 31)))) {
+        unsigned int fg = palette[attr & 0x0F];
+        unsigned int bg = palette[(attr >> 4) & 0x0F];
+        const unsigned char* bits = font + ch * FONT_HEIGHT;
+
+        for (int y = 0; y < FONT_HEIGHT; y++) {
+            for (int x = 0; x < FONT_WIDTH; x++) {
+                glyph[y * FONT_WIDTH + x] = (bits[y] & (0x80 >> x)) ? fg : bg;
+            }
+        }
+        slot_valid[slot][ch >> 5] |= 1u << (ch & 31);
+    }
+
+    return glyph;
+}
+
+// Render a single character cell
+static void draw_cell(int row, int col, unsigned short entry) {
+    unsigned char* dst = fb_base + row * FONT_HEIGHT * fb_pitch + col * FONT_WIDTH * 4;
+    blit_glyph(dst, glyph_lookup((unsigned char)(entry >> 8), (unsigned char)(entry & 0xFF)));
+}
+
+// Render every dirty span and mark the screen clean
+static void render_dirty(const unsigned short* cells) {
+    if (!any_dirty) return;
+
+    for (int row = 0; row < fb_rows; row++) {
+        if (dirty_min[row] > dirty_max[row]) continue;
+
+        for (int col = dirty_min[row]; col <= dirty_max[row]; col++) {
+            draw_cell(row, col, cells[row * fb_cols + col]);
+        }
+        dirty_min[row] = fb_cols;
+        dirty_max[row] = -1;
+    }
+    any_dirty = 0;
+}
+
+// Reset all dirty spans without rendering
+static void reset_dirty() {
+    for (int row = 0; row < SCREEN_MAX_HEIGHT; row++) {
+        dirty_min[row] = SCREEN_MAX_WIDTH;
+        dirty_max[row] = -1;
+    }
+    any_dirty = 0;
+}
+
+// Initialize the framebuffer console if the bootloader set a VBE mode.
+// Returns 1 and the console size in cells, or 0 to stay in text mode.
+int fbcon_init(int* cols, int* rows) {
+    if (*(volatile unsigned int*)BOOT_INFO_ADDR != BOOT_VBE_MAGIC) {
+        return 0;
+    }
+
+    const unsigned char* info = (const unsigned char*)BOOT_VBE_MODE_INFO_ADDR;
+    unsigned int pitch = *(const unsigned short*)(info + 0x10);
+    unsigned int width = *(const unsigned short*)(info + 0x12);
+    unsigned int height = *(const unsigned short*)(info + 0x14);
+    unsigned int bpp = info[0x19];
+    unsigned int phys_base = *(const unsigned int*)(info + 0x28);
+
+    // Only 32bpp linear modes are supported
+    if (bpp != 32 || phys_base == 0 || (pitch & 15) != 0) {
+        return 0;
+    }
+
+    fb_base = (unsigned char*)phys_base;
+    fb_pitch = pitch;
+    fb_cols = width / FONT_WIDTH;
+    fb_rows = height / FONT_HEIGHT;
+    if (fb_cols > SCREEN_MAX_WIDTH) fb_cols = SCREEN_MAX_WIDTH;
+    if (fb_rows > SCREEN_MAX_HEIGHT) fb_rows = SCREEN_MAX_HEIGHT;
+
+    // Build the palette from the mode's color field layout
+    for (int i = 0; i < 16; i++) {
+        unsigned int r = (vga_rgb[i] >> 16) & 0xFF;
+        unsigned int g = (vga_rgb[i] >> 8) & 0xFF;
+        unsigned int b = vga_rgb[i] & 0xFF;
+        palette[i] = ((r >> (8 - info[0x1F])) << info[0x20]) |
+                     ((g >> (8 - info[0x21])) << info[0x22]) |
+                     ((b >> (8 - info[0x23])) << info[0x24]);
+    }
+
+    has_sse2 = enable_sse2();
+
+    // Empty glyph cache
+    for (int i = 0; i < 256; i++) {
+        pair_slot[i] = -1;
+    }
+    for (int i = 0; i < GLYPH_CACHE_SLOTS; i++) {
+        slot_stamp[i] = 0;
+    }
+    cache_clock = 0;
+
+    reset_dirty();
+    drawn_cursor_row = -1;
+    drawn_cursor_col = -1;
+
+    *cols = fb_cols;
+    *rows = fb_rows;
+    return 1;
+}
+
+// Record that a cell changed in the shadow buffer
+void fbcon_mark_dirty(int row, int col) {
+    if (row < 0 || row >= fb_rows || col < 0 || col >= fb_cols) return;
+
+    if (col < dirty_min[row]) dirty_min[row] = col;
+    if (col > dirty_max[row]) dirty_max[row] = col;
+    any_dirty = 1;
+}
+
+// Render pending changes and move the cursor bar
+void fbcon_flush(const unsigned short* cells, int cursor_row, int cursor_col) {
+    int cursor_moved = cursor_row != drawn_cursor_row || cursor_col != drawn_cursor_col;
+    if (!any_dirty && !cursor_moved) return;
+
+    // Re-rendering the old cell erases the previous cursor bar
+    if (cursor_moved && drawn_cursor_row >= 0) {
+        fbcon_mark_dirty(drawn_cursor_row, drawn_cursor_col);
+    }
+    render_dirty(cells);
+
+    // Draw the cursor as an underline in the cell's foreground color
+    if (cursor_row >= 0 && cursor_row < fb_rows && cursor_col >= 0 && cursor_col < fb_cols) {
+        unsigned int fg = palette[(cells[cursor_row * fb_cols + cursor_col] >> 8) & 0x0F];
+        unsigned char* dst = fb_base + (cursor_row * FONT_HEIGHT + FONT_HEIGHT - 2) * fb_pitch +
+                             cursor_col * FONT_WIDTH * 4;
+        fb_fill(dst, fg, FONT_WIDTH * 4);
+        fb_fill(dst + fb_pitch, fg, FONT_WIDTH * 4);
+    }
+    drawn_cursor_row = cursor_row;
+    drawn_cursor_col = cursor_col;
+}
+
+// Scroll the framebuffer up one text row. Called with the shadow buffer
+// still unshifted so pending changes land before the pixels are moved.
+void fbcon_scroll(const unsigned short* cells, char color) {
+    render_dirty(cells);
+
+    unsigned int row_bytes = FONT_HEIGHT * fb_pitch;
+    fb_copy(fb_base, fb_base + row_bytes, (fb_rows - 1) * row_bytes);
+    fb_fill(fb_base + (fb_rows - 1) * row_bytes, palette[(color >> 4) & 0x0F], row_bytes);
+
+    // The cursor bar moved up with the pixels
+    drawn_cursor_row--;
+}
+
+// Clear the whole console to the background of the given color
+void fbcon_clear(char color) {
+    fb_fill(fb_base, palette[(color >> 4) & 0x0F], fb_rows * FONT_HEIGHT * fb_pitch);
+    reset_dirty();
+    drawn_cursor_row = -1;
+    drawn_cursor_col = -1;
+}
+
+// Mark the whole console dirty (e.g. after switching virtual consoles)
+void fbcon_invalidate() {
+    for (int row = 0; row < fb_rows; row++) {
+        dirty_min[row] = 0;
+        dirty_max[row] = fb_cols - 1;
+    }
+    any_dirty = 1;
+    
+    // The repaint wipes the cursor bar along with everything else
+    drawn_cursor_row = -1;
+    drawn_cursor_col = -1;
+}
@@ -0,0 +1,24 @@
+#ifndef FBCON_H
+#define FBCON_H
+
+// VBE linear framebuffer console.
+// screen.c keeps the character cells in a shadow buffer and marks the cells
+// it changes; fbcon renders them on flush through a glyph cache that holds
+// pre-rendered 32bpp glyphs for the most recently used color pairs.
+
+// Font and glyph cache geometry
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 16
+#define FONT_GLYPHS 256
+#define GLYPH_BYTES (FONT_WIDTH * FONT_HEIGHT * 4)
+#define GLYPH_CACHE_SLOTS 16              // Color pairs cached at once
+
+// Framebuffer console functions
+int fbcon_init(int* cols, int* rows);
+void fbcon_mark_dirty(int row, int col);
+void fbcon_flush(const unsigned short* cells, int cursor_row, int cursor_col);
+void fbcon_scroll(const unsigned short* cells, char color);
+void fbcon_clear(char color);
+void fbcon_invalidate();
+
+#endif // FBCON_H
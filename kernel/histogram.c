@@ -0,0 +1,71 @@
+#include "histogram.h"
+#include "timer.h"
+
+// Bucket holding a value
+static int bucket_index(unsigned int value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    
+    int msb = 31 - __builtin_clz(value);
+    int sub = (value >> (msb - 2)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (msb - 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// Largest value that falls in a bucket
+static unsigned int bucket_upper_bound(int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    
+    int msb = index / HISTOGRAM_SUB_BUCKETS + 1;
+    int sub = index % HISTOGRAM_SUB_BUCKETS;
+    unsigned int width = 1u << (msb - 2);
+    return ((HISTOGRAM_SUB_BUCKETS + sub) << (msb - 2)) + (width - 1);
+}
+
+// Clear all samples
+void histogram_reset(histogram_t* histogram) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        histogram->buckets[i] = 0;
+    }
+    histogram->count = 0;
+    histogram->max = 0;
+    histogram->total = 0;
+}
+
+// Add one sample
+void histogram_record(histogram_t* histogram, unsigned int value) {
+    histogram->buckets[bucket_index(value)]++;
+    histogram->count++;
+    histogram->total += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+// Value at or below which `percent` of the samples fall, reported as the
+// upper bound of its bucket (never above the exact maximum)
+unsigned int histogram_percentile(const histogram_t* histogram, unsigned int percent) {
+    if (histogram->count == 0) return 0;
+    
+    // Rank of the sample we're after, rounded up
+    unsigned int rank = (unsigned int)udiv64((unsigned long long)histogram->count * percent + 99, 100);
+    if (rank == 0) rank = 1;
+    
+    unsigned int seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            unsigned int bound = bucket_upper_bound(i);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// Average of all samples
+unsigned int histogram_mean(const histogram_t* histogram) {
+    if (histogram->count == 0) return 0;
+    return (unsigned int)udiv64(histogram->total, histogram->count);
+}
@@ -0,0 +1,22 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+// Log-bucketed histogram: values below 4 get exact buckets, then each
+// power of two is split into 4 sub-buckets (<= 25% relative error)
+#define HISTOGRAM_SUB_BUCKETS 4
+#define HISTOGRAM_BUCKETS 124           // Covers the full 32-bit range
+
+typedef struct {
+    unsigned int buckets[HISTOGRAM_BUCKETS];
+    unsigned int count;
+    unsigned int max;
+    unsigned long long total;
+} histogram_t;
+
+// Histogram functions
+void histogram_reset(histogram_t* histogram);
+void histogram_record(histogram_t* histogram, unsigned int value);
+unsigned int histogram_percentile(const histogram_t* histogram, unsigned int percent);
+unsigned int histogram_mean(const histogram_t* histogram);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,239 @@
+#include "history.h"
+#include "memory.h"
+
+// The byte ring, entry table and save image share the reserved pool
+#define HISTORY_TABLE_SIZE (HISTORY_MAX_ENTRIES * sizeof(history_entry_t))
+#define HISTORY_IMAGE_SIZE (HISTORY_SIZE - HISTORY_RING_SIZE - HISTORY_TABLE_SIZE)
+
+static char* const ring = (char*)HISTORY_BASE;
+static history_entry_t* const entries = (history_entry_t*)(HISTORY_BASE + HISTORY_RING_SIZE);
+static char* const image = (char*)(HISTORY_BASE + HISTORY_RING_SIZE + HISTORY_TABLE_SIZE);
+
+static int count = 0;                   // Entries, oldest first
+static unsigned int tail = 0;           // Next free byte in the ring
+static history_store_fn store = 0;
+static int loading = 0;
+
+// Initialize an empty history
+void init_history() {
+    count = 0;
+    tail = 0;
+    store = 0;
+    loading = 0;
+}
+
+// Signature bit for the n-gram at `text`
+static unsigned int ngram_bit(const char* text, int n) {
+    unsigned int hash = 2166136261u ^ n;
+    
+    for (int i = 0; i < n; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 15;
+    return hash & (HISTORY_SIGNATURE_WORDS * 32 - 1);
+}
+
+static void make_signature(const char* text, int length, unsigned int signature[]) {
+    for (int w = 0; w < HISTORY_SIGNATURE_WORDS; w++) {
+        signature[w] = 0;
+    }
+    for (int n = 2; n <= 3; n++) {
+        for (int i = 0; i + n <= length; i++) {
+            unsigned int bit = ngram_bit(text + i, n);
+            signature[bit >> 5] |= 1u << (bit & 31);
+        }
+    }
+}
+
+static void remove_entry(int index) {
+    for (int i = index; i < count - 1; i++) {
+        entries[i] = entries[i + 1];
+    }
+    count--;
+}
+
+static int overlaps(const history_entry_t* entry, unsigned int start, unsigned int length) {
+    return entry->offset < start + length && start < entry->offset + entry->length + 1;
+}
+
+static int same_text(const history_entry_t* entry, const char* text, int length) {
+    const char* stored = ring + entry->offset;
+    if ((int)entry->length != length) return 0;
+    for (int i = 0; i < length; i++) {
+        if (stored[i] != text[i]) return 0;
+    }
+    return 1;
+}
+
+// Hand the saved image to the store, if one is attached
+static void persist() {
+    if (!store || loading) return;
+    
+    int length = history_save(image, HISTORY_IMAGE_SIZE);
+    if (length > 0) {
+        store(image, length);
+    }
+}
+
+// Append a command. An older copy of the same command is dropped, and the
+// oldest entries make room when the ring or the table is full.
+void history_add(const char* command) {
+    int length = 0;
+    while (command[length]) length++;
+    if (length == 0 || length + 1 > HISTORY_RING_SIZE / 4) return;
+    
+    unsigned int signature[HISTORY_SIGNATURE_WORDS];
+    make_signature(command, length, signature);
+    
+    for (int i = count - 1; i >= 0; i--) {
+        if (entries[i].signature[0] == signature[0] && same_text(&entries[i], command, length)) {
+            remove_entry(i);
+            break;
+        }
+    }
+    
+    // Entries never straddle the end of the ring. Live text runs in age
+    // order from the oldest entry round to `tail`: the previous lap's
+    // entries lie past `tail`, oldest first. Wrapping abandons the rest of
+    // the ring, so they go before the new lap starts over the older end
+    // of the current one. After that only the oldest entry can be in the
+    // way.
+    unsigned int need = length + 1;
+    if (tail + need > HISTORY_RING_SIZE) {
+        while (count > 0 && entries[0].offset >= tail) {
+            remove_entry(0);
+        }
+        tail = 0;
+    }
+    while (count > 0 && (count >= HISTORY_MAX_ENTRIES || overlaps(&entries[0], tail, need))) {
+        remove_entry(0);
+    }
+    
+    history_entry_t* entry = &entries[count++];
+    entry->offset = tail;
+    entry->length = length;
+    for (int w = 0; w < HISTORY_SIGNATURE_WORDS; w++) {
+        entry->signature[w] = signature[w];
+    }
+    for (int i = 0; i <= length; i++) {
+        ring[tail + i] = command[i];
+    }
+    tail += need;
+    
+    persist();
+}
+
+// Entry by age (0 = most recent), NULL past the oldest
+const char* history_entry(int age) {
+    if (age < 0 || age >= count) return 0;
+    return ring + entries[count - 1 - age].offset;
+}
+
+int history_count() {
+    return count;
+}
+
+static int contains(const char* text, const char* pattern) {
+    for (; *text; text++) {
+        int i = 0;
+        while (pattern[i] && text[i] == pattern[i]) i++;
+        if (!pattern[i]) return 1;
+    }
+    return 0;
+}
+
+// Age of the most recent entry no newer than `from_age` containing
+// `pattern`, or -1. Entries whose signature lacks any of the pattern's
+// n-grams are skipped without looking at their text.
+int history_search(const char* pattern, int from_age) {
+    int length = 0;
+    while (pattern[length]) length++;
+    
+    unsigned int wanted[HISTORY_SIGNATURE_WORDS];
+    make_signature(pattern, length, wanted);
+    
+    for (int age = from_age < 0 ? 0 : from_age; age < count; age++) {
+        const history_entry_t* entry = &entries[count - 1 - age];
+        
+        int candidate = 1;
+        for (int w = 0; w < HISTORY_SIGNATURE_WORDS; w++) {
+            if ((entry->signature[w] & wanted[w]) != wanted[w]) {
+                candidate = 0;
+                break;
+            }
+        }
+        if (candidate && contains(ring + entry->offset, pattern)) {
+            return age;
+        }
+    }
+    return -1;
+}
+
+void history_clear() {
+    count = 0;
+    tail = 0;
+    persist();
+}
+
+// Serialize as the magic, the entry count and the commands oldest first,
+// each NUL-terminated. Returns the length, or -1 if `buffer` is too small.
+int history_save(char* buffer, int size) {
+    unsigned int header[2] = { HISTORY_MAGIC, (unsigned int)count };
+    int length = sizeof(header);
+    
+    if (size < length) return -1;
+    for (int i = 0; i < length; i++) {
+        buffer[i] = ((const char*)header)[i];
+    }
+    
+    for (int e = 0; e < count; e++) {
+        const char* text = ring + entries[e].offset;
+        if (length + (int)entries[e].length + 1 > size) return -1;
+        for (unsigned int i = 0; i <= entries[e].length; i++) {
+            buffer[length++] = text[i];
+        }
+    }
+    return length;
+}
+
+// Replace the history with a saved image. Returns the number of entries,
+// or -1 if the data isn't a history image.
+int history_load(const char* data, int length) {
+    unsigned int header[2];
+    
+    if (length < (int)sizeof(header)) return -1;
+    for (unsigned int i = 0; i < sizeof(header); i++) {
+        ((char*)header)[i] = data[i];
+    }
+    if (header[0] != HISTORY_MAGIC) return -1;
+    
+    count = 0;
+    tail = 0;
+    loading = 1;
+    
+    int position = sizeof(header);
+    for (unsigned int e = 0; e < header[1] && position < length; e++) {
+        int end = position;
+        while (end < length && data[end]) end++;
+        if (end == length) break;               // Truncated entry
+        history_add(data + position);
+        position = end + 1;
+    }
+    
+    loading = 0;
+    return count;
+}
+
+// Load the history kept by a persistent store, then attach the store so it
+// receives the image after each change. Returns the entries loaded.
+int history_attach(history_fetch_fn fetch, history_store_fn history_store) {
+    int loaded = 0;
+    
+    int length = fetch(image, HISTORY_IMAGE_SIZE);
+    if (length > 0) {
+        loaded = history_load(image, length);
+    }
+    store = history_store;
+    return loaded > 0 ? loaded : 0;
+}
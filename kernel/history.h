@@ -0,0 +1,35 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// Shell history configuration
+#define HISTORY_RING_SIZE 0x8000        // Bytes of command text kept
+#define HISTORY_MAX_ENTRIES 4096
+#define HISTORY_MAGIC 0x54534850        // "PHST", start of a saved history image
+#define HISTORY_SIGNATURE_WORDS 4       // 128-bit n-gram signature per entry
+
+// Persistent storage for the history: fetch reads a stored image into
+// `buffer` and returns its length, store receives the saved image after
+// every change
+typedef int (*history_fetch_fn)(char* buffer, int size);
+typedef int (*history_store_fn)(const char* data, int length);
+
+// An entry. Text lives NUL-terminated in the byte ring; the signature has
+// one bit set per hashed bigram and trigram of the text.
+typedef struct {
+    unsigned int offset;
+    unsigned int length;
+    unsigned int signature[HISTORY_SIGNATURE_WORDS];
+} history_entry_t;
+
+// History functions
+void init_history();
+void history_add(const char* command);
+const char* history_entry(int age);
+int history_count();
+int history_search(const char* pattern, int from_age);
+void history_clear();
+int history_save(char* buffer, int size);
+int history_load(const char* data, int length);
+int history_attach(history_fetch_fn fetch, history_store_fn store);
+
+#endif // HISTORY_H
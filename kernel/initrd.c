@@ -0,0 +1,120 @@
+#include "initrd.h"
+#include "memory.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+int strcmp(const char* s1, const char* s2);
+
+static const unsigned char* const archive = (const unsigned char*)INITRD_BASE;
+static const initrd_header_t* header = NULL;
+static const initrd_entry_t* entries = NULL;
+
+static unsigned int fnv1a(const unsigned char* data, unsigned int length) {
+    unsigned int hash = 2166136261u;
+    for (unsigned int i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Check the archive the bootloader left at INITRD_BASE. A short load or
+// stale memory fails the checksum. Returns 1 if it can be used.
+int init_initrd() {
+    const initrd_header_t* candidate = (const initrd_header_t*)archive;
+    
+    header = NULL;
+    if (candidate->magic != INITRD_MAGIC) {
+        klog(KLOG_INFO, "initrd: none loaded");
+        return 0;
+    }
+    if (candidate->size > INITRD_MAX_SIZE || candidate->count == 0 ||
+        candidate->count > INITRD_MAX_ENTRIES ||
+        sizeof(initrd_header_t) + candidate->count * sizeof(initrd_entry_t) > candidate->size) {
+        klog(KLOG_ERR, "initrd: bad header");
+        return 0;
+    }
+    if (fnv1a(archive + sizeof(initrd_header_t), candidate->size - sizeof(initrd_header_t)) != candidate->checksum) {
+        klog(KLOG_ERR, "initrd: checksum mismatch, archive ignored");
+        return 0;
+    }
+    
+    const initrd_entry_t* table = (const initrd_entry_t*)(archive + sizeof(initrd_header_t));
+    for (unsigned int i = 0; i < candidate->count; i++) {
+        if (table[i].parent >= candidate->count || table[i].offset > candidate->size ||
+            table[i].size >= candidate->size - table[i].offset) {
+            klog_value(KLOG_ERR, "initrd: bad entry ", i);
+            return 0;
+        }
+    }
+    
+    header = candidate;
+    entries = table;
+    klog_value(KLOG_INFO, "initrd: entries: ", header->count);
+    return 1;
+}
+
+int initrd_present() {
+    return header != NULL;
+}
+
+unsigned int initrd_size() {
+    return header ? header->size : 0;
+}
+
+// VFS glue. Node ids are entry indexes, 0 being the root directory.
+static int initrd_lookup(const vfs_node_t* directory, const char* name, vfs_node_t* node) {
+    for (unsigned int i = 1; i < header->count; i++) {
+        if (entries[i].parent == directory->id && strcmp(entries[i].name, name) == 0) {
+            node->id = i;
+            node->size = entries[i].size;
+            node->type = entries[i].type == INITRD_DIRECTORY ? VFS_DIRECTORY : VFS_FILE;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int initrd_read(vfs_file_t* file, void* buffer, unsigned int length) {
+    const initrd_entry_t* entry = &entries[file->node.id];
+    const unsigned char* data = archive + entry->offset;
+    unsigned char* out = (unsigned char*)buffer;
+    
+    if (file->position >= entry->size) return 0;
+    if (length > entry->size - file->position) length = entry->size - file->position;
+    for (unsigned int i = 0; i < length; i++) out[i] = data[file->position + i];
+    file->position += length;
+    return length;
+}
+
+static int initrd_size_of(const vfs_node_t* node) {
+    return entries[node->id].size;
+}
+
+static int initrd_list(const vfs_node_t* directory, vfs_list_fn callback, void* context) {
+    for (unsigned int i = 1; i < header->count; i++) {
+        if (entries[i].parent == directory->id) {
+            callback(entries[i].name, entries[i].size, entries[i].type == INITRD_DIRECTORY, context);
+        }
+    }
+    return 0;
+}
+
+static const void* initrd_map(const vfs_node_t* node) {
+    return archive + entries[node->id].offset;
+}
+
+const vfs_ops_t initrd_vfs_ops = {
+    "initrd",
+    initrd_lookup,
+    initrd_read,
+    NULL,
+    NULL,
+    NULL,
+    initrd_size_of,
+    initrd_list,
+    initrd_map,
+};
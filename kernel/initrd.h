@@ -0,0 +1,41 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include "vfs.h"
+
+// Initial ramdisk archive, packed at build time by tools/mkinitrd.c and
+// loaded by the bootloader at INITRD_BASE (see memory.h). Files are used
+// in place: each one starts on an INITRD_ALIGN boundary and is followed
+// by a NUL, so text files can be read as C strings straight from the
+// archive.
+#define INITRD_MAGIC 0x44524E49         // "INRD"
+#define INITRD_ALIGN 16
+#define INITRD_NAME_LENGTH 48
+#define INITRD_MAX_ENTRIES 256
+
+#define INITRD_FILE 1
+#define INITRD_DIRECTORY 2
+
+// Followed by `count` entries, then file data
+typedef struct {
+    unsigned int magic;
+    unsigned int size;                  // Whole archive, header included
+    unsigned int count;                 // Entries; entry 0 is the root directory
+    unsigned int checksum;              // FNV-1a of everything after the header
+} initrd_header_t;
+
+typedef struct {
+    char name[INITRD_NAME_LENGTH];      // One path component
+    unsigned int parent;                // Index of the containing directory
+    unsigned int type;
+    unsigned int offset;                // From the start of the archive
+    unsigned int size;
+} initrd_entry_t;
+
+// Initial ramdisk functions
+int init_initrd();
+int initrd_present();
+unsigned int initrd_size();
+extern const vfs_ops_t initrd_vfs_ops;
+
+#endif // INITRD_H
@@ -0,0 +1,202 @@
+#include "interrupts.h"
+#include "io.h"
+
+// IDT gate descriptor
+typedef struct {
+    unsigned short offset_low;
+    unsigned short selector;
+    unsigned char zero;
+    unsigned char type_attr;
+    unsigned short offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    unsigned short limit;
+    unsigned int base;
+} __attribute__((packed)) idt_descriptor_t;
+
+static idt_entry_t idt[IDT_ENTRIES];
+static irq_handler_t irq_handlers[IRQ_COUNT][IRQ_MAX_HANDLERS];
+static volatile unsigned int irq_counts[IRQ_COUNT];
+
+// Current PIC masks (bit set = IRQ disabled)
+static unsigned char master_mask = 0xFF;
+static unsigned char slave_mask = 0xFF;
+
+// IRQ entry stubs. Each pushes its IRQ number and joins irq_common, which
+// saves the general registers around the C dispatcher. Segment registers
+// are flat and never change, so they aren't saved.
+#define IRQ_STUB(n) \
+    __asm__(".pushsection .text\n" \
+            ".globl irq_stub_" #n "\n" \
+            "irq_stub_" #n ":\n" \
+            "    pushl $" #n "\n" \
+            "    jmp irq_common\n" \
+            ".popsection\n"); \
+    void irq_stub_##n(void);
+
+__asm__(".pushsection .text\n"
+        ".globl irq_common\n"
+        "irq_common:\n"
+        "    pusha\n"
+        "    cld\n"
+        "    pushl 32(%esp)\n"          // IRQ number, above the pusha frame
+        "    call irq_dispatch\n"
+        "    addl $4, %esp\n"
+        "    popa\n"
+        "    addl $4, %esp\n"           // Drop the IRQ number
+        "    iret\n"
+        ".popsection\n");
+
+IRQ_STUB(0) IRQ_STUB(1) IRQ_STUB(2) IRQ_STUB(3)
+IRQ_STUB(4) IRQ_STUB(5) IRQ_STUB(6) IRQ_STUB(7)
+IRQ_STUB(8) IRQ_STUB(9) IRQ_STUB(10) IRQ_STUB(11)
+IRQ_STUB(12) IRQ_STUB(13) IRQ_STUB(14) IRQ_STUB(15)
+
+static void (*const irq_stubs[IRQ_COUNT])(void) = {
+    irq_stub_0, irq_stub_1, irq_stub_2, irq_stub_3,
+    irq_stub_4, irq_stub_5, irq_stub_6, irq_stub_7,
+    irq_stub_8, irq_stub_9, irq_stub_10, irq_stub_11,
+    irq_stub_12, irq_stub_13, irq_stub_14, irq_stub_15
+};
+
+// Short delay for the PIC between initialization words
+static inline void io_wait() {
+    outb(0x80, 0);
+}
+
+static void set_gate(int vector, void (*handler)(void), unsigned char type) {
+    unsigned int offset = (unsigned int)handler;
+    idt[vector].offset_low = offset & 0xFFFF;
+    idt[vector].selector = KERNEL_CODE_SELECTOR;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = type;
+    idt[vector].offset_high = (offset >> 16) & 0xFFFF;
+}
+
+static void write_masks() {
+    outb(PIC_MASTER_DATA, master_mask);
+    outb(PIC_SLAVE_DATA, slave_mask);
+}
+
+// IRQ 7 and 15 also fire spuriously; the in-service register tells
+static int is_spurious(int irq) {
+    if (irq != 7 && irq != 15) return 0;
+    
+    unsigned short port = irq == 7 ? PIC_MASTER_COMMAND : PIC_SLAVE_COMMAND;
+    outb(port, PIC_READ_ISR);
+    return (inb(port) & 0x80) == 0;
+}
+
+// Called from irq_common with interrupts disabled
+void irq_dispatch(int irq) {
+    if (is_spurious(irq)) {
+        // The master still saw a real cascade interrupt for a spurious IRQ 15
+        if (irq == 15) outb(PIC_MASTER_COMMAND, PIC_EOI);
+        return;
+    }
+    
+    irq_counts[irq]++;
+    
+    // A shared line gives no hint which device raised it: every handler
+    // checks its own device's status
+    for (int i = 0; i < IRQ_MAX_HANDLERS && irq_handlers[irq][i]; i++) {
+        irq_handlers[irq][i]();
+    }
+    
+    if (irq >= 8) {
+        outb(PIC_SLAVE_COMMAND, PIC_EOI);
+    }
+    outb(PIC_MASTER_COMMAND, PIC_EOI);
+}
+
+// Remap the PICs, mask every line and load the IDT. Interrupts stay
+// disabled until enable_interrupts().
+void init_interrupts() {
+    // ICW1: edge triggered, cascade, ICW4 follows
+    outb(PIC_MASTER_COMMAND, 0x11);
+    io_wait();
+    outb(PIC_SLAVE_COMMAND, 0x11);
+    io_wait();
+    // ICW2: vector offsets
+    outb(PIC_MASTER_DATA, IRQ_BASE_VECTOR);
+    io_wait();
+    outb(PIC_SLAVE_DATA, IRQ_BASE_VECTOR + 8);
+    io_wait();
+    // ICW3: slave on IRQ2
+    outb(PIC_MASTER_DATA, 1 << PIC_CASCADE_IRQ);
+    io_wait();
+    outb(PIC_SLAVE_DATA, PIC_CASCADE_IRQ);
+    io_wait();
+    // ICW4: 8086 mode
+    outb(PIC_MASTER_DATA, 0x01);
+    io_wait();
+    outb(PIC_SLAVE_DATA, 0x01);
+    io_wait();
+    
+    // Everything masked except the cascade; drivers unmask their line
+    master_mask = 0xFF & ~(1 << PIC_CASCADE_IRQ);
+    slave_mask = 0xFF;
+    write_masks();
+    
+    for (int i = 0; i < IRQ_COUNT; i++) {
+        for (int h = 0; h < IRQ_MAX_HANDLERS; h++) {
+            irq_handlers[i][h] = 0;
+        }
+        irq_counts[i] = 0;
+        set_gate(IRQ_BASE_VECTOR + i, irq_stubs[i], IDT_INTERRUPT_GATE);
+    }
+    
+    idt_descriptor_t descriptor;
+    descriptor.limit = sizeof(idt) - 1;
+    descriptor.base = (unsigned int)idt;
+    __asm__ __volatile__("lidt %0" : : "m" (descriptor));
+}
+
+// Add a handler for an IRQ line, after any already sharing it, and
+// unmask the line. Registering the same handler again has no effect.
+void register_irq_handler(int irq, irq_handler_t handler) {
+    if (irq < 0 || irq >= IRQ_COUNT) return;
+    
+    unsigned int flags = irq_save();
+    for (int i = 0; i < IRQ_MAX_HANDLERS; i++) {
+        if (irq_handlers[irq][i] == handler) break;
+        if (!irq_handlers[irq][i]) {
+            irq_handlers[irq][i] = handler;
+            break;
+        }
+    }
+    if (irq >= 8) {
+        slave_mask &= ~(1 << (irq - 8));
+    } else {
+        master_mask &= ~(1 << irq);
+    }
+    write_masks();
+    irq_restore(flags);
+}
+
+// Install the entry stub for a CPU exception. Trap gates leave the
+// interrupt flag as it was, so a handler can wait for disk I/O.
+void register_trap_handler(int vector, void (*stub)(void)) {
+    if (vector < 0 || vector >= IRQ_BASE_VECTOR) return;
+    set_gate(vector, stub, IDT_TRAP_GATE);
+}
+
+// Number of interrupts handled on an IRQ line
+unsigned int get_irq_count(int irq) {
+    if (irq < 0 || irq >= IRQ_COUNT) return 0;
+    return irq_counts[irq];
+}
+
+// Halt until the next interrupt, unless `ready` finds work already
+// waiting. `ready` runs with interrupts off and `sti; hlt` only enables
+// them as the CPU halts, so an interrupt arriving after the check still
+// wakes it.
+void wait_for_interrupt(int (*ready)(void)) {
+    __asm__ __volatile__("cli");
+    if (ready && ready()) {
+        __asm__ __volatile__("sti");
+        return;
+    }
+    __asm__ __volatile__("sti; hlt");
+}
@@ -0,0 +1,53 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+// 8259 PIC ports and commands
+#define PIC_MASTER_COMMAND 0x20
+#define PIC_MASTER_DATA 0x21
+#define PIC_SLAVE_COMMAND 0xA0
+#define PIC_SLAVE_DATA 0xA1
+#define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0B
+#define PIC_CASCADE_IRQ 2
+
+// IRQs are remapped above the CPU exception vectors
+#define IRQ_BASE_VECTOR 0x20
+#define IRQ_COUNT 16
+#define IRQ_MAX_HANDLERS 4          // Handlers sharing one line (PCI devices)
+#define IDT_ENTRIES 256
+
+// Hardware IRQ lines
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+#define IRQ_MOUSE 12
+
+// Flat code segment set up by the bootloader
+#define KERNEL_CODE_SELECTOR 0x08
+#define IDT_INTERRUPT_GATE 0x8E     // Present, ring 0, 32-bit interrupt gate
+#define IDT_TRAP_GATE 0x8F          // Same, but leaves interrupts as they were
+
+typedef void (*irq_handler_t)(void);
+
+// Interrupt functions
+void init_interrupts();
+void register_irq_handler(int irq, irq_handler_t handler);
+void register_trap_handler(int vector, void (*stub)(void));
+unsigned int get_irq_count(int irq);
+void wait_for_interrupt(int (*ready)(void));
+
+static inline void enable_interrupts() {
+    __asm__ __volatile__("sti");
+}
+
+// Disable interrupts, returning the previous EFLAGS for irq_restore
+static inline unsigned int irq_save() {
+    unsigned int flags;
+    __asm__ __volatile__("pushfl; popl %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(unsigned int flags) {
+    __asm__ __volatile__("pushl %0; popfl" : : "r" (flags) : "memory", "cc");
+}
+
+#endif // INTERRUPTS_H
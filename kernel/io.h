@@ -0,0 +1,45 @@
+#ifndef IO_H
+#define IO_H
+
+// Port I/O helpers shared by all hardware drivers
+
+static inline unsigned char inb(unsigned short port) {
+    unsigned char result;
+    __asm__ __volatile__("inb %1, %0" : "=a" (result) : "Nd" (port));
+    return result;
+}
+
+static inline void outb(unsigned short port, unsigned char data) {
+    __asm__ __volatile__("outb %0, %1" : : "a" (data), "Nd" (port));
+}
+
+static inline unsigned short inw(unsigned short port) {
+    unsigned short result;
+    __asm__ __volatile__("inw %1, %0" : "=a" (result) : "Nd" (port));
+    return result;
+}
+
+static inline void outw(unsigned short port, unsigned short data) {
+    __asm__ __volatile__("outw %0, %1" : : "a" (data), "Nd" (port));
+}
+
+static inline unsigned int inl(unsigned short port) {
+    unsigned int result;
+    __asm__ __volatile__("inl %1, %0" : "=a" (result) : "Nd" (port));
+    return result;
+}
+
+static inline void outl(unsigned short port, unsigned int data) {
+    __asm__ __volatile__("outl %0, %1" : : "a" (data), "Nd" (port));
+}
+
+// Block transfers of `count` words, for PIO data registers
+static inline void insw(unsigned short port, void* buffer, unsigned int count) {
+    __asm__ __volatile__("rep insw" : "+D" (buffer), "+c" (count) : "d" (port) : "memory");
+}
+
+static inline void outsw(unsigned short port, const void* buffer, unsigned int count) {
+    __asm__ __volatile__("rep outsw" : "+S" (buffer), "+c" (count) : "d" (port));
+}
+
+#endif // IO_H
@@ -0,0 +1,400 @@
+#include "job.h"
+#include "screen.h"
+#include "keyboard.h"
+#include "memory.h"
+#include "vfs.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+static job_t jobs[JOB_MAX];
+static job_t* current = NULL;           // Job on the CPU, NULL in the shell loop
+static unsigned int shell_esp;          // Shell loop stack while a job runs
+static unsigned int spawn_sequence = 0;
+
+// Console output of jobs on held_console, kept off a pager drawn there
+// until jobs_release_console
+static int held_console = -1;
+static char held_text[JOB_HELD_OUTPUT];
+static char held_colors[JOB_HELD_OUTPUT];
+static int held_length = 0;
+
+// Push the callee-saved registers, store the stack pointer in *save and
+// resume the stack at `next`, which was saved the same way
+void job_switch(unsigned int* save, unsigned int next);
+
+__asm__(".pushsection .text\n"
+        ".globl job_switch\n"
+        "job_switch:\n"
+        "    movl 4(%esp), %eax\n"
+        "    movl 8(%esp), %edx\n"
+        "    pushl %ebp\n"
+        "    pushl %ebx\n"
+        "    pushl %esi\n"
+        "    pushl %edi\n"
+        "    movl %esp, (%eax)\n"
+        "    movl %edx, %esp\n"
+        "    popl %edi\n"
+        "    popl %esi\n"
+        "    popl %ebx\n"
+        "    popl %ebp\n"
+        "    ret\n"
+        ".popsection\n");
+
+static int job_id(const job_t* job) {
+    return job - jobs + 1;
+}
+
+// Pass buffered piped output on. Backspaces were already applied, so a
+// reader sees the text as it would have appeared on screen.
+static void flush_line(job_t* job) {
+    if (job->line_length > 0 && job->out) {
+        stream_write(job->out, job->line, job->line_length);
+    }
+    job->line_length = 0;
+}
+
+// Screen output hook while a piped job runs
+static void job_output(char c, char color, void* context) {
+    job_t* job = (job_t*)context;
+    
+    if (c == '\b') {
+        if (job->line_length > 0) job->line_length--;
+        return;
+    }
+    
+    job->line[job->line_length++] = c;
+    if (c == '\n' || job->line_length == JOB_LINE_LENGTH) {
+        flush_line(job);
+    }
+}
+
+static void job_finish(job_t* job) {
+    if (job->in) {
+        stream_close_read(job->in);
+        job->in = NULL;
+    }
+    if (job->out) {
+        stream_close_write(job->out);
+        job->out = NULL;
+    }
+    job->state = JOB_DONE;
+}
+
+// First code run on a job's stack
+static void job_entry() {
+    job_t* job = current;
+    
+    job->status = job->run(job->command);
+    flush_line(job);
+    job_finish(job);
+    
+    // Never resumed: the slot is reclaimed once the shell has seen it finish
+    job_switch(&job->esp, shell_esp);
+}
+
+// Create a runnable job for one command. `group` 0 starts a new group.
+// Returns the job id, or 0 if every slot is taken.
+int job_spawn(const char* command, const char* pipeline, job_command_fn run,
+              stream_t* in, stream_t* out, int group, int background) {
+    for (int i = 0; i < JOB_MAX; i++) {
+        job_t* job = &jobs[i];
+        if (job->state != JOB_FREE) continue;
+        
+        int length = 0;
+        while (command[length] && length < JOB_COMMAND_LENGTH - 1) {
+            job->command[length] = command[length];
+            length++;
+        }
+        job->command[length] = '\0';
+        length = 0;
+        while (pipeline[length] && length < JOB_COMMAND_LENGTH - 1) {
+            job->pipeline[length] = pipeline[length];
+            length++;
+        }
+        job->pipeline[length] = '\0';
+        
+        job->group = group ? group : job_id(job);
+        job->background = background;
+        job->console = get_active_console();
+        job->status = 0;
+        job->sequence = ++spawn_sequence;
+        job->run = run;
+        job->in = in;
+        job->out = out;
+        job->output = NULL;
+        job->output_context = NULL;
+        job->line_length = 0;
+        for (int f = 0; f < JOB_MAX_FILES; f++) {
+            job->files[f] = -1;
+        }
+        
+        // Initial frame for job_switch: four registers, then job_entry as
+        // the return address and a dummy return address for job_entry
+        unsigned int* stack = (unsigned int*)(JOB_STACK_BASE + (i + 1) * JOB_STACK_SIZE);
+        *--stack = 0;
+        *--stack = (unsigned int)job_entry;
+        for (int r = 0; r < 4; r++) {
+            *--stack = 0;
+        }
+        job->esp = (unsigned int)stack;
+        job->state = JOB_RUNNABLE;
+        return job_id(job);
+    }
+    return 0;
+}
+
+// Screen output hook for a job writing to a held console
+static void held_output(char c, char color, void* context) {
+    if (held_length < JOB_HELD_OUTPUT) {
+        held_text[held_length] = c;
+        held_colors[held_length] = color;
+        held_length++;
+    }
+}
+
+// Whether a slice now would reach the console while it is held
+static int job_prints_held(const job_t* job) {
+    return job->console == held_console && !job->output && !job->out;
+}
+
+// Jobs writing to a held console wait once the holding buffer is full
+static int job_may_run(const job_t* job) {
+    if (job->state != JOB_RUNNABLE) return 0;
+    return !job_prints_held(job) || held_length < JOB_HELD_OUTPUT;
+}
+
+// Give one slice to a job, on its own console and with its output routed
+static void run_job(job_t* job) {
+    int console = get_active_console();
+    void* saved_context;
+    screen_output_fn saved_output = screen_get_output(&saved_context);
+    
+    select_console(job->console);
+    if (job->output) {
+        screen_redirect_output(job->output, job->output_context);
+    } else if (job_prints_held(job)) {
+        screen_redirect_output(held_output, NULL);
+    } else {
+        screen_redirect_output(job->out ? job_output : NULL, job);
+    }
+    current = job;
+    job_switch(&shell_esp, job->esp);
+    current = NULL;
+    screen_redirect_output(saved_output, saved_context);
+    select_console(console);
+}
+
+// Let other work run. From a job this returns to the shell loop; from the
+// shell loop it gives every runnable job a slice.
+void job_yield() {
+    if (current) {
+        job_switch(&current->esp, shell_esp);
+    } else {
+        jobs_run();
+    }
+}
+
+static int group_done(int group) {
+    int found = 0;
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].group == group) {
+            if (jobs[i].state != JOB_DONE) return 0;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// Status of the last stage, then release every slot of the group
+static int group_reap(int group) {
+    unsigned int last = 0;
+    int status = 0;
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].group == group) {
+            if (jobs[i].sequence > last) {
+                last = jobs[i].sequence;
+                status = jobs[i].status;
+            }
+            jobs[i].state = JOB_FREE;
+        }
+    }
+    return status;
+}
+
+// Run every runnable job once
+void jobs_step() {
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (job_may_run(&jobs[i])) {
+            run_job(&jobs[i]);
+        }
+    }
+}
+
+int jobs_runnable() {
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (job_may_run(&jobs[i])) return 1;
+    }
+    return 0;
+}
+
+// Run every runnable job once, then report finished background groups
+void jobs_run() {
+    jobs_step();
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        job_t* job = &jobs[i];
+        if (job->state == JOB_DONE && job->background && job->group == job_id(job) &&
+            group_done(job->group)) {
+            int console = get_active_console();
+            select_console(job->console);
+            print_string("[", VGA_LIGHT_GREY);
+            print_uint(job->group, VGA_LIGHT_WHITE);
+            print_string("] Done  ", VGA_LIGHT_GREY);
+            print_string(job->pipeline, VGA_LIGHT_WHITE);
+            print_string("\n", VGA_LIGHT_WHITE);
+            select_console(console);
+            group_reap(job->group);
+        }
+    }
+}
+
+// Run a group in the foreground until every stage has finished. Returns
+// the last stage's status, or -1 if there is no such group.
+int job_wait(int group) {
+    int found = 0;
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].group == group) {
+            if (&jobs[i] == current) return -1;     // Waiting on itself
+            jobs[i].background = 0;
+            found = 1;
+        }
+    }
+    if (!found) return -1;
+    
+    while (!group_done(group)) {
+        if (current) {
+            job_yield();
+        } else {
+            // Keep the screen and keyboard alive while the shell waits
+            jobs_run();
+            screen_flush();
+            poll_keyboard();
+        }
+    }
+    
+    return group_reap(group);
+}
+
+// Stop every stage of a group. Their streams are closed so neighbouring
+// stages see end of input or a gone reader, and the files they held are
+// closed, as their stacks never unwind to do it. Returns -1 if there is no
+// such group or it contains the calling job.
+int job_kill(int group) {
+    int found = 0;
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].group == group) {
+            if (&jobs[i] == current) return -1;
+            found = 1;
+        }
+    }
+    if (!found) return -1;
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].group == group) {
+            for (int f = 0; f < JOB_MAX_FILES; f++) {
+                if (jobs[i].files[f] >= 0) vfs_close(jobs[i].files[f]);
+                jobs[i].files[f] = -1;
+            }
+            job_finish(&jobs[i]);
+            jobs[i].state = JOB_FREE;
+        }
+    }
+    return 0;
+}
+
+// Most recently started background group, 0 if none
+int job_latest_background() {
+    unsigned int latest = 0;
+    int group = 0;
+    
+    for (int i = 0; i < JOB_MAX; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].background && jobs[i].sequence > latest) {
+            latest = jobs[i].sequence;
+            group = jobs[i].group;
+        }
+    }
+    return group;
+}
+
+const job_t* job_get(int id) {
+    if (id < 1 || id > JOB_MAX || jobs[id - 1].state == JOB_FREE) return NULL;
+    return &jobs[id - 1];
+}
+
+// Id of the running job, 0 in the shell loop
+int job_current() {
+    return current ? job_id(current) : 0;
+}
+
+// Input of the running pipeline stage, NULL outside a pipe
+stream_t* job_stdin() {
+    return current ? current->in : NULL;
+}
+
+// Send the running job's output to `output` (NULL: back to its pipe or
+// the console). Unlike screen_redirect_output this lasts across slices.
+void job_redirect(screen_output_fn output, void* context) {
+    if (!current) return;
+    
+    current->output = output;
+    current->output_context = context;
+    if (output) {
+        screen_redirect_output(output, context);
+    } else {
+        screen_redirect_output(current->out ? job_output : NULL, current);
+    }
+}
+
+// Hold back console output of jobs on `console`, which something other
+// than print_char is drawing on (the pager)
+void jobs_hold_console(int console) {
+    held_console = console;
+    held_length = 0;
+}
+
+// Print the output held back, on the console the caller has selected
+void jobs_release_console() {
+    held_console = -1;
+    for (int i = 0; i < held_length; i++) {
+        print_char(held_text[i], held_colors[i]);
+    }
+    held_length = 0;
+}
+
+// Note a file the running job has open across slices, for job_kill to
+// close. Outside a job, or with every slot taken, it is not tracked.
+void job_hold_file(int fd) {
+    if (!current) return;
+    
+    for (int f = 0; f < JOB_MAX_FILES; f++) {
+        if (current->files[f] < 0) {
+            current->files[f] = fd;
+            return;
+        }
+    }
+}
+
+// The running job has closed `fd` itself
+void job_release_file(int fd) {
+    if (!current) return;
+    
+    for (int f = 0; f < JOB_MAX_FILES; f++) {
+        if (current->files[f] == fd) current->files[f] = -1;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include "stream.h"
+#include "screen.h"
+
+// Job configuration
+#define JOB_MAX 8
+#define JOB_COMMAND_LENGTH 256
+#define JOB_LINE_LENGTH 160             // Piped output is passed on a line at a time
+#define JOB_MAX_FILES 4                 // Open files a job holds, closed if it is killed
+#define JOB_HELD_OUTPUT 4096            // Console output held back while a pager is up
+
+// Job states
+#define JOB_FREE 0
+#define JOB_RUNNABLE 1
+#define JOB_DONE 2
+
+// Runs one command of a job. The line is the job's own copy and may be
+// split in place.
+typedef int (*job_command_fn)(char* command_line);
+
+// A shell command running on its own stack. Jobs are cooperative: they
+// run until they block on a stream or call job_yield(), so the shell loop
+// keeps serving input between slices. Stages of one pipeline share a group
+// (the id of the first stage).
+typedef struct {
+    int state;
+    int group;
+    int background;                     // Report completion at the prompt
+    int console;                        // Console the job prints on
+    int status;
+    unsigned int sequence;              // Spawn order; the highest in a group is its last stage
+    unsigned int esp;                   // Saved stack pointer while switched out
+    job_command_fn run;
+    char command[JOB_COMMAND_LENGTH];   // This stage
+    char pipeline[JOB_COMMAND_LENGTH];  // The whole command line, for `jobs`
+    stream_t* in;                       // NULL: no input
+    stream_t* out;                      // NULL: the console
+    screen_output_fn output;            // Set by job_redirect, overrides `out`
+    void* output_context;
+    char line[JOB_LINE_LENGTH];         // Piped output not yet written to `out`
+    int line_length;
+    int files[JOB_MAX_FILES];           // VFS descriptors held open, -1 for none
+} job_t;
+
+// Job functions
+int job_spawn(const char* command, const char* pipeline, job_command_fn run,
+              stream_t* in, stream_t* out, int group, int background);
+void job_yield();
+void jobs_run();
+void jobs_step();
+int jobs_runnable();
+int job_wait(int group);
+int job_kill(int group);
+int job_latest_background();
+const job_t* job_get(int id);
+int job_current();
+stream_t* job_stdin();
+void job_redirect(screen_output_fn output, void* context);
+void jobs_hold_console(int console);
+void jobs_release_console();
+void job_hold_file(int fd);
+void job_release_file(int fd);
+
+#endif // JOB_H
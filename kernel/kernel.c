@@ -9,47 +9,66 @@
 #include "env.h"
 #include "voice.h"
 #include "assistant.h"
-
-// VGA text mode buffer starts at 0xB8000
-volatile unsigned short* vga_buffer = (volatile unsigned short*)0xB8000;
-
-// VGA text mode screen dimensions are defined in screen.h
-
-// Current cursor position
-int cursor_row = 0;
-int cursor_col = 0;
-
-// Function to print a character with color attribute
-void print_char(char c, char color) {
-    unsigned short attribute = (unsigned short)color << 8;
-    unsigned short* location = vga_buffer + (cursor_row * VGA_WIDTH + cursor_col);
-    *location = c | attribute;
-    cursor_col++;
-    if (cursor_col >= VGA_WIDTH) {
-        cursor_col = 0;
-        cursor_row++;
-    }
-}
-
-// Function to print a null-terminated string with color
-void print_string(const char* str, char color) {
-    while (*str != '\0') {
-        print_char(*str, color);
-        str++;
-    }
-}
+#include "timer.h"
+#include "klog.h"
+#include "interrupts.h"
+#include "serial.h"
+#include "replay.h"
+#include "pci.h"
+#include "ata.h"
+#include "virtio.h"
+#include "fat.h"
+#include "bcache.h"
+#include "vfs.h"
+#include "initrd.h"
+#include "convlog.h"
+#include "paging.h"
+#include "mmap.h"
 
 // Initialize the kernel
 void init_kernel() {
     // Initialize screen
     init_screen();
     
+    // Calibrate the TSC and start the kernel log
+    init_timer();
+    init_serial();
+    init_klog();
+    
+    // Remap the PICs and load the IDT (all IRQ lines masked)
+    init_interrupts();
+    
+    // Page tables: identity map plus the window for memory-mapped files
+    init_paging();
+    
     // Initialize keyboard
     init_keyboard();
     
     // Initialize mouse
     init_mouse();
     
+    // Scan the PCI bus and probe the IDE and virtio disks
+    init_pci();
+    init_ata();
+    init_virtio_blk();
+    init_bcache();
+    
+    // Mount the FAT volume, then build the file tree: ramfs at /, the
+    // initrd the bootloader loaded under /initrd, the FAT volume under /disk
+    init_fat();
+    init_initrd();
+    init_vfs();
+    init_mmap();
+    
+    // Drivers have registered their IRQ handlers
+    enable_interrupts();
+    
+    // AI conversation log, on the first disk that holds one or is blank
+    init_convlog();
+    
+    // Input recorder for replayed benchmark sessions
+    init_replay();
+    
     // Initialize network (simulated)
     init_network();
     
@@ -67,7 +86,7 @@ void init_kernel() {
     print_string("Welcome to your voice-controlled AI operating system!\n", VGA_LIGHT_CYAN);
     print_string("Default AI Model: Google Gemini\n", VGA_LIGHT_YELLOW);
     print_string("Voice Assistant: Always-on, ready for 'Hey Proto' commands\n", VGA_LIGHT_YELLOW);
-    print_string("Mouse Support: PS/2 mouse driver initialized\n", VGA_LIGHT_BLUE);
+    print_string("Kernel log: type 'dmesg' to view boot messages\n", VGA_LIGHT_BLUE);
     print_string("==========================================\n", VGA_LIGHT_GREY);
 }
 
@@ -91,6 +110,7 @@ void delay(int milliseconds) {
 
 // Panic function for critical errors
 void panic(const char* message) {
+    klog(KLOG_EMERG, message);
     set_color(VGA_LIGHT_RED);
     print_string("\n*** KERNEL PANIC ***\n", VGA_LIGHT_RED);
     print_string(message, VGA_LIGHT_RED);
@@ -102,8 +122,19 @@ void panic(const char* message) {
     }
 }
 
-// Entry point for the kernel
+// Bounds of .bss, from linker.ld
+extern char __bss_start[];
+extern char __bss_end[];
+
+// Entry point for the kernel. The bootloader calls the start of the
+// image, so this goes first (linker.ld places .text.entry there).
+__attribute__((section(".text.entry")))
 void kernel_main() {
+    // The flat binary stops at .data; clear .bss before anything uses it
+    for (char* p = __bss_start; p < __bss_end; p++) {
+        *p = 0;
+    }
+    
     // Initialize the system
     init_system();
     init_kernel();
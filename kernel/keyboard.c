@@ -1,69 +1,313 @@
 #include "keyboard.h"
 #include "screen.h"
+#include "io.h"
+#include "timer.h"
+#include "replay.h"
+#include "interrupts.h"
 
-// Keyboard buffer
+// Keyboard buffers, one input queue per virtual console
 #define KEYBOARD_BUFFER_SIZE 256
-char keyboard_buffer[KEYBOARD_BUFFER_SIZE];
-int buffer_head = 0;
-int buffer_tail = 0;
-int buffer_count = 0;
-
-// PS/2 keyboard scancode to ASCII conversion table
-static const char scancode_to_ascii[] = {
-    0, 0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
-    '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
-    0, 'a', 's', 'd', 'f', 'g', 'h', 'j', 'k', 'l', ';', '\'', '`',
-    0, '\\', 'z', 'x', 'c', 'v', 'b', 'n', 'm', ',', '.', '/', 0,
-    '*', 0, ' ', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    '-', 0, 0, 0, '+', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+key_event_t keyboard_buffer[MAX_CONSOLES][KEYBOARD_BUFFER_SIZE];
+int buffer_head[MAX_CONSOLES];
+int buffer_tail[MAX_CONSOLES];
+int buffer_count[MAX_CONSOLES];
+
+// Held modifier keys, left and right tracked separately
+#define HELD_LEFT_SHIFT 0x01
+#define HELD_RIGHT_SHIFT 0x02
+#define HELD_LEFT_CTRL 0x04
+#define HELD_RIGHT_CTRL 0x08
+#define HELD_LEFT_ALT 0x10
+#define HELD_RIGHT_ALT 0x20
+#define HELD_SHIFT (HELD_LEFT_SHIFT | HELD_RIGHT_SHIFT)
+#define HELD_CTRL (HELD_LEFT_CTRL | HELD_RIGHT_CTRL)
+#define HELD_ALT (HELD_LEFT_ALT | HELD_RIGHT_ALT)
+
+// Lock keys, in keyboard LED bit order
+#define LOCK_SCROLL 0x01
+#define LOCK_NUM 0x02
+#define LOCK_CAPS 0x04
+
+// Keymap entry flags
+#define KEYF_CAPS 0x01              // Caps Lock inverts Shift for this key
+#define KEYF_NUM 0x02               // Num Lock inverts Shift for this key
+#define KEYF_CTRL 0x04              // Ctrl maps the key to a C0 control code
+
+// One physical key: what it types unshifted and shifted, and which
+// modifier or lock (if any) it drives
+typedef struct {
+    unsigned char keys[2];
+    unsigned char flags;
+    unsigned char held;
+    unsigned char lock;
+} keymap_entry_t;
+
+#define KEY(normal, shifted) { { normal, shifted }, 0, 0, 0 }
+#define LETTER(c) { { c, c - 'a' + 'A' }, KEYF_CAPS | KEYF_CTRL, 0, 0 }
+#define PUNCT(normal, shifted) { { normal, shifted }, KEYF_CTRL, 0, 0 }
+#define PAD(nav, digit) { { nav, digit }, KEYF_NUM, 0, 0 }
+#define MODIFIER(bit) { { 0, 0 }, 0, bit, 0 }
+#define LOCK(bit) { { 0, 0 }, 0, 0, bit }
+#define E0(code) (KEYCODE_EXTENDED | (code))
+
+// US layout, indexed by keycode. Translation is a single lookup; every
+// layout decision lives in this table.
+static const keymap_entry_t keymap[KEYCODE_COUNT] = {
+    [0x01] = KEY(KEY_ESCAPE, KEY_ESCAPE),
+    [0x02] = KEY('1', '!'), [0x03] = KEY('2', '@'), [0x04] = KEY('3', '#'),
+    [0x05] = KEY('4', '$'), [0x06] = KEY('5', '%'), [0x07] = KEY('6', '^'),
+    [0x08] = KEY('7', '&'), [0x09] = KEY('8', '*'), [0x0A] = KEY('9', '('),
+    [0x0B] = KEY('0', ')'), [0x0C] = KEY('-', '_'), [0x0D] = KEY('=', '+'),
+    [0x0E] = KEY('\b', '\b'), [0x0F] = KEY('\t', '\t'),
+    [0x10] = LETTER('q'), [0x11] = LETTER('w'), [0x12] = LETTER('e'),
+    [0x13] = LETTER('r'), [0x14] = LETTER('t'), [0x15] = LETTER('y'),
+    [0x16] = LETTER('u'), [0x17] = LETTER('i'), [0x18] = LETTER('o'),
+    [0x19] = LETTER('p'), [0x1A] = PUNCT('[', '{'), [0x1B] = PUNCT(']', '}'),
+    [0x1C] = KEY('\n', '\n'), [0x1D] = MODIFIER(HELD_LEFT_CTRL),
+    [0x1E] = LETTER('a'), [0x1F] = LETTER('s'), [0x20] = LETTER('d'),
+    [0x21] = LETTER('f'), [0x22] = LETTER('g'), [0x23] = LETTER('h'),
+    [0x24] = LETTER('j'), [0x25] = LETTER('k'), [0x26] = LETTER('l'),
+    [0x27] = KEY(';', ':'), [0x28] = KEY('\'', '"'), [0x29] = KEY('`', '~'),
+    [0x2A] = MODIFIER(HELD_LEFT_SHIFT), [0x2B] = PUNCT('\\', '|'),
+    [0x2C] = LETTER('z'), [0x2D] = LETTER('x'), [0x2E] = LETTER('c'),
+    [0x2F] = LETTER('v'), [0x30] = LETTER('b'), [0x31] = LETTER('n'),
+    [0x32] = LETTER('m'), [0x33] = KEY(',', '<'), [0x34] = KEY('.', '>'),
+    [0x35] = KEY('/', '?'), [0x36] = MODIFIER(HELD_RIGHT_SHIFT),
+    [0x37] = KEY('*', '*'), [0x38] = MODIFIER(HELD_LEFT_ALT),
+    [0x39] = KEY(' ', ' '), [0x3A] = LOCK(LOCK_CAPS),
+    [0x3B] = KEY(KEY_F1, KEY_F1), [0x3C] = KEY(KEY_F1 + 1, KEY_F1 + 1),
+    [0x3D] = KEY(KEY_F1 + 2, KEY_F1 + 2), [0x3E] = KEY(KEY_F1 + 3, KEY_F1 + 3),
+    [0x3F] = KEY(KEY_F1 + 4, KEY_F1 + 4), [0x40] = KEY(KEY_F1 + 5, KEY_F1 + 5),
+    [0x41] = KEY(KEY_F1 + 6, KEY_F1 + 6), [0x42] = KEY(KEY_F1 + 7, KEY_F1 + 7),
+    [0x43] = KEY(KEY_F1 + 8, KEY_F1 + 8), [0x44] = KEY(KEY_F1 + 9, KEY_F1 + 9),
+    [0x45] = LOCK(LOCK_NUM), [0x46] = LOCK(LOCK_SCROLL),
+    [0x47] = PAD(KEY_HOME, '7'), [0x48] = PAD(KEY_UP, '8'),
+    [0x49] = PAD(KEY_PAGE_UP, '9'), [0x4A] = KEY('-', '-'),
+    [0x4B] = PAD(KEY_LEFT, '4'), [0x4C] = PAD(0, '5'),
+    [0x4D] = PAD(KEY_RIGHT, '6'), [0x4E] = KEY('+', '+'),
+    [0x4F] = PAD(KEY_END, '1'), [0x50] = PAD(KEY_DOWN, '2'),
+    [0x51] = PAD(KEY_PAGE_DOWN, '3'), [0x52] = PAD(KEY_INSERT, '0'),
+    [0x53] = PAD(KEY_DELETE, '.'),
+    [0x57] = KEY(KEY_F1 + 10, KEY_F1 + 10), [0x58] = KEY(KEY_F12, KEY_F12),
+    
+    [E0(0x1C)] = KEY('\n', '\n'), [E0(0x1D)] = MODIFIER(HELD_RIGHT_CTRL),
+    [E0(0x35)] = KEY('/', '/'), [E0(0x38)] = MODIFIER(HELD_RIGHT_ALT),
+    [E0(0x47)] = KEY(KEY_HOME, KEY_HOME), [E0(0x48)] = KEY(KEY_UP, KEY_UP),
+    [E0(0x49)] = KEY(KEY_PAGE_UP, KEY_PAGE_UP), [E0(0x4B)] = KEY(KEY_LEFT, KEY_LEFT),
+    [E0(0x4D)] = KEY(KEY_RIGHT, KEY_RIGHT), [E0(0x4F)] = KEY(KEY_END, KEY_END),
+    [E0(0x50)] = KEY(KEY_DOWN, KEY_DOWN), [E0(0x51)] = KEY(KEY_PAGE_DOWN, KEY_PAGE_DOWN),
+    [E0(0x52)] = KEY(KEY_INSERT, KEY_INSERT), [E0(0x53)] = KEY(KEY_DELETE, KEY_DELETE),
 };
 
+// Decoder and modifier state
+static unsigned char prefix = 0;            // KEYCODE_EXTENDED after an E0 byte
+static int pause_remaining = 0;             // Bytes of an E1 Pause sequence left to skip
+static unsigned char held = 0;              // HELD_* bits
+static unsigned char locks = 0;             // LOCK_* bits
+static unsigned char keys_down[KEYCODE_COUNT / 8];
+
+// Send a byte to the keyboard. The ACK comes back through poll_keyboard,
+// which discards it.
+static void keyboard_write(unsigned char data) {
+    unsigned int timeout = 100000;
+    while ((inb(KEYBOARD_PORT_STATUS) & KEYBOARD_STATUS_INPUT_FULL) && timeout--) {
+    }
+    outb(KEYBOARD_PORT_DATA, data);
+}
+
+// Drain the controller's ACK for a command sent during init
+static void keyboard_wait_ack() {
+    unsigned int timeout = 100000;
+    while (timeout--) {
+        unsigned char status = inb(KEYBOARD_PORT_STATUS);
+        if ((status & KEYBOARD_STATUS_OUTPUT_FULL) && !(status & KEYBOARD_STATUS_AUX)) {
+            if (inb(KEYBOARD_PORT_DATA) == KEYBOARD_RESPONSE_ACK) return;
+        }
+    }
+}
+
+static void keyboard_irq() {
+}
+
 // Initialize keyboard
 void init_keyboard() {
-    // Clear buffer
-    buffer_head = 0;
-    buffer_tail = 0;
-    buffer_count = 0;
+    // Clear buffers
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        buffer_head[i] = 0;
+        buffer_tail[i] = 0;
+        buffer_count[i] = 0;
+    }
+    for (int i = 0; i < KEYCODE_COUNT / 8; i++) {
+        keys_down[i] = 0;
+    }
+    prefix = 0;
+    pause_remaining = 0;
+    held = 0;
+    locks = 0;
     
-    // For now, we'll use polling instead of interrupts
-    // In a real OS, you'd set up an interrupt handler
+    // Fixed typematic rate so repeat timing doesn't depend on the firmware
+    keyboard_write(KEYBOARD_CMD_SET_TYPEMATIC);
+    keyboard_wait_ack();
+    keyboard_write(KEYBOARD_TYPEMATIC_RATE);
+    keyboard_wait_ack();
+    
+    // Keys are still read by poll_keyboard; IRQ1 only wakes a CPU halted
+    // in wait_for_interrupt
+    register_irq_handler(IRQ_KEYBOARD, keyboard_irq);
 }
 
-// Check if a key is available
+// Check if a key is available for the active console
 int key_available() {
-    return buffer_count > 0;
+    return buffer_count[get_active_console()] > 0;
 }
 
-// Read a character from keyboard buffer
-char get_char() {
-    if (buffer_count == 0) {
+// Read the next key event from the active console's queue
+int get_key_event(key_event_t* event) {
+    int vc = get_active_console();
+    if (buffer_count[vc] == 0) {
         return 0; // No key available
     }
     
-    char key = keyboard_buffer[buffer_head];
-    buffer_head = (buffer_head + 1) % KEYBOARD_BUFFER_SIZE;
-    buffer_count--;
+    *event = keyboard_buffer[vc][buffer_head[vc]];
+    buffer_head[vc] = (buffer_head[vc] + 1) % KEYBOARD_BUFFER_SIZE;
+    buffer_count[vc]--;
+    
+    return 1;
+}
+
+// Read a character from the active console's keyboard buffer. Non-ASCII
+// keys come back as their KEY_* code.
+char get_char() {
+    key_event_t event;
+    if (!get_key_event(&event)) {
+        return 0;
+    }
+    return (char)event.key;
+}
+
+// Queue an event for the console on screen. Typematic repeats are dropped
+// once the queue is half full so a held key can't bury other input.
+static void queue_key_event(key_event_t event) {
+    int vc = get_visible_console();
+    int limit = (event.flags & KEY_EVENT_REPEAT) ? KEYBOARD_BUFFER_SIZE / 2 : KEYBOARD_BUFFER_SIZE;
     
-    return key;
+    if (buffer_count[vc] < limit) {
+        keyboard_buffer[vc][buffer_tail[vc]] = event;
+        buffer_tail[vc] = (buffer_tail[vc] + 1) % KEYBOARD_BUFFER_SIZE;
+        buffer_count[vc]++;
+    }
 }
 
-// Add a character to the keyboard buffer
+// Add a character to the keyboard buffer of the console on screen
 void add_key_to_buffer(char key) {
-    if (buffer_count < KEYBOARD_BUFFER_SIZE) {
-        keyboard_buffer[buffer_tail] = key;
-        buffer_tail = (buffer_tail + 1) % KEYBOARD_BUFFER_SIZE;
-        buffer_count++;
+    key_event_t event = { 0, (unsigned char)key, keyboard_modifiers(), 0, read_tsc() };
+    queue_key_event(event);
+}
+
+// Current modifier and lock state
+unsigned char keyboard_modifiers() {
+    return ((held & HELD_SHIFT) ? KEY_MOD_SHIFT : 0) |
+           ((held & HELD_CTRL) ? KEY_MOD_CTRL : 0) |
+           ((held & HELD_ALT) ? KEY_MOD_ALT : 0) |
+           (locks << 4);
+}
+
+// Apply a make or break code for one physical key
+static void handle_key(unsigned char keycode, int release, unsigned long long tsc) {
+    const keymap_entry_t* entry = &keymap[keycode];
+    unsigned char bit = 1 << (keycode & 7);
+    int repeat = (keys_down[keycode >> 3] & bit) != 0;
+    
+    if (release) {
+        keys_down[keycode >> 3] &= ~bit;
+        held &= ~entry->held;
+        return;
+    }
+    keys_down[keycode >> 3] |= bit;
+    
+    // Modifiers and locks produce no events and locks don't auto-repeat
+    if (entry->held | entry->lock) {
+        held |= entry->held;
+        if (!repeat && entry->lock) {
+            locks ^= entry->lock;
+            keyboard_write(KEYBOARD_CMD_SET_LEDS);
+            keyboard_write(locks);
+        }
+        return;
+    }
+    
+    unsigned char modifiers = keyboard_modifiers();
+    
+    // Shift, inverted by Caps Lock on letters and Num Lock on the keypad
+    int level = (modifiers & KEY_MOD_SHIFT) ^
+                ((modifiers >> 6) & entry->flags & KEYF_CAPS) ^
+                ((modifiers >> 5) & (entry->flags >> 1) & 1);
+    unsigned char key = entry->keys[level & 1];
+    
+    // Ctrl clears bits 5-6: 'a'/'A' -> 0x01, '[' -> ESC
+    key &= ~(0x60 & -((modifiers >> 1) & (entry->flags >> 2) & 1));
+    
+    if (key == 0) {
+        return;
+    }
+    
+    // Alt+F1..F4 switches virtual consoles
+    if ((modifiers & KEY_MOD_ALT) && key >= KEY_F1 && key < KEY_F1 + MAX_CONSOLES) {
+        if (!repeat) {
+            switch_console(key - KEY_F1);
+        }
+        return;
     }
+    
+    key_event_t event = { keycode, key, modifiers, repeat ? KEY_EVENT_REPEAT : 0, tsc };
+    replay_capture_key(key);
+    queue_key_event(event);
 }
 
-// Simple keyboard polling function (for demonstration)
-void poll_keyboard() {
-    // This is a simplified version - in reality you'd read from port 0x60
-    // For now, we'll just simulate some input
-    static int demo_counter = 0;
+// Feed one byte from the controller through the scancode decoder
+static void decode_scancode(unsigned char scancode, unsigned long long tsc) {
+    // The Pause key sends E1 1D 45 E1 9D C5 with no break code; skip it
+    if (pause_remaining > 0) {
+        pause_remaining--;
+        return;
+    }
     
-    if (demo_counter++ > 1000) { // Simulate key press every 1000 calls
-        demo_counter = 0;
-        add_key_to_buffer('A' + (demo_counter % 26));
+    if (scancode == SCANCODE_EXTENDED) {
+        prefix = KEYCODE_EXTENDED;
+        return;
+    }
+    if (scancode == SCANCODE_PAUSE) {
+        pause_remaining = SCANCODE_PAUSE_LENGTH;
+        return;
+    }
+    
+    // Command responses (LED and typematic ACKs, errors) aren't keys
+    if (prefix == 0 && (scancode == KEYBOARD_RESPONSE_ACK || scancode == KEYBOARD_RESPONSE_RESEND ||
+                        scancode == KEYBOARD_RESPONSE_ERROR || scancode == 0x00)) {
+        return;
+    }
+    
+    unsigned char keycode = (scancode & ~SCANCODE_RELEASE) | prefix;
+    prefix = 0;
+    handle_key(keycode, scancode & SCANCODE_RELEASE, tsc);
+}
+
+// Poll the keyboard controller, decoding every byte it has queued
+int keyboard_pending() {
+    return (inb(KEYBOARD_PORT_STATUS) & KEYBOARD_STATUS_OUTPUT_FULL) != 0;
+}
+
+void poll_keyboard() {
+    while (1) {
+        unsigned char status = inb(KEYBOARD_PORT_STATUS);
+        
+        // Leave mouse (AUX) bytes for the mouse driver
+        if (!(status & KEYBOARD_STATUS_OUTPUT_FULL) || (status & KEYBOARD_STATUS_AUX)) {
+            return;
+        }
+        
+        // Input latency is measured from here
+        unsigned char scancode = inb(KEYBOARD_PORT_DATA);
+        decode_scancode(scancode, read_tsc());
     }
 }
@@ -3,19 +3,90 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+// PS/2 controller ports and status bits
+#define KEYBOARD_PORT_DATA 0x60
+#define KEYBOARD_PORT_STATUS 0x64
+#define KEYBOARD_STATUS_OUTPUT_FULL 0x01
+#define KEYBOARD_STATUS_INPUT_FULL 0x02
+#define KEYBOARD_STATUS_AUX 0x20
+
+// Keyboard commands and responses
+#define KEYBOARD_CMD_SET_LEDS 0xED
+#define KEYBOARD_CMD_SET_TYPEMATIC 0xF3
+#define KEYBOARD_RESPONSE_ACK 0xFA
+#define KEYBOARD_RESPONSE_RESEND 0xFE
+#define KEYBOARD_RESPONSE_ERROR 0xFF
+
+// Typematic setting: 250ms delay (bits 5-6 = 0), 30 repeats/s (bits 0-4 = 0)
+#define KEYBOARD_TYPEMATIC_RATE 0x00
+
+// Scancodes (set 1)
+#define SCANCODE_RELEASE 0x80
+#define SCANCODE_EXTENDED 0xE0
+#define SCANCODE_PAUSE 0xE1
+#define SCANCODE_PAUSE_LENGTH 5     // Bytes following E1 in the Pause sequence
+
+// Keycodes: set 1 make codes, with E0-prefixed keys moved to 0x80-0xFF
+#define KEYCODE_COUNT 256
+#define KEYCODE_EXTENDED 0x80
+
+// Non-ASCII keys, delivered in key_event_t.key (and by get_char)
+#define KEY_UP 0x80
+#define KEY_DOWN 0x81
+#define KEY_LEFT 0x82
+#define KEY_RIGHT 0x83
+#define KEY_HOME 0x84
+#define KEY_END 0x85
+#define KEY_PAGE_UP 0x86
+#define KEY_PAGE_DOWN 0x87
+#define KEY_INSERT 0x88
+#define KEY_DELETE 0x89
+#define KEY_F1 0x90                 // F1..F12 are consecutive
+#define KEY_F12 0x9B
+#define KEY_ESCAPE 0x1B
+
+// Modifier bits in key_event_t.modifiers
+#define KEY_MOD_SHIFT 0x01
+#define KEY_MOD_CTRL 0x02
+#define KEY_MOD_ALT 0x04
+#define KEY_MOD_SCROLL_LOCK 0x10    // Lock bits match the keyboard LED byte << 4
+#define KEY_MOD_NUM_LOCK 0x20
+#define KEY_MOD_CAPS_LOCK 0x40
+
+// Event flags
+#define KEY_EVENT_REPEAT 0x01       // Typematic repeat of a key already held
+
+// A translated key press
+typedef struct {
+    unsigned char keycode;          // Layout-independent physical key
+    unsigned char key;              // ASCII or KEY_* code, after modifiers
+    unsigned char modifiers;        // KEY_MOD_* state at the time of the press
+    unsigned char flags;            // KEY_EVENT_*
+    unsigned long long tsc;         // When the scancode was read from the controller
+} key_event_t;
+
 // Initialize the keyboard
 void init_keyboard();
 
-// Check if a key is available
+// Check if a key is available for the active console
 int key_available();
 
-// Read a single character (blocking or from buffer, depending on implementation)
+// Read a single character from the active console's input queue
 char get_char();
 
-// Add a key to the buffer (for testing/demo purposes)
+// Read the next key event from the active console's input queue
+int get_key_event(key_event_t* event);
+
+// Add a key to the input queue of the console on screen
 void add_key_to_buffer(char key);
 
-// Poll keyboard for input (for demo purposes)
+// Current modifier and lock state
+unsigned char keyboard_modifiers();
+
+// Poll the keyboard controller for input
 void poll_keyboard();
 
+// Check if the controller holds a byte poll_keyboard hasn't read
+int keyboard_pending();
+
 #endif // KEYBOARD_H
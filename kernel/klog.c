@@ -0,0 +1,205 @@
+#include "klog.h"
+#include "screen.h"
+#include "timer.h"
+#include "serial.h"
+
+// The log ring. Writers claim a sequence number with an atomic increment
+// and publish the record by storing sequence + 1 last, so logging never
+// takes a lock (interrupt handlers may log too). Readers copy a record and
+// re-check its stamp to detect it being overwritten underneath them.
+static klog_record_t klog_ring[KLOG_RING_SIZE];
+static volatile unsigned int klog_head = 0;
+static unsigned int klog_clear_sequence = 0;
+
+// Console sink threshold
+static int console_level = KLOG_DEFAULT_CONSOLE_LEVEL;
+
+// Rate limiter state
+static volatile int rate_tokens = KLOG_RATE_BURST;
+static unsigned int rate_last_refill_ms = 0;
+static volatile unsigned int suppressed = 0;
+static unsigned int suppressed_reported = 0;
+
+static const char* level_names[8] = {
+    "emerg", "alert", "crit", "err", "warn", "notice", "info", "debug"
+};
+
+// Initialize the kernel log
+void init_klog() {
+    klog_head = 0;
+    klog_clear_sequence = 0;
+    console_level = KLOG_DEFAULT_CONSOLE_LEVEL;
+    rate_tokens = KLOG_RATE_BURST;
+    rate_last_refill_ms = get_uptime_ms();
+    suppressed = 0;
+    suppressed_reported = 0;
+}
+
+// Console color for a log level
+static char level_color(int level) {
+    if (level <= KLOG_ERR) return VGA_LIGHT_RED;
+    if (level == KLOG_WARNING) return VGA_LIGHT_YELLOW;
+    if (level == KLOG_NOTICE) return VGA_LIGHT_GREEN;
+    if (level == KLOG_INFO) return VGA_LIGHT_GREY;
+    return VGA_DARK_GREY;
+}
+
+// Take a token from the rate limiter; returns 0 if the message must be dropped
+static int rate_allow(int level) {
+    // Emergencies always get through
+    if (level <= KLOG_CRIT) return 1;
+    
+    unsigned int now = get_uptime_ms();
+    unsigned int elapsed = now - rate_last_refill_ms;
+    if (elapsed >= 1000 / KLOG_RATE_PER_SECOND) {
+        int refill = (int)(elapsed * KLOG_RATE_PER_SECOND / 1000);
+        rate_tokens = rate_tokens + refill > KLOG_RATE_BURST ? KLOG_RATE_BURST : rate_tokens + refill;
+        rate_last_refill_ms = now;
+    }
+    
+    if (rate_tokens <= 0) {
+        __sync_fetch_and_add(&suppressed, 1);
+        return 0;
+    }
+    __sync_fetch_and_sub(&rate_tokens, 1);
+    return 1;
+}
+
+// Append a record made of up to two string parts
+static void klog_write(int level, const char* message, const char* detail) {
+    if (level < KLOG_EMERG) level = KLOG_EMERG;
+    if (level > KLOG_DEBUG) level = KLOG_DEBUG;
+    
+    if (!rate_allow(level)) return;
+    
+    unsigned int seq = __sync_fetch_and_add(&klog_head, 1);
+    klog_record_t* record = &klog_ring[seq & (KLOG_RING_SIZE - 1)];
+    
+    record->sequence = 0;
+    __asm__ __volatile__("" : : : "memory");
+    
+    record->tsc = read_tsc();
+    record->level = level;
+    
+    int len = 0;
+    for (int i = 0; message && message[i] && len < KLOG_MESSAGE_LENGTH - 1; i++) {
+        record->message[len++] = message[i];
+    }
+    for (int i = 0; detail && detail[i] && len < KLOG_MESSAGE_LENGTH - 1; i++) {
+        record->message[len++] = detail[i];
+    }
+    record->message[len] = '\0';
+    
+    __asm__ __volatile__("" : : : "memory");
+    record->sequence = seq + 1;
+    
+    // Console sink
+    if (level <= console_level) {
+        print_string(record->message, level_color(level));
+        print_string("\n", level_color(level));
+        
+        // Mirror to COM1 so a host can capture timings from a headless run
+        if (serial_present()) {
+            serial_write_string(record->message);
+            serial_write_string("\r\n");
+        }
+    }
+}
+
+// Log a message
+void klog(int level, const char* message) {
+    klog_write(level, message, 0);
+}
+
+// Log a message followed by a string detail (e.g. a name)
+void klog_detail(int level, const char* message, const char* detail) {
+    klog_write(level, message, detail);
+}
+
+// Log a message followed by an unsigned decimal value
+void klog_value(int level, const char* message, unsigned int value) {
+    char digits[12];
+    int i = sizeof(digits) - 1;
+    
+    digits[i] = '\0';
+    do {
+        digits[--i] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+    
+    klog_write(level, message, &digits[i]);
+}
+
+// Set the most verbose level echoed to the console
+void klog_set_console_level(int level) {
+    if (level >= KLOG_EMERG && level <= KLOG_DEBUG) {
+        console_level = level;
+    }
+}
+
+// Get the console threshold
+int klog_get_console_level() {
+    return console_level;
+}
+
+// Oldest sequence number still held in the ring (and not cleared)
+unsigned int klog_first_sequence() {
+    unsigned int head = klog_head;
+    unsigned int first = head > KLOG_RING_SIZE ? head - KLOG_RING_SIZE : 0;
+    return first > klog_clear_sequence ? first : klog_clear_sequence;
+}
+
+// Copy the record at *sequence and advance it. Records that were
+// overwritten before we got to them are skipped. Returns 0 at the end.
+int klog_read(unsigned int* sequence, klog_record_t* record) {
+    while (*sequence < klog_head) {
+        unsigned int first = klog_first_sequence();
+        if (*sequence < first) {
+            *sequence = first;
+            continue;
+        }
+        
+        klog_record_t* slot = &klog_ring[*sequence & (KLOG_RING_SIZE - 1)];
+        unsigned int stamp = slot->sequence;
+        
+        // Still being written: nothing more to read yet
+        if (stamp != *sequence + 1) {
+            if (stamp == 0) return 0;
+            (*sequence)++;
+            continue;
+        }
+        
+        *record = *slot;
+        __asm__ __volatile__("" : : : "memory");
+        
+        // Overwritten while we copied it
+        if (slot->sequence != stamp) {
+            (*sequence)++;
+            continue;
+        }
+        
+        (*sequence)++;
+        return 1;
+    }
+    
+    return 0;
+}
+
+// Hide everything logged so far from later reads
+void klog_clear() {
+    klog_clear_sequence = klog_head;
+}
+
+// Number of messages dropped by the rate limiter since the last call
+unsigned int klog_suppressed_count() {
+    unsigned int total = suppressed;
+    unsigned int fresh = total - suppressed_reported;
+    suppressed_reported = total;
+    return fresh;
+}
+
+// Short name of a log level
+const char* klog_level_name(int level) {
+    if (level < KLOG_EMERG || level > KLOG_DEBUG) return "?";
+    return level_names[level];
+}
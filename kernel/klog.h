@@ -0,0 +1,49 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+// Kernel log levels (lower is more severe)
+#define KLOG_EMERG 0
+#define KLOG_ALERT 1
+#define KLOG_CRIT 2
+#define KLOG_ERR 3
+#define KLOG_WARNING 4
+#define KLOG_NOTICE 5
+#define KLOG_INFO 6
+#define KLOG_DEBUG 7
+
+// Log ring configuration
+#define KLOG_RING_SIZE 128                // Records, must be a power of two
+#define KLOG_MESSAGE_LENGTH 96
+#define KLOG_DEFAULT_CONSOLE_LEVEL KLOG_NOTICE
+
+// Rate limiting: token bucket refilled per second
+#define KLOG_RATE_BURST 32
+#define KLOG_RATE_PER_SECOND 16
+
+// Log record. `sequence` holds the record's sequence number + 1 once the
+// writer has finished filling it in (0 or stale while being written).
+typedef struct {
+    volatile unsigned int sequence;
+    unsigned long long tsc;
+    int level;
+    char message[KLOG_MESSAGE_LENGTH];
+} klog_record_t;
+
+// Logging functions
+void init_klog();
+void klog(int level, const char* message);
+void klog_detail(int level, const char* message, const char* detail);
+void klog_value(int level, const char* message, unsigned int value);
+
+// Console sink threshold
+void klog_set_console_level(int level);
+int klog_get_console_level();
+
+// Reading the ring (dmesg)
+unsigned int klog_first_sequence();
+int klog_read(unsigned int* sequence, klog_record_t* record);
+void klog_clear();
+unsigned int klog_suppressed_count();
+const char* klog_level_name(int level);
+
+#endif // KLOG_H
@@ -2,7 +2,33 @@
 #include "network.h"
 #include "json.h"
 #include "screen.h"
-#include <string.h>
+#include "klog.h"
+#include "vfs.h"
+#include "convlog.h"
+
+// Define size_t for kernel environment
+typedef unsigned int size_t;
+
+// String functions, defined elsewhere in the kernel
+int strcmp(const char* s1, const char* s2);
+char* strcpy(char* dest, const char* src);
+char* strncpy(char* dest, const char* src, size_t n);
+size_t strlen(const char* s);
+char* strstr(const char* haystack, const char* needle);
+int snprintf(char* str, size_t size, const char* format, ...);
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+// System message: the initrd's prompt template when there is one, used
+// in place
+static const char* system_prompt() {
+    const char* prompt = (const char*)vfs_map(LANGCHAIN_SYSTEM_PROMPT_PATH, NULL);
+    return prompt ? prompt : LANGCHAIN_DEFAULT_SYSTEM_PROMPT;
+}
 
 // Initialize LangChain session
 void langchain_init(langchain_session_t* session, const char* api_key, int model_type) {
@@ -34,15 +60,14 @@ void langchain_init(langchain_session_t* session, const char* api_key, int model
     
     // Initialize conversation history
     session->history_count = 0;
+    session->logged = 0;
     session->max_tokens = 1000;
     session->temperature = 0.7;
     
     // Add system message
-    langchain_add_message(session, "system", "You are a helpful AI assistant running on ProtoOS, a custom operating system. Keep responses concise and helpful.");
+    langchain_add_message(session, "system", system_prompt());
     
-    print_string("LangChain session initialized with model: ", VGA_LIGHT_GREEN);
-    print_string(session->model_name, VGA_LIGHT_GREEN);
-    print_string("\n", VGA_LIGHT_GREEN);
+    klog_detail(KLOG_INFO, "langchain: session initialized with model ", session->model_name);
 }
 
 // Add a message to conversation history
@@ -67,6 +92,12 @@ int langchain_add_message(langchain_session_t* session, const char* role, const
     session->history[idx].timestamp = get_timestamp();
     session->history_count++;
     
+    // The system message is re-added on every start, so only the turns
+    // themselves are logged
+    if (session->logged && strcmp(role, "system") != 0) {
+        convlog_append(&session->history[idx]);
+    }
+    
     return 1;
 }
 
@@ -75,13 +106,27 @@ int langchain_clear_history(langchain_session_t* session) {
     if (!session) return 0;
     
     session->history_count = 0;
+    if (session->logged) convlog_append_clear();
     
     // Re-add system message
-    langchain_add_message(session, "system", "You are a helpful AI assistant running on ProtoOS, a custom operating system. Keep responses concise and helpful.");
+    langchain_add_message(session, "system", system_prompt());
     
     return 1;
 }
 
+// Continue the conversation kept in the conversation log: reload its last
+// turns after the system message and log new ones from now on. Returns
+// the number of messages restored.
+int langchain_attach_log(langchain_session_t* session) {
+    if (!session || !convlog_ready()) return 0;
+    
+    int restored = convlog_restore(&session->history[session->history_count],
+                                   MAX_CONVERSATION_HISTORY - session->history_count);
+    session->history_count += restored;
+    session->logged = 1;
+    return restored;
+}
+
 // Set AI model
 int langchain_set_model(langchain_session_t* session, int model_type, const char* model_name) {
     if (!session) return 0;
@@ -157,6 +202,31 @@ int langchain_chat(langchain_session_t* session, const char* prompt, char* respo
     return success;
 }
 
+// Chat with the response delivered incrementally through `on_chunk`. The
+// full response is still assembled in `response` for the history. The
+// simulated backends complete synchronously, so their output is handed
+// over in LANGCHAIN_STREAM_CHUNK pieces; a network backend would invoke
+// the callback per received chunk instead.
+int langchain_chat_stream(langchain_session_t* session, const char* prompt, char* response, int max_response_size,
+                          langchain_chunk_callback_t on_chunk, void* context) {
+    if (!langchain_chat(session, prompt, response, max_response_size)) {
+        return 0;
+    }
+    
+    if (on_chunk) {
+        int length = strlen(response);
+        for (int offset = 0; offset < length; offset += LANGCHAIN_STREAM_CHUNK) {
+            int chunk = length - offset;
+            if (chunk > LANGCHAIN_STREAM_CHUNK) {
+                chunk = LANGCHAIN_STREAM_CHUNK;
+            }
+            on_chunk(response + offset, chunk, context);
+        }
+    }
+    
+    return 1;
+}
+
 // OpenAI chat completion
 int openai_chat_completion(langchain_session_t* session, const char* prompt, char* response, int max_response_size) {
     // Create OpenAI API request
@@ -170,7 +240,6 @@ int openai_chat_completion(langchain_session_t* session, const char* prompt, cha
         session->model_name, formatted_prompt, session->max_tokens, session->temperature);
     
     // Make HTTP request to OpenAI API
-    char http_response[8192];
     char api_url[256];
     snprintf(api_url, sizeof(api_url), "https://api.openai.com/v1/chat/completions");
     
@@ -219,7 +288,6 @@ int gemini_chat_completion(langchain_session_t* session, const char* prompt, cha
         formatted_prompt, session->temperature, session->max_tokens);
     
     // Make HTTP request to Gemini API
-    char http_response[8192];
     char api_url[256];
     snprintf(api_url, sizeof(api_url), "https://generativelanguage.googleapis.com/v1beta/models/gemini-pro:generateContent?key=%s", session->api_key);
     
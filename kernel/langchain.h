@@ -6,6 +6,9 @@
 #define MAX_RESPONSE_LENGTH 2048
 #define MAX_CONVERSATION_HISTORY 10
 #define MAX_API_KEY_LENGTH 128
+#define LANGCHAIN_STREAM_CHUNK 16   // Bytes per streamed response chunk
+#define LANGCHAIN_SYSTEM_PROMPT_PATH "/initrd/prompts/system.txt"
+#define LANGCHAIN_DEFAULT_SYSTEM_PROMPT "You are a helpful AI assistant running on ProtoOS, a custom operating system. Keep responses concise and helpful."
 
 // AI model types
 #define MODEL_OPENAI_GPT 0
@@ -27,15 +30,22 @@ typedef struct {
     char model_name[64];
     conversation_message_t history[MAX_CONVERSATION_HISTORY];
     int history_count;
+    int logged;           // Messages are appended to the conversation log
     int max_tokens;
     float temperature;
 } langchain_session_t;
 
+// Called with each piece of a streamed response as it arrives
+typedef void (*langchain_chunk_callback_t)(const char* chunk, int length, void* context);
+
 // LangChain functions
 void langchain_init(langchain_session_t* session, const char* api_key, int model_type);
 int langchain_chat(langchain_session_t* session, const char* prompt, char* response, int max_response_size);
+int langchain_chat_stream(langchain_session_t* session, const char* prompt, char* response, int max_response_size,
+                          langchain_chunk_callback_t on_chunk, void* context);
 int langchain_add_message(langchain_session_t* session, const char* role, const char* content);
 int langchain_clear_history(langchain_session_t* session);
+int langchain_attach_log(langchain_session_t* session);
 int langchain_set_model(langchain_session_t* session, int model_type, const char* model_name);
 
 // AI API specific functions
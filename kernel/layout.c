@@ -0,0 +1,93 @@
+#include "layout.h"
+#include "screen.h"
+
+// Start a new line at the layout's indent
+static void layout_newline(text_layout_t* layout) {
+    print_char('\n', layout->color);
+    for (int i = 0; i < layout->indent; i++) {
+        print_char(' ', layout->color);
+    }
+    layout->column = layout->indent;
+}
+
+// The partial word overflowed the line: blank it out and redraw it on the
+// next line. Words that would not fit even on an empty line stay where they
+// are and are hard-broken instead.
+static int layout_reflow(text_layout_t* layout) {
+    if (layout->word_length == 0 ||
+        layout->word_length >= layout->width - layout->indent) {
+        return 0;
+    }
+
+    for (int i = 0; i < layout->word_length; i++) {
+        print_char('\b', layout->color);
+    }
+    for (int i = 0; i < layout->word_length; i++) {
+        print_char(' ', layout->color);
+    }
+
+    layout_newline(layout);
+    for (int i = 0; i < layout->word_length; i++) {
+        print_char(layout->word[i], layout->color);
+    }
+    layout->column += layout->word_length;
+    return 1;
+}
+
+// Begin laying out text. `start_column` is where the cursor already is
+// (e.g. after a "AI: " label); continuation lines start at `indent`.
+void layout_begin(text_layout_t* layout, int start_column, int indent, char color) {
+    // Keep the last screen column free so the console's own line wrap never
+    // moves the cursor behind the layout's back
+    layout->width = VGA_WIDTH - 1;
+    layout->indent = indent < layout->width / 2 ? indent : 0;
+    layout->column = start_column;
+    layout->color = color;
+    layout->word_length = 0;
+}
+
+// Lay out a chunk of text. Chunks may split words anywhere; every character
+// is drawn immediately and the screen is flushed before returning.
+void layout_write(text_layout_t* layout, const char* text, int length) {
+    for (int i = 0; i < length && text[i] != '\0'; i++) {
+        char c = text[i];
+
+        if (c == '\n') {
+            layout->word_length = 0;
+            layout_newline(layout);
+            continue;
+        }
+
+        if (c == ' ' || c == '\t' || c == '\r') {
+            layout->word_length = 0;
+            // Spaces at a line break are dropped rather than carried over
+            if (layout->column >= layout->width) {
+                layout_newline(layout);
+            } else if (layout->column > layout->indent) {
+                print_char(' ', layout->color);
+                layout->column++;
+            }
+            continue;
+        }
+
+        if (layout->column >= layout->width && !layout_reflow(layout)) {
+            // Hard break inside a word longer than a whole line
+            layout->word_length = 0;
+            layout_newline(layout);
+        }
+
+        print_char(c, layout->color);
+        layout->word[layout->word_length++] = c;
+        layout->column++;
+    }
+
+    screen_flush();
+}
+
+// Finish the layout, ending the current line
+void layout_end(text_layout_t* layout) {
+    print_char('\n', layout->color);
+    layout->column = 0;
+    layout->word_length = 0;
+    screen_flush();
+}
@@ -0,0 +1,26 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "screen.h"
+
+// Streaming text layout configuration
+#define LAYOUT_MAX_WORD SCREEN_MAX_WIDTH
+
+// Incremental word-wrap state. Text is fed in arbitrary chunks; characters
+// are drawn as soon as they arrive and a word that turns out not to fit is
+// erased and redrawn at the start of the next line.
+typedef struct {
+    int indent;                     // Column continuation lines start at
+    int width;                      // Usable columns per line
+    int column;                     // Current output column
+    char color;
+    char word[LAYOUT_MAX_WORD];     // Partial word already drawn on this line
+    int word_length;
+} text_layout_t;
+
+// Layout functions
+void layout_begin(text_layout_t* layout, int start_column, int indent, char color);
+void layout_write(text_layout_t* layout, const char* text, int length);
+void layout_end(text_layout_t* layout);
+
+#endif // LAYOUT_H
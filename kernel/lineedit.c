@@ -0,0 +1,434 @@
+#include "lineedit.h"
+#include "keyboard.h"
+#include "screen.h"
+
+#define LINE_COLOR VGA_LIGHT_WHITE
+#define SEARCH_COLOR VGA_LIGHT_CYAN
+
+// Completion trie: first-child/next-sibling nodes in a static pool, with
+// siblings kept in sorted order. A node that ends a command may own a
+// second trie (next_word) holding that command's subcommands.
+typedef struct {
+    char c;
+    char terminal;
+    short child;
+    short sibling;
+    short next_word;
+} trie_node_t;
+
+static trie_node_t trie_nodes[COMPLETION_MAX_NODES];
+static int trie_node_count = 0;
+
+// Allocate a node; node 0 is always the command trie's root
+static int trie_alloc(char c) {
+    if (trie_node_count >= COMPLETION_MAX_NODES) return -1;
+    
+    trie_node_t* node = &trie_nodes[trie_node_count];
+    node->c = c;
+    node->terminal = 0;
+    node->child = -1;
+    node->sibling = -1;
+    node->next_word = -1;
+    return trie_node_count++;
+}
+
+// Find (or with `create`, insert) the child of `parent` for character c
+static int trie_child(int parent, char c, int create) {
+    short* link = &trie_nodes[parent].child;
+    
+    while (*link >= 0 && trie_nodes[*link].c < c) {
+        link = &trie_nodes[*link].sibling;
+    }
+    if (*link >= 0 && trie_nodes[*link].c == c) {
+        return *link;
+    }
+    if (!create) return -1;
+    
+    int node = trie_alloc(c);
+    if (node < 0) return -1;
+    trie_nodes[node].sibling = *link;
+    *link = node;
+    return node;
+}
+
+// Walk `length` characters of `word` from `root`, returning the last node
+static int trie_walk(int root, const char* word, int length, int create) {
+    int node = root;
+    for (int i = 0; i < length && node >= 0; i++) {
+        node = trie_child(node, word[i], create);
+    }
+    return node;
+}
+
+static int word_length(const char* word) {
+    int length = 0;
+    while (word[length] && length < COMPLETION_MAX_WORD - 1) length++;
+    return length;
+}
+
+// Add a completion candidate
+int lineedit_add_completion(const char* command, const char* subcommand) {
+    if (trie_node_count == 0 && trie_alloc(0) < 0) return 0;
+    
+    int node = trie_walk(0, command, word_length(command), 1);
+    if (node < 0) return 0;
+    trie_nodes[node].terminal = 1;
+    
+    if (subcommand) {
+        if (trie_nodes[node].next_word < 0) {
+            int root = trie_alloc(0);
+            if (root < 0) return 0;
+            trie_nodes[node].next_word = root;
+        }
+        node = trie_walk(trie_nodes[node].next_word, subcommand, word_length(subcommand), 1);
+        if (node < 0) return 0;
+        trie_nodes[node].terminal = 1;
+    }
+    
+    return 1;
+}
+
+// Print every word below `node`, `prefix` holding the characters so far
+static void trie_list(int node, char* prefix, int depth) {
+    if (trie_nodes[node].terminal) {
+        prefix[depth] = '\0';
+        print_string(prefix, VGA_LIGHT_YELLOW);
+        print_string("  ", VGA_LIGHT_GREY);
+    }
+    
+    if (depth >= COMPLETION_MAX_WORD - 1) return;
+    for (int child = trie_nodes[node].child; child >= 0; child = trie_nodes[child].sibling) {
+        prefix[depth] = trie_nodes[child].c;
+        trie_list(child, prefix, depth + 1);
+    }
+}
+
+// Bring the screen in line with `text`, rewriting only from the first
+// character that differs from what is shown, then place the cursor
+static void refresh(line_editor_t* editor, const char* text, int length, int cursor, char color) {
+    int common = 0;
+    while (common < length && common < editor->shown_length && text[common] == editor->shown[common]) {
+        common++;
+    }
+    
+    int position = editor->shown_cursor;
+    if (common < length || common < editor->shown_length) {
+        // Back up (or step forward over unchanged text) to the divergence point
+        while (position > common) {
+            print_char('\b', color);
+            position--;
+        }
+        while (position < common) {
+            print_char(editor->shown[position++], color);
+        }
+        
+        for (int i = common; i < length; i++) {
+            print_char(text[i], color);
+            editor->shown[i] = text[i];
+        }
+        position = length;
+        
+        // Blank out whatever the old text had beyond the new end
+        while (position < editor->shown_length) {
+            print_char(' ', VGA_LIGHT_GREY);
+            position++;
+        }
+        editor->shown_length = length;
+    }
+    
+    while (position > cursor) {
+        print_char('\b', color);
+        position--;
+    }
+    while (position < cursor) {
+        print_char(editor->shown[position++], color);
+    }
+    editor->shown_cursor = cursor;
+}
+
+static void refresh_line(line_editor_t* editor) {
+    refresh(editor, editor->buffer, editor->length, editor->cursor, LINE_COLOR);
+}
+
+static void set_line(line_editor_t* editor, const char* text) {
+    int length = 0;
+    while (text[length] && length < LINEEDIT_MAX_LENGTH - 1) {
+        editor->buffer[length] = text[length];
+        length++;
+    }
+    editor->buffer[length] = '\0';
+    editor->length = length;
+    editor->cursor = length;
+}
+
+// Stash the line being typed before history replaces it
+static void save_fresh_line(line_editor_t* editor) {
+    if (editor->history_age != 0) return;
+    for (int i = 0; i <= editor->length; i++) {
+        editor->saved[i] = editor->buffer[i];
+    }
+}
+
+// Does `haystack` contain the current search string?
+static int search_matches(line_editor_t* editor, const char* haystack) {
+    for (int i = 0; haystack[i]; i++) {
+        int j = 0;
+        while (j < editor->search_length && haystack[i + j] == editor->search[j]) j++;
+        if (j == editor->search_length) return 1;
+    }
+    return editor->search_length == 0;
+}
+
+// Find the most recent entry no newer than `age` matching the search
+static void search_from(line_editor_t* editor, int age) {
+    if (editor->find) {
+        char pattern[LINEEDIT_SEARCH_LENGTH + 1];
+        for (int i = 0; i < editor->search_length; i++) pattern[i] = editor->search[i];
+        pattern[editor->search_length] = '\0';
+        
+        int match = editor->find(pattern, age);
+        if (match >= 0) editor->search_age = match;
+        return;
+    }
+    
+    const char* entry;
+    for (; (entry = editor->history(age)) != 0; age++) {
+        if (search_matches(editor, entry)) {
+            editor->search_age = age;
+            return;
+        }
+    }
+}
+
+// Draw the search status in place of the line
+static void refresh_search(line_editor_t* editor) {
+    char status[LINEEDIT_MAX_LENGTH];
+    const char* label = "(search)'";
+    int length = 0;
+    
+    for (int i = 0; label[i]; i++) status[length++] = label[i];
+    for (int i = 0; i < editor->search_length; i++) status[length++] = editor->search[i];
+    status[length++] = '\'';
+    status[length++] = ':';
+    status[length++] = ' ';
+    
+    int cursor = length;
+    const char* match = editor->search_age >= 0 ? editor->history(editor->search_age) : "";
+    while (*match && length < LINEEDIT_MAX_LENGTH - 1) status[length++] = *match++;
+    
+    refresh(editor, status, length, cursor, SEARCH_COLOR);
+}
+
+// Leave search mode, optionally taking the match as the line
+static void end_search(line_editor_t* editor, int accept) {
+    editor->searching = 0;
+    if (accept && editor->search_age >= 0) {
+        set_line(editor, editor->history(editor->search_age));
+        editor->history_age = editor->search_age + 1;
+    }
+    refresh_line(editor);
+}
+
+// Handle a key while searching. Returns 1 if the key should also be
+// processed as a normal editing key.
+static int search_key(line_editor_t* editor, unsigned char key) {
+    if (key == LINEEDIT_CTRL_R) {
+        if (editor->search_age >= 0) {
+            search_from(editor, editor->search_age + 1);
+        }
+    } else if (key == '\b') {
+        if (editor->search_length > 0) {
+            editor->search_length--;
+            editor->search_age = -1;
+            search_from(editor, 0);
+        }
+    } else if (key == LINEEDIT_CTRL_G || key == KEY_ESCAPE) {
+        end_search(editor, 0);
+        return 0;
+    } else if (key >= 32 && key < 127) {
+        if (editor->search_length < LINEEDIT_SEARCH_LENGTH) {
+            editor->search[editor->search_length++] = key;
+            search_from(editor, editor->search_age >= 0 ? editor->search_age : 0);
+        }
+    } else {
+        // Any other key accepts the match and then acts on it
+        end_search(editor, 1);
+        return 1;
+    }
+    
+    refresh_search(editor);
+    return 0;
+}
+
+// Complete the word before the cursor from the trie
+static void complete(line_editor_t* editor) {
+    if (trie_node_count == 0) return;
+    
+    // Locate the word being completed and which word of the line it is
+    int start = editor->cursor;
+    while (start > 0 && editor->buffer[start - 1] != ' ') start--;
+    
+    int root = 0;
+    int first = 0;
+    while (first < start && editor->buffer[first] == ' ') first++;
+    if (first < start) {
+        // Second word: complete against the command's subcommands
+        int end = first;
+        while (editor->buffer[end] != ' ') end++;
+        int node = trie_walk(0, editor->buffer + first, end - first, 0);
+        
+        for (int i = end; i < start; i++) {
+            if (editor->buffer[i] != ' ') return; // Third word or later
+        }
+        if (node < 0 || !trie_nodes[node].terminal || trie_nodes[node].next_word < 0) return;
+        root = trie_nodes[node].next_word;
+    }
+    
+    int node = trie_walk(root, editor->buffer + start, editor->cursor - start, 0);
+    if (node < 0) return;
+    
+    // Extend while the choice is forced
+    char extension[COMPLETION_MAX_WORD + 1];
+    int added = 0;
+    while (!trie_nodes[node].terminal && trie_nodes[node].child >= 0 &&
+           trie_nodes[trie_nodes[node].child].sibling < 0 && added < COMPLETION_MAX_WORD) {
+        node = trie_nodes[node].child;
+        extension[added++] = trie_nodes[node].c;
+    }
+    if (trie_nodes[node].terminal && trie_nodes[node].child < 0) {
+        extension[added++] = ' ';
+    }
+    
+    if (added > 0) {
+        if (editor->length + added >= LINEEDIT_MAX_LENGTH) return;
+        for (int i = editor->length; i >= editor->cursor; i--) {
+            editor->buffer[i + added] = editor->buffer[i];
+        }
+        for (int i = 0; i < added; i++) {
+            editor->buffer[editor->cursor++] = extension[i];
+        }
+        editor->length += added;
+        refresh_line(editor);
+        return;
+    }
+    
+    // Ambiguous: list the candidates and redraw the line below them
+    char word[COMPLETION_MAX_WORD];
+    int depth = editor->cursor - start;
+    if (depth >= COMPLETION_MAX_WORD) return;
+    for (int i = 0; i < depth; i++) word[i] = editor->buffer[start + i];
+    
+    print_char('\n', VGA_LIGHT_GREY);
+    trie_list(node, word, depth);
+    print_char('\n', VGA_LIGHT_GREY);
+    
+    lineedit_reset(editor);
+    editor->print_prompt();
+    refresh_line(editor);
+}
+
+// Initialize an editor
+void lineedit_init(line_editor_t* editor, void (*print_prompt)(void), lineedit_history_fn history,
+                   lineedit_search_fn find) {
+    editor->print_prompt = print_prompt;
+    editor->history = history;
+    editor->find = find;
+    editor->length = 0;
+    editor->cursor = 0;
+    editor->buffer[0] = '\0';
+    lineedit_reset(editor);
+}
+
+// Forget what is on screen (a fresh prompt was just printed). The line
+// buffer itself is kept.
+void lineedit_reset(line_editor_t* editor) {
+    editor->shown_length = 0;
+    editor->shown_cursor = 0;
+    editor->history_age = 0;
+    editor->searching = 0;
+}
+
+// Feed one key to the editor. Returns 1 when Enter completes the line,
+// which is then in editor->buffer.
+int lineedit_key(line_editor_t* editor, unsigned char key) {
+    if (editor->searching && !search_key(editor, key)) {
+        return 0;
+    }
+    
+    if (key == '\n' || key == '\r') {
+        editor->cursor = editor->length;
+        refresh_line(editor);
+        return 1;
+    }
+    
+    switch (key) {
+        case '\b':
+            // Step back, then delete the character now under the cursor
+            if (editor->cursor == 0) break;
+            editor->cursor--;
+            // Fall through
+        case KEY_DELETE:
+            if (editor->cursor >= editor->length) break;
+            for (int i = editor->cursor; i < editor->length; i++) {
+                editor->buffer[i] = editor->buffer[i + 1];
+            }
+            editor->length--;
+            break;
+        case KEY_LEFT:
+            if (editor->cursor > 0) editor->cursor--;
+            break;
+        case KEY_RIGHT:
+            if (editor->cursor < editor->length) editor->cursor++;
+            break;
+        case KEY_HOME:
+        case LINEEDIT_CTRL_A:
+            editor->cursor = 0;
+            break;
+        case KEY_END:
+        case LINEEDIT_CTRL_E:
+            editor->cursor = editor->length;
+            break;
+        case KEY_UP:
+            if (!editor->history(editor->history_age)) break;
+            save_fresh_line(editor);
+            set_line(editor, editor->history(editor->history_age++));
+            break;
+        case KEY_DOWN:
+            if (editor->history_age == 0) break;
+            editor->history_age--;
+            set_line(editor, editor->history_age == 0 ? editor->saved : editor->history(editor->history_age - 1));
+            break;
+        case '\t':
+            complete(editor);
+            return 0;
+        case LINEEDIT_CTRL_R:
+            save_fresh_line(editor);
+            editor->searching = 1;
+            editor->search_length = 0;
+            editor->search_age = -1;
+            search_from(editor, 0);
+            refresh_search(editor);
+            return 0;
+        case LINEEDIT_CTRL_C:
+            editor->cursor = editor->length;
+            refresh_line(editor);
+            print_string("^C\n", VGA_LIGHT_GREY);
+            editor->length = 0;
+            editor->cursor = 0;
+            editor->buffer[0] = '\0';
+            lineedit_reset(editor);
+            editor->print_prompt();
+            return 0;
+        default:
+            if (key < 32 || key >= 127 || editor->length >= LINEEDIT_MAX_LENGTH - 1) break;
+            for (int i = editor->length; i >= editor->cursor; i--) {
+                editor->buffer[i + 1] = editor->buffer[i];
+            }
+            editor->buffer[editor->cursor++] = key;
+            editor->length++;
+            break;
+    }
+    
+    refresh_line(editor);
+    return 0;
+}
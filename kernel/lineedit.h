@@ -0,0 +1,58 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+// Line editor configuration
+#define LINEEDIT_MAX_LENGTH 256
+#define LINEEDIT_SEARCH_LENGTH 64
+#define COMPLETION_MAX_NODES 1024
+#define COMPLETION_MAX_WORD 32
+
+// Control keys understood by the editor
+#define LINEEDIT_CTRL_A 0x01        // Start of line
+#define LINEEDIT_CTRL_C 0x03        // Abandon line
+#define LINEEDIT_CTRL_E 0x05        // End of line
+#define LINEEDIT_CTRL_G 0x07        // Leave search, keep the original line
+#define LINEEDIT_CTRL_R 0x12        // Reverse incremental history search
+
+// Supplies history entries: age 0 is the most recent, NULL past the end
+typedef const char* (*lineedit_history_fn)(int age);
+
+// Age of the most recent entry no newer than `from_age` containing
+// `pattern`, or -1. Optional; without it search scans the entries.
+typedef int (*lineedit_search_fn)(const char* pattern, int from_age);
+
+// Editor state for one command line. `shown` mirrors what is currently on
+// screen after the prompt so each edit only redraws what changed.
+typedef struct {
+    char buffer[LINEEDIT_MAX_LENGTH];
+    int length;
+    int cursor;
+    
+    char shown[LINEEDIT_MAX_LENGTH];
+    int shown_length;
+    int shown_cursor;
+    
+    int history_age;                        // 0 while editing a fresh line
+    char saved[LINEEDIT_MAX_LENGTH];        // Fresh line stashed during recall
+    
+    int searching;
+    char search[LINEEDIT_SEARCH_LENGTH];
+    int search_length;
+    int search_age;                         // Age of the current match, -1 if none
+    
+    void (*print_prompt)(void);
+    lineedit_history_fn history;
+    lineedit_search_fn find;
+} line_editor_t;
+
+// Line editor functions
+void lineedit_init(line_editor_t* editor, void (*print_prompt)(void), lineedit_history_fn history,
+                   lineedit_search_fn find);
+void lineedit_reset(line_editor_t* editor);
+int lineedit_key(line_editor_t* editor, unsigned char key);
+
+// Tab completion. `subcommand` NULL adds a command name, otherwise a
+// second word completed after `command`.
+int lineedit_add_completion(const char* command, const char* subcommand);
+
+#endif // LINEEDIT_H
@@ -0,0 +1,54 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+// Physical memory layout shared by the bootloader and the kernel.
+// Addresses below 1MB are real-mode memory handed over at boot; large
+// kernel pools live above 1MB (A20 is enabled by the bootloader).
+
+// Boot information left by the bootloader (see boot/bootloader.asm)
+#define BOOT_INFO_ADDR 0x0500             // Magic dword, set when a VBE mode is active
+#define BOOT_VBE_MAGIC 0x21454256         // "VBE!"
+#define BOOT_VBE_MODE_INFO_ADDR 0x0600    // VBE ModeInfoBlock (256 bytes)
+#define BOOT_FONT_ADDR 0x90000            // VGA BIOS 8x16 font (256 glyphs, 4KB)
+
+// Low memory loaded by the bootloader. The kernel image and its .bss must
+// end below KERNEL_LIMIT (checked by linker.ld); the boot stack grows down
+// from the font.
+#define KERNEL_BASE 0x10000
+#define KERNEL_LIMIT 0x70000
+#define INITRD_BASE 0x70000               // Initial ramdisk archive (see initrd.h)
+#define INITRD_MAX_SIZE 0x10000
+#define BOOT_STACK_TOP 0x90000
+
+// Kernel memory pools above 1MB
+#define GLYPH_CACHE_BASE 0x00100000       // Framebuffer console glyph cache
+#define GLYPH_CACHE_SIZE 0x00200000
+#define CONSOLE_SHADOW_BASE 0x00300000    // Framebuffer console cell buffers
+#define CONSOLE_SHADOW_SIZE 0x00020000
+#define JOB_STACK_BASE 0x00320000         // One stack per shell job slot
+#define JOB_STACK_SIZE 0x00008000
+#define CAPTURE_BASE 0x00360000           // Captured command output (pager)
+#define CAPTURE_SIZE 0x00080000
+#define HISTORY_BASE 0x003E0000           // Shell history ring, index and save image
+#define HISTORY_SIZE 0x00030000
+#define DISK_BUFFER_BASE 0x00410000       // Disk benchmark transfers (64KB aligned)
+#define DISK_BUFFER_SIZE 0x00020000
+#define VIRTIO_QUEUE_BASE 0x00430000      // virtio-blk ring (page aligned)
+#define VIRTIO_QUEUE_SIZE 0x00008000
+#define FAT_CACHE_BASE 0x00438000         // FAT table of the mounted volume
+#define FAT_CACHE_SIZE 0x00020000
+#define BCACHE_BASE 0x00458000            // Block buffer cache slab (4KB buffers)
+#define BCACHE_SIZE 0x00100000
+#define RAMFS_BASE 0x00558000             // ramfs file pages
+#define RAMFS_SIZE 0x00100000
+#define PAGE_TABLES_BASE 0x00658000       // Page directory, then the mmap window's tables
+#define PAGE_TABLES_SIZE 0x00011000
+#define PAGE_CACHE_BASE 0x00670000        // Page cache frames behind file mappings
+#define PAGE_CACHE_SIZE 0x00200000
+
+// Virtual addresses. Everything else is identity mapped; this window,
+// above any RAM and below the PCI hole, holds memory-mapped files.
+#define MMAP_WINDOW_BASE 0x40000000
+#define MMAP_WINDOW_SIZE 0x04000000
+
+#endif // MEMORY_H
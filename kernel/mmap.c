@@ -0,0 +1,386 @@
+#include "mmap.h"
+#include "paging.h"
+#include "memory.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+#define MMAP_PAGES (PAGE_CACHE_SIZE / PAGE_SIZE)
+#define MMAP_NONE -1
+
+// Cached file page. Frames live in the PAGE_CACHE pool, one per entry.
+typedef struct {
+    int mount;
+    unsigned int id;
+    unsigned int index;                 // Page of the file
+    short next;                         // Hash chain
+    unsigned char valid;
+    unsigned char referenced;           // CLOCK bit, set when read in
+    unsigned int maps;                  // Page table entries pointing at the frame
+} mmap_page_t;
+
+// A file range mapped at `base`. Holds the file open for page-ins.
+typedef struct {
+    int in_use;
+    int fd;
+    vfs_node_t node;
+    unsigned int base;
+    unsigned int pages;
+    unsigned int first_index;           // File page mapped at base
+    int advice;
+    unsigned int next_fault;            // Page a sequential reader faults on next
+    unsigned int window;                // Current read-ahead in pages
+} mmap_mapping_t;
+
+static char* const frames = (char*)PAGE_CACHE_BASE;
+static mmap_page_t pages[MMAP_PAGES];
+static short buckets[MMAP_HASH_SIZE];
+static mmap_mapping_t mappings[MMAP_MAX_MAPPINGS];
+static int hand = 0;
+static int ready = 0;
+static mmap_stats_t stats;
+
+static char* frame_of(int slot) {
+    return frames + slot * PAGE_SIZE;
+}
+
+static int slot_of(unsigned int pte) {
+    return ((pte & PAGE_FRAME_MASK) - PAGE_CACHE_BASE) / PAGE_SIZE;
+}
+
+static unsigned int bucket_of(int mount, unsigned int id, unsigned int index) {
+    unsigned int hash = (index * 0x9E3779B9u) ^ (id * 0x85EBCA6Bu) ^ mount;
+    return (hash ^ (hash >> 16)) & (MMAP_HASH_SIZE - 1);
+}
+
+static int find(int mount, unsigned int id, unsigned int index) {
+    for (int slot = buckets[bucket_of(mount, id, index)]; slot != MMAP_NONE; slot = pages[slot].next) {
+        mmap_page_t* page = &pages[slot];
+        if (page->mount == mount && page->id == id && page->index == index) return slot;
+    }
+    return MMAP_NONE;
+}
+
+static void unhash(int slot) {
+    mmap_page_t* page = &pages[slot];
+    short* link = &buckets[bucket_of(page->mount, page->id, page->index)];
+    while (*link != slot) link = &pages[*link].next;
+    *link = page->next;
+}
+
+// Page table entry of `mapping` that would map the cached page `slot`,
+// or NULL if the page lies outside the mapping
+static unsigned int* entry_for(mmap_mapping_t* mapping, int slot) {
+    const mmap_page_t* page = &pages[slot];
+    if (!mapping->in_use || mapping->node.mount != page->mount || mapping->node.id != page->id ||
+        page->index - mapping->first_index >= mapping->pages) {
+        return NULL;
+    }
+    return paging_pte(mapping->base + (page->index - mapping->first_index) * PAGE_SIZE);
+}
+
+// CLOCK test: used since the last sweep, through any mapping or by a fill
+static int referenced(int slot) {
+    int used = pages[slot].referenced;
+    pages[slot].referenced = 0;
+    
+    for (int m = 0; m < MMAP_MAX_MAPPINGS && pages[slot].maps; m++) {
+        unsigned int* pte = entry_for(&mappings[m], slot);
+        if (pte && (*pte & PAGE_PRESENT) && (*pte & PAGE_ACCESSED)) {
+            *pte &= ~PAGE_ACCESSED;
+            paging_invalidate(mappings[m].base + (pages[slot].index - mappings[m].first_index) * PAGE_SIZE);
+            used = 1;
+        }
+    }
+    return used;
+}
+
+// Drop a cached page, unmapping it wherever it is mapped
+static void evict(int slot) {
+    for (int m = 0; m < MMAP_MAX_MAPPINGS && pages[slot].maps; m++) {
+        unsigned int* pte = entry_for(&mappings[m], slot);
+        if (pte && (*pte & PAGE_PRESENT)) {
+            *pte = 0;
+            paging_invalidate(mappings[m].base + (pages[slot].index - mappings[m].first_index) * PAGE_SIZE);
+            pages[slot].maps--;
+        }
+    }
+    unhash(slot);
+    pages[slot].valid = 0;
+    stats.cached--;
+}
+
+// A free frame, or one reclaimed by CLOCK
+static int allocate() {
+    for (int i = 0; i < 2 * MMAP_PAGES; i++) {
+        int slot = hand;
+        hand = (hand + 1) % MMAP_PAGES;
+        
+        if (!pages[slot].valid) return slot;
+        if (referenced(slot)) continue;
+        
+        evict(slot);
+        stats.evictions++;
+        return slot;
+    }
+    return MMAP_NONE;
+}
+
+// Read page `index` of the mapped file into the cache
+static int load(mmap_mapping_t* mapping, unsigned int index) {
+    int slot = allocate();
+    if (slot == MMAP_NONE) return MMAP_NONE;
+    
+    char* data = frame_of(slot);
+    unsigned int done = 0;
+    if (vfs_seek(mapping->fd, index * PAGE_SIZE) < 0) return MMAP_NONE;
+    while (done < PAGE_SIZE) {
+        int length = vfs_read(mapping->fd, data + done, PAGE_SIZE - done);
+        if (length < 0) return MMAP_NONE;
+        if (length == 0) break;
+        done += length;
+    }
+    while (done < PAGE_SIZE) data[done++] = 0;
+    
+    mmap_page_t* page = &pages[slot];
+    page->mount = mapping->node.mount;
+    page->id = mapping->node.id;
+    page->index = index;
+    page->valid = 1;
+    page->referenced = 1;
+    page->maps = 0;
+    
+    unsigned int bucket = bucket_of(page->mount, page->id, index);
+    page->next = buckets[bucket];
+    buckets[bucket] = slot;
+    stats.cached++;
+    return slot;
+}
+
+// Map page `page` of a mapping, reading it in if it isn't cached
+static int map_page(mmap_mapping_t* mapping, unsigned int page, int readahead) {
+    unsigned int* pte = paging_pte(mapping->base + page * PAGE_SIZE);
+    if (*pte & PAGE_PRESENT) return 0;
+    
+    unsigned int index = mapping->first_index + page;
+    int slot = find(mapping->node.mount, mapping->node.id, index);
+    if (slot == MMAP_NONE) {
+        slot = load(mapping, index);
+        if (slot == MMAP_NONE) return -1;
+        if (readahead) {
+            stats.readahead_pages++;
+        } else {
+            stats.major_faults++;
+        }
+    } else if (!readahead) {
+        stats.minor_faults++;
+    }
+    
+    // Read-only; a missing page needs no TLB flush
+    *pte = (unsigned int)frame_of(slot) | PAGE_PRESENT;
+    pages[slot].maps++;
+    return 0;
+}
+
+static mmap_mapping_t* mapping_at(unsigned int address) {
+    for (int m = 0; m < MMAP_MAX_MAPPINGS; m++) {
+        mmap_mapping_t* mapping = &mappings[m];
+        if (mapping->in_use && address - mapping->base < mapping->pages * PAGE_SIZE) return mapping;
+    }
+    return NULL;
+}
+
+// Page fault in the mmap window: map the page, then read ahead of it when
+// the mapping is read in order
+static int handle_fault(unsigned int address, unsigned int error) {
+    mmap_mapping_t* mapping = mapping_at(address);
+    if (!mapping || (error & PAGE_FAULT_WRITE)) return 0;
+    
+    unsigned int page = (address - mapping->base) / PAGE_SIZE;
+    if (map_page(mapping, page, 0) < 0) {
+        klog_value(KLOG_ERR, "mmap: cannot read file page ", mapping->first_index + page);
+        return 0;
+    }
+    
+    unsigned int window = 0;
+    if (mapping->advice == MMAP_SEQUENTIAL) {
+        window = MMAP_READAHEAD_MAX;
+    } else if (mapping->advice == MMAP_NORMAL && page == mapping->next_fault) {
+        window = mapping->window ? mapping->window * 2 : MMAP_READAHEAD_MIN;
+        if (window > MMAP_READAHEAD_MAX) window = MMAP_READAHEAD_MAX;
+    }
+    // Reading ahead must not evict the pages it just read
+    if (window > MMAP_PAGES / 4) window = MMAP_PAGES / 4;
+    mapping->window = window;
+    
+    unsigned int ahead = 1;
+    for (; ahead <= window && page + ahead < mapping->pages; ahead++) {
+        if (map_page(mapping, page + ahead, 1) < 0) break;
+    }
+    mapping->next_fault = page + ahead;
+    return 1;
+}
+
+// Lowest free range of `count` pages in the window, with an unmapped
+// guard page after it so overruns fault. Returns 0 if the window is full.
+static unsigned int find_space(unsigned int count) {
+    unsigned int base = MMAP_WINDOW_BASE;
+    
+    for (int moved = 1; moved; ) {
+        moved = 0;
+        for (int m = 0; m < MMAP_MAX_MAPPINGS; m++) {
+            const mmap_mapping_t* mapping = &mappings[m];
+            unsigned int end = mapping->base + (mapping->pages + 1) * PAGE_SIZE;
+            if (mapping->in_use && base < end && mapping->base < base + (count + 1) * PAGE_SIZE) {
+                base = end;
+                moved = 1;
+            }
+        }
+    }
+    if (base - MMAP_WINDOW_BASE + (count + 1) * PAGE_SIZE > MMAP_WINDOW_SIZE) return 0;
+    return base;
+}
+
+void init_mmap() {
+    for (int i = 0; i < MMAP_HASH_SIZE; i++) buckets[i] = MMAP_NONE;
+    for (int i = 0; i < MMAP_PAGES; i++) pages[i].valid = 0;
+    for (int i = 0; i < MMAP_MAX_MAPPINGS; i++) mappings[i].in_use = 0;
+    hand = 0;
+    
+    stats.major_faults = 0;
+    stats.minor_faults = 0;
+    stats.readahead_pages = 0;
+    stats.evictions = 0;
+    stats.cached = 0;
+    stats.capacity = MMAP_PAGES;
+    stats.mappings = 0;
+    
+    ready = paging_enabled();
+    if (!ready) {
+        klog(KLOG_INFO, "mmap: paging is off, files cannot be mapped");
+        return;
+    }
+    paging_set_fault_handler(handle_fault);
+    klog_value(KLOG_INFO, "mmap: page cache pages: ", MMAP_PAGES);
+}
+
+int mmap_ready() {
+    return ready;
+}
+
+// Map `length` bytes of a file from `offset` (a multiple of PAGE_SIZE),
+// read-only; 0 maps to the end. Nothing is read until it is touched.
+// Returns the address, or NULL; `mapped` receives the mapped length.
+const void* mmap_map(const char* path, unsigned int offset, unsigned int length, unsigned int* mapped) {
+    vfs_node_t node;
+    mmap_mapping_t* mapping = NULL;
+    
+    if (!ready || offset % PAGE_SIZE || vfs_lookup(path, &node) < 0 || node.type != VFS_FILE) return NULL;
+    
+    for (int m = 0; m < MMAP_MAX_MAPPINGS && !mapping; m++) {
+        if (!mappings[m].in_use) mapping = &mappings[m];
+    }
+    if (!mapping) return NULL;
+    
+    // The looked-up node's size may predate writes; ask the open file
+    int fd = vfs_open(path, VFS_READ);
+    if (fd < 0) return NULL;
+    int size = vfs_size(fd);
+    if (size < 0 || offset >= (unsigned int)size) {
+        vfs_close(fd);
+        return NULL;
+    }
+    if (length == 0 || length > size - offset) length = size - offset;
+    
+    unsigned int count = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+    unsigned int base = find_space(count);
+    if (!base) {
+        vfs_close(fd);
+        return NULL;
+    }
+    
+    mapping->in_use = 1;
+    mapping->fd = fd;
+    mapping->node = node;
+    mapping->base = base;
+    mapping->pages = count;
+    mapping->first_index = offset / PAGE_SIZE;
+    mapping->advice = MMAP_NORMAL;
+    mapping->next_fault = 0;
+    mapping->window = 0;
+    stats.mappings++;
+    
+    if (mapped) *mapped = length;
+    return (const void*)base;
+}
+
+// Unmap the pages of `mapping` from `first` up to `last`. They stay cached.
+static void unmap_range(mmap_mapping_t* mapping, unsigned int first, unsigned int last) {
+    for (unsigned int page = first; page < last; page++) {
+        unsigned int address = mapping->base + page * PAGE_SIZE;
+        unsigned int* pte = paging_pte(address);
+        if (*pte & PAGE_PRESENT) {
+            pages[slot_of(*pte)].maps--;
+            *pte = 0;
+            paging_invalidate(address);
+        }
+    }
+}
+
+// Remove a mapping made by mmap_map. Returns -1 if `address` isn't one.
+int mmap_unmap(const void* address) {
+    mmap_mapping_t* mapping = mapping_at((unsigned int)address);
+    if (!mapping || mapping->base != (unsigned int)address) return -1;
+    
+    unmap_range(mapping, 0, mapping->pages);
+    vfs_close(mapping->fd);
+    mapping->in_use = 0;
+    stats.mappings--;
+    return 0;
+}
+
+// Advise how a range of a mapping will be used. MMAP_NORMAL, MMAP_RANDOM
+// and MMAP_SEQUENTIAL set the read-ahead policy of the whole mapping.
+int mmap_advise(const void* address, unsigned int length, int advice) {
+    mmap_mapping_t* mapping = mapping_at((unsigned int)address);
+    if (!mapping) return -1;
+    
+    unsigned int offset = (unsigned int)address - mapping->base;
+    unsigned int first = offset / PAGE_SIZE;
+    unsigned int last = mapping->pages;
+    if (length < mapping->pages * PAGE_SIZE - offset) last = (offset + length + PAGE_SIZE - 1) / PAGE_SIZE;
+    
+    switch (advice) {
+        case MMAP_NORMAL:
+        case MMAP_RANDOM:
+        case MMAP_SEQUENTIAL:
+            mapping->advice = advice;
+            mapping->window = 0;
+            return 0;
+        case MMAP_WILLNEED:
+            for (unsigned int page = first; page < last; page++) {
+                if (map_page(mapping, page, 1) < 0) return -1;
+            }
+            return 0;
+        case MMAP_DONTNEED:
+            unmap_range(mapping, first, last);
+            return 0;
+    }
+    return -1;
+}
+
+// Forget the cached pages of a file that is being written
+void mmap_invalidate(const vfs_node_t* node) {
+    if (!ready) return;
+    for (int slot = 0; slot < MMAP_PAGES; slot++) {
+        if (pages[slot].valid && pages[slot].mount == node->mount && pages[slot].id == node->id) {
+            evict(slot);
+        }
+    }
+}
+
+const mmap_stats_t* mmap_get_stats() {
+    return &stats;
+}
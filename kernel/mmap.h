@@ -0,0 +1,45 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include "vfs.h"
+
+// Memory-mapped files. A mapping reserves read-only pages in the mmap
+// window (see memory.h); touching one faults the file page in from the
+// page cache, which keeps each file page once however many mappings share
+// it. Cached pages are evicted by CLOCK on the page tables' accessed bits.
+#define MMAP_MAX_MAPPINGS 8
+#define MMAP_HASH_SIZE 256              // Page cache buckets, power of two
+
+// Read-ahead on faults: a fault right after the last one ramps the window
+// from MMAP_READAHEAD_MIN up to MMAP_READAHEAD_MAX pages; MMAP_SEQUENTIAL
+// starts at the maximum
+#define MMAP_READAHEAD_MIN 2
+#define MMAP_READAHEAD_MAX 16
+
+// mmap_advise hints
+#define MMAP_NORMAL 0
+#define MMAP_RANDOM 1                   // No read-ahead
+#define MMAP_SEQUENTIAL 2               // Full read-ahead from the first fault
+#define MMAP_WILLNEED 3                 // Read the range in now
+#define MMAP_DONTNEED 4                 // Unmap the range; pages stay cached
+
+typedef struct {
+    unsigned int major_faults;          // Page read from the file
+    unsigned int minor_faults;          // Page already in the cache
+    unsigned int readahead_pages;       // Read before being touched
+    unsigned int evictions;
+    unsigned int cached;
+    unsigned int capacity;
+    unsigned int mappings;
+} mmap_stats_t;
+
+// Memory-mapped file functions
+void init_mmap();
+int mmap_ready();
+const void* mmap_map(const char* path, unsigned int offset, unsigned int length, unsigned int* mapped);
+int mmap_unmap(const void* address);
+int mmap_advise(const void* address, unsigned int length, int advice);
+void mmap_invalidate(const vfs_node_t* node);
+const mmap_stats_t* mmap_get_stats();
+
+#endif // MMAP_H
@@ -1,9 +1,32 @@
 #include "mouse.h"
 #include "screen.h"
+#include "io.h"
+#include "klog.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "replay.h"
 
 // Global mouse state
-mouse_state_t mouse_state = {0, 0, 0, 0, 0, 1};
-mouse_buffer_t mouse_buffer = {{0}, 0, 0, 0};
+mouse_state_t mouse_state = {0, 0, 0, 0, 0, 0, 1, 0};
+mouse_buffer_t mouse_buffer = {{{0}}, 0, 0, 0};
+static mouse_stats_t mouse_stats;
+
+// Packet assembly, owned by the IRQ12 handler
+static unsigned char packet[4];
+static int packet_size = 3;
+static int packet_index = 0;
+static unsigned int last_byte_ms = 0;
+
+// Motion accumulated by the IRQ handler since the last poll_mouse. Every
+// packet of a frame merges here and is applied as one state update.
+static volatile int pending_dx = 0;
+static volatile int pending_dy = 0;
+static volatile int pending_dz = 0;
+static volatile int pending_buttons = 0;     // Latest button state
+static volatile int pending_clicks = 0;      // Buttons that went down during the frame
+static volatile int pending_packets = 0;
+
+static void mouse_irq();
 
 // Wait for mouse controller to be ready
 void mouse_wait(unsigned char type) {
@@ -29,7 +52,7 @@ void mouse_wait(unsigned char type) {
 // Write data to mouse
 void mouse_write(unsigned char data) {
     mouse_wait(0); // Wait for input buffer to be empty
-    outb(MOUSE_PORT_COMMAND, 0xD4); // Tell controller we're sending mouse data
+    outb(MOUSE_PORT_COMMAND, MOUSE_CMD_WRITE_AUX); // Tell controller we're sending mouse data
     mouse_wait(0);
     outb(MOUSE_PORT_DATA, data); // Send the data
 }
@@ -50,6 +73,7 @@ void init_mouse() {
     mouse_state.left_button = 0;
     mouse_state.right_button = 0;
     mouse_state.middle_button = 0;
+    mouse_state.clicks = 0;
     mouse_state.visible = 1;
     
     // Clear mouse buffer
@@ -75,16 +99,35 @@ void init_mouse() {
     outb(MOUSE_PORT_DATA, status);
     
     // Set mouse to use default settings
-    mouse_write(0xF6);
+    mouse_write(MOUSE_DEV_SET_DEFAULTS);
     mouse_read(); // Acknowledge
     
-    // Enable the mouse
-    mouse_write(0xF4);
+    // IntelliMouse knock: sample rates 200, 100, 80 turn on the wheel
+    // (and 4-byte packets) on mice that have one
+    static const unsigned char knock[3] = {200, 100, 80};
+    for (int i = 0; i < 3; i++) {
+        mouse_write(MOUSE_DEV_SET_RATE);
+        mouse_read();
+        mouse_write(knock[i]);
+        mouse_read();
+    }
+    mouse_write(MOUSE_DEV_GET_ID);
     mouse_read(); // Acknowledge
+    mouse_stats.has_wheel = mouse_read() == MOUSE_ID_WHEEL;
+    packet_size = mouse_stats.has_wheel ? 4 : 3;
     
     // Set mouse to stream mode
-    mouse_write(0xEA);
+    mouse_write(MOUSE_DEV_STREAM_MODE);
+    mouse_read(); // Acknowledge
+    
+    // Enable the mouse
+    mouse_write(MOUSE_DEV_ENABLE);
     mouse_read(); // Acknowledge
+    
+    register_irq_handler(IRQ_MOUSE, mouse_irq);
+    
+    update_mouse_cursor();
+    klog(KLOG_INFO, mouse_stats.has_wheel ? "mouse: PS/2 wheel mouse on IRQ12" : "mouse: PS/2 mouse on IRQ12");
 }
 
 // Check if mouse data is available
@@ -114,36 +157,39 @@ void add_mouse_packet(mouse_packet_t packet) {
     }
 }
 
-// Process a mouse packet and update mouse state
-void process_mouse_packet(mouse_packet_t packet) {
-    // Update button states
-    mouse_state.left_button = packet.left_button;
-    mouse_state.right_button = packet.right_button;
-    mouse_state.middle_button = packet.middle_button;
+// Apply one merged movement to the mouse state
+static void apply_mouse_motion(int dx, int dy, int dz, int buttons) {
+    mouse_state.left_button = (buttons & 0x01) ? 1 : 0;
+    mouse_state.right_button = (buttons & 0x02) ? 1 : 0;
+    mouse_state.middle_button = (buttons & 0x04) ? 1 : 0;
+    mouse_state.wheel += dz;
     
-    // Update position
-    int new_x = mouse_state.x + packet.x_movement;
-    int new_y = mouse_state.y - packet.y_movement; // Invert Y for screen coordinates
+    // Update position, inverting Y for screen coordinates
+    int new_x = mouse_state.x + dx;
+    int new_y = mouse_state.y - dy;
     
     // Clamp to screen boundaries
-    if (new_x >= 0 && new_x < VGA_WIDTH) {
-        mouse_state.x = new_x;
-    }
-    if (new_y >= 0 && new_y < VGA_HEIGHT) {
-        mouse_state.y = new_y;
-    }
+    if (new_x < 0) new_x = 0;
+    if (new_x >= VGA_WIDTH) new_x = VGA_WIDTH - 1;
+    if (new_y < 0) new_y = 0;
+    if (new_y >= VGA_HEIGHT) new_y = VGA_HEIGHT - 1;
+    mouse_state.x = new_x;
+    mouse_state.y = new_y;
     
     // Update cursor display
     update_mouse_cursor();
 }
 
-// Update mouse cursor display
+// Process a mouse packet and update mouse state
+void process_mouse_packet(mouse_packet_t packet) {
+    int buttons = packet.left_button | (packet.right_button << 1) | (packet.middle_button << 2);
+    apply_mouse_motion(packet.x_movement, packet.y_movement, 0, buttons);
+}
+
+// Update mouse cursor display. The screen composites the pointer at the
+// next flush, so this only hands over the latest position.
 void update_mouse_cursor() {
-    if (mouse_state.visible) {
-        // In a real implementation, you'd save/restore the character under the cursor
-        // For now, we'll just show a simple cursor character
-        print_string_at(">", VGA_LIGHT_CYAN, mouse_state.y, mouse_state.x);
-    }
+    screen_set_pointer(mouse_state.y, mouse_state.x, mouse_state.visible);
 }
 
 // Show mouse cursor
@@ -155,7 +201,7 @@ void show_mouse_cursor() {
 // Hide mouse cursor
 void hide_mouse_cursor() {
     mouse_state.visible = 0;
-    // In a real implementation, you'd restore the character under the cursor
+    update_mouse_cursor();
 }
 
 // Set mouse position
@@ -183,51 +229,129 @@ int is_mouse_button_pressed(int button) {
     }
 }
 
-// Poll mouse for input (simplified version)
+// Take a press of a mouse button since the last call. A click shorter
+// than a frame shows up here even though the button never reads as held.
+int mouse_button_clicked(int button) {
+    int mask = 1 << button;
+    if (!(mouse_state.clicks & mask)) return 0;
+    mouse_state.clicks &= ~mask;
+    return 1;
+}
+
+// Decode a complete packet into the pending accumulator
+static void mouse_decode_packet() {
+    unsigned char status = packet[0];
+    
+    mouse_stats.packets++;
+    pending_clicks |= status & MOUSE_PACKET_BUTTONS & ~pending_buttons;
+    pending_buttons = status & MOUSE_PACKET_BUTTONS;
+    pending_packets++;
+    
+    // Overflowed deltas are garbage; keep the buttons, drop the motion
+    if (status & MOUSE_PACKET_OVERFLOW) {
+        mouse_stats.dropped++;
+        return;
+    }
+    
+    // Deltas are 9-bit two's complement with the sign bit in the status byte
+    pending_dx += (int)packet[1] - ((status & MOUSE_PACKET_X_SIGN) ? 256 : 0);
+    pending_dy += (int)packet[2] - ((status & MOUSE_PACKET_Y_SIGN) ? 256 : 0);
+    
+    // IntelliMouse Z is a signed 4-bit value
+    if (packet_size == 4) {
+        pending_dz += (signed char)(packet[3] << 4) >> 4;
+    }
+}
+
+// IRQ12 handler: one byte per interrupt
+static void mouse_irq() {
+    unsigned char status = inb(MOUSE_PORT_STATUS);
+    
+    // The byte belongs to the keyboard (or was already read)
+    if ((status & MOUSE_STATUS_OUTPUT_FULL) == 0 || (status & MOUSE_STATUS_AUX) == 0) {
+        return;
+    }
+    
+    unsigned char data = inb(MOUSE_PORT_DATA);
+    
+    // A long gap means the rest of the previous packet was lost
+    unsigned int now = get_uptime_ms();
+    if (packet_index > 0 && now - last_byte_ms > MOUSE_PACKET_TIMEOUT_MS) {
+        packet_index = 0;
+        mouse_stats.resyncs++;
+    }
+    last_byte_ms = now;
+    
+    // Resync: a packet must start with a status byte (bit 3 always set)
+    if (packet_index == 0 && !(data & MOUSE_PACKET_ALWAYS_1)) {
+        mouse_stats.resyncs++;
+        return;
+    }
+    
+    packet[packet_index++] = data;
+    if (packet_index == packet_size) {
+        packet_index = 0;
+        mouse_decode_packet();
+    }
+}
+
+// Apply everything the IRQ handler collected since the last frame as a
+// single state update, so redraws stay at one per frame however fast the
+// mouse moves. Called once per shell loop iteration.
 void poll_mouse() {
-    // Check if mouse data is available
-    if ((inb(MOUSE_PORT_STATUS) & MOUSE_STATUS_OUTPUT_FULL) == 1) {
-        unsigned char data = inb(MOUSE_PORT_DATA);
-        
-        // This is a simplified polling implementation
-        // In a real OS, you'd use interrupts and proper packet parsing
-        static int packet_byte = 0;
-        static mouse_packet_t current_packet = {0};
-        
-        switch (packet_byte) {
-            case 0:
-                // First byte - status byte
-                current_packet.left_button = (data & 0x01) ? 1 : 0;
-                current_packet.right_button = (data & 0x02) ? 1 : 0;
-                current_packet.middle_button = (data & 0x04) ? 1 : 0;
-                current_packet.x_sign = (data & 0x10) ? 1 : 0;
-                current_packet.y_sign = (data & 0x20) ? 1 : 0;
-                current_packet.x_overflow = (data & 0x40) ? 1 : 0;
-                current_packet.y_overflow = (data & 0x80) ? 1 : 0;
-                packet_byte = 1;
-                break;
-            case 1:
-                // Second byte - X movement
-                current_packet.x_movement = (char)data;
-                packet_byte = 2;
-                break;
-            case 2:
-                // Third byte - Y movement
-                current_packet.y_movement = (char)data;
-                process_mouse_packet(current_packet);
-                packet_byte = 0;
-                break;
+    unsigned int flags = irq_save();
+    int packets = pending_packets;
+    int dx = pending_dx;
+    int dy = pending_dy;
+    int dz = pending_dz;
+    int buttons = pending_buttons;
+    int clicks = pending_clicks;
+    pending_packets = 0;
+    pending_dx = 0;
+    pending_dy = 0;
+    pending_dz = 0;
+    pending_clicks = 0;
+    irq_restore(flags);
+    
+    if (packets > 0) {
+        // A click released within the frame is recorded as a press and a
+        // release at the same time, so playback latches it the same way
+        if (clicks & ~buttons) {
+            replay_capture_mouse(dx, dy, dz, buttons | clicks);
+            replay_capture_mouse(0, 0, 0, buttons);
+        } else {
+            replay_capture_mouse(dx, dy, dz, buttons);
         }
+        apply_mouse_motion(dx, dy, dz, buttons);
+        mouse_state.clicks |= clicks;
     }
 }
 
-// Assembly functions for port I/O
-static inline unsigned char inb(unsigned short port) {
-    unsigned char result;
-    __asm__ __volatile__("inb %1, %0" : "=a" (result) : "Nd" (port));
-    return result;
+// Check for packets received since the last poll_mouse
+int mouse_pending() {
+    return pending_packets > 0;
+}
+
+// Feed synthetic motion through the same path as hardware packets
+void inject_mouse_motion(int dx, int dy, int dz, int buttons) {
+    unsigned int flags = irq_save();
+    pending_dx += dx;
+    pending_dy += dy;
+    pending_dz += dz;
+    pending_clicks |= buttons & ~pending_buttons;
+    pending_buttons = buttons;
+    pending_packets++;
+    irq_restore(flags);
+}
+
+// Take the wheel movement accumulated since the last call
+int get_mouse_wheel() {
+    int wheel = mouse_state.wheel;
+    mouse_state.wheel = 0;
+    return wheel;
 }
 
-static inline void outb(unsigned short port, unsigned char data) {
-    __asm__ __volatile__("outb %0, %1" : : "a" (data), "Nd" (port));
+// Driver statistics
+const mouse_stats_t* get_mouse_stats() {
+    return &mouse_stats;
 }
@@ -11,6 +11,7 @@
 #define MOUSE_STATUS_INPUT_FULL  0x02
 #define MOUSE_STATUS_SYSTEM      0x04
 #define MOUSE_STATUS_COMMAND     0x08
+#define MOUSE_STATUS_AUX         0x20
 #define MOUSE_STATUS_TIMEOUT     0x40
 #define MOUSE_STATUS_PARITY      0x80
 
@@ -23,6 +24,25 @@
 #define MOUSE_CMD_TEST_MOUSE     0xA9
 #define MOUSE_CMD_RESET          0xFF
 
+// Mouse device commands (sent through MOUSE_CMD_WRITE_AUX)
+#define MOUSE_CMD_WRITE_AUX      0xD4
+#define MOUSE_DEV_SET_DEFAULTS   0xF6
+#define MOUSE_DEV_ENABLE         0xF4
+#define MOUSE_DEV_STREAM_MODE    0xEA
+#define MOUSE_DEV_SET_RATE       0xF3
+#define MOUSE_DEV_GET_ID         0xF2
+#define MOUSE_ID_WHEEL           3   // IntelliMouse: 4-byte packets with Z
+
+// Packet status byte bits
+#define MOUSE_PACKET_BUTTONS     0x07
+#define MOUSE_PACKET_ALWAYS_1    0x08
+#define MOUSE_PACKET_X_SIGN      0x10
+#define MOUSE_PACKET_Y_SIGN      0x20
+#define MOUSE_PACKET_OVERFLOW    0xC0
+
+// A packet whose bytes are further apart than this is abandoned
+#define MOUSE_PACKET_TIMEOUT_MS  50
+
 // Mouse packet structure
 typedef struct {
     unsigned char left_button:1;
@@ -44,9 +64,19 @@ typedef struct {
     int left_button;
     int right_button;
     int middle_button;
+    int clicks;             // Presses not yet consumed, bit per button
     int visible;
+    int wheel;              // Wheel movement not yet consumed
 } mouse_state_t;
 
+// Driver statistics
+typedef struct {
+    int has_wheel;
+    unsigned int packets;
+    unsigned int resyncs;   // Bytes dropped while looking for a status byte
+    unsigned int dropped;   // Packets discarded for overflow
+} mouse_stats_t;
+
 // Mouse buffer
 #define MOUSE_BUFFER_SIZE 64
 typedef struct {
@@ -74,6 +104,11 @@ void hide_mouse_cursor();
 void set_mouse_position(int x, int y);
 void get_mouse_position(int* x, int* y);
 int is_mouse_button_pressed(int button);
+int mouse_button_clicked(int button);
 void poll_mouse();
+int mouse_pending();
+void inject_mouse_motion(int dx, int dy, int dz, int buttons);
+int get_mouse_wheel();
+const mouse_stats_t* get_mouse_stats();
 
 #endif // MOUSE_H
@@ -1,5 +1,6 @@
 #include "network.h"
 #include "screen.h"
+#include "klog.h"
 
 // Define NULL for kernel environment
 #ifndef NULL
@@ -77,7 +78,7 @@ static char http_buffer[MAX_HTTP_RESPONSE_SIZE];
 void init_network() {
     // In a real OS, this would initialize network drivers
     // For now, we'll just print a message
-    print_string("Network subsystem initialized (simulated)\n", VGA_LIGHT_CYAN);
+    klog(KLOG_INFO, "network: subsystem initialized (simulated)");
 }
 
 // Parse URL into components
@@ -0,0 +1,104 @@
+#include "paging.h"
+#include "interrupts.h"
+#include "memory.h"
+#include "kernel.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+#define WINDOW_TABLES (MMAP_WINDOW_SIZE / PAGE_LARGE_SIZE)
+
+static unsigned int* const directory = (unsigned int*)PAGE_TABLES_BASE;
+static unsigned int* const window_tables = (unsigned int*)(PAGE_TABLES_BASE + PAGE_SIZE);
+static page_fault_handler_t fault_handler = NULL;
+static int enabled = 0;
+
+// Page fault entry. The CPU pushes an error code; the stub hands it and
+// the faulting address (CR2) to page_fault, then retries the access.
+__asm__(".pushsection .text\n"
+        ".globl page_fault_stub\n"
+        "page_fault_stub:\n"
+        "    pusha\n"
+        "    cld\n"
+        "    pushl 32(%esp)\n"          // Error code, above the pusha frame
+        "    movl %cr2, %eax\n"
+        "    pushl %eax\n"
+        "    call page_fault\n"
+        "    addl $8, %esp\n"
+        "    popa\n"
+        "    addl $4, %esp\n"           // Drop the error code
+        "    iret\n"
+        ".popsection\n");
+void page_fault_stub(void);
+
+void page_fault(unsigned int address, unsigned int error) {
+    if (fault_handler && address - MMAP_WINDOW_BASE < MMAP_WINDOW_SIZE && fault_handler(address, error)) {
+        return;
+    }
+    
+    klog_value(KLOG_EMERG, "paging: fault at ", address);
+    klog_value(KLOG_EMERG, "paging: error code ", error);
+    panic(error & PAGE_FAULT_WRITE ? "Page fault writing an unmapped or read-only page" :
+                                     "Page fault reading an unmapped page");
+}
+
+static int has_pse() {
+    unsigned int eax, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+    return (edx & CPUID_PSE) != 0;
+}
+
+// Identity map the 4GB address space with 4MB pages, give the mmap window
+// empty 4KB page tables and turn paging on. Returns 1 if paging is on;
+// without PSE the kernel keeps running unpaged and nothing can be mapped.
+int init_paging() {
+    if (!has_pse()) {
+        klog(KLOG_WARNING, "paging: CPU lacks 4MB pages, paging disabled");
+        return 0;
+    }
+    
+    for (unsigned int i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+        directory[i] = (i * PAGE_LARGE_SIZE) | PAGE_LARGE | PAGE_WRITABLE | PAGE_PRESENT;
+    }
+    for (unsigned int t = 0; t < WINDOW_TABLES; t++) {
+        unsigned int* table = window_tables + t * PAGE_TABLE_ENTRIES;
+        for (unsigned int i = 0; i < PAGE_TABLE_ENTRIES; i++) table[i] = 0;
+        directory[MMAP_WINDOW_BASE / PAGE_LARGE_SIZE + t] = (unsigned int)table | PAGE_WRITABLE | PAGE_PRESENT;
+    }
+    
+    register_trap_handler(PAGE_FAULT_VECTOR, page_fault_stub);
+    
+    unsigned int cr0, cr4;
+    __asm__ __volatile__("movl %0, %%cr3" : : "r" (directory) : "memory");
+    __asm__ __volatile__("movl %%cr4, %0" : "=r" (cr4));
+    __asm__ __volatile__("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    __asm__ __volatile__("movl %%cr0, %0" : "=r" (cr0));
+    __asm__ __volatile__("movl %0, %%cr0" : : "r" (cr0 | CR0_PG | CR0_WP) : "memory");
+    
+    enabled = 1;
+    klog_value(KLOG_INFO, "paging: enabled, mmap window KB: ", MMAP_WINDOW_SIZE / 1024);
+    return 1;
+}
+
+int paging_enabled() {
+    return enabled;
+}
+
+// Page table entry for an address in the mmap window, NULL outside it
+unsigned int* paging_pte(unsigned int address) {
+    unsigned int offset = address - MMAP_WINDOW_BASE;
+    if (!enabled || offset >= MMAP_WINDOW_SIZE) return NULL;
+    return window_tables + offset / PAGE_SIZE;
+}
+
+// Drop the TLB entry of a page whose mapping changed
+void paging_invalidate(unsigned int address) {
+    __asm__ __volatile__("invlpg (%0)" : : "r" (address) : "memory");
+}
+
+// Install the mmap layer's handler for faults in the window
+void paging_set_fault_handler(page_fault_handler_t handler) {
+    fault_handler = handler;
+}
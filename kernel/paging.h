@@ -0,0 +1,41 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+// Paging: physical memory and devices stay identity mapped through 4MB
+// pages; only MMAP_WINDOW (see memory.h) uses 4KB pages, filled in on
+// demand by the page fault handler
+#define PAGE_SIZE 4096
+#define PAGE_TABLE_ENTRIES 1024
+#define PAGE_LARGE_SIZE 0x400000
+
+// Page directory and table entry bits
+#define PAGE_PRESENT 0x001
+#define PAGE_WRITABLE 0x002
+#define PAGE_ACCESSED 0x020
+#define PAGE_LARGE 0x080                // 4MB page (needs CR4.PSE)
+#define PAGE_FRAME_MASK 0xFFFFF000
+
+// Page fault error code bits
+#define PAGE_FAULT_PRESENT 0x01         // Protection fault, not a missing page
+#define PAGE_FAULT_WRITE 0x02
+
+// Control register bits
+#define CR0_WP 0x00010000               // Read-only pages bind the kernel too
+#define CR0_PG 0x80000000
+#define CR4_PSE 0x00000010
+#define CPUID_PSE 0x00000008            // CPUID 1, EDX
+
+#define PAGE_FAULT_VECTOR 14
+
+// Resolves a fault inside the mmap window. Returns 1 once the page is
+// mapped, 0 if the access is a bug.
+typedef int (*page_fault_handler_t)(unsigned int address, unsigned int error);
+
+// Paging functions
+int init_paging();
+int paging_enabled();
+unsigned int* paging_pte(unsigned int address);
+void paging_invalidate(unsigned int address);
+void paging_set_fault_handler(page_fault_handler_t handler);
+
+#endif // PAGING_H
@@ -0,0 +1,125 @@
+#include "pci.h"
+#include "io.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+static pci_device_t devices[PCI_MAX_DEVICES];
+static int device_count = 0;
+
+static unsigned int config_address(unsigned char bus, unsigned char device,
+                                   unsigned char function, unsigned char offset) {
+    return 0x80000000u | ((unsigned int)bus << 16) | ((unsigned int)device << 11) |
+           ((unsigned int)function << 8) | (offset & 0xFC);
+}
+
+static unsigned int config_read(unsigned char bus, unsigned char device,
+                                unsigned char function, unsigned char offset) {
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, device, function, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+unsigned int pci_read32(const pci_device_t* device, unsigned char offset) {
+    return config_read(device->bus, device->device, device->function, offset);
+}
+
+unsigned short pci_read16(const pci_device_t* device, unsigned char offset) {
+    return pci_read32(device, offset) >> ((offset & 2) * 8);
+}
+
+unsigned char pci_read8(const pci_device_t* device, unsigned char offset) {
+    return pci_read32(device, offset) >> ((offset & 3) * 8);
+}
+
+void pci_write32(const pci_device_t* device, unsigned char offset, unsigned int value) {
+    outl(PCI_CONFIG_ADDRESS, config_address(device->bus, device->device, device->function, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// 16-bit writes go through the whole dword so the neighbouring field keeps
+// its value
+void pci_write16(const pci_device_t* device, unsigned char offset, unsigned short value) {
+    unsigned int shift = (offset & 2) * 8;
+    unsigned int dword = pci_read32(device, offset);
+    dword = (dword & ~(0xFFFFu << shift)) | ((unsigned int)value << shift);
+    pci_write32(device, offset, dword);
+}
+
+// Base address from BAR `index` with the flag bits cleared
+unsigned int pci_bar(const pci_device_t* device, int index) {
+    unsigned int bar = pci_read32(device, PCI_BAR0 + index * 4);
+    return (bar & PCI_BAR_IO) ? (bar & PCI_BAR_IO_MASK) : (bar & PCI_BAR_MEMORY_MASK);
+}
+
+// Set bits in the command register (I/O, memory decoding, bus mastering)
+void pci_enable(const pci_device_t* device, unsigned short command_bits) {
+    pci_write16(device, PCI_COMMAND, pci_read16(device, PCI_COMMAND) | command_bits);
+}
+
+static void add_function(unsigned char bus, unsigned char device, unsigned char function) {
+    if (device_count >= PCI_MAX_DEVICES) return;
+    
+    pci_device_t* entry = &devices[device_count++];
+    entry->bus = bus;
+    entry->device = device;
+    entry->function = function;
+    
+    unsigned int id = pci_read32(entry, PCI_VENDOR_ID);
+    unsigned int class_revision = pci_read32(entry, PCI_CLASS_REVISION);
+    entry->vendor_id = id & 0xFFFF;
+    entry->device_id = id >> 16;
+    entry->class_code = class_revision >> 24;
+    entry->subclass = (class_revision >> 16) & 0xFF;
+    entry->prog_if = (class_revision >> 8) & 0xFF;
+    entry->irq = pci_read8(entry, PCI_INTERRUPT_LINE);
+}
+
+// Scan every bus for functions once; drivers look them up afterwards
+void init_pci() {
+    device_count = 0;
+    
+    for (int bus = 0; bus < 256; bus++) {
+        for (int device = 0; device < 32; device++) {
+            if ((config_read(bus, device, 0, PCI_VENDOR_ID) & 0xFFFF) == PCI_VENDOR_NONE) continue;
+            
+            unsigned int header = config_read(bus, device, 0, PCI_HEADER_TYPE) >> 16;
+            int functions = (header & PCI_HEADER_MULTIFUNCTION) ? 8 : 1;
+            for (int function = 0; function < functions; function++) {
+                if ((config_read(bus, device, function, PCI_VENDOR_ID) & 0xFFFF) != PCI_VENDOR_NONE) {
+                    add_function(bus, device, function);
+                }
+            }
+        }
+    }
+    
+    klog_value(KLOG_INFO, "pci: functions found: ", device_count);
+}
+
+int pci_device_count() {
+    return device_count;
+}
+
+const pci_device_t* pci_get_device(int index) {
+    if (index < 0 || index >= device_count) return NULL;
+    return &devices[index];
+}
+
+const pci_device_t* pci_find_class(unsigned char class_code, unsigned char subclass) {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].class_code == class_code && devices[i].subclass == subclass) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+const pci_device_t* pci_find_device(unsigned short vendor_id, unsigned short device_id) {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].vendor_id == vendor_id && devices[i].device_id == device_id) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,66 @@
+#ifndef PCI_H
+#define PCI_H
+
+// PCI configuration mechanism #1
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_MAX_DEVICES 32
+
+// Configuration space offsets
+#define PCI_VENDOR_ID 0x00
+#define PCI_DEVICE_ID 0x02
+#define PCI_COMMAND 0x04
+#define PCI_STATUS 0x06
+#define PCI_CLASS_REVISION 0x08      // Class, subclass, prog IF, revision
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_BAR0 0x10
+#define PCI_CAPABILITIES 0x34
+#define PCI_INTERRUPT_LINE 0x3C
+
+#define PCI_HEADER_MULTIFUNCTION 0x80
+#define PCI_STATUS_CAPABILITIES 0x10
+#define PCI_VENDOR_NONE 0xFFFF
+
+// Command register bits
+#define PCI_COMMAND_IO 0x01
+#define PCI_COMMAND_MEMORY 0x02
+#define PCI_COMMAND_BUS_MASTER 0x04
+
+// BAR bits
+#define PCI_BAR_IO 0x01
+#define PCI_BAR_IO_MASK 0xFFFFFFFC
+#define PCI_BAR_MEMORY_MASK 0xFFFFFFF0
+
+// Device classes
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+// A function found by the bus scan
+typedef struct {
+    unsigned char bus;
+    unsigned char device;
+    unsigned char function;
+    unsigned short vendor_id;
+    unsigned short device_id;
+    unsigned char class_code;
+    unsigned char subclass;
+    unsigned char prog_if;
+    unsigned char irq;
+} pci_device_t;
+
+// PCI functions
+void init_pci();
+int pci_device_count();
+const pci_device_t* pci_get_device(int index);
+const pci_device_t* pci_find_class(unsigned char class_code, unsigned char subclass);
+const pci_device_t* pci_find_device(unsigned short vendor_id, unsigned short device_id);
+
+unsigned int pci_read32(const pci_device_t* device, unsigned char offset);
+unsigned short pci_read16(const pci_device_t* device, unsigned char offset);
+unsigned char pci_read8(const pci_device_t* device, unsigned char offset);
+void pci_write32(const pci_device_t* device, unsigned char offset, unsigned int value);
+void pci_write16(const pci_device_t* device, unsigned char offset, unsigned short value);
+unsigned int pci_bar(const pci_device_t* device, int index);
+void pci_enable(const pci_device_t* device, unsigned short command_bits);
+
+#endif // PCI_H
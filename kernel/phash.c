@@ -0,0 +1,176 @@
+#include "phash.h"
+
+#define PHASH_NAME_LENGTH 32            // Longest name compared by phash_similar
+
+int strcmp(const char* s1, const char* s2);
+
+// FNV-1a with a seeded start and a final mix, so the low bits used for
+// the slot depend on every character
+static unsigned int phash_hash(unsigned int seed, const char* key) {
+    unsigned int hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x7FEB352Du;
+    hash ^= hash >> 15;
+    return hash;
+}
+
+void phash_init(phash_t* index) {
+    index->count = 0;
+    index->seed = 0;
+    index->mask = 0;
+    index->built = 0;
+}
+
+// Add a key before phash_build(). Returns 0 if the index is full.
+int phash_add(phash_t* index, const char* key, int value) {
+    if (index->count >= PHASH_MAX_KEYS) return 0;
+    
+    index->keys[index->count] = key;
+    index->values[index->count] = value;
+    index->count++;
+    index->built = 0;
+    return 1;
+}
+
+// Place every key with one seed. Returns 1 on success, 0 on a collision,
+// -1 if two keys are equal (no seed can separate them).
+static int try_seed(phash_t* index, unsigned int seed, unsigned int mask) {
+    for (unsigned int i = 0; i <= mask; i++) {
+        index->slots[i] = 0;
+    }
+    
+    for (int i = 0; i < index->count; i++) {
+        unsigned int slot = phash_hash(seed, index->keys[i]) & mask;
+        if (index->slots[slot]) {
+            return strcmp(index->keys[index->slots[slot] - 1], index->keys[i]) == 0 ? -1 : 0;
+        }
+        index->slots[slot] = i + 1;
+    }
+    return 1;
+}
+
+// Search for a seed that gives every key its own slot, growing the table
+// when the seeds for a size run out. Returns 0 on duplicate keys; lookups
+// then fall back to a linear scan.
+int phash_build(phash_t* index) {
+    unsigned int size = 1;
+    
+    index->built = 0;
+    while (size < (unsigned int)index->count * PHASH_MIN_LOAD) size <<= 1;
+    
+    for (; size <= PHASH_MAX_SLOTS; size <<= 1) {
+        for (unsigned int seed = 1; seed <= PHASH_SEED_TRIES; seed++) {
+            int result = try_seed(index, seed, size - 1);
+            if (result < 0) return 0;
+            if (result > 0) {
+                index->seed = seed;
+                index->mask = size - 1;
+                index->built = 1;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Value stored for a key, or -1
+int phash_lookup(const phash_t* index, const char* key) {
+    if (!index->built) {
+        for (int i = 0; i < index->count; i++) {
+            if (strcmp(index->keys[i], key) == 0) return index->values[i];
+        }
+        return -1;
+    }
+    
+    unsigned int slot = index->slots[phash_hash(index->seed, key) & index->mask];
+    if (slot && strcmp(index->keys[slot - 1], key) == 0) {
+        return index->values[slot - 1];
+    }
+    return -1;
+}
+
+// Edit distance counting insertions, deletions, substitutions and swaps
+// of adjacent characters (optimal string alignment)
+static int edit_distance(const char* a, const char* b) {
+    int rows[3][PHASH_NAME_LENGTH + 1];
+    int a_length = 0;
+    int b_length = 0;
+    
+    while (a[a_length]) a_length++;
+    while (b[b_length]) b_length++;
+    if (a_length > PHASH_NAME_LENGTH || b_length > PHASH_NAME_LENGTH) {
+        return PHASH_NAME_LENGTH;
+    }
+    
+    int* two_back = rows[0];
+    int* previous = rows[1];
+    int* row = rows[2];
+    for (int j = 0; j <= b_length; j++) previous[j] = j;
+    
+    for (int i = 1; i <= a_length; i++) {
+        row[0] = i;
+        for (int j = 1; j <= b_length; j++) {
+            int cost = a[i - 1] != b[j - 1];
+            int best = previous[j - 1] + cost;
+            if (previous[j] + 1 < best) best = previous[j] + 1;
+            if (row[j - 1] + 1 < best) best = row[j - 1] + 1;
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] &&
+                two_back[j - 2] + 1 < best) {
+                best = two_back[j - 2] + 1;
+            }
+            row[j] = best;
+        }
+        
+        int* recycled = two_back;
+        two_back = previous;
+        previous = row;
+        row = recycled;
+    }
+    return previous[b_length];
+}
+
+static int is_prefix(const char* prefix, const char* key) {
+    while (*prefix && *prefix == *key) {
+        prefix++;
+        key++;
+    }
+    return *prefix == '\0';
+}
+
+// Keys within `max_distance` edits of `key`, or that it abbreviates,
+// closest first. Returns the number of matches.
+int phash_similar(const phash_t* index, const char* key, int max_distance,
+                  const char* matches[], int max_matches) {
+    int distances[PHASH_MAX_KEYS];
+    int found = 0;
+    
+    for (int i = 0; i < index->count; i++) {
+        const char* candidate = index->keys[i];
+        int distance = edit_distance(key, candidate);
+        if (distance > max_distance && key[0] && key[1] && is_prefix(key, candidate)) {
+            distance = max_distance;
+        }
+        if (distance > max_distance) continue;
+        
+        // Insertion sort by distance, dropping the farthest when full
+        int position = found < max_matches ? found : max_matches;
+        while (position > 0 && distances[position - 1] > distance) {
+            if (position < max_matches) {
+                matches[position] = matches[position - 1];
+                distances[position] = distances[position - 1];
+            }
+            position--;
+        }
+        if (position < max_matches) {
+            matches[position] = candidate;
+            distances[position] = distance;
+            if (found < max_matches) found++;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,30 @@
+#ifndef PHASH_H
+#define PHASH_H
+
+// Perfect hash index over a fixed set of names, built once at startup
+#define PHASH_MAX_KEYS 128
+#define PHASH_MAX_SLOTS 1024            // Power of two
+#define PHASH_MIN_LOAD 4                // Start with at least 4 slots per key
+#define PHASH_SEED_TRIES 256            // Seeds tried before doubling the table
+
+// Keys are not copied and must outlive the index. After phash_build()
+// every key has a slot of its own, so a lookup is one hash and one compare.
+typedef struct {
+    const char* keys[PHASH_MAX_KEYS];
+    int values[PHASH_MAX_KEYS];
+    int count;
+    unsigned short slots[PHASH_MAX_SLOTS];  // Key index + 1, 0 when empty
+    unsigned int seed;
+    unsigned int mask;
+    int built;
+} phash_t;
+
+// Perfect hash functions
+void phash_init(phash_t* index);
+int phash_add(phash_t* index, const char* key, int value);
+int phash_build(phash_t* index);
+int phash_lookup(const phash_t* index, const char* key);
+int phash_similar(const phash_t* index, const char* key, int max_distance,
+                  const char* matches[], int max_matches);
+
+#endif // PHASH_H
@@ -0,0 +1,176 @@
+#include "ramfs.h"
+#include "memory.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+#define RAMFS_PAGES (RAMFS_SIZE / RAMFS_PAGE_SIZE)
+#define RAMFS_NONE -1
+
+int strcmp(const char* s1, const char* s2);
+
+// A file or directory. File data sits in pages of the RAMFS pool; a
+// directory's entries are its children, linked through `next`.
+typedef struct {
+    int used;
+    unsigned char type;
+    short parent;
+    short children;
+    short next;
+    char name[VFS_NAME_LENGTH];
+    unsigned int size;
+    short pages[RAMFS_FILE_PAGES];      // RAMFS_NONE where nothing was written
+} ramfs_node_t;
+
+static char* const pool = (char*)RAMFS_BASE;
+static ramfs_node_t nodes[RAMFS_MAX_NODES];
+static short free_pages[RAMFS_PAGES];
+static int free_count;
+
+static char* page_data(int page) {
+    return pool + page * RAMFS_PAGE_SIZE;
+}
+
+// Empty the filesystem. Returns the root directory's id.
+unsigned int init_ramfs() {
+    for (int i = 0; i < RAMFS_MAX_NODES; i++) nodes[i].used = 0;
+    free_count = 0;
+    for (int page = RAMFS_PAGES - 1; page >= 0; page--) free_pages[free_count++] = page;
+    
+    ramfs_node_t* root = &nodes[0];
+    root->used = 1;
+    root->type = VFS_DIRECTORY;
+    root->parent = RAMFS_NONE;
+    root->children = RAMFS_NONE;
+    root->next = RAMFS_NONE;
+    root->name[0] = '\0';
+    root->size = 0;
+    return 0;
+}
+
+static int ramfs_lookup(const vfs_node_t* directory, const char* name, vfs_node_t* node) {
+    for (int i = nodes[directory->id].children; i != RAMFS_NONE; i = nodes[i].next) {
+        if (strcmp(nodes[i].name, name) == 0) {
+            node->id = i;
+            node->size = nodes[i].size;
+            node->type = nodes[i].type;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int ramfs_read(vfs_file_t* file, void* buffer, unsigned int length) {
+    ramfs_node_t* node = &nodes[file->node.id];
+    char* out = (char*)buffer;
+    
+    if (file->position >= node->size) return 0;
+    if (length > node->size - file->position) length = node->size - file->position;
+    
+    for (unsigned int done = 0; done < length; ) {
+        unsigned int offset = file->position % RAMFS_PAGE_SIZE;
+        unsigned int chunk = RAMFS_PAGE_SIZE - offset;
+        if (chunk > length - done) chunk = length - done;
+        
+        int page = node->pages[file->position / RAMFS_PAGE_SIZE];
+        for (unsigned int i = 0; i < chunk; i++) {
+            out[done + i] = page == RAMFS_NONE ? 0 : page_data(page)[offset + i];
+        }
+        done += chunk;
+        file->position += chunk;
+    }
+    return length;
+}
+
+// Write, taking pages as the file grows. A short count means the file
+// hit RAMFS_FILE_PAGES or the pool ran out.
+static int ramfs_write(vfs_file_t* file, const void* buffer, unsigned int length) {
+    ramfs_node_t* node = &nodes[file->node.id];
+    const char* in = (const char*)buffer;
+    unsigned int done = 0;
+    
+    while (done < length) {
+        unsigned int index = file->position / RAMFS_PAGE_SIZE;
+        unsigned int offset = file->position % RAMFS_PAGE_SIZE;
+        if (index >= RAMFS_FILE_PAGES) break;
+        
+        if (node->pages[index] == RAMFS_NONE) {
+            if (free_count == 0) break;
+            node->pages[index] = free_pages[--free_count];
+        }
+        
+        unsigned int chunk = RAMFS_PAGE_SIZE - offset;
+        if (chunk > length - done) chunk = length - done;
+        char* data = page_data(node->pages[index]);
+        for (unsigned int i = 0; i < chunk; i++) data[offset + i] = in[done + i];
+        
+        done += chunk;
+        file->position += chunk;
+        if (file->position > node->size) node->size = file->position;
+    }
+    return done == 0 && length > 0 ? -1 : (int)done;
+}
+
+static int ramfs_create(const vfs_node_t* directory, const char* name, int type, vfs_node_t* node) {
+    int length = 0;
+    while (name[length]) length++;
+    if (length >= VFS_NAME_LENGTH) return -1;
+    
+    for (int i = 1; i < RAMFS_MAX_NODES; i++) {
+        ramfs_node_t* created = &nodes[i];
+        if (created->used) continue;
+        
+        created->used = 1;
+        created->type = type;
+        created->parent = directory->id;
+        created->children = RAMFS_NONE;
+        for (int c = 0; c <= length; c++) created->name[c] = name[c];
+        created->size = 0;
+        for (int p = 0; p < RAMFS_FILE_PAGES; p++) created->pages[p] = RAMFS_NONE;
+        
+        created->next = nodes[directory->id].children;
+        nodes[directory->id].children = i;
+        
+        node->id = i;
+        node->size = 0;
+        node->type = type;
+        return 0;
+    }
+    return -1;
+}
+
+static int ramfs_truncate(const vfs_node_t* node) {
+    ramfs_node_t* file = &nodes[node->id];
+    for (int p = 0; p < RAMFS_FILE_PAGES; p++) {
+        if (file->pages[p] != RAMFS_NONE) {
+            free_pages[free_count++] = file->pages[p];
+            file->pages[p] = RAMFS_NONE;
+        }
+    }
+    file->size = 0;
+    return 0;
+}
+
+static int ramfs_size(const vfs_node_t* node) {
+    return nodes[node->id].size;
+}
+
+static int ramfs_list(const vfs_node_t* directory, vfs_list_fn callback, void* context) {
+    for (int i = nodes[directory->id].children; i != RAMFS_NONE; i = nodes[i].next) {
+        callback(nodes[i].name, nodes[i].size, nodes[i].type == VFS_DIRECTORY, context);
+    }
+    return 0;
+}
+
+const vfs_ops_t ramfs_ops = {
+    "ramfs",
+    ramfs_lookup,
+    ramfs_read,
+    ramfs_write,
+    ramfs_create,
+    ramfs_truncate,
+    ramfs_size,
+    ramfs_list,
+    NULL,
+};
@@ -0,0 +1,15 @@
+#ifndef RAMFS_H
+#define RAMFS_H
+
+#include "vfs.h"
+
+// In-memory filesystem configuration
+#define RAMFS_MAX_NODES 128
+#define RAMFS_PAGE_SIZE 4096
+#define RAMFS_FILE_PAGES 64             // Largest file: 256KB
+
+// ramfs functions
+unsigned int init_ramfs();
+extern const vfs_ops_t ramfs_ops;
+
+#endif // RAMFS_H
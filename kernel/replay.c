@@ -0,0 +1,314 @@
+#include "replay.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "screen.h"
+#include "serial.h"
+#include "timer.h"
+#include "klog.h"
+
+// Events being recorded or replayed
+static input_record_t records[REPLAY_MAX_EVENTS];
+static int record_count = 0;
+static int record_overflow = 0;
+
+static int state = REPLAY_IDLE;
+static unsigned int start_ms = 0;
+static unsigned int speed = 1;
+static int next_event = 0;
+
+// Built-in benchmark session: help, an AI query, a search, some wheel
+// scrolling and pointer motion, then the latency report
+static const char embedded_script[] =
+    "# ProtoOS interactive benchmark session\n"
+    "500 text help\n"
+    "1200 key 10\n"
+    "2000 text ai What is ProtoOS?\n"
+    "3500 key 10\n"
+    "5000 text search operating systems\n"
+    "6500 key 10\n"
+    "7000 mouse 0 0 -3 0\n"
+    "7200 mouse 0 0 3 0\n"
+    "7500 mouse 12 -6 0 0\n"
+    "8000 text inputlat\n"
+    "8600 key 10\n";
+
+// Initialize the recorder
+void init_replay() {
+    record_count = 0;
+    record_overflow = 0;
+    state = REPLAY_IDLE;
+}
+
+static input_record_t* append_record(unsigned int time_ms, unsigned char type) {
+    if (record_count >= REPLAY_MAX_EVENTS) {
+        record_overflow = 1;
+        return 0;
+    }
+    
+    input_record_t* record = &records[record_count++];
+    record->time_ms = time_ms;
+    record->type = type;
+    record->key = 0;
+    record->buttons = 0;
+    record->dz = 0;
+    record->dx = 0;
+    record->dy = 0;
+    return record;
+}
+
+// Start capturing input into an empty buffer
+void replay_start_recording() {
+    record_count = 0;
+    record_overflow = 0;
+    start_ms = get_uptime_ms();
+    state = REPLAY_RECORDING;
+}
+
+// Stop recording or playback
+void replay_stop() {
+    state = REPLAY_IDLE;
+}
+
+void replay_capture_key(unsigned char key) {
+    if (state != REPLAY_RECORDING) return;
+    
+    input_record_t* record = append_record(get_uptime_ms() - start_ms, REPLAY_EVENT_KEY);
+    if (record) {
+        record->key = key;
+    }
+}
+
+void replay_capture_mouse(int dx, int dy, int dz, int buttons) {
+    if (state != REPLAY_RECORDING) return;
+    
+    input_record_t* record = append_record(get_uptime_ms() - start_ms, REPLAY_EVENT_MOUSE);
+    if (record) {
+        record->dx = dx;
+        record->dy = dy;
+        record->dz = dz;
+        record->buttons = buttons;
+    }
+}
+
+// Play the buffer back, `multiplier` times faster than recorded
+int replay_start(unsigned int multiplier) {
+    if (record_count == 0) return 0;
+    
+    if (multiplier < 1) multiplier = 1;
+    if (multiplier > REPLAY_MAX_SPEED) multiplier = REPLAY_MAX_SPEED;
+    
+    speed = multiplier;
+    next_event = 0;
+    start_ms = get_uptime_ms();
+    state = REPLAY_PLAYING;
+    klog_value(KLOG_NOTICE, "replay: started, events ", record_count);
+    return 1;
+}
+
+// Feed every event that is due. Called once per shell loop iteration,
+// before the input drivers are polled.
+void replay_poll() {
+    if (state != REPLAY_PLAYING) return;
+    
+    unsigned int elapsed = (get_uptime_ms() - start_ms) * speed;
+    while (next_event < record_count && records[next_event].time_ms <= elapsed) {
+        input_record_t* record = &records[next_event++];
+        if (record->type == REPLAY_EVENT_KEY) {
+            add_key_to_buffer((char)record->key);
+        } else {
+            inject_mouse_motion(record->dx, record->dy, record->dz, record->buttons);
+        }
+    }
+    
+    if (next_event >= record_count) {
+        state = REPLAY_IDLE;
+        klog_value(KLOG_NOTICE, "replay: finished, elapsed ms ", get_uptime_ms() - start_ms);
+    }
+}
+
+// Script parsing helpers
+static const char* skip_spaces(const char* p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+static const char* parse_int(const char* p, int* value) {
+    int sign = 1;
+    int result = 0;
+    
+    p = skip_spaces(p);
+    if (*p == '-') {
+        sign = -1;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        result = result * 10 + (*p++ - '0');
+    }
+    *value = sign * result;
+    return p;
+}
+
+static int word_is(const char* p, const char* word) {
+    while (*word && *p == *word) {
+        p++;
+        word++;
+    }
+    return *word == '\0' && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\0');
+}
+
+// Parse one script line into records. Times never go backwards: an event
+// scheduled before the end of earlier typed text waits for it.
+static int parse_line(const char* line, unsigned int* last_ms) {
+    line = skip_spaces(line);
+    if (*line == '#' || *line == '\n' || *line == '\0') return 1;
+    
+    int time_ms;
+    line = skip_spaces(parse_int(line, &time_ms));
+    unsigned int when = time_ms > (int)*last_ms ? (unsigned int)time_ms : *last_ms;
+    
+    if (word_is(line, "key")) {
+        int key;
+        parse_int(line + 3, &key);
+        input_record_t* record = append_record(when, REPLAY_EVENT_KEY);
+        if (!record) return 0;
+        record->key = key;
+    } else if (word_is(line, "text")) {
+        const char* text = skip_spaces(line + 4);
+        for (; *text && *text != '\n'; text++) {
+            input_record_t* record = append_record(when, REPLAY_EVENT_KEY);
+            if (!record) return 0;
+            record->key = *text;
+            when += REPLAY_TYPE_INTERVAL_MS;
+        }
+    } else if (word_is(line, "mouse")) {
+        int dx, dy, dz, buttons;
+        line = parse_int(line + 5, &dx);
+        line = parse_int(line, &dy);
+        line = parse_int(line, &dz);
+        parse_int(line, &buttons);
+        input_record_t* record = append_record(when, REPLAY_EVENT_MOUSE);
+        if (!record) return 0;
+        record->dx = dx;
+        record->dy = dy;
+        record->dz = dz;
+        record->buttons = buttons;
+    } else {
+        return 0;
+    }
+    
+    *last_ms = when;
+    return 1;
+}
+
+// Replace the buffer with a script. Returns the number of events loaded,
+// or -1 on a malformed line.
+int replay_load_script(const char* script) {
+    unsigned int last_ms = 0;
+    
+    state = REPLAY_IDLE;
+    record_count = 0;
+    record_overflow = 0;
+    
+    while (*script) {
+        if (!parse_line(script, &last_ms)) {
+            return -1;
+        }
+        while (*script && *script != '\n') script++;
+        if (*script == '\n') script++;
+    }
+    
+    return record_count;
+}
+
+int replay_load_embedded() {
+    return replay_load_script(embedded_script);
+}
+
+// Load a script from COM1, one line at a time until a line reading "end"
+// or the sender goes quiet
+int replay_load_serial() {
+    char line[REPLAY_LINE_LENGTH];
+    unsigned int last_ms = 0;
+    
+    if (!serial_present()) return -1;
+    
+    state = REPLAY_IDLE;
+    record_count = 0;
+    record_overflow = 0;
+    
+    while (1) {
+        int length = 0;
+        int c;
+        while ((c = serial_read_char(REPLAY_SERIAL_TIMEOUT_MS)) >= 0 && c != '\n') {
+            if (c != '\r' && length < REPLAY_LINE_LENGTH - 1) {
+                line[length++] = c;
+            }
+        }
+        line[length] = '\0';
+        
+        if (word_is(line, "end")) break;
+        if (!parse_line(line, &last_ms)) return -1;
+        if (c < 0) break; // Timed out
+    }
+    
+    return record_count;
+}
+
+// Emit a line on the screen and, for capture by the host, on COM1
+static void dump_string(const char* str) {
+    print_string(str, VGA_LIGHT_WHITE);
+    serial_write_string(str);
+}
+
+static void dump_int(int value) {
+    char digits[12];
+    int i = 0;
+    unsigned int magnitude = value < 0 ? -value : value;
+    
+    do {
+        digits[i++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) digits[i++] = '-';
+    
+    char text[13];
+    int length = 0;
+    while (i > 0) text[length++] = digits[--i];
+    text[length] = '\0';
+    dump_string(text);
+}
+
+// Print the buffer in script form so it can be saved and replayed
+void replay_dump() {
+    for (int i = 0; i < record_count; i++) {
+        input_record_t* record = &records[i];
+        dump_int(record->time_ms);
+        if (record->type == REPLAY_EVENT_KEY) {
+            dump_string(" key ");
+            dump_int(record->key);
+        } else {
+            dump_string(" mouse ");
+            dump_int(record->dx);
+            dump_string(" ");
+            dump_int(record->dy);
+            dump_string(" ");
+            dump_int(record->dz);
+            dump_string(" ");
+            dump_int(record->buttons);
+        }
+        dump_string("\n");
+    }
+    dump_string("end\n");
+    
+    if (record_overflow) {
+        print_string("(recording was truncated)\n", VGA_LIGHT_YELLOW);
+    }
+}
+
+int replay_state() {
+    return state;
+}
+
+int replay_event_count() {
+    return record_count;
+}
@@ -0,0 +1,52 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// Input record/replay configuration
+#define REPLAY_MAX_EVENTS 2048
+#define REPLAY_MAX_SPEED 100
+#define REPLAY_TYPE_INTERVAL_MS 40      // Spacing of keys expanded from `text`
+#define REPLAY_SERIAL_TIMEOUT_MS 5000   // Give up on a silent serial line
+#define REPLAY_LINE_LENGTH 160
+
+// Recorded event types
+#define REPLAY_EVENT_KEY 1
+#define REPLAY_EVENT_MOUSE 2
+
+// Replay states
+#define REPLAY_IDLE 0
+#define REPLAY_RECORDING 1
+#define REPLAY_PLAYING 2
+
+// One input event, timed from the start of the recording. Scripts use the
+// same model as text, one event per line:
+//   <ms> key <code>                       key code as delivered by get_char
+//   <ms> text <characters>                one key per REPLAY_TYPE_INTERVAL_MS
+//   <ms> mouse <dx> <dy> <dz> <buttons>   merged motion of one frame
+typedef struct {
+    unsigned int time_ms;
+    unsigned char type;
+    unsigned char key;
+    unsigned char buttons;
+    signed char dz;
+    short dx;
+    short dy;
+} input_record_t;
+
+// Replay functions
+void init_replay();
+void replay_start_recording();
+void replay_stop();
+int replay_start(unsigned int speed);
+int replay_load_script(const char* script);
+int replay_load_embedded();
+int replay_load_serial();
+void replay_poll();
+void replay_dump();
+int replay_state();
+int replay_event_count();
+
+// Capture hooks called by the input drivers
+void replay_capture_key(unsigned char key);
+void replay_capture_mouse(int dx, int dy, int dz, int buttons);
+
+#endif // REPLAY_H
@@ -1,9 +1,22 @@
 #include "screen.h"
-#include "mouse.h"
+#include "io.h"
+#include "fbcon.h"
+#include "memory.h"
 
 // VGA text mode buffer
 volatile unsigned short* vga_buffer = (unsigned short*)VGA_BUFFER;
 
+// Console dimensions
+int screen_width = TEXT_MODE_WIDTH;
+int screen_height = TEXT_MODE_HEIGHT;
+
+// Framebuffer console: cells live in RAM shadow buffers (one per virtual
+// console) and fbcon renders the changed ones on screen_flush. fb_render is
+// set while the console being written to is also the one on screen.
+static int fb_console = 0;
+static int fb_render = 0;
+#define SHADOW_CELLS (SCREEN_MAX_WIDTH * SCREEN_MAX_HEIGHT)
+
 // Current cursor position
 int cursor_row = 0;
 int cursor_col = 0;
@@ -11,6 +24,34 @@ int cursor_col = 0;
 // Current color attribute
 char current_color = VGA_LIGHT_GREY;
 
+// Cursor position last written to the CRTC (-1 forces a reprogram)
+static int hw_cursor_pos = -1;
+
+// Virtual consoles. vga_buffer, cursor_row/col and current_color always
+// describe the active console (the one print_* writes to); the others are
+// parked in their console_t slot. The visible console may differ from the
+// active one, e.g. while a background console is being written.
+static console_t consoles[MAX_CONSOLES];
+static int active_console = 0;
+static int visible_console = 0;
+
+// Mouse pointer overlay. The pointer is not part of any console's cells: it
+// is composited onto the visible console at flush time (full 16-bit cell
+// saved, inverse attribute drawn) and lifted again before cells move.
+static int pointer_row = 0;
+static int pointer_col = 0;
+static int pointer_visible = 0;
+static int overlay_index = -1;            // Cell the overlay is drawn on, -1 if none
+static int overlay_console = 0;
+static unsigned short overlay_saved;      // Cell contents under the pointer
+static unsigned short overlay_drawn;      // Inverse cell written over them
+
+static void overlay_lift();
+
+// Output hook set by screen_redirect_output
+static screen_output_fn output_hook = 0;
+static void* output_context = 0;
+
 // Create a VGA entry (character + color attribute)
 unsigned short make_vga_entry(char c, char color) {
     return (unsigned short)c | (unsigned short)(color << 8);
@@ -18,8 +59,50 @@ unsigned short make_vga_entry(char c, char color) {
 
 // Initialize the screen
 void init_screen() {
-    clear_screen();
-    set_cursor(0, 0);
+    int cols, rows;
+    
+    if (fbcon_init(&cols, &rows)) {
+        // The bootloader left a VBE mode set up
+        fb_console = 1;
+        screen_width = cols;
+        screen_height = rows;
+    } else {
+        // Enable the hardware cursor as an underline (scanlines 14-15)
+        outb(VGA_CRTC_INDEX, VGA_CRTC_CURSOR_START);
+        outb(VGA_CRTC_DATA, 14);
+        outb(VGA_CRTC_INDEX, VGA_CRTC_CURSOR_END);
+        outb(VGA_CRTC_DATA, 15);
+    }
+    hw_cursor_pos = -1;
+    
+    // Give every console its own buffer and clear it
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        if (fb_console) {
+            consoles[i].buffer = (unsigned short*)CONSOLE_SHADOW_BASE + i * SHADOW_CELLS;
+        } else {
+            consoles[i].buffer = (unsigned short*)(VGA_BUFFER + i * VGA_PAGE_SIZE);
+        }
+        consoles[i].cursor_row = 0;
+        consoles[i].cursor_col = 0;
+        consoles[i].color = VGA_LIGHT_GREY;
+        consoles[i].ansi.state = ANSI_STATE_NORMAL;
+        consoles[i].ansi.param_count = 0;
+        consoles[i].ansi.saved_row = 0;
+        consoles[i].ansi.saved_col = 0;
+    }
+    
+    active_console = 0;
+    for (int i = MAX_CONSOLES - 1; i >= 0; i--) {
+        vga_buffer = consoles[i].buffer;
+        cursor_row = 0;
+        cursor_col = 0;
+        current_color = VGA_LIGHT_GREY;
+        active_console = i;
+        clear_screen();
+    }
+    
+    show_console(0);
+    screen_flush();
 }
 
 // Clear the entire screen
@@ -29,10 +112,13 @@ void clear_screen() {
             vga_buffer[row * VGA_WIDTH + col] = make_vga_entry(' ', current_color);
         }
     }
+    if (fb_render) {
+        fbcon_clear(current_color);
+    }
     set_cursor(0, 0);
 }
 
-// Set cursor position
+// Set cursor position (software only; the CRTC follows on screen_flush)
 void set_cursor(int row, int col) {
     if (row >= 0 && row < VGA_HEIGHT && col >= 0 && col < VGA_WIDTH) {
         cursor_row = row;
@@ -42,34 +128,234 @@ void set_cursor(int row, int col) {
 
 // Print a single character
 void print_char(char c, char color) {
+    if (output_hook) {
+        output_hook(c, color, output_context);
+        return;
+    }
+    
     if (c == '\n') {
         cursor_row++;
         cursor_col = 0;
     } else if (c == '\r') {
         cursor_col = 0;
+    } else if (c == '\b') {
+        if (cursor_col > 0) {
+            cursor_col--;
+        } else if (cursor_row > 0) {
+            cursor_row--;
+            cursor_col = VGA_WIDTH - 1;
+        }
     } else if (c == '\t') {
         cursor_col = (cursor_col + 4) & ~3; // Align to 4-character boundary
     } else {
         vga_buffer[cursor_row * VGA_WIDTH + cursor_col] = make_vga_entry(c, color);
+        if (fb_render) {
+            fbcon_mark_dirty(cursor_row, cursor_col);
+        }
         cursor_col++;
     }
-
+    
     // Handle line wrapping
     if (cursor_col >= VGA_WIDTH) {
         cursor_col = 0;
         cursor_row++;
     }
-
+    
     // Handle screen overflow
     if (cursor_row >= VGA_HEIGHT) {
         scroll_screen();
     }
 }
 
-// Print a string with specified color
+// ANSI color number (black, red, green, yellow, blue, magenta, cyan, white)
+// to VGA color
+static const char ansi_to_vga[8] = {
+    VGA_BLACK, VGA_RED, VGA_GREEN, VGA_BROWN, VGA_BLUE, VGA_MAGENTA, VGA_CYAN, VGA_LIGHT_GREY
+};
+
+// Apply an SGR (Select Graphic Rendition) sequence to the working color
+static char apply_sgr(ansi_parser_t* ansi, char color, char base_color) {
+    int fg = color & 0x0F;
+    int bg = (color >> 4) & 0x0F;
+    
+    for (int i = 0; i < ansi->param_count; i++) {
+        int p = ansi->params[i];
+        
+        if (p == 0) {
+            fg = base_color & 0x0F;
+            bg = (base_color >> 4) & 0x0F;
+        } else if (p == 1) {
+            fg |= 0x08;
+        } else if (p == 22) {
+            fg &= 0x07;
+        } else if (p == 7 || p == 27) {
+            int tmp = fg;
+            fg = bg;
+            bg = tmp;
+        } else if (p >= 30 && p <= 37) {
+            fg = ansi_to_vga[p - 30] | (fg & 0x08);
+        } else if (p == 39) {
+            fg = base_color & 0x0F;
+        } else if (p >= 40 && p <= 47) {
+            bg = ansi_to_vga[p - 40];
+        } else if (p == 49) {
+            bg = (base_color >> 4) & 0x0F;
+        } else if (p >= 90 && p <= 97) {
+            fg = ansi_to_vga[p - 90] | 0x08;
+        } else if (p >= 100 && p <= 107) {
+            bg = ansi_to_vga[p - 100] | 0x08;
+        }
+    }
+    
+    return (char)((bg << 4) | fg);
+}
+
+// Blank a run of cells on one row with the given color
+static void erase_cells(int row, int from_col, int to_col, char color) {
+    for (int col = from_col; col <= to_col; col++) {
+        print_char_at(' ', color, row, col);
+    }
+}
+
+// Execute a complete CSI sequence ending in `final`
+static void execute_csi(ansi_parser_t* ansi, char final, char* color, char base_color) {
+    int n = ansi->params[0] > 0 ? ansi->params[0] : 1;
+    
+    switch (final) {
+        case 'm':
+            *color = apply_sgr(ansi, *color, base_color);
+            break;
+        case 'A':
+            cursor_row = cursor_row - n < 0 ? 0 : cursor_row - n;
+            break;
+        case 'B':
+            cursor_row = cursor_row + n >= VGA_HEIGHT ? VGA_HEIGHT - 1 : cursor_row + n;
+            break;
+        case 'C':
+            cursor_col = cursor_col + n >= VGA_WIDTH ? VGA_WIDTH - 1 : cursor_col + n;
+            break;
+        case 'D':
+            cursor_col = cursor_col - n < 0 ? 0 : cursor_col - n;
+            break;
+        case 'G':
+            set_cursor(cursor_row, n - 1);
+            break;
+        case 'H':
+        case 'f': {
+            int row = ansi->params[0] > 0 ? ansi->params[0] : 1;
+            int col = ansi->param_count > 1 && ansi->params[1] > 0 ? ansi->params[1] : 1;
+            set_cursor(row - 1, col - 1);
+            break;
+        }
+        case 'J':
+            if (ansi->params[0] == 2) {
+                for (int row = 0; row < VGA_HEIGHT; row++) {
+                    erase_cells(row, 0, VGA_WIDTH - 1, *color);
+                }
+            } else if (ansi->params[0] == 1) {
+                for (int row = 0; row < cursor_row; row++) {
+                    erase_cells(row, 0, VGA_WIDTH - 1, *color);
+                }
+                erase_cells(cursor_row, 0, cursor_col, *color);
+            } else {
+                erase_cells(cursor_row, cursor_col, VGA_WIDTH - 1, *color);
+                for (int row = cursor_row + 1; row < VGA_HEIGHT; row++) {
+                    erase_cells(row, 0, VGA_WIDTH - 1, *color);
+                }
+            }
+            break;
+        case 'K':
+            if (ansi->params[0] == 2) {
+                erase_cells(cursor_row, 0, VGA_WIDTH - 1, *color);
+            } else if (ansi->params[0] == 1) {
+                erase_cells(cursor_row, 0, cursor_col, *color);
+            } else {
+                erase_cells(cursor_row, cursor_col, VGA_WIDTH - 1, *color);
+            }
+            break;
+        case 's':
+            ansi->saved_row = cursor_row;
+            ansi->saved_col = cursor_col;
+            break;
+        case 'u':
+            set_cursor(ansi->saved_row, ansi->saved_col);
+            break;
+        default:
+            // Unsupported sequence: ignore it
+            break;
+    }
+}
+
+// Print a string with specified color. ANSI escape sequences are
+// interpreted: SGR colors apply until the end of this call, cursor movement
+// and erase act on the active console. A sequence split across calls is
+// resumed from the console's parser state.
 void print_string(const char* str, char color) {
+    ansi_parser_t* ansi = &consoles[active_console].ansi;
+    char working_color = color;
+    
     for (int i = 0; str[i] != '\0'; i++) {
-        print_char(str[i], color);
+        char c = str[i];
+        
+        if (ansi->state == ANSI_STATE_NORMAL) {
+            if (c == '\033') {
+                ansi->state = ANSI_STATE_ESCAPE;
+            } else {
+                print_char(c, working_color);
+            }
+        } else if (ansi->state == ANSI_STATE_ESCAPE) {
+            if (c == '[') {
+                ansi->state = ANSI_STATE_CSI;
+                ansi->param_count = 1;
+                for (int p = 0; p < ANSI_MAX_PARAMS; p++) {
+                    ansi->params[p] = 0;
+                }
+            } else {
+                ansi->state = ANSI_STATE_NORMAL;
+            }
+        } else {
+            if (c >= '0' && c <= '9') {
+                int* p = &ansi->params[ansi->param_count - 1];
+                if (*p < 1000) {
+                    *p = *p * 10 + (c - '0');
+                }
+            } else if (c == ';') {
+                if (ansi->param_count < ANSI_MAX_PARAMS) {
+                    ansi->param_count++;
+                }
+            } else if (c >= 0x40 && c <= 0x7E) {
+                execute_csi(ansi, c, &working_color, color);
+                ansi->state = ANSI_STATE_NORMAL;
+            }
+            // Intermediate/private bytes such as '?' are skipped
+        }
+    }
+}
+
+// Send subsequent output to a hook instead of the active console
+void screen_redirect_output(screen_output_fn output, void* context) {
+    output_hook = output;
+    output_context = context;
+}
+
+// Current output hook, NULL when printing to the console
+screen_output_fn screen_get_output(void** context) {
+    *context = output_context;
+    return output_hook;
+}
+
+// Print an unsigned decimal number
+void print_uint(unsigned int value, char color) {
+    char digits[12];
+    int i = 0;
+    
+    do {
+        digits[i++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+    
+    while (i > 0) {
+        print_char(digits[--i], color);
     }
 }
 
@@ -86,6 +372,16 @@ void print_string_at(const char* str, char color, int row, int col) {
 
 // Scroll the screen up by one line
 void scroll_screen() {
+    // The overlay cell must not travel up with the text
+    if (overlay_console == active_console) {
+        overlay_lift();
+    }
+    
+    // Move the framebuffer pixels first, while the shadow still matches them
+    if (fb_render) {
+        fbcon_scroll((const unsigned short*)vga_buffer, current_color);
+    }
+    
     // Move all lines up by one
     for (int row = 1; row < VGA_HEIGHT; row++) {
         for (int col = 0; col < VGA_WIDTH; col++) {
@@ -111,6 +407,9 @@ void set_color(char color) {
 void print_char_at(char c, char color, int row, int col) {
     if (row >= 0 && row < VGA_HEIGHT && col >= 0 && col < VGA_WIDTH) {
         vga_buffer[row * VGA_WIDTH + col] = make_vga_entry(c, color);
+        if (fb_render) {
+            fbcon_mark_dirty(row, col);
+        }
     }
 }
 
@@ -122,24 +421,150 @@ char get_char_at(int row, int col) {
     return ' ';
 }
 
-// Save character under mouse cursor
-char saved_char_under_mouse = ' ';
-int saved_mouse_x = 0;
-int saved_mouse_y = 0;
+// Restore the cell under the pointer overlay. If output has replaced the
+// cell since the overlay was drawn, the new contents win.
+static void overlay_lift() {
+    if (overlay_index < 0) return;
+    
+    volatile unsigned short* cells = consoles[overlay_console].buffer;
+    if (cells[overlay_index] == overlay_drawn) {
+        cells[overlay_index] = overlay_saved;
+        if (fb_console) {
+            fbcon_mark_dirty(overlay_index / VGA_WIDTH, overlay_index % VGA_WIDTH);
+        }
+    }
+    overlay_index = -1;
+}
 
-// Save character under mouse cursor position
-void save_char_under_mouse() {
-    if (mouse_state.visible) {
-        saved_char_under_mouse = get_char_at(mouse_state.y, mouse_state.x);
-        saved_mouse_x = mouse_state.x;
-        saved_mouse_y = mouse_state.y;
+// Composite the pointer onto the visible console. Nothing is touched
+// unless the pointer moved or output overwrote the overlay cell.
+static void overlay_update() {
+    volatile unsigned short* cells = consoles[visible_console].buffer;
+    int index = pointer_visible ? pointer_row * VGA_WIDTH + pointer_col : -1;
+    
+    if (index == overlay_index &&
+        (index < 0 || (overlay_console == visible_console && cells[index] == overlay_drawn))) {
+        return;
+    }
+    
+    overlay_lift();
+    if (index < 0) return;
+    
+    // Swap foreground and background, keeping the intensity bit on the
+    // foreground so the blink bit is never set
+    unsigned char attr = (unsigned char)(cells[index] >> 8);
+    unsigned char inverse = ((attr & 0x07) << 4) | ((attr >> 4) & 0x07) | (attr & 0x08);
+    
+    overlay_saved = cells[index];
+    overlay_drawn = (overlay_saved & 0x00FF) | ((unsigned short)inverse << 8);
+    cells[index] = overlay_drawn;
+    overlay_index = index;
+    overlay_console = visible_console;
+    
+    if (fb_console) {
+        fbcon_mark_dirty(pointer_row, pointer_col);
     }
 }
 
-// Restore character under mouse cursor
-void restore_char_under_mouse() {
-    if (saved_mouse_x >= 0 && saved_mouse_x < VGA_WIDTH && 
-        saved_mouse_y >= 0 && saved_mouse_y < VGA_HEIGHT) {
-        print_char_at(saved_char_under_mouse, current_color, saved_mouse_y, saved_mouse_x);
+// Set the mouse pointer position on the visible console. Only recorded
+// here; the overlay follows on the next screen_flush, so any number of
+// movements between frames cost one redraw.
+void screen_set_pointer(int row, int col, int visible) {
+    if (row < 0 || row >= VGA_HEIGHT || col < 0 || col >= VGA_WIDTH) return;
+    
+    pointer_row = row;
+    pointer_col = col;
+    pointer_visible = visible;
+}
+
+// Commit deferred hardware state. print_char only moves the software cursor;
+// the CRTC registers are reprogrammed here, and only when the position
+// changed since the last flush, so a long string costs no port I/O.
+// On the framebuffer console this is also where changed cells are drawn.
+void screen_flush() {
+    // The cursor shown is the visible console's, not necessarily the active one
+    int row = cursor_row;
+    int col = cursor_col;
+    if (visible_console != active_console) {
+        row = consoles[visible_console].cursor_row;
+        col = consoles[visible_console].cursor_col;
     }
+    
+    overlay_update();
+    
+    if (fb_console) {
+        fbcon_flush((const unsigned short*)consoles[visible_console].buffer, row, col);
+        return;
+    }
+    
+    // CRTC cursor addresses are relative to the start of VGA memory
+    int pos = visible_console * (VGA_PAGE_SIZE / 2) + row * VGA_WIDTH + col;
+    if (pos == hw_cursor_pos) {
+        return;
+    }
+    
+    outb(VGA_CRTC_INDEX, VGA_CRTC_CURSOR_LOW);
+    outb(VGA_CRTC_DATA, (unsigned char)(pos & 0xFF));
+    outb(VGA_CRTC_INDEX, VGA_CRTC_CURSOR_HIGH);
+    outb(VGA_CRTC_DATA, (unsigned char)((pos >> 8) & 0xFF));
+    hw_cursor_pos = pos;
+}
+
+// Make a console the target of print_* output. Only the output state is
+// swapped (a handful of fields), no cells are copied.
+void select_console(int index) {
+    if (index < 0 || index >= MAX_CONSOLES || index == active_console) return;
+    
+    consoles[active_console].buffer = vga_buffer;
+    consoles[active_console].cursor_row = cursor_row;
+    consoles[active_console].cursor_col = cursor_col;
+    consoles[active_console].color = current_color;
+    
+    vga_buffer = consoles[index].buffer;
+    cursor_row = consoles[index].cursor_row;
+    cursor_col = consoles[index].cursor_col;
+    current_color = consoles[index].color;
+    active_console = index;
+    
+    fb_render = fb_console && active_console == visible_console;
+}
+
+// Display a console. Text mode flips the CRTC start address to the
+// console's VGA page; the framebuffer console repaints from its shadow.
+void show_console(int index) {
+    if (index < 0 || index >= MAX_CONSOLES) return;
+    
+    // The overlay belongs to the page being hidden
+    overlay_lift();
+    visible_console = index;
+    fb_render = fb_console && active_console == visible_console;
+    
+    if (fb_console) {
+        fbcon_invalidate();
+    } else {
+        unsigned int start = index * (VGA_PAGE_SIZE / 2);
+        outb(VGA_CRTC_INDEX, VGA_CRTC_START_HIGH);
+        outb(VGA_CRTC_DATA, (unsigned char)((start >> 8) & 0xFF));
+        outb(VGA_CRTC_INDEX, VGA_CRTC_START_LOW);
+        outb(VGA_CRTC_DATA, (unsigned char)(start & 0xFF));
+        hw_cursor_pos = -1;
+    }
+}
+
+// Switch the console the user sees and types into
+void switch_console(int index) {
+    if (index < 0 || index >= MAX_CONSOLES || index == visible_console) return;
+    
+    show_console(index);
+    select_console(index);
+}
+
+// Get the console print_* currently writes to
+int get_active_console() {
+    return active_console;
+}
+
+// Get the console currently on screen
+int get_visible_console() {
+    return visible_console;
 }
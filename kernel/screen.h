@@ -2,10 +2,68 @@
 #define SCREEN_H
 
 // VGA text mode constants
-#define VGA_WIDTH 80
-#define VGA_HEIGHT 25
+#define TEXT_MODE_WIDTH 80
+#define TEXT_MODE_HEIGHT 25
 #define VGA_BUFFER 0xB8000
 
+// Console size in character cells. Text mode is fixed at 80x25; the VBE
+// framebuffer console (fbcon.c) derives its size from the boot video mode.
+#define SCREEN_MAX_WIDTH 160
+#define SCREEN_MAX_HEIGHT 64
+#define VGA_WIDTH screen_width
+#define VGA_HEIGHT screen_height
+extern int screen_width;
+extern int screen_height;
+
+// VGA CRT controller registers (hardware text cursor)
+#define VGA_CRTC_INDEX 0x3D4
+#define VGA_CRTC_DATA 0x3D5
+#define VGA_CRTC_CURSOR_START 0x0A
+#define VGA_CRTC_CURSOR_END 0x0B
+#define VGA_CRTC_CURSOR_HIGH 0x0E
+#define VGA_CRTC_CURSOR_LOW 0x0F
+#define VGA_CRTC_START_HIGH 0x0C
+#define VGA_CRTC_START_LOW 0x0D
+
+// Virtual consoles (Alt+F1..F4). In text mode each console owns one page of
+// VGA memory and switching only moves the CRTC start address.
+#define MAX_CONSOLES 4
+#define VGA_PAGE_SIZE 0x1000
+
+// ANSI/VT100 escape sequence parser (print_string)
+#define ANSI_STATE_NORMAL 0
+#define ANSI_STATE_ESCAPE 1
+#define ANSI_STATE_CSI 2
+#define ANSI_MAX_PARAMS 4
+
+typedef struct {
+    int state;
+    int params[ANSI_MAX_PARAMS];
+    int param_count;
+    int saved_row;
+    int saved_col;
+} ansi_parser_t;
+
+// SGR sequences for emitting a formatted block in one print_string call.
+// Colors set this way last until the end of that call.
+#define ANSI_RESET "\033[0m"
+#define ANSI_LIGHT_GREY "\033[37m"
+#define ANSI_LIGHT_RED "\033[91m"
+#define ANSI_LIGHT_GREEN "\033[92m"
+#define ANSI_LIGHT_YELLOW "\033[93m"
+#define ANSI_LIGHT_BLUE "\033[94m"
+#define ANSI_LIGHT_CYAN "\033[96m"
+#define ANSI_LIGHT_WHITE "\033[97m"
+
+// Per-console output state
+typedef struct {
+    volatile unsigned short* buffer;
+    int cursor_row;
+    int cursor_col;
+    char color;
+    ansi_parser_t ansi;
+} console_t;
+
 // Color constants
 #define VGA_BLACK 0x00
 #define VGA_BLUE 0x01
@@ -34,11 +92,26 @@ void set_cursor(int row, int col);
 void print_char(char c, char color);
 void print_string(const char* str, char color);
 void print_string_at(const char* str, char color, int row, int col);
+void print_uint(unsigned int value, char color);
 void scroll_screen();
 void set_color(char color);
 void print_char_at(char c, char color, int row, int col);
 char get_char_at(int row, int col);
-void save_char_under_mouse();
-void restore_char_under_mouse();
+void screen_set_pointer(int row, int col, int visible);
+void screen_flush();
+
+// Divert print_char/print_string output (not positioned writes) to a
+// hook, e.g. a job's pipe. The hook sees text after ANSI sequences have
+// been applied. NULL restores the console.
+typedef void (*screen_output_fn)(char c, char color, void* context);
+void screen_redirect_output(screen_output_fn output, void* context);
+screen_output_fn screen_get_output(void** context);
+
+// Virtual console functions
+void select_console(int index);
+void show_console(int index);
+void switch_console(int index);
+int get_active_console();
+int get_visible_console();
 
 #endif // SCREEN_H
@@ -0,0 +1,366 @@
+#include "script.h"
+#include "shell.h"
+#include "env.h"
+#include "screen.h"
+#include "timer.h"
+#include "klog.h"
+#include "job.h"
+#include "vfs.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+int strcmp(const char* s1, const char* s2);
+
+// Startup script. Sets the defaults the load tests below rely on.
+static const char rc_script[] =
+    "# ProtoOS startup script, run once before the first prompt.\n"
+    "# Pick another script with RC_SCRIPT=<name>, or RC_SCRIPT=none to skip it.\n"
+    "LOADTEST_RUNS=10\n"
+    "LOADTEST_PROMPT=What is ProtoOS?\n";
+
+static const char loadtest_ai_script[] =
+    "# Drive the AI pipeline without a keyboard\n"
+    "echo AI load test: $LOADTEST_RUNS runs\n"
+    "repeat $LOADTEST_RUNS\n"
+    "    ai $LOADTEST_PROMPT\n"
+    "end\n";
+
+static const char loadtest_search_script[] =
+    "# Drive web search with a few different queries\n"
+    "echo Search load test: $LOADTEST_RUNS runs per query\n"
+    "for QUERY in kernels schedulers filesystems\n"
+    "    repeat $LOADTEST_RUNS\n"
+    "        search $QUERY\n"
+    "    end\n"
+    "end\n";
+
+static const embedded_script_t embedded_scripts[] = {
+    {"rc", "Startup script", rc_script},
+    {"loadtest-ai", "Repeated AI queries", loadtest_ai_script},
+    {"loadtest-search", "Repeated web searches", loadtest_search_script},
+    {NULL, NULL, NULL} // End marker
+};
+
+static int source_depth = 0;
+
+static void script_error(const char* message, const char* detail) {
+    print_string("script: ", VGA_LIGHT_RED);
+    print_string(message, VGA_LIGHT_RED);
+    if (detail) {
+        print_string(detail, VGA_LIGHT_RED);
+    }
+    print_string("\n", VGA_LIGHT_RED);
+}
+
+static int is_name_start(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static int is_name_char(char c) {
+    return is_name_start(c) || (c >= '0' && c <= '9');
+}
+
+static int append_char(char* out, int* length, int size, char c) {
+    if (*length >= size - 1) return 0;
+    out[(*length)++] = c;
+    return 1;
+}
+
+// Expand $NAME, ${NAME} and $? into `out`. Returns 0 if the result
+// doesn't fit. A `$` that starts no variable is kept as is.
+int script_expand(const char* in, char* out, int size) {
+    int length = 0;
+    
+    while (*in) {
+        if (in[0] == '$' && in[1] == '?') {
+            char digits[12];
+            int count = 0;
+            unsigned int status = (unsigned int)shell_last_status();
+            do {
+                digits[count++] = '0' + status % 10;
+                status /= 10;
+            } while (status > 0);
+            while (count > 0) {
+                if (!append_char(out, &length, size, digits[--count])) return 0;
+            }
+            in += 2;
+            continue;
+        }
+        
+        if (in[0] == '$' && (is_name_start(in[1]) || (in[1] == '{' && is_name_start(in[2])))) {
+            int braced = in[1] == '{';
+            const char* p = in + 1 + braced;
+            char name[MAX_ENV_KEY_LENGTH];
+            int name_length = 0;
+            
+            while (is_name_char(*p)) {
+                if (name_length < MAX_ENV_KEY_LENGTH - 1) {
+                    name[name_length++] = *p;
+                }
+                p++;
+            }
+            name[name_length] = '\0';
+            
+            if (!braced || *p == '}') {
+                if (braced) p++;
+                for (const char* value = get_env_var(name); value && *value; value++) {
+                    if (!append_char(out, &length, size, *value)) return 0;
+                }
+                in = p;
+                continue;
+            }
+        }
+        
+        if (!append_char(out, &length, size, *in++)) return 0;
+    }
+    
+    out[length] = '\0';
+    return 1;
+}
+
+// Line helpers. Scripts are walked in place; each line is copied out,
+// trimmed, before it is interpreted.
+static const char* next_line(const char* p) {
+    while (*p && *p != '\n') p++;
+    return *p ? p + 1 : p;
+}
+
+static void copy_line(char* dest, const char* p) {
+    int length = 0;
+    
+    while (*p == ' ' || *p == '\t') p++;
+    while (*p && *p != '\n' && length < MAX_COMMAND_LENGTH - 1) {
+        if (*p != '\r') dest[length++] = *p;
+        p++;
+    }
+    while (length > 0 && (dest[length - 1] == ' ' || dest[length - 1] == '\t')) length--;
+    dest[length] = '\0';
+}
+
+static int first_word_is(const char* line, const char* word) {
+    while (*word && *line == *word) {
+        line++;
+        word++;
+    }
+    return *word == '\0' && (*line == ' ' || *line == '\t' || *line == '\0');
+}
+
+static int count_words(const char* line) {
+    int words = 0;
+    int in_word = 0;
+    
+    for (; *line; line++) {
+        int space = *line == ' ' || *line == '\t';
+        if (!space && !in_word) words++;
+        in_word = !space;
+    }
+    return words;
+}
+
+// `repeat N` on its own line opens a block; `repeat N cmd` is the builtin
+static int opens_block(const char* line) {
+    return (first_word_is(line, "repeat") && count_words(line) == 2) ||
+           first_word_is(line, "for");
+}
+
+// Find the `end` closing a block whose body starts at `body`
+static const char* find_block_end(const char* body) {
+    char line[MAX_COMMAND_LENGTH];
+    int nesting = 0;
+    
+    for (const char* p = body; *p; p = next_line(p)) {
+        copy_line(line, p);
+        if (opens_block(line)) {
+            nesting++;
+        } else if (strcmp(line, "end") == 0) {
+            if (nesting == 0) return p;
+            nesting--;
+        }
+    }
+    return NULL;
+}
+
+// NAME=value sets an environment variable
+static int is_assignment(const char* line) {
+    if (!is_name_start(*line)) return 0;
+    while (is_name_char(*line)) line++;
+    return *line == '=';
+}
+
+static int run_assignment(const char* line) {
+    char name[MAX_ENV_KEY_LENGTH];
+    char value[MAX_ENV_VALUE_LENGTH];
+    int length = 0;
+    
+    while (*line != '=' && length < MAX_ENV_KEY_LENGTH - 1) {
+        name[length++] = *line++;
+    }
+    name[length] = '\0';
+    
+    if (!script_expand(line + 1, value, MAX_ENV_VALUE_LENGTH)) {
+        script_error("value too long for ", name);
+        return 1;
+    }
+    if (!set_env_var(name, value)) {
+        script_error("environment full, cannot set ", name);
+        return 1;
+    }
+    return 0;
+}
+
+static int run_lines(const char* p, const char* stop, int nesting);
+
+// Run a repeat or for block. `header` is the line that opened it.
+static int run_block(const char* header, const char* body, const char* end, int nesting) {
+    char expanded[MAX_COMMAND_LENGTH];
+    char* argv[MAX_ARGS];
+    int status = 0;
+    
+    if (!script_expand(header, expanded, MAX_COMMAND_LENGTH)) {
+        script_error("line too long: ", header);
+        return 1;
+    }
+    int argc = parse_command(expanded, argv, MAX_ARGS);
+    
+    if (strcmp(argv[0], "repeat") == 0) {
+        int count = 0;
+        const char* digit = argc >= 2 ? argv[1] : "";
+        while (*digit >= '0' && *digit <= '9' && count <= SCRIPT_MAX_REPEAT) {
+            count = count * 10 + (*digit++ - '0');
+        }
+        if (*digit != '\0' || count < 1 || count > SCRIPT_MAX_REPEAT) {
+            script_error("bad repeat count: ", header);
+            return 1;
+        }
+        
+        unsigned int start_ms = get_uptime_ms();
+        for (int i = 0; i < count; i++) {
+            status = run_lines(body, end, nesting);
+            job_yield();
+        }
+        script_print_timing(count, get_uptime_ms() - start_ms);
+        return status;
+    }
+    
+    if (argc < 3 || !is_name_start(argv[1][0]) || strcmp(argv[2], "in") != 0) {
+        script_error("expected: for <NAME> in <words...>: ", header);
+        return 1;
+    }
+    for (int i = 3; i < argc; i++) {
+        if (!set_env_var(argv[1], argv[i])) {
+            script_error("environment full, cannot set ", argv[1]);
+            return 1;
+        }
+        status = run_lines(body, end, nesting);
+    }
+    return status;
+}
+
+// Run lines from `p` up to `stop` (or the end of the text if NULL).
+// Returns the status of the last command.
+static int run_lines(const char* p, const char* stop, int nesting) {
+    char line[MAX_COMMAND_LENGTH];
+    int status = 0;
+    
+    while (*p && (!stop || p < stop)) {
+        const char* next = next_line(p);
+        copy_line(line, p);
+        
+        if (line[0] == '\0' || line[0] == '#') {
+            // Blank or comment
+        } else if (opens_block(line)) {
+            const char* end = find_block_end(next);
+            if (!end) {
+                script_error("missing end for: ", line);
+                return 1;
+            }
+            if (nesting >= SCRIPT_MAX_NESTING) {
+                script_error("blocks nested too deeply", NULL);
+                return 1;
+            }
+            status = run_block(line, next, end, nesting + 1);
+            next = next_line(end);
+        } else if (strcmp(line, "end") == 0) {
+            script_error("end without repeat or for", NULL);
+            return 1;
+        } else if (is_assignment(line)) {
+            status = run_assignment(line);
+        } else {
+            status = execute_command(line);
+        }
+        
+        p = next;
+    }
+    
+    return status;
+}
+
+// Run a script held in memory
+int script_run(const char* text) {
+    if (!text) return 1;
+    return run_lines(text, NULL, 0);
+}
+
+// Run an embedded script by name. Returns -1 if there is no such script.
+static int run_sourced(const char* name, const char* text) {
+    if (source_depth >= SCRIPT_MAX_DEPTH) {
+        script_error("source nested too deeply: ", name);
+        return 1;
+    }
+    
+    source_depth++;
+    int status = script_run(text);
+    source_depth--;
+    return status;
+}
+
+// Run a script from the initrd's scripts directory, which takes
+// precedence, or an embedded one. Initrd scripts run in place. Returns
+// -1 if there is no such script.
+int script_source(const char* name) {
+    char path[VFS_PATH_LENGTH];
+    int length = 0;
+    
+    for (const char* p = SCRIPT_INITRD_DIR; *p; p++) path[length++] = *p;
+    for (const char* p = name; *p && *p != '/' && length < VFS_PATH_LENGTH - 1; p++) path[length++] = *p;
+    path[length] = '\0';
+    
+    const char* text = (const char*)vfs_map(path, NULL);
+    if (text) return run_sourced(name, text);
+    
+    for (int i = 0; embedded_scripts[i].name != NULL; i++) {
+        if (strcmp(embedded_scripts[i].name, name) == 0) {
+            return run_sourced(name, embedded_scripts[i].text);
+        }
+    }
+    return -1;
+}
+
+// Run the startup script named by RC_SCRIPT, or the default one
+void script_run_rc() {
+    const char* name = get_env_var(SCRIPT_RC_VARIABLE);
+    if (!name) name = SCRIPT_RC_DEFAULT;
+    if (strcmp(name, "none") == 0) return;
+    
+    klog_detail(KLOG_INFO, "script: running startup script ", name);
+    if (script_source(name) < 0) {
+        klog_detail(KLOG_WARNING, "script: no such startup script ", name);
+    }
+}
+
+const embedded_script_t* script_list() {
+    return embedded_scripts;
+}
+
+// Report how long a repeat took, for load tests
+void script_print_timing(int runs, unsigned int elapsed_ms) {
+    print_string("repeat: ", VGA_LIGHT_CYAN);
+    print_uint(runs, VGA_LIGHT_WHITE);
+    print_string(" runs in ", VGA_LIGHT_CYAN);
+    print_uint(elapsed_ms, VGA_LIGHT_WHITE);
+    print_string(" ms, ", VGA_LIGHT_CYAN);
+    print_uint(elapsed_ms / runs, VGA_LIGHT_WHITE);
+    print_string(" ms each\n", VGA_LIGHT_CYAN);
+}
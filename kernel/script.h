@@ -0,0 +1,38 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+// Script configuration
+#define SCRIPT_MAX_DEPTH 4              // Nested `source` calls
+#define SCRIPT_MAX_NESTING 8            // Nested repeat/for blocks
+#define SCRIPT_MAX_REPEAT 10000
+#define SCRIPT_RC_VARIABLE "RC_SCRIPT"  // Names the boot script; "none" skips it
+#define SCRIPT_RC_DEFAULT "rc"
+#define SCRIPT_INITRD_DIR "/initrd/scripts/"  // Scripts packed into the initrd
+
+// Scripts are plain command lines, one per line, with:
+//   # comment
+//   NAME=value                 set an environment variable
+//   cmd1 && cmd2               run cmd2 only if cmd1 succeeded
+//   repeat <count>             run the block up to `end` count times
+//   for <NAME> in <words...>   run the block once per word, NAME set to it
+//   end
+// $NAME and ${NAME} expand to environment variables, $? to the last status.
+// Each command is expanded after the line is split on &&, | and >, so
+// values are never parsed as operators.
+
+// An embedded script, compiled into the kernel
+typedef struct {
+    const char* name;
+    const char* description;
+    const char* text;
+} embedded_script_t;
+
+// Script functions
+int script_run(const char* text);
+int script_expand(const char* in, char* out, int size);
+int script_source(const char* name);
+void script_run_rc();
+const embedded_script_t* script_list();
+void script_print_timing(int runs, unsigned int elapsed_ms);
+
+#endif // SCRIPT_H
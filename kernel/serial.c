@@ -0,0 +1,63 @@
+#include "serial.h"
+#include "io.h"
+#include "timer.h"
+
+static int serial_ok = 0;
+
+// Program COM1 for 115200 8N1 with FIFOs, polled (no interrupts)
+void init_serial() {
+    // A missing UART reads back 0xFF; use the scratch register to tell
+    outb(SERIAL_COM1 + SERIAL_SCRATCH, 0x5A);
+    if (inb(SERIAL_COM1 + SERIAL_SCRATCH) != 0x5A) {
+        serial_ok = 0;
+        return;
+    }
+    
+    outb(SERIAL_COM1 + SERIAL_INTERRUPT_ENABLE, 0x00);
+    outb(SERIAL_COM1 + SERIAL_LINE_CONTROL, SERIAL_LCR_DLAB);
+    outb(SERIAL_COM1 + SERIAL_DATA, SERIAL_DIVISOR_115200 & 0xFF);
+    outb(SERIAL_COM1 + SERIAL_INTERRUPT_ENABLE, (SERIAL_DIVISOR_115200 >> 8) & 0xFF);
+    outb(SERIAL_COM1 + SERIAL_LINE_CONTROL, SERIAL_LCR_8N1);
+    outb(SERIAL_COM1 + SERIAL_FIFO_CONTROL, 0xC7);    // Enable and clear, 14-byte threshold
+    outb(SERIAL_COM1 + SERIAL_MODEM_CONTROL, 0x03);   // DTR + RTS
+    serial_ok = 1;
+}
+
+int serial_present() {
+    return serial_ok;
+}
+
+// Is a received byte waiting?
+int serial_received() {
+    return serial_ok && (inb(SERIAL_COM1 + SERIAL_LINE_STATUS) & SERIAL_LSR_DATA_READY);
+}
+
+// Read one byte, waiting up to timeout_ms. Returns -1 on timeout.
+int serial_read_char(unsigned int timeout_ms) {
+    if (!serial_ok) return -1;
+    
+    unsigned int start = get_uptime_ms();
+    while (!serial_received()) {
+        if (get_uptime_ms() - start >= timeout_ms) {
+            return -1;
+        }
+    }
+    return inb(SERIAL_COM1 + SERIAL_DATA);
+}
+
+void serial_write_char(char c) {
+    if (!serial_ok) return;
+    
+    while (!(inb(SERIAL_COM1 + SERIAL_LINE_STATUS) & SERIAL_LSR_TX_EMPTY)) {
+    }
+    outb(SERIAL_COM1 + SERIAL_DATA, c);
+}
+
+void serial_write_string(const char* str) {
+    while (*str) {
+        if (*str == '\n') {
+            serial_write_char('\r');
+        }
+        serial_write_char(*str++);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+// 16550 UART on COM1
+#define SERIAL_COM1 0x3F8
+#define SERIAL_DATA 0               // Register offsets from the base port
+#define SERIAL_INTERRUPT_ENABLE 1
+#define SERIAL_FIFO_CONTROL 2
+#define SERIAL_LINE_CONTROL 3
+#define SERIAL_MODEM_CONTROL 4
+#define SERIAL_LINE_STATUS 5
+#define SERIAL_SCRATCH 7
+
+#define SERIAL_LSR_DATA_READY 0x01
+#define SERIAL_LSR_TX_EMPTY 0x20
+#define SERIAL_LCR_DLAB 0x80
+#define SERIAL_LCR_8N1 0x03
+#define SERIAL_DIVISOR_115200 1
+
+// Serial functions
+void init_serial();
+int serial_present();
+int serial_received();
+int serial_read_char(unsigned int timeout_ms);
+void serial_write_char(char c);
+void serial_write_string(const char* str);
+
+#endif // SERIAL_H
@@ -6,6 +6,26 @@
 #include "env.h"
 #include "voice.h"
 #include "assistant.h"
+#include "klog.h"
+#include "timer.h"
+#include "layout.h"
+#include "lineedit.h"
+#include "histogram.h"
+#include "replay.h"
+#include "script.h"
+#include "job.h"
+#include "stream.h"
+#include "phash.h"
+#include "capture.h"
+#include "history.h"
+#include "ata.h"
+#include "block.h"
+#include "bcache.h"
+#include "vfs.h"
+#include "fat.h"
+#include "convlog.h"
+#include "mmap.h"
+#include "memory.h"
 
 // Define NULL for kernel environment
 #ifndef NULL
@@ -19,6 +39,7 @@ typedef unsigned int size_t;
 size_t strlen(const char* s);
 char* strncpy(char* dest, const char* src, size_t n);
 int strcmp(const char* s1, const char* s2);
+char* strstr(const char* haystack, const char* needle);
 void* memset(void* s, int c, size_t n);
 
 // Command function declarations
@@ -87,33 +108,90 @@ void* memset(void* s, int c, size_t n) {
 }
 
 // Global shell state
-static char command_history[MAX_HISTORY][MAX_COMMAND_LENGTH];
-static int history_index = 0;
-static int history_count = 0;
 static char current_prompt[PROMPT_LENGTH] = "ProtoOS> ";
 static langchain_session_t ai_session;
+static int last_status = 0;
+static int capture_allowed = 0;         // Set while running a line typed at the prompt
+
+// Input latency: from a scancode being read off the controller until the
+// frame that echoes it has been flushed to the screen
+static histogram_t input_latency;
+static unsigned long long frame_key_tsc[INPUTLAT_FRAME_KEYS];
+static int frame_key_count = 0;
 
 // Built-in commands array
 static shell_command_t builtin_commands[] = {
     {"help", "Show available commands", cmd_help},
-    {"clear", "Clear the screen", cmd_clear},
-    {"ai", "Interact with AI assistant", cmd_ai},
-    {"chat", "Chat with AI (alias for 'ai')", cmd_chat},
+    {"clear", "Clear the screen", cmd_clear, SHELL_NO_CAPTURE},
+    {"ai", "Interact with AI assistant", cmd_ai, SHELL_NO_CAPTURE | SHELL_FREE_TEXT},
+    {"chat", "Chat with AI (alias for 'ai')", cmd_chat, SHELL_NO_CAPTURE | SHELL_FREE_TEXT},
     {"model", "Set AI model type", cmd_model},
     {"setkey", "Set API key for AI models", cmd_set_api_key},
     {"env", "Show environment variables", cmd_env},
     {"voice", "Voice assistant commands", cmd_voice},
     {"assistant", "AI assistant system", cmd_assistant},
-    {"search", "Web search functionality", cmd_search},
+    {"search", "Web search functionality", cmd_search, SHELL_FREE_TEXT},
     {"weather", "Get weather information", cmd_weather},
     {"news", "Get latest news", cmd_news},
-    {"history", "Show command history", cmd_history},
+    {"history", "Show, search (history <text>) or clear (-c) history", cmd_history},
+    {"dmesg", "Show the kernel log", cmd_dmesg},
+    {"inputlat", "Show key-to-screen latency", cmd_inputlat},
+    {"replay", "Record and replay input sessions", cmd_replay, SHELL_NO_CAPTURE},
+    {"diskbench", "Measure disk throughput and IOPS", cmd_diskbench},
+    {"mmapbench", "Read a file through a memory mapping", cmd_mmapbench},
+    {"cachestat", "Show block cache hit rates", cmd_cachestat},
+    {"sync", "Write cached disk blocks back", cmd_sync},
+    {"ailog", "Show the AI conversation log (sync, compact)", cmd_ailog},
+    {"ls", "List a directory", cmd_ls},
+    {"cat", "Print files (or piped input)", cmd_cat},
+    {"source", "Run a script", cmd_source, SHELL_NO_CAPTURE},
+    {"repeat", "Run a command several times", cmd_repeat, SHELL_NO_CAPTURE},
+    {"echo", "Print arguments", cmd_echo},
+    {"set", "Set or show environment variables", cmd_set},
+    {"jobs", "List background jobs", cmd_jobs},
+    {"fg", "Wait for a background job", cmd_fg, SHELL_NO_CAPTURE},
+    {"kill", "Stop a background job", cmd_kill},
+    {"grep", "Filter piped input by a pattern", cmd_grep},
     {"reset", "Reset AI conversation", cmd_reset},
     {"mouse", "Mouse control commands", cmd_mouse},
-    {"exit", "Exit the shell", cmd_exit},
+    {"exit", "Exit the shell", cmd_exit, SHELL_NO_CAPTURE},
     {"", "", NULL} // End marker
 };
 
+// Alternative command names
+static const shell_alias_t builtin_aliases[] = {
+    {"?", "help"},
+    {"cls", "clear"},
+    {"h", "history"},
+    {"quit", "exit"},
+    {NULL, NULL} // End marker
+};
+
+// Perfect hash over command names and aliases, built by init_shell
+static phash_t command_index;
+
+// Subcommands offered by tab completion
+static const shell_subcommand_t builtin_subcommands[] = {
+    {"model", "openai"}, {"model", "claude"}, {"model", "gemini"}, {"model", "local"},
+    {"voice", "start"}, {"voice", "stop"}, {"voice", "status"}, {"voice", "help"},
+    {"assistant", "start"}, {"assistant", "stop"}, {"assistant", "status"}, {"assistant", "help"},
+    {"dmesg", "-c"}, {"dmesg", "-n"},
+    {"history", "-c"},
+    {"inputlat", "reset"},
+    {"mmapbench", "normal"}, {"mmapbench", "random"}, {"mmapbench", "sequential"}, {"mmapbench", "willneed"},
+    {"cachestat", "reset"},
+    {"ailog", "sync"}, {"ailog", "compact"},
+    {"replay", "record"}, {"replay", "stop"}, {"replay", "play"}, {"replay", "script"},
+    {"replay", "serial"}, {"replay", "dump"}, {"replay", "status"},
+    {"mouse", "status"}, {"mouse", "show"}, {"mouse", "hide"}, {"mouse", "pos"},
+    {NULL, NULL} // End marker
+};
+
+// Offer the initrd's scripts to `source` completion
+static void add_script_completion(const char* name, unsigned int size, int directory, void* context) {
+    if (!directory) lineedit_add_completion("source", name);
+}
+
 // Initialize shell
 void init_shell() {
     // Initialize environment first
@@ -127,19 +205,61 @@ void init_shell() {
     if (gemini_key && strcmp(gemini_key, "your_gemini_api_key_here") != 0) {
         // Use the actual API key from .env
         langchain_init(&ai_session, gemini_key, MODEL_GOOGLE_GEMINI);
-        print_string("Gemini API key loaded from environment\n", VGA_LIGHT_GREEN);
+        klog(KLOG_NOTICE, "shell: Gemini API key loaded from environment");
     } else {
         // Use demo key initially
         langchain_init(&ai_session, "demo-key", MODEL_GOOGLE_GEMINI);
-        print_string("Using demo API key. Use 'setkey' to set your Gemini API key\n", VGA_LIGHT_YELLOW);
+        klog(KLOG_WARNING, "shell: using demo API key, use 'setkey' to set your Gemini API key");
+    }
+    
+    // Pick up the conversation where the last boot left it
+    int restored = langchain_attach_log(&ai_session);
+    if (restored > 0) {
+        klog_value(KLOG_NOTICE, "shell: AI messages restored from the conversation log: ", restored);
     }
     
     // Start the AI assistant
     start_assistant();
     
-    // Clear command history
-    history_count = 0;
-    history_index = 0;
+    // Reload the command history kept on the log disk, if there is one
+    init_history();
+    if (convlog_ready()) {
+        int commands = history_attach(convlog_load_history, convlog_store_history);
+        if (commands > 0) {
+            klog_value(KLOG_NOTICE, "shell: commands restored to the history: ", commands);
+        }
+    }
+    
+    histogram_reset(&input_latency);
+    
+    // Index command names and aliases for dispatch
+    phash_init(&command_index);
+    for (int i = 0; builtin_commands[i].function != NULL; i++) {
+        phash_add(&command_index, builtin_commands[i].name, i);
+    }
+    for (int i = 0; builtin_aliases[i].name != NULL; i++) {
+        int command = phash_lookup(&command_index, builtin_aliases[i].command);
+        if (command >= 0) {
+            phash_add(&command_index, builtin_aliases[i].name, command);
+        }
+    }
+    if (phash_build(&command_index)) {
+        klog_value(KLOG_INFO, "shell: command index built, slots ", command_index.mask + 1);
+    } else {
+        klog(KLOG_WARNING, "shell: duplicate command names, using linear dispatch");
+    }
+    
+    // Build the tab completion trie
+    for (int i = 0; builtin_commands[i].function != NULL; i++) {
+        lineedit_add_completion(builtin_commands[i].name, NULL);
+    }
+    for (int i = 0; builtin_subcommands[i].command != NULL; i++) {
+        lineedit_add_completion(builtin_subcommands[i].command, builtin_subcommands[i].name);
+    }
+    for (const embedded_script_t* script = script_list(); script->name != NULL; script++) {
+        lineedit_add_completion("source", script->name);
+    }
+    vfs_list(SCRIPT_INITRD_DIR, add_script_completion, NULL);
     
     print_string("ProtoOS Shell with AI Assistant Integration\n", VGA_LIGHT_CYAN);
     print_string("Type 'help' for available commands\n", VGA_LIGHT_GREY);
@@ -155,44 +275,28 @@ void print_prompt() {
     print_string(current_prompt, VGA_LIGHT_YELLOW);
 }
 
-// Add command to history
-void add_to_history(const char* command) {
-    if (strlen(command) == 0) return;
-    
-    strncpy(command_history[history_index], command, MAX_COMMAND_LENGTH - 1);
-    command_history[history_index][MAX_COMMAND_LENGTH - 1] = '\0';
-    
-    history_index = (history_index + 1) % MAX_HISTORY;
-    if (history_count < MAX_HISTORY) {
-        history_count++;
-    }
-}
-
 // Parse command line into arguments
-int parse_command(const char* command_line, char* argv[], int max_args) {
+int parse_command(char* command_line, char* argv[], int max_args) {
     if (!command_line || !argv || max_args <= 0) return 0;
     
     int argc = 0;
-    const char* start = command_line;
-    const char* end = command_line;
+    char* start = command_line;
     
     // Skip leading whitespace
     while (*start == ' ' || *start == '\t') start++;
     
     while (*start != '\0' && argc < max_args - 1) {
-        end = start;
+        char* end = start;
         
         // Find end of current argument
         while (*end != '\0' && *end != ' ' && *end != '\t') end++;
         
-        if (end > start) {
-            int len = end - start;
-            argv[argc] = (char*)start;
-            start = end;
-            argc++;
-        }
+        argv[argc++] = start;
+        if (*end == '\0') break;
         
-        // Skip whitespace
+        // Terminate the argument in place and skip whitespace
+        *end++ = '\0';
+        start = end;
         while (*start == ' ' || *start == '\t') start++;
     }
     
@@ -200,88 +304,418 @@ int parse_command(const char* command_line, char* argv[], int max_args) {
     return argc;
 }
 
-// Process a command line
-void process_command(const char* command_line) {
-    if (!command_line || strlen(command_line) == 0) return;
+// Call a builtin. Commands typed at the prompt have their output captured
+// and shown in one pass (or paged) when they finish; commands that stream
+// or run others print directly, and so do the commands they run.
+static int run_command(const shell_command_t* command, int argc, char* argv[]) {
+    if (!capture_allowed || job_current() || capture_active()) {
+        return command->function(argc, argv);
+    }
     
-    // Add to history
-    add_to_history(command_line);
+    if (command->flags & SHELL_NO_CAPTURE) {
+        capture_allowed = 0;
+        int status = command->function(argc, argv);
+        capture_allowed = 1;
+        return status;
+    }
     
-    // Parse command and arguments
+    capture_begin();
+    int status = command->function(argc, argv);
+    capture_end();
+    return status;
+}
+
+// Output redirected into a file, written a line at a time
+typedef struct {
+    int fd;
+    char line[JOB_LINE_LENGTH];
+    int length;
+    int failed;                         // The file stopped taking data
+} redirect_t;
+
+static void redirect_flush(redirect_t* redirect) {
+    if (redirect->length > 0 && vfs_write(redirect->fd, redirect->line, redirect->length) != redirect->length) {
+        redirect->failed = 1;
+    }
+    redirect->length = 0;
+}
+
+// Screen output hook while a command's output goes to a file
+static void redirect_output(char c, char color, void* context) {
+    redirect_t* redirect = (redirect_t*)context;
+    
+    if (c == '\b') {
+        if (redirect->length > 0) redirect->length--;
+        return;
+    }
+    
+    redirect->line[redirect->length++] = c;
+    if (c == '\n' || redirect->length == JOB_LINE_LENGTH) {
+        redirect_flush(redirect);
+    }
+}
+
+// Split a trailing `> file` or `>> file` off a command line. The `>` must
+// be a word of its own and outside quotes, so `a>b` and "3 > 2" stay as
+// they are. Returns the file name, or NULL when the output isn't
+// redirected.
+static char* split_redirect(char* command_line, int* append) {
+    char quote = 0;
+    
+    for (char* p = command_line; *p; p++) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+            continue;
+        }
+        if (*p == '"' || *p == '\'') {
+            quote = *p;
+            continue;
+        }
+        if (*p != '>' || (p > command_line && p[-1] != ' ' && p[-1] != '\t')) continue;
+        
+        int length = p[1] == '>' ? 2 : 1;
+        if (p[length] != '\0' && p[length] != ' ' && p[length] != '\t') continue;
+        
+        *append = length == 2;
+        *p = '\0';
+        char* name = p + length;
+        while (*name == ' ' || *name == '\t') name++;
+        char* end = name;
+        while (*end && *end != ' ' && *end != '\t') end++;
+        *end = '\0';
+        return name;
+    }
+    return NULL;
+}
+
+// Call a builtin with its output going to a file instead of the screen.
+// In a job the redirect has to survive the job being switched out.
+static int run_redirected(const shell_command_t* command, int argc, char* argv[],
+                          const char* path, int append) {
+    redirect_t redirect;
+    
+    if (path[0] == '\0') {
+        print_string("Missing file name after >\n", VGA_LIGHT_RED);
+        return 2;
+    }
+    redirect.fd = vfs_open(path, VFS_WRITE | VFS_CREATE | (append ? VFS_APPEND : VFS_TRUNCATE));
+    if (redirect.fd < 0) {
+        print_string("Cannot write to ", VGA_LIGHT_RED);
+        print_string(path, VGA_LIGHT_RED);
+        print_string("\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    job_hold_file(redirect.fd);
+    redirect.length = 0;
+    redirect.failed = 0;
+    
+    void* saved_context;
+    screen_output_fn saved_output = screen_get_output(&saved_context);
+    if (job_current()) {
+        job_redirect(redirect_output, &redirect);
+    } else {
+        screen_redirect_output(redirect_output, &redirect);
+    }
+    
+    int status = command->function(argc, argv);
+    
+    if (job_current()) {
+        job_redirect(NULL, NULL);
+    } else {
+        screen_redirect_output(saved_output, saved_context);
+    }
+    redirect_flush(&redirect);
+    job_release_file(redirect.fd);
+    vfs_close(redirect.fd);
+    
+    if (redirect.failed) {
+        print_string(path, VGA_LIGHT_RED);
+        print_string(": file is full, output truncated\n", VGA_LIGHT_RED);
+        if (status == 0) status = 1;
+    }
+    return status;
+}
+
+// Run one builtin. Returns its status, 127 if there is no such command.
+static int run_builtin(char* command_line) {
+    char expanded[MAX_COMMAND_LENGTH];
+    char path[VFS_PATH_LENGTH];
     char* argv[MAX_ARGS];
-    int argc = parse_command(command_line, argv, MAX_ARGS);
+    char name[32];
+    int append = 0;
+    char* target = NULL;
     
-    if (argc == 0) return;
+    // Commands that take prose keep their '>'s
+    const char* word = command_line;
+    int length = 0;
+    while (*word == ' ' || *word == '\t') word++;
+    while (word[length] && word[length] != ' ' && word[length] != '\t' && length < (int)sizeof(name) - 1) {
+        name[length] = word[length];
+        length++;
+    }
+    name[length] = '\0';
+    int command = phash_lookup(&command_index, name);
+    if (command < 0 || !(builtin_commands[command].flags & SHELL_FREE_TEXT)) {
+        target = split_redirect(command_line, &append);
+    }
     
-    // Find and execute command
-    int found = 0;
-    for (int i = 0; builtin_commands[i].function != NULL; i++) {
-        if (strcmp(argv[0], builtin_commands[i].name) == 0) {
-            builtin_commands[i].function(argc, argv);
-            found = 1;
-            break;
+    // Expand variables now that the line is split
+    if (!script_expand(command_line, expanded, MAX_COMMAND_LENGTH) ||
+        (target && !script_expand(target, path, VFS_PATH_LENGTH))) {
+        print_string("Command line too long after expansion\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    int argc = parse_command(expanded, argv, MAX_ARGS);
+    if (argc == 0) return 0;
+    
+    command = phash_lookup(&command_index, argv[0]);
+    if (command >= 0 && target) {
+        return run_redirected(&builtin_commands[command], argc, argv, path, append);
+    }
+    if (command >= 0) {
+        return run_command(&builtin_commands[command], argc, argv);
+    }
+    
+    print_string("Command not found: ", VGA_LIGHT_RED);
+    print_string(argv[0], VGA_LIGHT_RED);
+    print_string("\n", VGA_LIGHT_RED);
+    
+    const char* suggestions[SHELL_SUGGESTIONS];
+    int max_distance = strlen(argv[0]) <= 3 ? 1 : 2;     // Short names are all close
+    int count = phash_similar(&command_index, argv[0], max_distance, suggestions, SHELL_SUGGESTIONS);
+    if (count > 0) {
+        print_string("Did you mean: ", VGA_LIGHT_YELLOW);
+        for (int i = 0; i < count; i++) {
+            print_string(suggestions[i], VGA_LIGHT_WHITE);
+            print_string(i + 1 < count ? ", " : "?\n", VGA_LIGHT_YELLOW);
         }
+    } else {
+        print_string("Type 'help' for available commands\n", VGA_LIGHT_RED);
     }
+    return 127;
+}
+
+// Start `a | b | c` as one job group, each stage on its own stack and
+// joined by streams. Foreground pipelines are waited for.
+static int run_pipeline(char* pipeline, int background) {
+    char text[MAX_COMMAND_LENGTH];
+    strcpy(text, pipeline);
+    
+    int group = 0;
+    stream_t* in = NULL;
+    char* stage = pipeline;
     
-    if (!found) {
-        print_string("Command not found: ", VGA_LIGHT_RED);
-        print_string(argv[0], VGA_LIGHT_RED);
-        print_string("\nType 'help' for available commands\n", VGA_LIGHT_RED);
+    while (stage) {
+        char* next = NULL;
+        for (char* p = stage; *p; p++) {
+            if (*p == '|') {
+                *p = '\0';
+                next = p + 1;
+                break;
+            }
+        }
+        
+        stream_t* out = NULL;
+        if (next) {
+            out = stream_open();
+        }
+        int id = (next && !out) ? 0 : job_spawn(stage, text, run_builtin, in, out, group, background);
+        if (!id) {
+            print_string("Too many jobs or pipes\n", VGA_LIGHT_RED);
+            if (in) stream_close_read(in);
+            if (out) {
+                stream_close_read(out);
+                stream_close_write(out);
+            }
+            if (group) job_kill(group);
+            return 1;
+        }
+        
+        if (!group) group = id;
+        in = out;
+        stage = next;
+    }
+    
+    if (background) {
+        print_string("[", VGA_LIGHT_GREY);
+        print_uint(group, VGA_LIGHT_WHITE);
+        print_string("] ", VGA_LIGHT_GREY);
+        print_string(text, VGA_LIGHT_WHITE);
+        print_string("\n", VGA_LIGHT_WHITE);
+        return 0;
     }
+    return job_wait(group);
 }
 
-// Run the shell
-void run_shell() {
-    char command_buffer[MAX_COMMAND_LENGTH];
-    int buffer_pos = 0;
+// Run one `&&` segment: a plain builtin in place, or a pipeline and/or
+// background job
+static int run_segment(char* segment) {
+    int length = strlen(segment);
+    int background = 0;
+    int piped = 0;
     
-    while (1) {
-        print_prompt();
+    while (length > 0 && (segment[length - 1] == ' ' || segment[length - 1] == '\t')) length--;
+    if (length > 0 && segment[length - 1] == '&') {
+        background = 1;
+        length--;
+    }
+    segment[length] = '\0';
+    
+    for (char* p = segment; *p; p++) {
+        if (*p == '|') piped = 1;
+    }
+    
+    if (!background && !piped) {
+        return run_builtin(segment);
+    }
+    return run_pipeline(segment, background);
+}
+
+// Run a command line, following `&&` chains while each command succeeds.
+// Variables are expanded per command once the line is split, so their
+// values can't add commands, pipes or redirects. Does not touch the
+// history.
+int execute_command(const char* command_line) {
+    char line[MAX_COMMAND_LENGTH];
+    
+    strncpy(line, command_line, MAX_COMMAND_LENGTH - 1);
+    line[MAX_COMMAND_LENGTH - 1] = '\0';
+    
+    char* segment = line;
+    while (segment) {
+        char* next = NULL;
+        for (char* p = segment; *p; p++) {
+            if (p[0] == '&' && p[1] == '&') {
+                *p = '\0';
+                next = p + 2;
+                break;
+            }
+        }
         
-        // Read command from user
-        buffer_pos = 0;
-        memset(command_buffer, 0, MAX_COMMAND_LENGTH);
+        last_status = run_segment(segment);
+        if (last_status != 0) break;
+        segment = next;
+    }
+    
+    return last_status;
+}
+
+// Status of the last command, for $?
+int shell_last_status() {
+    return last_status;
+}
+
+void process_command(const char* command_line) {
+    if (!command_line || strlen(command_line) == 0) return;
+    
+    // Add to history
+    history_add(command_line);
+    
+    capture_allowed = 1;
+    execute_command(command_line);
+    capture_allowed = 0;
+}
+
+// Per-console command line being typed
+typedef struct {
+    line_editor_t editor;
+    int need_prompt;
+} shell_line_t;
+
+static shell_line_t console_lines[MAX_CONSOLES];
+
+// Record latency for every key consumed this frame, now that it's visible
+static void record_frame_latency() {
+    if (frame_key_count == 0) return;
+    
+    unsigned long long now = read_tsc();
+    for (int i = 0; i < frame_key_count; i++) {
+        histogram_record(&input_latency, (unsigned int)tsc_to_us(now - frame_key_tsc[i]));
+    }
+    frame_key_count = 0;
+}
+
+// Handle pending keys for the active console's command line
+static void service_console_input(shell_line_t* line) {
+    if (line->need_prompt) {
+        print_prompt();
+        lineedit_reset(&line->editor);
+        line->need_prompt = 0;
+    }
+    
+    key_event_t event;
+    while (get_key_event(&event)) {
+        if (frame_key_count < INPUTLAT_FRAME_KEYS) {
+            frame_key_tsc[frame_key_count++] = event.tsc;
+        }
         
-        while (1) {
-            // Poll for keyboard input
-            poll_keyboard();
+        if (lineedit_key(&line->editor, event.key)) {
+            print_string("\n", VGA_LIGHT_GREY);
             
-            // Poll for mouse input
-            poll_mouse();
+            // The keys so far, Enter included, are answered once the line
+            // is shown; the command's own runtime is not input latency
+            screen_flush();
+            record_frame_latency();
             
-            if (key_available()) {
-                char key = get_char();
-                
-                if (key == '\n' || key == '\r') {
-                    print_string("\n", VGA_LIGHT_GREY);
-                    break;
-                } else if (key == '\b' && buffer_pos > 0) {
-                    buffer_pos--;
-                    command_buffer[buffer_pos] = '\0';
-                    print_char('\b', VGA_LIGHT_GREY);
-                    print_char(' ', VGA_LIGHT_GREY);
-                    print_char('\b', VGA_LIGHT_GREY);
-                } else if (key >= 32 && key < 127 && buffer_pos < MAX_COMMAND_LENGTH - 1) {
-                    command_buffer[buffer_pos++] = key;
-                    print_char(key, VGA_LIGHT_WHITE);
-                }
-            }
-            
-            // Check for mouse clicks
-            if (is_mouse_button_pressed(0)) { // Left click
-                // Move cursor to mouse position
-                int mouse_x, mouse_y;
-                get_mouse_position(&mouse_x, &mouse_y);
-                set_cursor(mouse_y, mouse_x);
-                // Could add click-to-position functionality here
-            }
+            // Process the command
+            process_command(line->editor.buffer);
             
-            // Small delay to prevent excessive CPU usage
-            for (volatile int i = 0; i < 1000; i++);
+            lineedit_init(&line->editor, print_prompt, history_entry, history_search);
+            line->need_prompt = 1;
+            return;
+        }
+    }
+}
+
+// Run the shell. Every virtual console has its own command line; each pass
+// serves whichever consoles have input queued.
+void run_shell() {
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        lineedit_init(&console_lines[i].editor, print_prompt, history_entry, history_search);
+        console_lines[i].need_prompt = 1;
+    }
+    
+    // Startup script runs on the first console before its first prompt
+    script_run_rc();
+    
+    while (1) {
+        // Inject any replayed input that is due
+        replay_poll();
+        
+        // Poll for keyboard input
+        poll_keyboard();
+        
+        // Poll for mouse input
+        poll_mouse();
+        
+        for (int i = 0; i < MAX_CONSOLES; i++) {
+            select_console(i);
+            service_console_input(&console_lines[i]);
         }
+        select_console(get_visible_console());
+        
+        // Give background jobs and pipelines a slice
+        jobs_run();
         
-        // Process the command
-        process_command(command_buffer);
+        // Commit batched conversation log records, advance compaction
+        convlog_poll();
+        
+        // Check for mouse clicks
+        if (mouse_button_clicked(0)) { // Left click
+            // Move cursor to mouse position
+            int mouse_x, mouse_y;
+            get_mouse_position(&mouse_x, &mouse_y);
+            set_cursor(mouse_y, mouse_x);
+            // Could add click-to-position functionality here
+        }
+        
+        // Move the hardware cursor once per batch of input events
+        screen_flush();
+        record_frame_latency();
+        
+        // Small delay to prevent excessive CPU usage
+        for (volatile int i = 0; i < 1000; i++);
     }
 }
 
@@ -297,37 +731,36 @@ int cmd_help(int argc, char* argv[]) {
         print_string("\n", VGA_LIGHT_GREY);
     }
     
-    print_string("\nAI Commands:\n", VGA_LIGHT_GREEN);
-    print_string("  ai <message> - Chat with AI\n", VGA_LIGHT_WHITE);
-    print_string("  model <type> - Set AI model (openai, claude, gemini, local)\n", VGA_LIGHT_WHITE);
-    print_string("  setkey <key> - Set API key for AI models\n", VGA_LIGHT_WHITE);
-    print_string("  reset - Clear AI conversation history\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nVoice Assistant Commands:\n", VGA_LIGHT_GREEN);
-    print_string("  voice - Voice assistant controls\n", VGA_LIGHT_WHITE);
-    print_string("  assistant - AI assistant system\n", VGA_LIGHT_WHITE);
-    print_string("  Say 'Hey Proto' to activate voice commands\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nInformation Commands:\n", VGA_LIGHT_GREEN);
-    print_string("  search <query> - Web search\n", VGA_LIGHT_WHITE);
-    print_string("  weather <location> - Weather information\n", VGA_LIGHT_WHITE);
-    print_string("  news <topic> - Latest news\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nAvailable AI Models:\n", VGA_LIGHT_GREEN);
-    print_string("  openai - OpenAI GPT models\n", VGA_LIGHT_WHITE);
-    print_string("  claude - Anthropic Claude models\n", VGA_LIGHT_WHITE);
-    print_string("  gemini - Google Gemini models (default)\n", VGA_LIGHT_WHITE);
-    print_string("  local - Local LLM models\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nEnvironment:\n", VGA_LIGHT_GREEN);
-    print_string("  env - Show environment variables\n", VGA_LIGHT_WHITE);
-    print_string("  API keys are automatically loaded from .env file\n", VGA_LIGHT_WHITE);
-    
-    print_string("\nMouse Commands:\n", VGA_LIGHT_GREEN);
-    print_string("  mouse status - Show mouse status\n", VGA_LIGHT_WHITE);
-    print_string("  mouse show - Show mouse cursor\n", VGA_LIGHT_WHITE);
-    print_string("  mouse hide - Hide mouse cursor\n", VGA_LIGHT_WHITE);
-    print_string("  mouse pos - Show mouse position\n", VGA_LIGHT_WHITE);
+    print_string(
+        ANSI_LIGHT_GREEN "\nAI Commands:\n"
+        ANSI_LIGHT_WHITE "  ai <message> - Chat with AI\n"
+        "  model <type> - Set AI model (openai, claude, gemini, local)\n"
+        "  setkey <key> - Set API key for AI models\n"
+        "  reset - Clear AI conversation history\n"
+        ANSI_LIGHT_GREEN "\nVoice Assistant Commands:\n"
+        ANSI_LIGHT_WHITE "  voice - Voice assistant controls\n"
+        "  assistant - AI assistant system\n"
+        "  Say 'Hey Proto' to activate voice commands\n"
+        ANSI_LIGHT_GREEN "\nInformation Commands:\n"
+        ANSI_LIGHT_WHITE "  search <query> - Web search\n"
+        "  weather <location> - Weather information\n"
+        "  news <topic> - Latest news\n"
+        ANSI_LIGHT_GREEN "\nAvailable AI Models:\n"
+        ANSI_LIGHT_WHITE "  openai - OpenAI GPT models\n"
+        "  claude - Anthropic Claude models\n"
+        "  gemini - Google Gemini models (default)\n"
+        "  local - Local LLM models\n"
+        ANSI_LIGHT_GREEN "\nEnvironment:\n"
+        ANSI_LIGHT_WHITE "  env - Show environment variables\n"
+        "  API keys are automatically loaded from .env file\n"
+        ANSI_LIGHT_GREEN "\nMouse Commands:\n"
+        ANSI_LIGHT_WHITE "  mouse status - Show mouse status\n"
+        "  mouse show - Show mouse cursor\n"
+        "  mouse hide - Hide mouse cursor\n"
+        "  mouse pos - Show mouse position\n"
+        ANSI_LIGHT_GREEN "\nVirtual Consoles:\n"
+        ANSI_LIGHT_WHITE "  Alt+F1..F4 - Switch console\n",
+        VGA_LIGHT_WHITE);
     
     return 0;
 }
@@ -337,6 +770,14 @@ int cmd_clear(int argc, char* argv[]) {
     return 0;
 }
 
+// Streamed AI response chunk: feed it to the layout engine
+static void ai_response_chunk(const char* chunk, int length, void* context) {
+    layout_write((text_layout_t*)context, chunk, length);
+    
+    // Let the shell and other jobs run while a background query streams in
+    job_yield();
+}
+
 int cmd_ai(int argc, char* argv[]) {
     if (argc < 2) {
         print_string("Usage: ai <message>\n", VGA_LIGHT_RED);
@@ -355,15 +796,18 @@ int cmd_ai(int argc, char* argv[]) {
     
     print_string("AI: ", VGA_LIGHT_GREEN);
     
-    // Get AI response
+    // Stream the AI response through the word-wrap layout engine
     char response[MAX_RESPONSE_LENGTH];
-    if (langchain_chat(&ai_session, message, response, MAX_RESPONSE_LENGTH)) {
-        print_string(response, VGA_LIGHT_WHITE);
-    } else {
-        print_string("Sorry, I couldn't process your request.", VGA_LIGHT_RED);
+    text_layout_t layout;
+    layout_begin(&layout, 4, 4, VGA_LIGHT_WHITE);
+    if (!langchain_chat_stream(&ai_session, message, response, MAX_RESPONSE_LENGTH,
+                               ai_response_chunk, &layout)) {
+        layout.color = VGA_LIGHT_RED;
+        const char* error = "Sorry, I couldn't process your request.";
+        layout_write(&layout, error, strlen(error));
     }
+    layout_end(&layout);
     
-    print_string("\n", VGA_LIGHT_WHITE);
     return 0;
 }
 
@@ -434,6 +878,7 @@ int cmd_voice(int argc, char* argv[]) {
     
     if (strcmp(argv[1], "start") == 0) {
         start_voice_listening();
+        print_string("Voice listening started\n", VGA_LIGHT_GREEN);
     } else if (strcmp(argv[1], "stop") == 0) {
         print_string("Voice listening stopped\n", VGA_LIGHT_YELLOW);
     } else if (strcmp(argv[1], "status") == 0) {
@@ -460,6 +905,7 @@ int cmd_assistant(int argc, char* argv[]) {
     
     if (strcmp(argv[1], "start") == 0) {
         start_assistant();
+        print_string("AI Assistant is now active and listening\n", VGA_LIGHT_GREEN);
     } else if (strcmp(argv[1], "stop") == 0) {
         stop_assistant();
     } else if (strcmp(argv[1], "status") == 0) {
@@ -596,32 +1042,863 @@ int cmd_news(int argc, char* argv[]) {
 }
 
 int cmd_history(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
+        history_clear();
+        print_string("Command history cleared\n", VGA_LIGHT_GREEN);
+        return 0;
+    }
+    if (argc >= 2 && argv[1][0] != '\0') {
+        // Entries containing the pattern, oldest first
+        int ages[SHELL_HISTORY_MATCHES];
+        int found = 0;
+        for (int age = history_search(argv[1], 0); age >= 0 && found < SHELL_HISTORY_MATCHES;
+             age = history_search(argv[1], age + 1)) {
+            ages[found++] = age;
+        }
+        while (found > 0) {
+            int age = ages[--found];
+            print_string("  ", VGA_LIGHT_GREY);
+            print_uint(history_count() - age, VGA_LIGHT_BLUE);
+            print_string(": ", VGA_LIGHT_GREY);
+            print_string(history_entry(age), VGA_LIGHT_WHITE);
+            print_string("\n", VGA_LIGHT_GREY);
+        }
+        return 0;
+    }
+    
     print_string("Command history:\n", VGA_LIGHT_CYAN);
     
-    for (int i = 0; i < history_count; i++) {
-        int idx = (history_index - history_count + i + MAX_HISTORY) % MAX_HISTORY;
+    int count = history_count();
+    for (int i = 0; i < count; i++) {
         print_string("  ", VGA_LIGHT_GREY);
+        print_uint(i + 1, VGA_LIGHT_BLUE);
+        print_string(": ", VGA_LIGHT_GREY);
+        print_string(history_entry(count - 1 - i), VGA_LIGHT_WHITE);
+        print_string("\n", VGA_LIGHT_GREY);
+    }
+    
+    return 0;
+}
+
+int cmd_dmesg(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "-n") == 0) {
+        if (argc != 3 || argv[2][0] < '0' || argv[2][0] > '7' || argv[2][1] != '\0') {
+            print_string("Usage: dmesg -n <0-7>\n", VGA_LIGHT_RED);
+            return 1;
+        }
+        klog_set_console_level(argv[2][0] - '0');
+        print_string("Console log level set to ", VGA_LIGHT_GREEN);
+        print_string(klog_level_name(klog_get_console_level()), VGA_LIGHT_WHITE);
+        print_string("\n", VGA_LIGHT_WHITE);
+        return 0;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "-c") != 0) {
+        print_string("Usage: dmesg [-c | -n <level>]\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    klog_record_t record;
+    unsigned int sequence = klog_first_sequence();
+    
+    while (klog_read(&sequence, &record)) {
+        unsigned int ms = tsc_to_uptime_ms(record.tsc);
         
-        char num_str[16];
-        int temp = i + 1;
-        int j = 0;
-        do {
-            num_str[j++] = '0' + (temp % 10);
-            temp /= 10;
-        } while (temp > 0);
+        print_string("[", VGA_DARK_GREY);
+        print_uint(ms / 1000, VGA_DARK_GREY);
+        print_char('.', VGA_DARK_GREY);
+        print_char('0' + (ms / 100) % 10, VGA_DARK_GREY);
+        print_char('0' + (ms / 10) % 10, VGA_DARK_GREY);
+        print_char('0' + ms % 10, VGA_DARK_GREY);
+        print_string("] ", VGA_DARK_GREY);
+        print_string(klog_level_name(record.level), VGA_LIGHT_BLUE);
+        print_string(": ", VGA_DARK_GREY);
+        print_string(record.message, record.level <= KLOG_WARNING ? VGA_LIGHT_YELLOW : VGA_LIGHT_WHITE);
+        print_string("\n", VGA_LIGHT_WHITE);
+    }
+    
+    unsigned int dropped = klog_suppressed_count();
+    if (dropped > 0) {
+        print_uint(dropped, VGA_LIGHT_RED);
+        print_string(" messages suppressed by rate limiting\n", VGA_LIGHT_RED);
+    }
+    
+    if (argc >= 2) {
+        klog_clear();
+    }
+    
+    return 0;
+}
+
+int cmd_inputlat(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        histogram_reset(&input_latency);
+        print_string("Input latency statistics reset\n", VGA_LIGHT_GREEN);
+        return 0;
+    }
+    
+    if (argc >= 2) {
+        print_string("Usage: inputlat [reset]\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    print_string("Input latency (key read to echo on screen):\n", VGA_LIGHT_CYAN);
+    print_string("  Samples: ", VGA_LIGHT_WHITE);
+    print_uint(input_latency.count, VGA_LIGHT_WHITE);
+    print_string("\n", VGA_LIGHT_WHITE);
+    if (input_latency.count == 0) {
+        return 0;
+    }
+    
+    print_string("  p50:  ", VGA_LIGHT_WHITE);
+    print_uint(histogram_percentile(&input_latency, 50), VGA_LIGHT_GREEN);
+    print_string(" us\n  p99:  ", VGA_LIGHT_WHITE);
+    print_uint(histogram_percentile(&input_latency, 99), VGA_LIGHT_YELLOW);
+    print_string(" us\n  max:  ", VGA_LIGHT_WHITE);
+    print_uint(input_latency.max, VGA_LIGHT_RED);
+    print_string(" us\n  mean: ", VGA_LIGHT_WHITE);
+    print_uint(histogram_mean(&input_latency), VGA_LIGHT_WHITE);
+    print_string(" us\n", VGA_LIGHT_WHITE);
+    return 0;
+}
+
+// Playback speed argument, 1 when absent or malformed
+static unsigned int replay_speed_arg(int argc, char* argv[]) {
+    unsigned int speed = 0;
+    
+    if (argc < 3) return 1;
+    for (const char* p = argv[2]; *p >= '0' && *p <= '9'; p++) {
+        speed = speed * 10 + (*p - '0');
+    }
+    return speed > 0 ? speed : 1;
+}
+
+static int start_replay(int loaded, unsigned int speed) {
+    if (loaded < 0) {
+        print_string("Replay script is malformed or unavailable\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    if (!replay_start(speed)) {
+        print_string("Nothing to replay\n", VGA_LIGHT_YELLOW);
+        return 1;
+    }
+    
+    print_string("Replaying ", VGA_LIGHT_GREEN);
+    print_uint(replay_event_count(), VGA_LIGHT_WHITE);
+    print_string(" events at ", VGA_LIGHT_GREEN);
+    print_uint(speed, VGA_LIGHT_WHITE);
+    print_string("x\n", VGA_LIGHT_GREEN);
+    return 0;
+}
+
+// Print "<KB/s> KB/s (<KB> KB in <ms> ms)" for a timed transfer
+static void print_throughput(unsigned int bytes, unsigned long long us) {
+    if (us == 0) us = 1;
+    print_uint(udiv64((unsigned long long)(bytes / 1024) * 1000000, (unsigned int)us), VGA_LIGHT_GREEN);
+    print_string(" KB/s (", VGA_LIGHT_WHITE);
+    print_uint(bytes / 1024, VGA_LIGHT_WHITE);
+    print_string(" KB in ", VGA_LIGHT_WHITE);
+    print_uint(udiv64(us, 1000), VGA_LIGHT_WHITE);
+    print_string(" ms)\n", VGA_LIGHT_WHITE);
+}
+
+// Time sequential transfers of `sectors` in DISKBENCH_CHUNK pieces. With
+// `write` set, each chunk is read (untimed) and written back unchanged.
+static int time_sequential(block_device_t* device, unsigned int sectors, int write,
+                           unsigned long long* us) {
+    char* buffer = (char*)DISK_BUFFER_BASE;
+    
+    *us = 0;
+    for (unsigned int lba = 0; lba < sectors; lba += DISKBENCH_CHUNK) {
+        unsigned int count = sectors - lba < DISKBENCH_CHUNK ? sectors - lba : DISKBENCH_CHUNK;
+        if (write && block_read(device, lba, count, buffer) < 0) return -1;
         
-        while (j > 0) {
-            print_char(num_str[--j], VGA_LIGHT_BLUE);
+        unsigned long long start = read_tsc();
+        int result = write ? block_write(device, lba, count, buffer) :
+                             block_read(device, lba, count, buffer);
+        *us += tsc_to_us(read_tsc() - start);
+        if (result < 0) return -1;
+    }
+    if (write && block_flush(device) < 0) return -1;
+    return 0;
+}
+
+// Time DISKBENCH_RANDOM_READS random 4KB reads, `depth` at a time. Drivers
+// that queue requests keep `depth` of them in flight at once.
+static int time_random(block_device_t* device, unsigned int sectors, int depth,
+                       unsigned long long* us) {
+    unsigned int blocks = sectors / DISKBENCH_RANDOM_SECTORS;
+    unsigned int seed = (unsigned int)read_tsc();
+    
+    if (blocks == 0) return -1;
+    
+    unsigned long long start = read_tsc();
+    for (int done = 0; done < DISKBENCH_RANDOM_READS; done += depth) {
+        for (int i = 0; i < depth; i++) {
+            seed = seed * 1103515245 + 12345;
+            unsigned int lba = ((seed >> 8) % blocks) * DISKBENCH_RANDOM_SECTORS;
+            char* buffer = (char*)DISK_BUFFER_BASE + i * DISKBENCH_RANDOM_SECTORS * BLOCK_SECTOR_SIZE;
+            if (block_submit(device, lba, DISKBENCH_RANDOM_SECTORS, buffer, 0) < 0) {
+                block_complete(device);
+                return -1;
+            }
+        }
+        if (block_complete(device) < 0) return -1;
+    }
+    *us = tsc_to_us(read_tsc() - start);
+    return 0;
+}
+
+static void print_random(int depth, unsigned long long us) {
+    if (us == 0) us = 1;
+    print_string("  Random 4KB, ", VGA_LIGHT_WHITE);
+    print_uint(depth, VGA_LIGHT_WHITE);
+    print_string(depth == 1 ? " in flight:  " : " in flight: ", VGA_LIGHT_WHITE);
+    print_uint(udiv64((unsigned long long)DISKBENCH_RANDOM_READS * 1000000, (unsigned int)us), VGA_LIGHT_GREEN);
+    print_string(" IOPS, ", VGA_LIGHT_WHITE);
+    print_uint(udiv64(us, DISKBENCH_RANDOM_READS), VGA_LIGHT_WHITE);
+    print_string(" us per read\n", VGA_LIGHT_WHITE);
+}
+
+static void list_block_devices() {
+    for (int i = 0; i < block_count(); i++) {
+        block_device_t* device = block_get(i);
+        print_string("  ", VGA_LIGHT_GREY);
+        print_string(device->name, VGA_LIGHT_WHITE);
+        print_string("  ", VGA_LIGHT_GREY);
+        print_string(device->driver, VGA_LIGHT_GREY);
+        print_string(", ", VGA_LIGHT_GREY);
+        print_uint(device->sectors / 2048, VGA_LIGHT_WHITE);
+        print_string(" MB\n", VGA_LIGHT_WHITE);
+    }
+}
+
+// diskbench [-w] [device [MB]]: sequential reads, then random 4KB reads
+// one at a time and DISKBENCH_QUEUE_DEPTH at a time. On an ATA disk the
+// sequential read is also run by PIO for comparison. -w adds a sequential
+// write pass that rewrites the data it just read, so the disk contents
+// don't change.
+int cmd_diskbench(int argc, char* argv[]) {
+    int write = 0;
+    const char* name = NULL;
+    unsigned int megabytes = DISKBENCH_DEFAULT_MB;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0) {
+            write = 1;
+        } else if (!name) {
+            name = argv[i];
+        } else {
+            megabytes = 0;
+            const char* p = argv[i];
+            for (; *p >= '0' && *p <= '9'; p++) megabytes = megabytes * 10 + (*p - '0');
+            if (*p != '\0' || p == argv[i]) {
+                print_string("Usage: diskbench [-w] [device [MB]]\n", VGA_LIGHT_RED);
+                return 1;
+            }
+        }
+    }
+    
+    block_device_t* device = name ? block_find(name) : block_get(0);
+    if (!device) {
+        print_string(block_count() ? "diskbench: no such device, have:\n" :
+                     "diskbench: no disks (run QEMU with a disk image)\n", VGA_LIGHT_RED);
+        list_block_devices();
+        return 1;
+    }
+    
+    // The benchmark bypasses the block cache; settle it first
+    if (write) bcache_sync(device);
+    
+    unsigned int sectors = megabytes * (1024 * 1024 / BLOCK_SECTOR_SIZE);
+    if (sectors == 0 || sectors > device->sectors) sectors = device->sectors;
+    unsigned int bytes = sectors * BLOCK_SECTOR_SIZE;
+    
+    print_string("Device ", VGA_LIGHT_CYAN);
+    print_string(device->name, VGA_LIGHT_CYAN);
+    print_string(" (", VGA_LIGHT_GREY);
+    print_string(device->driver, VGA_LIGHT_GREY);
+    print_string("), ", VGA_LIGHT_GREY);
+    print_uint(device->sectors / 2048, VGA_LIGHT_WHITE);
+    print_string(" MB\n", VGA_LIGHT_WHITE);
+    
+    const ata_drive_t* ata = strcmp(device->driver, "ata") == 0 ? ata_get_drive(device->unit) : NULL;
+    unsigned long long us;
+    int result = time_sequential(device, sectors, 0, &us);
+    if (result == 0) {
+        print_string(ata && ata->dma ? "  Sequential read (DMA): " : "  Sequential read:       ", VGA_LIGHT_WHITE);
+        print_throughput(bytes, us);
+    }
+    
+    if (result == 0 && ata && ata->dma) {
+        int dma_was_enabled = ata_dma_enabled();
+        ata_set_dma(0);
+        result = time_sequential(device, sectors, 0, &us);
+        ata_set_dma(dma_was_enabled);
+        if (result == 0) {
+            print_string("  Sequential read (PIO): ", VGA_LIGHT_WHITE);
+            print_throughput(bytes, us);
+        }
+    }
+    
+    if (result == 0 && write) {
+        result = time_sequential(device, sectors, 1, &us);
+        if (result == 0) {
+            print_string("  Sequential write:      ", VGA_LIGHT_WHITE);
+            print_throughput(bytes, us);
         }
+    }
+    
+    if (result == 0) {
+        result = time_random(device, sectors, 1, &us);
+        if (result == 0) print_random(1, us);
+    }
+    if (result == 0 && device->ops->submit) {
+        result = time_random(device, sectors, DISKBENCH_QUEUE_DEPTH, &us);
+        if (result == 0) print_random(DISKBENCH_QUEUE_DEPTH, us);
+    }
+    
+    if (result < 0) {
+        print_string("diskbench: I/O error (see dmesg)\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    return 0;
+}
+
+// Map a file and read every byte of it through the mapping, so each page
+// is faulted in (or read ahead) from the page cache
+int cmd_mmapbench(int argc, char* argv[]) {
+    static const char* advice_names[] = {"normal", "random", "sequential", "willneed"};
+    int advice = -1;
+    
+    if (argc == 2) advice = MMAP_NORMAL;
+    for (int i = 0; argc == 3 && i < 4; i++) {
+        if (strcmp(argv[2], advice_names[i]) == 0) advice = i;
+    }
+    if (advice < 0) {
+        print_string("Usage: mmapbench <file> [normal|random|sequential|willneed]\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    if (!mmap_ready()) {
+        print_string("mmapbench: paging is off (see dmesg)\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    unsigned int length;
+    const unsigned char* data = (const unsigned char*)mmap_map(argv[1], 0, 0, &length);
+    if (!data) {
+        print_string("mmapbench: cannot map ", VGA_LIGHT_RED);
+        print_string(argv[1], VGA_LIGHT_RED);
+        print_string("\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    mmap_stats_t before = *mmap_get_stats();
+    unsigned long long start = read_tsc();
+    mmap_advise(data, length, advice);
+    
+    unsigned int sum = 0;
+    for (unsigned int i = 0; i < length; i++) sum += data[i];
+    unsigned long long us = tsc_to_us(read_tsc() - start);
+    const mmap_stats_t* after = mmap_get_stats();
+    
+    print_string("Read ", VGA_LIGHT_WHITE);
+    print_string(argv[1], VGA_LIGHT_CYAN);
+    print_string(" (", VGA_LIGHT_WHITE);
+    print_string(advice_names[advice], VGA_LIGHT_WHITE);
+    print_string("): ", VGA_LIGHT_WHITE);
+    print_throughput(length, us);
+    print_string("  Faults:     ", VGA_LIGHT_WHITE);
+    print_uint(after->major_faults - before.major_faults, VGA_LIGHT_WHITE);
+    print_string(" major, ", VGA_LIGHT_WHITE);
+    print_uint(after->minor_faults - before.minor_faults, VGA_LIGHT_WHITE);
+    print_string(" minor, ", VGA_LIGHT_WHITE);
+    print_uint(after->readahead_pages - before.readahead_pages, VGA_LIGHT_WHITE);
+    print_string(" pages read ahead\n  Byte sum:   ", VGA_LIGHT_WHITE);
+    print_uint(sum, VGA_LIGHT_WHITE);
+    print_string("\n", VGA_LIGHT_WHITE);
+    
+    mmap_unmap(data);
+    return 0;
+}
+
+// Print part/whole as a percentage with one decimal
+static void print_percent(unsigned int part, unsigned int whole) {
+    unsigned int tenths = whole ? udiv64((unsigned long long)part * 1000, whole) : 0;
+    print_uint(tenths / 10, VGA_LIGHT_GREEN);
+    print_string(".", VGA_LIGHT_GREEN);
+    print_uint(tenths % 10, VGA_LIGHT_GREEN);
+    print_string("%", VGA_LIGHT_GREEN);
+}
+
+int cmd_cachestat(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        bcache_reset_stats();
+        print_string("Cache statistics reset\n", VGA_LIGHT_GREEN);
+        return 0;
+    }
+    
+    if (argc >= 2) {
+        print_string("Usage: cachestat [reset]\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    const bcache_stats_t* stats = bcache_get_stats();
+    unsigned int lookups = stats->hits + stats->misses;
+    
+    print_string("Block cache (4KB blocks):\n", VGA_LIGHT_CYAN);
+    print_string("  Lookups:    ", VGA_LIGHT_WHITE);
+    print_uint(lookups, VGA_LIGHT_WHITE);
+    print_string(", hit rate ", VGA_LIGHT_WHITE);
+    print_percent(stats->hits, lookups);
+    print_string("\n  Read-ahead: ", VGA_LIGHT_WHITE);
+    print_uint(stats->readahead_blocks, VGA_LIGHT_WHITE);
+    print_string(" blocks, ", VGA_LIGHT_WHITE);
+    print_percent(stats->readahead_hits, stats->readahead_blocks);
+    print_string(" used\n  Evictions:  ", VGA_LIGHT_WHITE);
+    print_uint(stats->evictions, VGA_LIGHT_WHITE);
+    print_string(", write-backs ", VGA_LIGHT_WHITE);
+    print_uint(stats->writebacks, VGA_LIGHT_WHITE);
+    if (stats->write_errors) {
+        print_string(", failed ", VGA_LIGHT_WHITE);
+        print_uint(stats->write_errors, VGA_LIGHT_RED);
+    }
+    print_string("\n  Resident:   ", VGA_LIGHT_WHITE);
+    print_uint(stats->cached, VGA_LIGHT_WHITE);
+    print_string("/", VGA_LIGHT_WHITE);
+    print_uint(stats->capacity, VGA_LIGHT_WHITE);
+    print_string(" blocks, ", VGA_LIGHT_WHITE);
+    print_uint(stats->dirty, stats->dirty ? VGA_LIGHT_YELLOW : VGA_LIGHT_WHITE);
+    print_string(" dirty\n", VGA_LIGHT_WHITE);
+    
+    const vfs_stats_t* vfs = vfs_get_stats();
+    print_string("VFS dentry cache:\n", VGA_LIGHT_CYAN);
+    print_string("  Lookups:    ", VGA_LIGHT_WHITE);
+    print_uint(vfs->lookups, VGA_LIGHT_WHITE);
+    print_string(", hit rate ", VGA_LIGHT_WHITE);
+    print_percent(vfs->dcache_hits, vfs->lookups);
+    print_string("\n", VGA_LIGHT_WHITE);
+    
+    if (fat_mounted()) {
+        const fat_stats_t* fat = fat_get_stats();
+        print_string("FAT directory cache:\n", VGA_LIGHT_CYAN);
+        print_string("  Lookups:    ", VGA_LIGHT_WHITE);
+        print_uint(fat->lookups, VGA_LIGHT_WHITE);
+        print_string(", hit rate ", VGA_LIGHT_WHITE);
+        print_percent(fat->dcache_hits, fat->lookups);
+        print_string("\n", VGA_LIGHT_WHITE);
+    }
+    
+    if (mmap_ready()) {
+        const mmap_stats_t* mmap = mmap_get_stats();
+        unsigned int faults = mmap->major_faults + mmap->minor_faults;
+        print_string("Page cache (mapped files):\n", VGA_LIGHT_CYAN);
+        print_string("  Faults:     ", VGA_LIGHT_WHITE);
+        print_uint(faults, VGA_LIGHT_WHITE);
+        print_string(", served from cache ", VGA_LIGHT_WHITE);
+        print_percent(mmap->minor_faults, faults);
+        print_string("\n  Read-ahead: ", VGA_LIGHT_WHITE);
+        print_uint(mmap->readahead_pages, VGA_LIGHT_WHITE);
+        print_string(" pages, evictions ", VGA_LIGHT_WHITE);
+        print_uint(mmap->evictions, VGA_LIGHT_WHITE);
+        print_string("\n  Resident:   ", VGA_LIGHT_WHITE);
+        print_uint(mmap->cached, VGA_LIGHT_WHITE);
+        print_string("/", VGA_LIGHT_WHITE);
+        print_uint(mmap->capacity, VGA_LIGHT_WHITE);
+        print_string(" pages, ", VGA_LIGHT_WHITE);
+        print_uint(mmap->mappings, VGA_LIGHT_WHITE);
+        print_string(" mappings\n", VGA_LIGHT_WHITE);
+    }
+    return 0;
+}
+
+static void list_entry(const char* name, unsigned int size, int directory, void* context) {
+    print_string("  ", VGA_LIGHT_GREY);
+    if (directory) {
+        print_string(name, VGA_LIGHT_BLUE);
+        print_string("/\n", VGA_LIGHT_BLUE);
+        return;
+    }
+    print_string(name, VGA_LIGHT_WHITE);
+    print_string("  ", VGA_LIGHT_GREY);
+    print_uint(size, VGA_LIGHT_GREY);
+    print_string("\n", VGA_LIGHT_GREY);
+}
+
+int cmd_ls(int argc, char* argv[]) {
+    const char* path = argc >= 2 ? argv[1] : "/";
+    
+    if (vfs_list(path, list_entry, NULL) < 0) {
+        print_string("ls: not a directory: ", VGA_LIGHT_RED);
+        print_string(path, VGA_LIGHT_RED);
+        print_string("\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    return 0;
+}
+
+// Print files, or the piped input when there are none
+int cmd_cat(int argc, char* argv[]) {
+    char buffer[SHELL_CAT_CHUNK + 1];
+    int status = 0;
+    
+    if (argc < 2) {
+        stream_t* in = job_stdin();
+        if (!in) {
+            print_string("Usage: cat <file>...\n", VGA_LIGHT_RED);
+            return 2;
+        }
+        int length;
+        while ((length = stream_read(in, buffer, SHELL_CAT_CHUNK)) > 0) {
+            buffer[length] = '\0';
+            print_string(buffer, VGA_LIGHT_WHITE);
+        }
+        return 0;
+    }
+    
+    for (int i = 1; i < argc; i++) {
+        int fd = vfs_open(argv[i], VFS_READ);
+        if (fd < 0) {
+            print_string("cat: cannot open ", VGA_LIGHT_RED);
+            print_string(argv[i], VGA_LIGHT_RED);
+            print_string("\n", VGA_LIGHT_RED);
+            status = 1;
+            continue;
+        }
+        job_hold_file(fd);
         
-        print_string(": ", VGA_LIGHT_GREY);
-        print_string(command_history[idx], VGA_LIGHT_WHITE);
-        print_string("\n", VGA_LIGHT_GREY);
+        int length;
+        while ((length = vfs_read(fd, buffer, SHELL_CAT_CHUNK)) > 0) {
+            buffer[length] = '\0';
+            print_string(buffer, VGA_LIGHT_WHITE);
+        }
+        if (length < 0) {
+            print_string("cat: read error on ", VGA_LIGHT_RED);
+            print_string(argv[i], VGA_LIGHT_RED);
+            print_string("\n", VGA_LIGHT_RED);
+            status = 1;
+        }
+        job_release_file(fd);
+        vfs_close(fd);
+    }
+    return status;
+}
+
+// Commit the conversation log and command history, then write back the
+// rest of the cache
+static int sync_disks() {
+    return (convlog_ready() && convlog_sync() < 0) || bcache_sync(NULL) < 0 ? -1 : 0;
+}
+
+int cmd_sync(int argc, char* argv[]) {
+    if (sync_disks() < 0) {
+        print_string("sync: write-back failed (see dmesg)\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    return 0;
+}
+
+int cmd_ailog(int argc, char* argv[]) {
+    if (!convlog_ready()) {
+        print_string("ailog: no conversation log disk\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "sync") == 0) {
+        if (convlog_sync() < 0) {
+            print_string("ailog: commit failed (see dmesg)\n", VGA_LIGHT_RED);
+            return 1;
+        }
+        return 0;
+    }
+    
+    if (argc >= 2 && strcmp(argv[1], "compact") == 0) {
+        if (convlog_compact() < 0) {
+            print_string("ailog: compaction failed (see dmesg)\n", VGA_LIGHT_RED);
+            return 1;
+        }
+        print_string("Conversation log compacted\n", VGA_LIGHT_GREEN);
+        return 0;
+    }
+    
+    if (argc >= 2) {
+        print_string("Usage: ailog [sync|compact]\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    const convlog_stats_t* stats = convlog_get_stats();
+    print_string("Conversation log on ", VGA_LIGHT_CYAN);
+    print_string(convlog_device_name(), VGA_LIGHT_CYAN);
+    print_string(":\n  Appended:   ", VGA_LIGHT_WHITE);
+    print_uint(stats->records, VGA_LIGHT_WHITE);
+    print_string(" records, ", VGA_LIGHT_WHITE);
+    print_uint(stats->bytes, VGA_LIGHT_WHITE);
+    print_string(" bytes, ", VGA_LIGHT_WHITE);
+    print_uint(stats->commits, VGA_LIGHT_WHITE);
+    print_string(" commits\n  Restored:   ", VGA_LIGHT_WHITE);
+    print_uint(stats->restored, VGA_LIGHT_WHITE);
+    print_string(" messages from ", VGA_LIGHT_WHITE);
+    print_uint(stats->restore_reads, VGA_LIGHT_WHITE);
+    print_string(" records read, ", VGA_LIGHT_WHITE);
+    print_uint(stats->recovered, VGA_LIGHT_WHITE);
+    print_string(" recovered\n  Region:     ", VGA_LIGHT_WHITE);
+    print_uint(stats->used, VGA_LIGHT_WHITE);
+    print_string("/", VGA_LIGHT_WHITE);
+    print_uint(stats->capacity, VGA_LIGHT_WHITE);
+    print_string(" bytes (", VGA_LIGHT_WHITE);
+    print_percent(stats->used, stats->capacity);
+    print_string("), ", VGA_LIGHT_WHITE);
+    print_uint(stats->compactions, VGA_LIGHT_WHITE);
+    print_string(" compactions\n", VGA_LIGHT_WHITE);
+    return 0;
+}
+
+int cmd_replay(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_string("Replay Commands:\n", VGA_LIGHT_CYAN);
+        print_string("  replay record - Start recording keyboard and mouse input\n", VGA_LIGHT_WHITE);
+        print_string("  replay stop - Stop recording or playback\n", VGA_LIGHT_WHITE);
+        print_string("  replay play [speed] - Replay the recording\n", VGA_LIGHT_WHITE);
+        print_string("  replay script [speed] - Replay the built-in benchmark session\n", VGA_LIGHT_WHITE);
+        print_string("  replay serial [speed] - Load a script from COM1 and replay it\n", VGA_LIGHT_WHITE);
+        print_string("  replay dump - Print the recording as a script\n", VGA_LIGHT_WHITE);
+        print_string("  replay status - Show recorder state\n", VGA_LIGHT_WHITE);
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "record") == 0) {
+        replay_start_recording();
+        print_string("Recording input; 'replay stop' to finish\n", VGA_LIGHT_GREEN);
+    } else if (strcmp(argv[1], "stop") == 0) {
+        replay_stop();
+        print_string("Replay stopped, ", VGA_LIGHT_GREEN);
+        print_uint(replay_event_count(), VGA_LIGHT_WHITE);
+        print_string(" events buffered\n", VGA_LIGHT_GREEN);
+    } else if (strcmp(argv[1], "play") == 0) {
+        return start_replay(replay_event_count(), replay_speed_arg(argc, argv));
+    } else if (strcmp(argv[1], "script") == 0) {
+        return start_replay(replay_load_embedded(), replay_speed_arg(argc, argv));
+    } else if (strcmp(argv[1], "serial") == 0) {
+        print_string("Reading replay script from COM1...\n", VGA_LIGHT_CYAN);
+        return start_replay(replay_load_serial(), replay_speed_arg(argc, argv));
+    } else if (strcmp(argv[1], "dump") == 0) {
+        replay_dump();
+    } else if (strcmp(argv[1], "status") == 0) {
+        static const char* state_names[] = {"idle", "recording", "playing"};
+        print_string("Replay: ", VGA_LIGHT_WHITE);
+        print_string(state_names[replay_state()], VGA_LIGHT_GREEN);
+        print_string(", ", VGA_LIGHT_WHITE);
+        print_uint(replay_event_count(), VGA_LIGHT_WHITE);
+        print_string(" events\n", VGA_LIGHT_WHITE);
+    } else {
+        print_string("Unknown replay command. Use: record, stop, play, script, serial, dump, status\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    return 0;
+}
+
+// Join argv[first..] back into one line
+static void join_args(char* dest, int size, int argc, char* argv[], int first) {
+    int length = 0;
+    
+    dest[0] = '\0';
+    for (int i = first; i < argc; i++) {
+        for (const char* p = argv[i]; *p && length < size - 2; p++) {
+            dest[length++] = *p;
+        }
+        if (i + 1 < argc) dest[length++] = ' ';
+    }
+    dest[length] = '\0';
+}
+
+static void list_initrd_script(const char* name, unsigned int size, int directory, void* context) {
+    if (directory) return;
+    print_string("  ", VGA_LIGHT_GREY);
+    print_string(name, VGA_LIGHT_YELLOW);
+    print_string(" - ", VGA_LIGHT_GREY);
+    print_string("From " SCRIPT_INITRD_DIR "\n", VGA_LIGHT_WHITE);
+}
+
+int cmd_source(int argc, char* argv[]) {
+    if (argc != 2) {
+        print_string("Usage: source <script>\nScripts:\n", VGA_LIGHT_RED);
+        for (const embedded_script_t* script = script_list(); script->name != NULL; script++) {
+            print_string("  ", VGA_LIGHT_GREY);
+            print_string(script->name, VGA_LIGHT_YELLOW);
+            print_string(" - ", VGA_LIGHT_GREY);
+            print_string(script->description, VGA_LIGHT_WHITE);
+            print_string("\n", VGA_LIGHT_WHITE);
+        }
+        vfs_list(SCRIPT_INITRD_DIR, list_initrd_script, NULL);
+        return 1;
+    }
+    
+    int status = script_source(argv[1]);
+    if (status < 0) {
+        print_string("No such script: ", VGA_LIGHT_RED);
+        print_string(argv[1], VGA_LIGHT_RED);
+        print_string("\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    return status;
+}
+
+int cmd_repeat(int argc, char* argv[]) {
+    int count = 0;
+    const char* digit = argc >= 3 ? argv[1] : "";
+    
+    while (*digit >= '0' && *digit <= '9' && count <= SCRIPT_MAX_REPEAT) {
+        count = count * 10 + (*digit++ - '0');
+    }
+    if (*digit != '\0' || count < 1 || count > SCRIPT_MAX_REPEAT) {
+        print_string("Usage: repeat <count> <command>\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    char command[MAX_COMMAND_LENGTH];
+    join_args(command, MAX_COMMAND_LENGTH, argc, argv, 2);
+    
+    int status = 0;
+    unsigned int start_ms = get_uptime_ms();
+    for (int i = 0; i < count; i++) {
+        status = execute_command(command);
+        job_yield();
+    }
+    script_print_timing(count, get_uptime_ms() - start_ms);
+    return status;
+}
+
+int cmd_echo(int argc, char* argv[]) {
+    char line[MAX_COMMAND_LENGTH];
+    join_args(line, MAX_COMMAND_LENGTH, argc, argv, 1);
+    print_string(line, VGA_LIGHT_WHITE);
+    print_string("\n", VGA_LIGHT_WHITE);
+    return 0;
+}
+
+int cmd_set(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_environment();
+        return 0;
     }
     
+    char value[MAX_COMMAND_LENGTH];
+    join_args(value, MAX_COMMAND_LENGTH, argc, argv, 2);
+    if (!set_env_var(argv[1], value)) {
+        print_string("Environment is full\n", VGA_LIGHT_RED);
+        return 1;
+    }
     return 0;
 }
 
+int cmd_jobs(int argc, char* argv[]) {
+    int shown = 0;
+    
+    for (int id = 1; id <= JOB_MAX; id++) {
+        const job_t* leader = job_get(id);
+        if (!leader || leader->group != id) continue;
+        
+        int running = 0;
+        for (int i = 1; i <= JOB_MAX; i++) {
+            const job_t* job = job_get(i);
+            if (job && job->group == id && job->state == JOB_RUNNABLE) running = 1;
+        }
+        
+        print_string("[", VGA_LIGHT_GREY);
+        print_uint(id, VGA_LIGHT_WHITE);
+        print_string("] ", VGA_LIGHT_GREY);
+        print_string(running ? "Running  " : "Done     ", running ? VGA_LIGHT_GREEN : VGA_LIGHT_GREY);
+        print_string(leader->pipeline, VGA_LIGHT_WHITE);
+        print_string("\n", VGA_LIGHT_WHITE);
+        shown++;
+    }
+    
+    if (shown == 0) {
+        print_string("No jobs\n", VGA_LIGHT_GREY);
+    }
+    return 0;
+}
+
+// Job id argument, or the latest background job
+static int job_arg(int argc, char* argv[]) {
+    int id = 0;
+    
+    if (argc < 2) return job_latest_background();
+    for (const char* p = argv[1][0] == '%' ? argv[1] + 1 : argv[1]; *p >= '0' && *p <= '9'; p++) {
+        id = id * 10 + (*p - '0');
+    }
+    return id;
+}
+
+int cmd_fg(int argc, char* argv[]) {
+    int id = job_arg(argc, argv);
+    const job_t* job = job_get(id);
+    
+    if (!job || job->group != id) {
+        print_string("fg: no such job\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    print_string(job->pipeline, VGA_LIGHT_WHITE);
+    print_string("\n", VGA_LIGHT_WHITE);
+    int status = job_wait(id);
+    if (status < 0) {
+        print_string("fg: a job cannot wait for itself\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    return status;
+}
+
+int cmd_kill(int argc, char* argv[]) {
+    if (argc != 2) {
+        print_string("Usage: kill <job>\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    int id = job_arg(argc, argv);
+    const job_t* job = job_get(id);
+    if (!job || job->group != id || job_kill(id) < 0) {
+        print_string("kill: no such job\n", VGA_LIGHT_RED);
+        return 1;
+    }
+    
+    print_string("[", VGA_LIGHT_GREY);
+    print_uint(id, VGA_LIGHT_WHITE);
+    print_string("] Killed\n", VGA_LIGHT_GREY);
+    return 0;
+}
+
+// Print the lines of the piped input that contain (or with -v, lack) the
+// pattern
+int cmd_grep(int argc, char* argv[]) {
+    int invert = argc >= 2 && strcmp(argv[1], "-v") == 0;
+    if (argc < 2 + invert) {
+        print_string("Usage: <command> | grep [-v] <pattern>\n", VGA_LIGHT_RED);
+        return 2;
+    }
+    
+    stream_t* in = job_stdin();
+    if (!in) {
+        print_string("grep: no input; use it after a pipe\n", VGA_LIGHT_RED);
+        return 2;
+    }
+    
+    char pattern[MAX_COMMAND_LENGTH];
+    join_args(pattern, MAX_COMMAND_LENGTH, argc, argv, 1 + invert);
+    
+    char line[JOB_LINE_LENGTH];
+    int matched = 0;
+    while (stream_read_line(in, line, JOB_LINE_LENGTH)) {
+        if ((strstr(line, pattern) != NULL) != invert) {
+            print_string(line, VGA_LIGHT_WHITE);
+            print_string("\n", VGA_LIGHT_WHITE);
+            matched++;
+        }
+    }
+    return matched > 0 ? 0 : 1;
+}
+
 int cmd_reset(int argc, char* argv[]) {
     langchain_clear_history(&ai_session);
     print_string("AI conversation history cleared\n", VGA_LIGHT_GREEN);
@@ -640,7 +1917,7 @@ int cmd_mouse(int argc, char* argv[]) {
     
     if (strcmp(argv[1], "status") == 0) {
         print_string("Mouse Status:\n", VGA_LIGHT_CYAN);
-        print_string("  Driver: PS/2 Mouse Driver\n", VGA_LIGHT_WHITE);
+        print_string("  Driver: PS/2 Mouse Driver (IRQ12)\n", VGA_LIGHT_WHITE);
         print_string("  Visible: ", VGA_LIGHT_WHITE);
         print_string(mouse_state.visible ? "Yes" : "No", mouse_state.visible ? VGA_LIGHT_GREEN : VGA_LIGHT_RED);
         print_string("\n  Left Button: ", VGA_LIGHT_WHITE);
@@ -649,7 +1926,17 @@ int cmd_mouse(int argc, char* argv[]) {
         print_string(mouse_state.right_button ? "Pressed" : "Released", mouse_state.right_button ? VGA_LIGHT_GREEN : VGA_LIGHT_GREY);
         print_string("\n  Middle Button: ", VGA_LIGHT_WHITE);
         print_string(mouse_state.middle_button ? "Pressed" : "Released", mouse_state.middle_button ? VGA_LIGHT_GREEN : VGA_LIGHT_GREY);
-        print_string("\n", VGA_LIGHT_WHITE);
+        
+        const mouse_stats_t* stats = get_mouse_stats();
+        print_string("\n  Wheel: ", VGA_LIGHT_WHITE);
+        print_string(stats->has_wheel ? "Yes" : "No", stats->has_wheel ? VGA_LIGHT_GREEN : VGA_LIGHT_GREY);
+        print_string("\n  Packets: ", VGA_LIGHT_WHITE);
+        print_uint(stats->packets, VGA_LIGHT_WHITE);
+        print_string(" (", VGA_LIGHT_GREY);
+        print_uint(stats->resyncs, VGA_LIGHT_WHITE);
+        print_string(" resyncs, ", VGA_LIGHT_GREY);
+        print_uint(stats->dropped, VGA_LIGHT_WHITE);
+        print_string(" overflowed)\n", VGA_LIGHT_GREY);
     } else if (strcmp(argv[1], "show") == 0) {
         show_mouse_cursor();
         print_string("Mouse cursor shown\n", VGA_LIGHT_GREEN);
@@ -696,6 +1983,9 @@ int cmd_mouse(int argc, char* argv[]) {
 }
 
 int cmd_exit(int argc, char* argv[]) {
+    if (sync_disks() < 0) {
+        print_string("exit: write-back failed (see dmesg)\n", VGA_LIGHT_RED);
+    }
     print_string("Exiting shell...\n", VGA_LIGHT_YELLOW);
     return -1; // Signal to exit
 }
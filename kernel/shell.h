@@ -4,20 +4,48 @@
 // Shell configuration
 #define MAX_COMMAND_LENGTH 256
 #define MAX_ARGS 16
-#define MAX_HISTORY 20
+#define SHELL_HISTORY_MATCHES 64    // Most matches listed by 'history <pattern>'
 #define PROMPT_LENGTH 64
+#define SHELL_SUGGESTIONS 3         // Near matches offered for an unknown command
+#define INPUTLAT_FRAME_KEYS 64     // Keys timed per frame; the rest go unsampled
+#define DISKBENCH_DEFAULT_MB 8
+#define DISKBENCH_CHUNK 256         // Sectors per call (128KB)
+#define DISKBENCH_RANDOM_READS 256
+#define DISKBENCH_RANDOM_SECTORS 8  // 4KB
+#define DISKBENCH_QUEUE_DEPTH 16
+#define SHELL_CAT_CHUNK 512         // Bytes read per call by 'cat'
+
+// Command flags
+#define SHELL_NO_CAPTURE 0x01       // Streams or runs other commands; print as it goes
+#define SHELL_FREE_TEXT 0x02        // Arguments are prose; a '>' in them is not a redirect
 
 // Command structure
 typedef struct {
     char name[32];
     char description[128];
     int (*function)(int argc, char* argv[]);
+    int flags;
 } shell_command_t;
 
+// Alternative name for a built-in command
+typedef struct {
+    const char* name;
+    const char* command;
+} shell_alias_t;
+
+// Subcommand (second word) of a built-in command, for tab completion
+typedef struct {
+    const char* command;
+    const char* name;
+} shell_subcommand_t;
+
 // Shell functions
 void init_shell();
 void run_shell();
 void process_command(const char* command_line);
+int execute_command(const char* command_line);
+int parse_command(char* command_line, char* argv[], int max_args);
+int shell_last_status();
 void print_prompt();
 void print_help();
 
@@ -27,6 +55,24 @@ int cmd_clear(int argc, char* argv[]);
 int cmd_ai(int argc, char* argv[]);
 int cmd_model(int argc, char* argv[]);
 int cmd_history(int argc, char* argv[]);
+int cmd_dmesg(int argc, char* argv[]);
+int cmd_inputlat(int argc, char* argv[]);
+int cmd_replay(int argc, char* argv[]);
+int cmd_diskbench(int argc, char* argv[]);
+int cmd_mmapbench(int argc, char* argv[]);
+int cmd_cachestat(int argc, char* argv[]);
+int cmd_sync(int argc, char* argv[]);
+int cmd_ailog(int argc, char* argv[]);
+int cmd_ls(int argc, char* argv[]);
+int cmd_cat(int argc, char* argv[]);
+int cmd_source(int argc, char* argv[]);
+int cmd_repeat(int argc, char* argv[]);
+int cmd_echo(int argc, char* argv[]);
+int cmd_set(int argc, char* argv[]);
+int cmd_jobs(int argc, char* argv[]);
+int cmd_fg(int argc, char* argv[]);
+int cmd_kill(int argc, char* argv[]);
+int cmd_grep(int argc, char* argv[]);
 int cmd_reset(int argc, char* argv[]);
 int cmd_mouse(int argc, char* argv[]);
 int cmd_exit(int argc, char* argv[]);
@@ -0,0 +1,96 @@
+#include "stream.h"
+#include "job.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+static stream_t streams[STREAM_MAX];
+
+// Allocate a stream with both ends open, NULL if none are free
+stream_t* stream_open() {
+    for (int i = 0; i < STREAM_MAX; i++) {
+        if (!streams[i].in_use) {
+            stream_t* stream = &streams[i];
+            stream->head = 0;
+            stream->tail = 0;
+            stream->writer_open = 1;
+            stream->reader_open = 1;
+            stream->in_use = 1;
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+static void stream_release(stream_t* stream) {
+    if (!stream->writer_open && !stream->reader_open) {
+        stream->in_use = 0;
+    }
+}
+
+// Write all of `data`, yielding while the buffer is full. Returns the
+// length written, or -1 once the reader has gone away.
+int stream_write(stream_t* stream, const char* data, int length) {
+    int written = 0;
+    
+    while (written < length) {
+        if (!stream->reader_open) return -1;
+        
+        unsigned int space = STREAM_BUFFER_SIZE - (stream->tail - stream->head);
+        if (space == 0) {
+            job_yield();
+            continue;
+        }
+        
+        while (space > 0 && written < length) {
+            stream->data[stream->tail++ & (STREAM_BUFFER_SIZE - 1)] = data[written++];
+            space--;
+        }
+    }
+    
+    return written;
+}
+
+// Read up to `length` bytes, yielding while the buffer is empty. Returns
+// 0 at end of stream.
+int stream_read(stream_t* stream, char* buffer, int length) {
+    while (stream->head == stream->tail) {
+        if (!stream->writer_open) return 0;
+        job_yield();
+    }
+    
+    int count = 0;
+    while (count < length && stream->head != stream->tail) {
+        buffer[count++] = stream->data[stream->head++ & (STREAM_BUFFER_SIZE - 1)];
+    }
+    return count;
+}
+
+// Read one line without its newline. Longer lines are split. Returns 0
+// at end of stream.
+int stream_read_line(stream_t* stream, char* line, int size) {
+    int length = 0;
+    char c;
+    
+    while (length < size - 1 && stream_read(stream, &c, 1) == 1) {
+        if (c == '\n') {
+            line[length] = '\0';
+            return 1;
+        }
+        line[length++] = c;
+    }
+    
+    line[length] = '\0';
+    return length > 0;
+}
+
+void stream_close_write(stream_t* stream) {
+    stream->writer_open = 0;
+    stream_release(stream);
+}
+
+void stream_close_read(stream_t* stream) {
+    stream->reader_open = 0;
+    stream_release(stream);
+}
@@ -0,0 +1,27 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+// In-kernel byte streams connecting the stages of a shell pipeline
+#define STREAM_BUFFER_SIZE 1024         // Power of two
+#define STREAM_MAX 8
+
+// A bounded byte pipe with one writer and one reader. Either side blocks
+// by yielding to other jobs; the stream is freed once both ends close.
+typedef struct {
+    char data[STREAM_BUFFER_SIZE];
+    unsigned int head;                  // Next byte to read
+    unsigned int tail;                  // Next byte to write
+    int writer_open;
+    int reader_open;
+    int in_use;
+} stream_t;
+
+// Stream functions
+stream_t* stream_open();
+int stream_write(stream_t* stream, const char* data, int length);
+int stream_read(stream_t* stream, char* buffer, int length);
+int stream_read_line(stream_t* stream, char* line, int size);
+void stream_close_write(stream_t* stream);
+void stream_close_read(stream_t* stream);
+
+#endif // STREAM_H
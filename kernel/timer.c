@@ -0,0 +1,74 @@
+#include "timer.h"
+#include "io.h"
+
+// TSC ticks per millisecond and the boot reference point
+static unsigned int tsc_khz = TIMER_DEFAULT_TSC_KHZ;
+static unsigned long long boot_tsc = 0;
+
+// 64-by-32-bit division done as two 32-bit divl steps
+unsigned long long udiv64(unsigned long long dividend, unsigned int divisor) {
+    unsigned int high = (unsigned int)(dividend >> 32);
+    unsigned int low = (unsigned int)dividend;
+    unsigned int quotient_high = high / divisor;
+    unsigned int remainder = high % divisor;
+    unsigned int quotient_low;
+    
+    __asm__("divl %4"
+            : "=a" (quotient_low), "=d" (remainder)
+            : "a" (low), "d" (remainder), "rm" (divisor));
+    
+    return ((unsigned long long)quotient_high << 32) | quotient_low;
+}
+
+// Measure the TSC rate by timing a PIT channel 2 one-shot countdown
+void init_timer() {
+    unsigned int count = PIT_FREQUENCY / (1000 / TIMER_CALIBRATION_MS);
+    
+    // Gate channel 2 on, speaker off
+    unsigned char gate = inb(PIT_PORT_GATE);
+    outb(PIT_PORT_GATE, (gate & ~0x02) | 0x01);
+    
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(PIT_PORT_COMMAND, 0xB0);
+    outb(PIT_PORT_CHANNEL2, count & 0xFF);
+    outb(PIT_PORT_CHANNEL2, (count >> 8) & 0xFF);
+    
+    unsigned long long start = read_tsc();
+    unsigned int spins = 0;
+    
+    // OUT2 (bit 5) goes high when the count expires
+    while (!(inb(PIT_PORT_GATE) & 0x20)) {
+        if (++spins > 10000000) {
+            break;
+        }
+    }
+    
+    unsigned long long elapsed = read_tsc() - start;
+    outb(PIT_PORT_GATE, gate);
+    
+    if (spins <= 10000000 && elapsed > TIMER_CALIBRATION_MS) {
+        tsc_khz = (unsigned int)elapsed / TIMER_CALIBRATION_MS;
+    }
+    
+    boot_tsc = read_tsc();
+}
+
+// Get the calibrated TSC frequency in kHz
+unsigned int get_tsc_khz() {
+    return tsc_khz;
+}
+
+// Convert a TSC delta to microseconds
+unsigned long long tsc_to_us(unsigned long long tsc) {
+    return udiv64(tsc * 1000, tsc_khz);
+}
+
+// Milliseconds since init_timer (wraps after ~49 days)
+unsigned int get_uptime_ms() {
+    return tsc_to_uptime_ms(read_tsc());
+}
+
+// Uptime in milliseconds at which a TSC value was taken
+unsigned int tsc_to_uptime_ms(unsigned long long tsc) {
+    return (unsigned int)udiv64(tsc - boot_tsc, tsc_khz);
+}
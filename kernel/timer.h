@@ -0,0 +1,34 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// Time source: the CPU timestamp counter, calibrated once at boot
+// against PIT channel 2
+
+// PIT (8253/8254) ports
+#define PIT_FREQUENCY 1193182
+#define PIT_PORT_CHANNEL2 0x42
+#define PIT_PORT_COMMAND 0x43
+#define PIT_PORT_GATE 0x61
+
+// Calibration window and fallback when the PIT does not respond
+#define TIMER_CALIBRATION_MS 10
+#define TIMER_DEFAULT_TSC_KHZ 1000000
+
+// Timer functions
+void init_timer();
+unsigned int get_tsc_khz();
+unsigned long long tsc_to_us(unsigned long long tsc);
+unsigned int get_uptime_ms();
+unsigned int tsc_to_uptime_ms(unsigned long long tsc);
+
+// 64-by-32-bit unsigned division (the kernel is not linked with libgcc)
+unsigned long long udiv64(unsigned long long dividend, unsigned int divisor);
+
+// Read the timestamp counter
+static inline unsigned long long read_tsc() {
+    unsigned long long tsc;
+    __asm__ __volatile__("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+#endif // TIMER_H
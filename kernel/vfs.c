@@ -0,0 +1,320 @@
+#include "vfs.h"
+#include "ramfs.h"
+#include "fat.h"
+#include "initrd.h"
+#include "mmap.h"
+#include "klog.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+int strcmp(const char* s1, const char* s2);
+
+// A mounted filesystem. `covered` is the directory it sits on (mount -1
+// for the root filesystem).
+typedef struct {
+    int in_use;
+    const vfs_ops_t* ops;
+    vfs_node_t root;
+    vfs_node_t covered;
+} vfs_mount_t;
+
+// Dentry cache, direct mapped on (mount, directory, name). Misses are
+// cached too, so probing for an absent file doesn't rescan the directory.
+// Nodes are cached as the filesystem returned them; mount points are
+// crossed after the cache.
+typedef struct {
+    int valid;
+    int found;
+    int mount;
+    unsigned int parent;
+    char name[VFS_NAME_LENGTH];
+    vfs_node_t node;
+} dentry_t;
+
+static vfs_mount_t mounts[VFS_MAX_MOUNTS];
+static vfs_file_t files[VFS_MAX_FILES];
+static dentry_t dcache[VFS_DCACHE_SIZE];
+static vfs_stats_t stats;
+
+static const vfs_ops_t* ops_of(const vfs_node_t* node) {
+    return mounts[node->mount].ops;
+}
+
+static dentry_t* dentry_slot(const vfs_node_t* directory, const char* name) {
+    unsigned int hash = 2166136261u ^ (directory->id * 0x9E3779B9u) ^ directory->mount;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return &dcache[(hash ^ (hash >> 16)) & (VFS_DCACHE_SIZE - 1)];
+}
+
+static void dentry_set(dentry_t* slot, const vfs_node_t* directory, const char* name,
+                       int found, const vfs_node_t* node) {
+    slot->valid = 1;
+    slot->found = found;
+    slot->mount = directory->mount;
+    slot->parent = directory->id;
+    int i = 0;
+    for (; name[i] && i < VFS_NAME_LENGTH - 1; i++) slot->name[i] = name[i];
+    slot->name[i] = '\0';
+    if (found) slot->node = *node;
+}
+
+// A mounted filesystem's root in place of the directory it covers
+static void cross_mount(vfs_node_t* node) {
+    for (int i = 1; i < VFS_MAX_MOUNTS; i++) {
+        if (mounts[i].in_use && mounts[i].covered.mount == node->mount &&
+            mounts[i].covered.id == node->id && node->type == VFS_DIRECTORY) {
+            *node = mounts[i].root;
+            return;
+        }
+    }
+}
+
+// Look `name` up in a directory, through the dentry cache. Returns 1 if found.
+static int lookup(const vfs_node_t* directory, const char* name, vfs_node_t* node) {
+    dentry_t* slot = dentry_slot(directory, name);
+    
+    stats.lookups++;
+    if (slot->valid && slot->mount == directory->mount && slot->parent == directory->id &&
+        strcmp(slot->name, name) == 0) {
+        stats.dcache_hits++;
+        if (!slot->found) return 0;
+        *node = slot->node;
+        cross_mount(node);
+        return 1;
+    }
+    
+    int found = ops_of(directory)->lookup(directory, name, node);
+    if (found < 0) return 0;
+    if (found) node->mount = directory->mount;
+    dentry_set(slot, directory, name, found, node);
+    if (found) cross_mount(node);
+    return found;
+}
+
+// Walk `path` from the root ("." and ".." are handled on the way; paths
+// are all absolute). With `last`, stop at the parent of the final
+// component and copy the component there. Returns 0, or -1 if a
+// directory on the way is missing.
+static int resolve(const char* path, vfs_node_t* node, char* last) {
+    vfs_node_t stack[VFS_MAX_DEPTH + 1];
+    int depth = 0;
+    
+    if (!mounts[0].in_use) return -1;
+    stack[0] = mounts[0].root;
+    if (last) last[0] = '\0';
+    
+    while (*path) {
+        char component[VFS_NAME_LENGTH];
+        int length = 0;
+        
+        while (*path == '/') path++;
+        while (*path && *path != '/') {
+            if (length >= VFS_NAME_LENGTH - 1) return -1;
+            component[length++] = *path++;
+        }
+        component[length] = '\0';
+        while (*path == '/') path++;
+        
+        if (length == 0 || (length == 1 && component[0] == '.')) continue;
+        if (length == 2 && component[0] == '.' && component[1] == '.') {
+            if (depth > 0) depth--;
+            continue;
+        }
+        if (last && *path == '\0') {
+            for (int i = 0; i <= length; i++) last[i] = component[i];
+            break;
+        }
+        
+        if (stack[depth].type != VFS_DIRECTORY || depth == VFS_MAX_DEPTH) return -1;
+        if (!lookup(&stack[depth], component, &stack[depth + 1])) return -1;
+        depth++;
+    }
+    
+    *node = stack[depth];
+    return 0;
+}
+
+void init_vfs() {
+    for (int i = 0; i < VFS_DCACHE_SIZE; i++) dcache[i].valid = 0;
+    for (int i = 0; i < VFS_MAX_FILES; i++) files[i].in_use = 0;
+    
+    vfs_mount("/", &ramfs_ops, init_ramfs());
+    vfs_mkdir(VFS_TMP_PATH);
+    
+    if (initrd_present()) {
+        vfs_mkdir(VFS_INITRD_PATH);
+        vfs_mount(VFS_INITRD_PATH, &initrd_vfs_ops, 0);
+    }
+    
+    if (fat_mounted()) {
+        vfs_mkdir(VFS_DISK_PATH);
+        if (vfs_mount(VFS_DISK_PATH, &fat_vfs_ops, 0) == 0) {
+            klog_detail(KLOG_INFO, "vfs: mounted " VFS_DISK_PATH " from ", fat_device_name());
+        }
+    }
+}
+
+// Mount a filesystem on an existing directory ("/" for the root
+// filesystem). Returns 0, or -1 if there is nowhere to put it.
+int vfs_mount(const char* path, const vfs_ops_t* ops, unsigned int root_id) {
+    int index = -1;
+    vfs_node_t covered = { -1, 0, 0, VFS_DIRECTORY };
+    
+    if (!mounts[0].in_use) {
+        if (strcmp(path, "/") != 0) return -1;
+        index = 0;
+    } else {
+        if (resolve(path, &covered, NULL) < 0 || covered.type != VFS_DIRECTORY) return -1;
+        for (int i = 1; i < VFS_MAX_MOUNTS && index < 0; i++) {
+            if (!mounts[i].in_use) index = i;
+        }
+        if (index < 0) return -1;
+    }
+    
+    mounts[index].in_use = 1;
+    mounts[index].ops = ops;
+    mounts[index].covered = covered;
+    mounts[index].root.mount = index;
+    mounts[index].root.id = root_id;
+    mounts[index].root.size = 0;
+    mounts[index].root.type = VFS_DIRECTORY;
+    return 0;
+}
+
+int vfs_lookup(const char* path, vfs_node_t* node) {
+    return resolve(path, node, NULL);
+}
+
+// Find the final component of `path`, creating it as `type` if it is
+// missing and `create` is set. Returns 0, or -1.
+static int find_or_create(const char* path, int create, int type, vfs_node_t* node) {
+    vfs_node_t directory;
+    char name[VFS_NAME_LENGTH];
+    
+    if (resolve(path, &directory, name) < 0) return -1;
+    if (name[0] == '\0') {
+        *node = directory;
+        return 0;
+    }
+    if (directory.type != VFS_DIRECTORY) return -1;
+    if (lookup(&directory, name, node)) return 0;
+    
+    const vfs_ops_t* ops = ops_of(&directory);
+    if (!create || !ops->create || ops->create(&directory, name, type, node) < 0) return -1;
+    node->mount = directory.mount;
+    dentry_set(dentry_slot(&directory, name), &directory, name, 1, node);
+    return 0;
+}
+
+// Create a directory. Returns 0, or -1 if it exists or can't be created.
+int vfs_mkdir(const char* path) {
+    vfs_node_t node;
+    
+    if (resolve(path, &node, NULL) == 0) return -1;
+    if (find_or_create(path, 1, VFS_DIRECTORY, &node) < 0) return -1;
+    return 0;
+}
+
+// Open a file. Returns a descriptor, or -1.
+int vfs_open(const char* path, int flags) {
+    vfs_node_t node;
+    
+    if (find_or_create(path, flags & VFS_CREATE, VFS_FILE, &node) < 0) return -1;
+    
+    const vfs_ops_t* ops = ops_of(&node);
+    if (flags & VFS_WRITE) {
+        if (node.type != VFS_FILE || !ops->write) return -1;
+        if ((flags & VFS_TRUNCATE) && ops->truncate(&node) < 0) return -1;
+        
+        // Cached pages of the file go stale; mappings fault the new data in
+        mmap_invalidate(&node);
+    }
+    
+    for (int fd = 0; fd < VFS_MAX_FILES; fd++) {
+        vfs_file_t* file = &files[fd];
+        if (file->in_use) continue;
+        
+        file->in_use = 1;
+        file->flags = flags;
+        file->node = node;
+        file->position = (flags & VFS_APPEND) ? ops->size(&node) : 0;
+        file->state[0] = 0;
+        file->state[1] = 0;
+        return fd;
+    }
+    return -1;
+}
+
+static vfs_file_t* file_of(int fd) {
+    if (fd < 0 || fd >= VFS_MAX_FILES || !files[fd].in_use) return NULL;
+    return &files[fd];
+}
+
+// Read from the current position. Returns the bytes read (0 at the end),
+// or -1.
+int vfs_read(int fd, void* buffer, unsigned int length) {
+    vfs_file_t* file = file_of(fd);
+    if (!file || !(file->flags & VFS_READ) || file->node.type != VFS_FILE) return -1;
+    return ops_of(&file->node)->read(file, buffer, length);
+}
+
+// Write at the current position. Returns the bytes written, or -1.
+int vfs_write(int fd, const void* buffer, unsigned int length) {
+    vfs_file_t* file = file_of(fd);
+    if (!file || !(file->flags & VFS_WRITE)) return -1;
+    return ops_of(&file->node)->write(file, buffer, length);
+}
+
+// Set where the next read or write starts
+int vfs_seek(int fd, unsigned int position) {
+    vfs_file_t* file = file_of(fd);
+    if (!file || file->node.type != VFS_FILE) return -1;
+    file->position = position;
+    return 0;
+}
+
+// Current size of an open file. Returns -1 if `fd` isn't a file.
+int vfs_size(int fd) {
+    vfs_file_t* file = file_of(fd);
+    if (!file || file->node.type != VFS_FILE) return -1;
+    return ops_of(&file->node)->size(&file->node);
+}
+
+int vfs_close(int fd) {
+    vfs_file_t* file = file_of(fd);
+    if (!file) return -1;
+    if (file->flags & VFS_WRITE) mmap_invalidate(&file->node);
+    file->in_use = 0;
+    return 0;
+}
+
+// Call `callback` for each entry of a directory. Returns -1 if `path`
+// isn't a directory.
+int vfs_list(const char* path, vfs_list_fn callback, void* context) {
+    vfs_node_t directory;
+    
+    if (resolve(path, &directory, NULL) < 0 || directory.type != VFS_DIRECTORY) return -1;
+    return ops_of(&directory)->list(&directory, callback, context);
+}
+
+// Contents of a file held in memory, used in place. Returns NULL if the
+// file doesn't exist or its filesystem can't map it.
+const void* vfs_map(const char* path, unsigned int* size) {
+    vfs_node_t node;
+    
+    if (resolve(path, &node, NULL) < 0 || node.type != VFS_FILE) return NULL;
+    
+    const vfs_ops_t* ops = ops_of(&node);
+    if (!ops->map) return NULL;
+    if (size) *size = ops->size(&node);
+    return ops->map(&node);
+}
+
+const vfs_stats_t* vfs_get_stats() {
+    return &stats;
+}
@@ -0,0 +1,84 @@
+#ifndef VFS_H
+#define VFS_H
+
+// Virtual filesystem configuration
+#define VFS_NAME_LENGTH 64
+#define VFS_PATH_LENGTH 128
+#define VFS_MAX_DEPTH 16                // Directories a path may descend
+#define VFS_MAX_MOUNTS 4
+#define VFS_MAX_FILES 16                // Open files
+#define VFS_DCACHE_SIZE 128             // Dentry cache slots, power of two
+#define VFS_TMP_PATH "/tmp"
+#define VFS_DISK_PATH "/disk"           // Where the FAT volume is mounted
+#define VFS_INITRD_PATH "/initrd"       // Where the initial ramdisk is mounted
+
+// Node types
+#define VFS_FILE 1
+#define VFS_DIRECTORY 2
+
+// Open flags
+#define VFS_READ 0x01
+#define VFS_WRITE 0x02
+#define VFS_CREATE 0x04
+#define VFS_TRUNCATE 0x08
+#define VFS_APPEND 0x10
+
+struct vfs_ops;
+
+// A file or directory of a mounted filesystem. `id` is the filesystem's
+// own handle (ramfs node, FAT first cluster); `size` is as of the lookup.
+typedef struct {
+    int mount;
+    unsigned int id;
+    unsigned int size;
+    unsigned char type;
+} vfs_node_t;
+
+typedef struct {
+    int in_use;
+    int flags;
+    vfs_node_t node;
+    unsigned int position;
+    unsigned int state[2];              // Filesystem's cursor (FAT: cluster, index)
+} vfs_file_t;
+
+// Called for each directory entry by vfs_list
+typedef void (*vfs_list_fn)(const char* name, unsigned int size, int directory, void* context);
+
+// Filesystem operations. Lookups return 1 if found, the rest 0 or the
+// byte count on success and -1 on an error. Read-only filesystems leave
+// write, create and truncate NULL; only filesystems whose files sit whole
+// in memory provide map.
+typedef struct vfs_ops {
+    const char* name;
+    int (*lookup)(const vfs_node_t* directory, const char* name, vfs_node_t* node);
+    int (*read)(vfs_file_t* file, void* buffer, unsigned int length);
+    int (*write)(vfs_file_t* file, const void* buffer, unsigned int length);
+    int (*create)(const vfs_node_t* directory, const char* name, int type, vfs_node_t* node);
+    int (*truncate)(const vfs_node_t* node);
+    int (*size)(const vfs_node_t* node);
+    int (*list)(const vfs_node_t* directory, vfs_list_fn callback, void* context);
+    const void* (*map)(const vfs_node_t* node);
+} vfs_ops_t;
+
+typedef struct {
+    unsigned int lookups;
+    unsigned int dcache_hits;
+} vfs_stats_t;
+
+// VFS functions
+void init_vfs();
+int vfs_mount(const char* path, const vfs_ops_t* ops, unsigned int root_id);
+int vfs_lookup(const char* path, vfs_node_t* node);
+int vfs_mkdir(const char* path);
+int vfs_open(const char* path, int flags);
+int vfs_read(int fd, void* buffer, unsigned int length);
+int vfs_write(int fd, const void* buffer, unsigned int length);
+int vfs_seek(int fd, unsigned int position);
+int vfs_size(int fd);
+int vfs_close(int fd);
+int vfs_list(const char* path, vfs_list_fn callback, void* context);
+const void* vfs_map(const char* path, unsigned int* size);
+const vfs_stats_t* vfs_get_stats();
+
+#endif // VFS_H
@@ -0,0 +1,363 @@
+#include "virtio.h"
+#include "pci.h"
+#include "io.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "klog.h"
+#include "block.h"
+#include "memory.h"
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+typedef struct {
+    unsigned long long address;
+    unsigned int length;
+    unsigned short flags;
+    unsigned short next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct {
+    unsigned short flags;
+    volatile unsigned short index;
+    unsigned short ring[];              // Followed by used_event
+} virtq_avail_t;
+
+typedef struct {
+    unsigned int id;
+    unsigned int length;
+} virtq_used_elem_t;
+
+typedef struct {
+    unsigned short flags;
+    volatile unsigned short index;
+    virtq_used_elem_t ring[];           // Followed by avail_event
+} virtq_used_t;
+
+// Request header and status byte; the device reads one and writes the other
+typedef struct {
+    unsigned int type;
+    unsigned int reserved;
+    unsigned long long sector;
+} __attribute__((packed)) virtio_blk_header_t;
+
+typedef struct {
+    virtio_blk_header_t header;
+    volatile unsigned char status;
+    int in_use;
+} virtio_blk_request_t;
+
+static unsigned short io_base = 0;
+static unsigned int features = 0;       // Negotiated
+static virtio_blk_info_t info;
+
+static virtq_desc_t* descriptors;
+static virtq_avail_t* avail;
+static virtq_used_t* used;
+static unsigned short free_head;
+static unsigned int free_count;
+static unsigned short last_used = 0;
+static unsigned short kicked = 0;       // avail index the device was last told about
+
+static virtio_blk_request_t requests[VIRTIO_BLK_MAX_REQUESTS];
+static unsigned char request_of_head[VIRTIO_QUEUE_MAX_SIZE];
+static int in_flight = 0;
+static int failed = 0;
+static volatile int interrupted = 0;
+
+// Full barrier: the device must see ring stores before the index and the
+// used_event store before we read its index
+static inline void memory_barrier() {
+    __asm__ __volatile__("lock; addl $0, (%%esp)" : : : "memory");
+}
+
+static unsigned short* used_event() {
+    return &avail->ring[info.queue_size];
+}
+
+// Queue interrupt. Reading the ISR acknowledges it; completions are
+// reaped by whoever is waiting, so the handler stays this short.
+static void virtio_irq() {
+    if (inb(io_base + VIRTIO_REG_ISR_STATUS) & VIRTIO_ISR_QUEUE) {
+        interrupted = 1;
+        info.interrupts++;
+    }
+}
+
+// Return finished requests and their descriptors to the free lists
+static void reap() {
+    while (last_used != used->index) {
+        virtq_used_elem_t* element = &used->ring[last_used % info.queue_size];
+        unsigned short head = element->id;
+        virtio_blk_request_t* request = &requests[request_of_head[head]];
+        
+        if (request->status != VIRTIO_BLK_S_OK) failed = 1;
+        request->in_use = 0;
+        
+        unsigned short last = head;
+        free_count++;
+        while (descriptors[last].flags & VIRTQ_DESC_F_NEXT) {
+            last = descriptors[last].next;
+            free_count++;
+        }
+        descriptors[last].next = free_head;
+        free_head = head;
+        
+        in_flight--;
+        last_used++;
+    }
+}
+
+// Tell the device about everything queued since the last notify. One
+// doorbell per batch instead of one per request.
+static void kick() {
+    if (kicked == avail->index) return;
+    memory_barrier();
+    outw(io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+    kicked = avail->index;
+}
+
+// Wait until at most `target` requests are in flight. With event index
+// negotiated the device interrupts once, when the last of the requests
+// we are waiting for completes.
+static int wait_in_flight(int target) {
+    kick();
+    
+    while (in_flight > target) {
+        interrupted = 0;
+        if (info.event_index) {
+            *used_event() = last_used + (in_flight - target) - 1;
+        }
+        memory_barrier();
+        reap();
+        if (in_flight <= target) break;
+        
+        unsigned int start = get_uptime_ms();
+        while (!interrupted && last_used == used->index) {
+            if (get_uptime_ms() - start >= VIRTIO_TIMEOUT_MS) {
+                klog(KLOG_ERR, "virtio-blk: request timed out");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Queue one request whose data descriptors point straight at the caller's
+// segments. Waits for room if the queue is full. Returns 0, or -1 if the
+// request can never fit.
+static int queue_request(unsigned int type, unsigned int lba,
+                         const virtio_segment_t* segments, int count, int write) {
+    if (count > VIRTIO_BLK_MAX_SEGMENTS || (unsigned int)count + 2 > info.queue_size) return -1;
+    
+    int slot = -1;
+    for (;;) {
+        for (int i = 0; i < VIRTIO_BLK_MAX_REQUESTS && slot < 0; i++) {
+            if (!requests[i].in_use) slot = i;
+        }
+        if (slot >= 0 && free_count >= (unsigned int)count + 2) break;
+        if (wait_in_flight(in_flight - 1) < 0) return -1;
+    }
+    
+    virtio_blk_request_t* request = &requests[slot];
+    request->header.type = type;
+    request->header.reserved = 0;
+    request->header.sector = lba;
+    request->status = 0xFF;
+    request->in_use = 1;
+    
+    // Chain: header, data segments, status
+    unsigned short head = free_head;
+    unsigned short index = head;
+    descriptors[index].address = (unsigned int)&request->header;
+    descriptors[index].length = sizeof(virtio_blk_header_t);
+    descriptors[index].flags = VIRTQ_DESC_F_NEXT;
+    
+    for (int s = 0; s < count; s++) {
+        index = descriptors[index].next;
+        descriptors[index].address = (unsigned int)segments[s].buffer;
+        descriptors[index].length = segments[s].length;
+        descriptors[index].flags = VIRTQ_DESC_F_NEXT | (write ? 0 : VIRTQ_DESC_F_WRITE);
+    }
+    
+    index = descriptors[index].next;
+    descriptors[index].address = (unsigned int)&request->status;
+    descriptors[index].length = 1;
+    descriptors[index].flags = VIRTQ_DESC_F_WRITE;
+    
+    free_head = descriptors[index].next;
+    free_count -= count + 2;
+    request_of_head[head] = slot;
+    
+    avail->ring[avail->index % info.queue_size] = head;
+    memory_barrier();
+    avail->index++;
+    
+    in_flight++;
+    info.requests++;
+    if (in_flight > (int)info.max_in_flight) info.max_in_flight = in_flight;
+    return 0;
+}
+
+// Queue a scatter-gather transfer at `lba` without waiting. The segments'
+// memory must stay put until virtio_blk_wait().
+int virtio_blk_submit(unsigned int lba, const virtio_segment_t* segments, int count, int write) {
+    if (!info.present || (write && info.read_only)) return -1;
+    
+    unsigned int sectors = 0;
+    for (int s = 0; s < count; s++) sectors += segments[s].length / BLOCK_SECTOR_SIZE;
+    if (lba >= info.sectors || sectors > info.sectors - lba) return -1;
+    
+    return queue_request(write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, lba, segments, count, write);
+}
+
+// Wait for every queued request. Returns -1 if any failed since the last
+// wait.
+int virtio_blk_wait() {
+    if (!info.present) return -1;
+    
+    int result = wait_in_flight(0);
+    if (failed) {
+        failed = 0;
+        return -1;
+    }
+    return result;
+}
+
+// Split a contiguous transfer into requests and keep them all in flight
+static int transfer(unsigned int lba, unsigned int count, void* buffer, int write) {
+    char* position = (char*)buffer;
+    
+    while (count > 0) {
+        unsigned int chunk = count > VIRTIO_BLK_REQUEST_SECTORS ? VIRTIO_BLK_REQUEST_SECTORS : count;
+        virtio_segment_t segment = { position, chunk * BLOCK_SECTOR_SIZE };
+        if (virtio_blk_submit(lba, &segment, 1, write) < 0) {
+            virtio_blk_wait();
+            return -1;
+        }
+        lba += chunk;
+        count -= chunk;
+        position += chunk * BLOCK_SECTOR_SIZE;
+    }
+    return virtio_blk_wait();
+}
+
+int virtio_blk_read(unsigned int lba, unsigned int count, void* buffer) {
+    return transfer(lba, count, buffer, 0);
+}
+
+int virtio_blk_write(unsigned int lba, unsigned int count, const void* buffer) {
+    return transfer(lba, count, (void*)buffer, 1);
+}
+
+int virtio_blk_flush() {
+    if (!info.present) return -1;
+    if (!(features & VIRTIO_BLK_F_FLUSH)) return 0;
+    if (queue_request(VIRTIO_BLK_T_FLUSH, 0, NULL, 0, 0) < 0) return -1;
+    return virtio_blk_wait();
+}
+
+static int block_read_op(block_device_t* device, unsigned int lba, unsigned int count, void* buffer) {
+    return virtio_blk_read(lba, count, buffer);
+}
+
+static int block_write_op(block_device_t* device, unsigned int lba, unsigned int count, const void* buffer) {
+    return virtio_blk_write(lba, count, buffer);
+}
+
+static int block_flush_op(block_device_t* device) {
+    return virtio_blk_flush();
+}
+
+static int block_submit_op(block_device_t* device, unsigned int lba, unsigned int count,
+                           void* buffer, int write) {
+    virtio_segment_t segment = { buffer, count * BLOCK_SECTOR_SIZE };
+    return virtio_blk_submit(lba, &segment, 1, write);
+}
+
+static int block_complete_op(block_device_t* device) {
+    return virtio_blk_wait();
+}
+
+static const block_ops_t block_ops = {
+    block_read_op, block_write_op, block_flush_op, block_submit_op, block_complete_op
+};
+
+// Bytes of ring memory for a queue of `size` entries (legacy layout: the
+// used ring starts on the next page after the available ring)
+static unsigned int ring_bytes(unsigned int size) {
+    unsigned int driver_area = 16 * size + 6 + 2 * size;
+    driver_area = (driver_area + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1);
+    return driver_area + 6 + 8 * size;
+}
+
+// Find the first virtio-blk device, set up its queue and register it as
+// vda. Returns 1 if a device is ready.
+int init_virtio_blk() {
+    const pci_device_t* device = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID);
+    
+    info.present = 0;
+    if (!device) return 0;
+    
+    pci_enable(device, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    io_base = pci_bar(device, 0);
+    
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, 0);        // Reset
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    
+    features = inl(io_base + VIRTIO_REG_DEVICE_FEATURES) &
+               (VIRTIO_BLK_F_RO | VIRTIO_BLK_F_FLUSH | VIRTIO_RING_F_EVENT_IDX);
+    outl(io_base + VIRTIO_REG_GUEST_FEATURES, features);
+    info.read_only = (features & VIRTIO_BLK_F_RO) != 0;
+    info.event_index = (features & VIRTIO_RING_F_EVENT_IDX) != 0;
+    
+    // Legacy devices fix the queue size; it has to fit the reserved pool
+    outw(io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+    info.queue_size = inw(io_base + VIRTIO_REG_QUEUE_SIZE);
+    if (info.queue_size == 0 || info.queue_size > VIRTIO_QUEUE_MAX_SIZE ||
+        ring_bytes(info.queue_size) > VIRTIO_QUEUE_SIZE) {
+        klog_value(KLOG_ERR, "virtio-blk: unsupported queue size ", info.queue_size);
+        outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        return 0;
+    }
+    
+    char* ring = (char*)VIRTIO_QUEUE_BASE;
+    for (unsigned int i = 0; i < ring_bytes(info.queue_size); i++) ring[i] = 0;
+    
+    unsigned int size = info.queue_size;
+    descriptors = (virtq_desc_t*)ring;
+    avail = (virtq_avail_t*)(ring + 16 * size);
+    used = (virtq_used_t*)(ring + ((16 * size + 6 + 2 * size + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1)));
+    
+    for (unsigned int i = 0; i < size; i++) {
+        descriptors[i].next = (i + 1) % size;
+    }
+    free_head = 0;
+    free_count = size;
+    last_used = 0;
+    kicked = 0;
+    in_flight = 0;
+    failed = 0;
+    for (int i = 0; i < VIRTIO_BLK_MAX_REQUESTS; i++) requests[i].in_use = 0;
+    
+    outl(io_base + VIRTIO_REG_QUEUE_ADDRESS, VIRTIO_QUEUE_BASE / VIRTQ_ALIGN);
+    
+    // Capacity in 512-byte sectors (64-bit; the high half is ignored)
+    info.sectors = inl(io_base + VIRTIO_REG_CONFIG);
+    if (inl(io_base + VIRTIO_REG_CONFIG + 4)) info.sectors = 0xFFFFFFFF;
+    
+    register_irq_handler(device->irq, virtio_irq);
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    
+    info.present = 1;
+    block_register("vda", "virtio", info.sectors, 0, &block_ops);
+    klog_value(KLOG_INFO, "virtio-blk: queue entries ", info.queue_size);
+    return 1;
+}
+
+const virtio_blk_info_t* virtio_blk_info() {
+    return &info;
+}
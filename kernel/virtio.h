@@ -0,0 +1,76 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+// virtio-blk over the legacy (0.9.5) PCI transport
+#define VIRTIO_VENDOR_ID 0x1AF4
+#define VIRTIO_BLK_DEVICE_ID 0x1001     // Transitional block device
+
+// Legacy I/O registers, offsets from BAR0
+#define VIRTIO_REG_DEVICE_FEATURES 0x00
+#define VIRTIO_REG_GUEST_FEATURES 0x04
+#define VIRTIO_REG_QUEUE_ADDRESS 0x08   // Page frame number of the ring
+#define VIRTIO_REG_QUEUE_SIZE 0x0C
+#define VIRTIO_REG_QUEUE_SELECT 0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY 0x10
+#define VIRTIO_REG_DEVICE_STATUS 0x12
+#define VIRTIO_REG_ISR_STATUS 0x13
+#define VIRTIO_REG_CONFIG 0x14          // Device config without MSI-X
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+
+#define VIRTIO_ISR_QUEUE 0x01
+
+// Feature bits
+#define VIRTIO_BLK_F_RO (1u << 5)
+#define VIRTIO_BLK_F_FLUSH (1u << 9)
+#define VIRTIO_RING_F_EVENT_IDX (1u << 29)
+
+// Ring layout
+#define VIRTQ_DESC_F_NEXT 1
+#define VIRTQ_DESC_F_WRITE 2            // Device writes the buffer
+#define VIRTQ_ALIGN 4096
+
+// Block requests
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+#define VIRTIO_BLK_S_OK 0
+
+// Driver limits
+#define VIRTIO_QUEUE_MAX_SIZE 1024      // Largest device queue the pool can hold
+#define VIRTIO_BLK_MAX_REQUESTS 32      // Requests in flight
+#define VIRTIO_BLK_MAX_SEGMENTS 8       // Data buffers per request
+#define VIRTIO_BLK_REQUEST_SECTORS 64   // Sectors per request when splitting reads
+#define VIRTIO_TIMEOUT_MS 2000
+
+// One data buffer of a scatter-gather request
+typedef struct {
+    void* buffer;
+    unsigned int length;                // Multiple of 512
+} virtio_segment_t;
+
+typedef struct {
+    int present;
+    int read_only;
+    int event_index;                    // Completion interrupts are coalesced
+    unsigned int queue_size;
+    unsigned int sectors;
+    unsigned int requests;
+    unsigned int interrupts;
+    unsigned int max_in_flight;
+} virtio_blk_info_t;
+
+// virtio-blk functions
+int init_virtio_blk();
+const virtio_blk_info_t* virtio_blk_info();
+int virtio_blk_submit(unsigned int lba, const virtio_segment_t* segments, int count, int write);
+int virtio_blk_wait();
+int virtio_blk_read(unsigned int lba, unsigned int count, void* buffer);
+int virtio_blk_write(unsigned int lba, unsigned int count, const void* buffer);
+int virtio_blk_flush();
+
+#endif // VIRTIO_H
@@ -1,6 +1,7 @@
 #include "voice.h"
 #include "screen.h"
 #include "langchain.h"
+#include "klog.h"
 
 // Define NULL for kernel environment
 #ifndef NULL
@@ -74,9 +75,8 @@ void init_voice_system() {
     voice_system_active = 1;
     listening_mode = 0;
     
-    print_string("Voice Assistant System Initialized\n", VGA_LIGHT_GREEN);
-    print_string("Wake words: 'Hey Proto', 'Proto Assistant', 'Hey OS'\n", VGA_LIGHT_CYAN);
-    print_string("Voice commands ready for hands-free operation\n", VGA_LIGHT_GREEN);
+    klog(KLOG_INFO, "voice: assistant system initialized");
+    klog(KLOG_INFO, "voice: wake words 'Hey Proto', 'Proto Assistant', 'Hey OS'");
 }
 
 // Start voice listening mode
@@ -84,8 +84,7 @@ int start_voice_listening() {
     if (!voice_system_active) return 0;
     
     listening_mode = 1;
-    print_string("Voice listening mode activated\n", VGA_LIGHT_YELLOW);
-    print_string("Say 'Hey Proto' to activate, or speak your command\n", VGA_LIGHT_CYAN);
+    klog(KLOG_INFO, "voice: listening mode activated");
     
     return 1;
 }
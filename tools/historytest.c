@@ -0,0 +1,100 @@
+// historytest.c - Host test for the shell history ring (kernel/history.c)
+//
+// Usage: historytest
+//
+// Adds commands of varying length for many laps of the byte ring, with
+// repeats mixed in, and after every add checks that the entries left are
+// the most recent distinct commands, newest first, with their text
+// intact. Then checks that a saved image loads back unchanged. Built and
+// run on the host by `make check`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The kernel's reserved pool is a host array here
+static char history_pool[0x30000];
+#define MEMORY_H
+#define HISTORY_BASE ((unsigned long)history_pool)
+#define HISTORY_SIZE sizeof(history_pool)
+
+#include "history.c"
+
+#define COMMANDS 20000
+#define LAPS_WANTED 8
+
+// Distinct commands in the order they were last added, oldest first
+static char* expected[COMMANDS];
+static int expected_count = 0;
+
+static void fail(const char* message, int step, int age) {
+    fprintf(stderr, "historytest: %s (step %d, age %d)\n", message, step, age);
+    exit(1);
+}
+
+static void expect_add(char* command) {
+    for (int i = 0; i < expected_count; i++) {
+        if (strcmp(expected[i], command) == 0) {
+            free(expected[i]);
+            memmove(&expected[i], &expected[i + 1], (expected_count - i - 1) * sizeof(char*));
+            expected_count--;
+            break;
+        }
+    }
+    expected[expected_count++] = command;
+}
+
+// The history holds the newest history_count() expected commands
+static void check(int step) {
+    int count = history_count();
+
+    if (count <= 0 || count > expected_count) fail("wrong entry count", step, count);
+    for (int age = 0; age < count; age++) {
+        const char* text = history_entry(age);
+        if (!text || strcmp(text, expected[expected_count - 1 - age]) != 0) {
+            fail("entry text does not match", step, age);
+        }
+    }
+    if (history_entry(count)) fail("entry past the oldest", step, count);
+}
+
+int main() {
+    unsigned int written = 0;
+
+    init_history();
+    srand(1);
+
+    for (int step = 0; step < COMMANDS; step++) {
+        char text[HISTORY_RING_SIZE / 4];
+
+        if (step > 10 && rand() % 8 == 0) {
+            // Repeat a recent command
+            int back = 1 + rand() % (expected_count < 10 ? expected_count : 10);
+            strcpy(text, expected[expected_count - back]);
+        } else {
+            int pad = rand() % 40;
+            int length = snprintf(text, sizeof(text), "lap%u_command_%03d ", written / HISTORY_RING_SIZE, step);
+            memset(text + length, 'a' + step % 26, pad);
+            text[length + pad] = '\0';
+            written += length + pad + 1;
+        }
+
+        history_add(text);
+        expect_add(strdup(text));
+        check(step);
+    }
+    if (written / HISTORY_RING_SIZE < LAPS_WANTED) fail("too few laps of the ring", COMMANDS, 0);
+
+    // A saved image loads back to the same entries
+    static char saved[HISTORY_SIZE];
+    int length = history_save(saved, sizeof(saved));
+    int count = history_count();
+    if (length < 0) fail("history_save failed", COMMANDS, 0);
+    history_clear();
+    if (history_load(saved, length) != count) fail("history_load lost entries", COMMANDS, 0);
+    check(COMMANDS);
+
+    printf("historytest: %d commands, %u laps, %d entries kept\n",
+           COMMANDS, written / HISTORY_RING_SIZE, count);
+    return 0;
+}
@@ -0,0 +1,130 @@
+// mkinitrd.c - Pack files into the initrd archive loaded by the bootloader
+//
+// Usage: mkinitrd <output> <path>=<file>...
+//
+// <path> is the name inside the archive ("scripts/rc", ".env"); its
+// directories are created as needed. The layout is described in
+// kernel/initrd.h. Built and run on the host by the Makefile.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "initrd.h"
+#include "memory.h"
+
+static unsigned char archive[INITRD_MAX_SIZE];
+static initrd_entry_t entries[INITRD_MAX_ENTRIES];
+static unsigned int entry_count = 1;   // Entry 0 is the root directory
+
+static void fail(const char* message, const char* detail) {
+    fprintf(stderr, "mkinitrd: %s%s\n", message, detail ? detail : "");
+    exit(1);
+}
+
+static void put32(unsigned char* at, unsigned int value) {
+    at[0] = value & 0xFF;
+    at[1] = (value >> 8) & 0xFF;
+    at[2] = (value >> 16) & 0xFF;
+    at[3] = (value >> 24) & 0xFF;
+}
+
+// Index of `name` in `parent`, added as `type` when missing
+static unsigned int find_or_add(unsigned int parent, const char* name, size_t length, unsigned int type) {
+    for (unsigned int i = 1; i < entry_count; i++) {
+        if (entries[i].parent == parent && strlen(entries[i].name) == length &&
+            memcmp(entries[i].name, name, length) == 0) {
+            if (entries[i].type != type) fail("file and directory with the same name: ", name);
+            if (type == INITRD_FILE) fail("duplicate file: ", name);
+            return i;
+        }
+    }
+    if (length == 0 || length >= INITRD_NAME_LENGTH) fail("bad name component in: ", name);
+    if (entry_count == INITRD_MAX_ENTRIES) fail("too many entries", NULL);
+    
+    initrd_entry_t* entry = &entries[entry_count];
+    memcpy(entry->name, name, length);
+    entry->name[length] = '\0';
+    entry->parent = parent;
+    entry->type = type;
+    return entry_count++;
+}
+
+static unsigned int fnv1a(const unsigned char* data, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int main(int argc, char* argv[]) {
+    const char* sources[INITRD_MAX_ENTRIES] = { 0 };
+    
+    if (argc < 2) {
+        fprintf(stderr, "Usage: mkinitrd <output> <path>=<file>...\n");
+        return 2;
+    }
+    
+    entries[0].type = INITRD_DIRECTORY;
+    for (int i = 2; i < argc; i++) {
+        char* separator = strchr(argv[i], '=');
+        if (!separator) fail("expected <path>=<file>, got ", argv[i]);
+        *separator = '\0';
+        
+        // Walk the directories, then add the file itself
+        const char* path = argv[i];
+        unsigned int parent = 0;
+        for (;;) {
+            const char* slash = strchr(path, '/');
+            if (!slash) break;
+            parent = find_or_add(parent, path, slash - path, INITRD_DIRECTORY);
+            path = slash + 1;
+        }
+        unsigned int index = find_or_add(parent, path, strlen(path), INITRD_FILE);
+        sources[index] = separator + 1;
+    }
+    
+    size_t size = sizeof(initrd_header_t) + entry_count * sizeof(initrd_entry_t);
+    for (unsigned int i = 1; i < entry_count; i++) {
+        if (entries[i].type != INITRD_FILE) continue;
+        
+        size = (size + INITRD_ALIGN - 1) & ~(size_t)(INITRD_ALIGN - 1);
+        FILE* file = fopen(sources[i], "rb");
+        if (!file) fail("cannot open ", sources[i]);
+        size_t length = fread(archive + size, 1, sizeof(archive) - size, file);
+        int truncated = !feof(file) || length + 1 > sizeof(archive) - size;
+        fclose(file);
+        if (truncated) fail("archive larger than INITRD_MAX_SIZE adding ", sources[i]);
+        
+        entries[i].offset = size;
+        entries[i].size = length;
+        archive[size + length] = '\0';
+        size += length + 1;
+    }
+    size = (size + INITRD_ALIGN - 1) & ~(size_t)(INITRD_ALIGN - 1);
+    if (size > sizeof(archive)) fail("archive larger than INITRD_MAX_SIZE", NULL);
+    
+    // Entry table, little endian like the kernel reads it
+    for (unsigned int i = 0; i < entry_count; i++) {
+        unsigned char* at = archive + sizeof(initrd_header_t) + i * sizeof(initrd_entry_t);
+        memcpy(at, entries[i].name, INITRD_NAME_LENGTH);
+        put32(at + INITRD_NAME_LENGTH, entries[i].parent);
+        put32(at + INITRD_NAME_LENGTH + 4, entries[i].type);
+        put32(at + INITRD_NAME_LENGTH + 8, entries[i].offset);
+        put32(at + INITRD_NAME_LENGTH + 12, entries[i].size);
+    }
+    
+    put32(archive, INITRD_MAGIC);
+    put32(archive + 4, size);
+    put32(archive + 8, entry_count);
+    put32(archive + 12, fnv1a(archive + sizeof(initrd_header_t), size - sizeof(initrd_header_t)));
+    
+    FILE* output = fopen(argv[1], "wb");
+    if (!output || fwrite(archive, 1, size, output) != size || fclose(output) != 0) {
+        fail("cannot write ", argv[1]);
+    }
+    printf("mkinitrd: %u entries, %u bytes\n", entry_count, (unsigned int)size);
+    return 0;
+}